@@ -0,0 +1,90 @@
+﻿#ifndef ___MCIMANAGER_CACHE_H__
+#define ___MCIMANAGER_CACHE_H__
+
+#include "MCIManager/MCIManager.h"
+
+// キャッシュファイルの形式を変更した場合は更新する（異なるバージョンのファイルは再作成される）
+#define MCIM_CACHE_VERSION 2
+
+/**
+ * @brief キャッシュの鍵となる元ファイルの状態
+ */
+typedef struct _MCIM_CACHE_STAMP {
+  uint64_t size;
+  uint64_t writeTime;  // 最終更新日時（FILETIME）
+} MCIM_CACHE_STAMP;
+
+/**
+ * @brief メモリマップしたキャッシュファイル
+ */
+typedef struct _MCIM_CACHE_VIEW {
+  HANDLE file;
+  HANDLE mapping;
+  const void* base;
+} MCIM_CACHE_VIEW;
+
+/**
+ * @brief キャッシュに保存されたラウドネス解析結果
+ */
+typedef struct _MCIM_CACHE_LOUDNESS {
+  double integrated;
+  double analysisTime;
+  double analysisCpuTime;
+} MCIM_CACHE_LOUDNESS;
+
+/**
+ * @brief キャッシュを保存するディレクトリを設定（NULLまたは空文字列の場合は無効）
+ * @note - ディレクトリが存在しない場合は作成する
+ */
+bool mcim_cache_set_directory(const wchar_t* directory);
+
+bool mcim_cache_enabled(void);
+
+void mcim_cache_get_stats(MCIM_CACHE_STATS* stats);
+
+/**
+ * @brief 元ファイルの状態を取得
+ * @note - キャッシュの有効/無効に関わらず取得できる
+ */
+bool mcim_cache_get_stamp(const wchar_t* restrict filepath, MCIM_CACHE_STAMP* restrict stamp);
+
+/**
+ * @brief デコード済みのPCMをキャッシュからメモリマップする
+ * @return const float* デコード済みのサンプル、キャッシュが無い場合や元ファイルと一致しない場合はNULL
+ * @note - 返り値はmcim_cache_unmapを呼ぶまで有効
+ * @note - 保存後の最初のマップではPCM全体のハッシュ値を検証し、一致しない場合はNULLを返す
+ */
+const float* mcim_cache_map(const wchar_t* restrict filepath,
+                            const MCIM_CACHE_STAMP* restrict stamp,
+                            uint32_t frames,
+                            uint32_t sampleRate,
+                            uint16_t channels,
+                            MCIM_CACHE_VIEW* restrict view);
+
+void mcim_cache_unmap(MCIM_CACHE_VIEW* view);
+
+/**
+ * @brief デコード済みのPCMをキャッシュへ保存
+ * @note - 既存のキャッシュに保存されたラウドネス解析結果は引き継ぐ
+ */
+void mcim_cache_store(const wchar_t* restrict filepath,
+                      const MCIM_CACHE_STAMP* restrict stamp,
+                      const float* restrict samples,
+                      uint32_t frames,
+                      uint32_t sampleRate,
+                      uint16_t channels);
+
+bool mcim_cache_find_loudness(const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, MCIM_CACHE_LOUDNESS* restrict loudness);
+
+/**
+ * @brief ラウドネス解析結果をキャッシュへ保存
+ * @note - PCMのキャッシュが存在する場合はヘッダのみを書き換える
+ */
+void mcim_cache_store_loudness(const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, const MCIM_CACHE_LOUDNESS* restrict loudness);
+
+/**
+ * @brief キャッシュを使用したロードに要した時間を記録
+ */
+void mcim_cache_record_load(bool hit, LONGLONG ticks);
+
+#endif  // ___MCIMANAGER_CACHE_H__
@@ -0,0 +1,112 @@
+﻿#ifndef ___MCIMANAGER_DSP_H__
+#define ___MCIMANAGER_DSP_H__
+
+#include "_MCIMKernels.h"
+
+#include <stdatomic.h>
+
+// 一つのチェーンに挿入できるエフェクト数の上限
+#define MCIM_DSP_MAX_EFFECTS 8
+
+// 先読みリミッターの遅延線の長さ（2の冪、先読みフレーム数はこれ未満）
+#define MCIM_LIMITER_RING_FRAMES 512
+
+// パラメータの三重バッファで、中間バッファが未読であることを示すビット
+#define MCIM_DSP_PARAMS_DIRTY 0x4
+
+/**
+ * @brief レンダリングスレッドへ渡すエフェクトのパラメータ
+ * @note - 係数等はAPI側で求めておき、レンダリングスレッドでは計算しない
+ */
+typedef struct _MCIM_DSP_PARAMS {
+  union {
+    struct {
+      uint32_t sectionCount;
+      MCIM_BIQUAD_COEFS sections[MCIM_EQ_MAX_BANDS];
+    } eq;
+    struct {
+      float ceiling;       // 線形
+      uint32_t lookahead;  // フレーム数
+      float release;       // 1フレームあたりの追従係数
+    } limiter;
+  };
+} MCIM_DSP_PARAMS;
+
+typedef struct _MCIM_DSP_EQ_STATE {
+  uint32_t sectionCount;              // 状態が有効な区間の数
+  float state[MCIM_EQ_MAX_BANDS][4];  // 区間毎の{z1L, z1R, z2L, z2R}
+} MCIM_DSP_EQ_STATE;
+
+typedef struct _MCIM_DSP_LIMITER_STATE {
+  uint32_t lookahead;                           // 状態が対応する先読みフレーム数（0の場合は未初期化）
+  uint32_t position;                            // 処理したフレーム数（遅延線等の書き込み位置）
+  float delay[2 * MCIM_LIMITER_RING_FRAMES];    // 入力の遅延線（ステレオ）
+  float minValue[MCIM_LIMITER_RING_FRAMES];     // 先読み区間の必要ゲインの単調増加キュー
+  uint32_t minIndex[MCIM_LIMITER_RING_FRAMES];  // 上記の各値を書き込んだ位置
+  uint32_t minHead;
+  uint32_t minCount;
+  float held;                                   // 先読み区間の最小値にリリースを掛けたゲイン
+  float average[MCIM_LIMITER_RING_FRAMES];      // 移動平均用のheldの履歴
+  uint32_t averagePosition;
+  double averageSum;
+} MCIM_DSP_LIMITER_STATE;
+
+/**
+ * @brief インサートエフェクト
+ * @note - パラメータは三重バッファを介して受け渡すため、更新も反映もロックを取らない
+ * @note - パラメータの更新は同時に一つのスレッドからのみ行える
+ */
+typedef struct _MCIM_DSP_EFFECT {
+  MCIM_EFFECT_TYPE type;
+  MCIM_DSP_PARAMS params[3];
+  _Atomic(uint32_t) middle;  // 中間バッファの添字（未読の場合はMCIM_DSP_PARAMS_DIRTYを立てる）
+  uint32_t back;             // 更新側が書き込むバッファの添字
+  uint32_t front;            // レンダリングスレッドが読むバッファの添字
+  union {
+    MCIM_DSP_EQ_STATE eq;
+    MCIM_DSP_LIMITER_STATE limiter;
+  };
+} MCIM_DSP_EFFECT;
+
+/**
+ * @brief エフェクトを直列に適用するチェーン
+ * @note - 構成の変更はミキサーのロックを保持した状態で行う
+ * @note - effects[i]を書き込んでからcountをreleaseで公開するため、パラメータを更新する側はロックなしでエフェクトを引ける
+ */
+typedef struct _MCIM_DSP_CHAIN {
+  _Atomic(MCIM_DSP_EFFECT*) effects[MCIM_DSP_MAX_EFFECTS];
+  _Atomic(uint32_t) count;
+} MCIM_DSP_CHAIN;
+
+/**
+ * @brief イコライザを作成
+ * @note - パラメータが不正な場合は失敗する
+ */
+ATTRIB_MALLOC MCIM_DSP_EFFECT* mcim_dsp_create_eq(const MCIM_EQ_PARAMS* restrict params, uint32_t sampleRate, mcim_allocator_t allocator);
+
+/**
+ * @brief 先読みリミッターを作成
+ * @note - パラメータが不正な場合は失敗する
+ */
+ATTRIB_MALLOC MCIM_DSP_EFFECT* mcim_dsp_create_limiter(const MCIM_LIMITER_PARAMS* restrict params, uint32_t sampleRate, mcim_allocator_t allocator);
+
+/**
+ * @brief イコライザのパラメータを更新
+ * @note - 次にレンダリングスレッドが処理するブロックから反映され、フィルタの状態は引き継がれる
+ */
+bool mcim_dsp_set_eq(MCIM_DSP_EFFECT* restrict effect, const MCIM_EQ_PARAMS* restrict params, uint32_t sampleRate);
+
+/**
+ * @brief 先読みリミッターのパラメータを更新
+ * @note - 先読み時間を変更した場合は遅延線を初期化する
+ */
+bool mcim_dsp_set_limiter(MCIM_DSP_EFFECT* restrict effect, const MCIM_LIMITER_PARAMS* restrict params, uint32_t sampleRate);
+
+/**
+ * @brief チェーンのエフェクトを順にbufferへ適用する
+ * @note - ミキサーのロックを保持した状態でレンダリングスレッドから呼ぶ
+ * @note - framesはMCIM_MIXER_BLOCK_FRAMES以下である必要がある
+ */
+void mcim_dsp_process(MCIM_DSP_CHAIN* restrict chain, const MCIM_KERNELS* restrict kernels, float* restrict buffer, uint32_t frames);
+
+#endif  // ___MCIMANAGER_DSP_H__
@@ -0,0 +1,82 @@
+﻿#ifndef ___MCIMANAGER_JOBS_H__
+#define ___MCIMANAGER_JOBS_H__
+
+#include "MCIManager/MCIManager.h"
+
+#include <stdatomic.h>
+
+// 呼び出し元のスレッドと共にジョブを処理するスレッド数の上限
+#define MCIM_JOBS_MAX_THREADS 16
+
+// ジョブを処理し終えたスレッドが、次の実行を待って眠る前に空転する回数
+#define MCIM_JOBS_SPIN_COUNT 4096
+
+/**
+ * @brief ジョブを1つ処理する関数のテンプレート
+ * @param job ジョブの番号（0以上count未満）
+ * @param participant 処理しているスレッドの番号（呼び出し元のスレッドは0）
+ */
+typedef void (*mcim_jobs_run_t)(void* context, uint32_t job, uint32_t participant);
+
+/**
+ * @brief 参加スレッド毎に割り振ったジョブの区間
+ * @note - 持ち主も他のスレッドもnextを進めて先頭から取り出すため、区間を使い切ったスレッドは他の区間から奪える
+ * @note - nextを別々のキャッシュラインに置くよう、構造体を64バイトに揃える
+ */
+typedef struct _MCIM_JOBS_RANGE {
+  _Atomic(uint32_t) next;
+  uint32_t end;
+  uint8_t padding[64 - 2 * sizeof(uint32_t)];
+} MCIM_JOBS_RANGE;
+
+typedef struct _MCIM_JOBS_WORKER {
+  struct _MCIM_JOBS* jobs;
+  HANDLE hthread;
+  uint32_t participant;
+} MCIM_JOBS_WORKER;
+
+/**
+ * @brief ジョブを呼び出し元のスレッドと専用のスレッドで分担して処理するプール
+ * @note - 同時に実行を開始できるのは1スレッドのみ
+ */
+typedef struct _MCIM_JOBS {
+  SRWLOCK lock;
+  CONDITION_VARIABLE startCond;
+  _Atomic(uint32_t) generation;  // 実行を開始する毎に進める（ロックを保持して更新する）
+  bool terminate;
+  uint32_t sleeping;      // startCondで待機しているスレッドの数
+  uint32_t participants;  // 現在の実行に参加するスレッドの数（呼び出し元のスレッドを含む）
+  mcim_jobs_run_t run;
+  void* context;
+  _Atomic(uint32_t) remaining;  // 現在の実行の未完了のジョブ数
+  _Atomic(uint32_t) entered;    // 現在の実行の区間を参照しているスレッドの数
+  uint32_t threadCount;
+  MCIM_JOBS_WORKER workers[MCIM_JOBS_MAX_THREADS];
+  MCIM_JOBS_RANGE ranges[MCIM_JOBS_MAX_THREADS + 1];
+} MCIM_JOBS;
+
+/**
+ * @brief threadCount本のスレッドを持つプールを作成
+ * @note - スレッドを作成できない場合は失敗する
+ */
+ATTRIB_MALLOC MCIM_JOBS* mcim_jobs_create(uint32_t threadCount, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+
+/**
+ * @brief スレッドを停止してプールを解放
+ * @note - 実行中に呼んではならない
+ */
+void mcim_jobs_destroy(MCIM_JOBS* jobs, mcim_deallocator_t deallocator);
+
+/**
+ * @brief count個のジョブを処理し、全て完了するまで待機する
+ * @note - jobsがNULLの場合は呼び出し元のスレッドで順に処理する
+ * @note - ジョブは参加スレッドに連続した区間として割り振られ、処理の順序は不定となる
+ */
+void mcim_jobs_run(MCIM_JOBS* restrict jobs, uint32_t count, mcim_jobs_run_t run, void* restrict context);
+
+/**
+ * @brief プールが持つスレッドの数
+ */
+uint32_t mcim_jobs_thread_count(const MCIM_JOBS* jobs);
+
+#endif  // ___MCIMANAGER_JOBS_H__
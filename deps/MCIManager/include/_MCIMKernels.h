@@ -0,0 +1,115 @@
+﻿#ifndef ___MCIMANAGER_KERNELS_H__
+#define ___MCIMANAGER_KERNELS_H__
+
+#include "MCIManager/MCIManager.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define MCIM_KERNELS_X86 1
+#endif
+
+/**
+ * @brief a0で正規化した双二次フィルタの係数
+ */
+typedef struct _MCIM_BIQUAD_COEFS {
+  float b0;
+  float b1;
+  float b2;
+  float a1;
+  float a2;
+} MCIM_BIQUAD_COEFS;
+
+/**
+ * @brief レンダリングパスのホットループ用カーネル群
+ * @note - ステレオのバッファはL/Rをインターリーブしたfloat列であり、framesはフレーム数、countはサンプル数を表す
+ * @note - 各ISA向けの実装を個別のソースファイルに分け、ファイル単位で命令セットのコンパイルオプションを与える
+ */
+typedef struct _MCIM_KERNELS {
+  const char* name;
+
+  /**
+   * @brief dst += src * gain をステレオで行う（gainはフレーム毎にgainStepずつ変化する）
+   */
+  void (*mix_ramp)(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep);
+
+  /**
+   * @brief dst += src * gain をチャンネル毎のゲインで行う（gain[c]はフレーム毎にgainStep[c]ずつ変化する）
+   */
+  void (*mix_pan)(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]);
+
+  /**
+   * @brief buffer *= gain をステレオで行う（gainはフレーム毎にgainStepずつ変化する）
+   */
+  void (*scale_ramp)(float* buffer, uint32_t frames, float gain, float gainStep);
+
+  /**
+   * @brief count個のサンプルの絶対値の最大値を求める
+   */
+  float (*peak)(const float* src, uint32_t count);
+
+  /**
+   * @brief 双二次フィルタ（転置直接形II）をステレオでin-placeに適用する
+   * @note - stateは{z1L, z1R, z2L, z2R}であり、処理後の状態で更新される
+   */
+  void (*biquad)(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]);
+
+  /**
+   * @brief count個のサンプルの内積を求める
+   */
+  float (*dot)(const float* a, const float* b, uint32_t count);
+
+  /**
+   * @brief 32.32固定小数点の位置positionからstep刻みで線形補間し、ステレオでframesフレーム分出力する
+   * @note - channelsは1または2であり、モノラルの場合は両チャンネルへ複製する
+   * @note - 全フレームについて(position >> 32) + 1が読み出し可能なフレームである必要がある
+   */
+  void (*resample)(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames);
+
+  /**
+   * @brief floatから16bit整数への変換（飽和、最近接丸め）
+   */
+  void (*float_to_s16)(int16_t* restrict dst, const float* restrict src, uint32_t count);
+
+  /**
+   * @brief 16bit整数からfloatへの変換
+   */
+  void (*s16_to_float)(float* restrict dst, const int16_t* restrict src, uint32_t count);
+
+  /**
+   * @brief 基数2の時間間引きFFTの1段分のバタフライ演算をcount点の複素数列に対してin-placeに行う
+   * @note - halfは2の冪であり、長さ2*halfの各ブロックの前半と後半を組にする
+   * @note - twRe[k]、twIm[k]（0 <= k < half）はこの段の回転因子exp(-iπk/half)である
+   */
+  void (*fft_pass)(float* restrict re, float* restrict im, const float* restrict twRe, const float* restrict twIm, uint32_t count, uint32_t half);
+} MCIM_KERNELS;
+
+extern const MCIM_KERNELS MCIM_KERNELS_GENERIC;
+#ifdef MCIM_KERNELS_X86
+extern const MCIM_KERNELS MCIM_KERNELS_SSE2;
+extern const MCIM_KERNELS MCIM_KERNELS_AVX2;
+extern const MCIM_KERNELS MCIM_KERNELS_AVX512;
+#endif
+
+/**
+ * @brief 実行中のCPUで利用可能な最も高速なカーネル群を取得
+ * @note - CPUIDによる判定は初回呼び出し時に一度だけ行う
+ */
+const MCIM_KERNELS* mcim_select_kernels(void);
+
+// 各ISA向け実装の端数処理に用いる汎用実装
+void mcim_mix_ramp_generic(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep);
+void mcim_mix_pan_generic(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]);
+void mcim_scale_ramp_generic(float* buffer, uint32_t frames, float gain, float gainStep);
+float mcim_peak_generic(const float* src, uint32_t count);
+void mcim_biquad_generic(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]);
+float mcim_dot_generic(const float* a, const float* b, uint32_t count);
+void mcim_resample_generic(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames);
+void mcim_float_to_s16_generic(int16_t* restrict dst, const float* restrict src, uint32_t count);
+void mcim_s16_to_float_generic(float* restrict dst, const int16_t* restrict src, uint32_t count);
+void mcim_fft_pass_generic(float* restrict re,
+                           float* restrict im,
+                           const float* restrict twRe,
+                           const float* restrict twIm,
+                           uint32_t count,
+                           uint32_t half);
+
+#endif  // ___MCIMANAGER_KERNELS_H__
@@ -0,0 +1,20 @@
+﻿#ifndef ___MCIMANAGER_LOG_H__
+#define ___MCIMANAGER_LOG_H__
+
+#include "MCIManager/MCIManager.h"
+
+/**
+ * @brief ログの出力先を設定し、出力用のスレッドを開始または停止する
+ * @note - outputがNULLの場合はログを無効にする
+ */
+bool mcim_log_set_output(HANDLE output, MCIM_LOG_LEVEL level);
+
+/**
+ * @brief レコードをリングバッファに積む
+ * @note - 待機およびメモリ確保を行わない
+ */
+bool mcim_log_write(MCIM_LOG_LEVEL level, const char* event, const char* key0, int64_t value0, const char* key1, int64_t value1);
+
+uint64_t mcim_log_get_dropped(void);
+
+#endif  // ___MCIMANAGER_LOG_H__
@@ -0,0 +1,78 @@
+﻿#ifndef ___MCIMANAGER_LOUDNESS_H__
+#define ___MCIMANAGER_LOUDNESS_H__
+
+#include "MCIManager/MCIManager.h"
+#include "_MCIMWorker.h"
+
+#include <stdatomic.h>
+
+typedef struct _MCIM_LOUDNESS_RESULT {
+  double integrated;       // 統合ラウドネス（LUFS）
+  double analysisTime;     // 解析に要した時間（秒）
+  double analysisCpuTime;  // 解析スレッドが消費したCPU時間（秒）
+  bool cached;
+} MCIM_LOUDNESS_RESULT;
+
+/**
+ * @brief 解析要求
+ * @note - 要求元の構造体に埋め込んで使用し、statusとresultは解析スレッドのロックで保護される
+ * @note - filepathは解析スレッドを破棄するまで有効である必要がある
+ */
+typedef struct _MCIM_LOUDNESS_REQUEST {
+  const wchar_t* filepath;
+  void* context;
+  MCIM_LOUDNESS_STATUS status;
+  MCIM_LOUDNESS_RESULT result;
+  struct _MCIM_LOUDNESS_REQUEST* next;
+} MCIM_LOUDNESS_REQUEST;
+
+/**
+ * @brief 解析の完了を通知する関数のテンプレート
+ * @note - 解析器のロックを保持したまま解析スレッドから呼ばれる
+ */
+typedef void (*mcim_analyzer_done_t)(void* context, MCIM_LOUDNESS_REQUEST* request);
+
+/**
+ * @brief ラウドネス解析器
+ * @note - 解析は全MCIMオブジェクトで共有するワーカーの低優先度（バックグラウンドモード）のスレッドで行う
+ * @note - 一つのタスクで一件ずつ解析し、他のMCIMオブジェクトの解析と交互に実行する
+ */
+typedef struct _MCIM_ANALYZER {
+  MCIM_WORKER_TASK task;  // 先頭に置き、タスクから解析器を求める
+  bool scheduled;         // taskがワーカーに積まれているか
+  HANDLE idleEvent;       // キューが空で解析中の要求も無い場合にシグナル状態
+  atomic_bool terminate;
+  CRITICAL_SECTION mutex;
+  MCIM_LOUDNESS_REQUEST* head;
+  MCIM_LOUDNESS_REQUEST* tail;
+  mcim_analyzer_done_t done;
+  void* doneContext;
+  mcim_allocator_t allocator;
+  mcim_deallocator_t deallocator;
+} MCIM_ANALYZER;
+
+bool mcim_analyzer_init(MCIM_ANALYZER* analyzer, mcim_analyzer_done_t done, void* doneContext, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+
+/**
+ * @brief 解析器を破棄する
+ * @note - 解析中の要求は完了を待ってから破棄する
+ * @note - 解析中および未処理の要求の結果は破棄され、statusはMCIM_LOUDNESS_PENDINGのまま残る
+ */
+void mcim_analyzer_destroy(MCIM_ANALYZER* analyzer);
+
+/**
+ * @brief 解析要求をキューに積む
+ * @note - 既にキューに積まれている要求は何もせず成功する
+ * @note - ワーカーのスレッドを作成できない場合はstatusをMCIM_LOUDNESS_FAILEDとして失敗する
+ */
+bool mcim_analyzer_request(MCIM_ANALYZER* restrict analyzer, MCIM_LOUDNESS_REQUEST* restrict request);
+
+/**
+ * @brief キューに積まれた全ての要求の解析が完了するまで待機
+ */
+void mcim_analyzer_wait(MCIM_ANALYZER* analyzer);
+
+void mcim_analyzer_lock(MCIM_ANALYZER* analyzer);
+void mcim_analyzer_unlock(MCIM_ANALYZER* analyzer);
+
+#endif  // ___MCIMANAGER_LOUDNESS_H__
@@ -0,0 +1,475 @@
+﻿#ifndef ___MCIMANAGER_MIXER_H__
+#define ___MCIMANAGER_MIXER_H__
+
+#include "_MCIMDsp.h"
+#include "_MCIMJobs.h"
+#include "_MCIMKernels.h"
+#include "_MCIMStretch.h"
+#include "_MCIMTap.h"
+#include "_MCIMWave.h"
+
+#include <stdatomic.h>
+
+// レンダリングパスの出力形式（ステレオのfloatをインターリーブ）
+#define MCIM_MIXER_SAMPLE_RATE 44100
+#define MCIM_MIXER_CHANNELS 2
+
+// ミックス処理の単位（音量変更の補間やフェードの包絡もこの単位で更新する）
+#define MCIM_MIXER_BLOCK_FRAMES 256
+
+// 再生位置の時計で未確定のフレーム位置を表す値
+#define MCIM_MIXER_CLOCK_NEVER UINT64_MAX
+
+// サブミックスバスの数の上限（マスターを含まない）
+#define MCIM_MIXER_MAX_BUSES 16
+
+// ボイスを分割してレンダリングするジョブの数の上限（バス毎に1つ以上必要なため、バスの数より多くする）
+#define MCIM_MIXER_MAX_CHUNKS 32
+
+// 1つのジョブでレンダリングするボイス数の最小値
+#define MCIM_MIXER_CHUNK_VOICES 8
+
+// ジョブを並列に処理する再生中のボイス数の下限（これ未満ではスレッドを起こす費用の方が大きい）
+#define MCIM_MIXER_PARALLEL_VOICES 16
+
+// 解析タップの数の上限
+#define MCIM_MIXER_MAX_TAPS 8
+
+// パラメータ変更要求キューの長さ（2の冪である必要がある）
+#define MCIM_MIXER_COMMAND_QUEUE_SIZE 256
+
+/**
+ * @brief ロックなしで再生位置を求めるためにボイス毎に公開する情報
+ * @note - ミキサーのロックを保持した状態で更新し、読み出し側はsequenceが奇数の間と前後で変化した場合に読み直す
+ */
+typedef struct _MCIM_VOICE_CLOCK {
+  _Atomic(uint32_t) sequence;
+  _Atomic(uint64_t) startFrame;     // startPositionに対応するミキサーのフレーム位置（再生開始前はMCIM_MIXER_CLOCK_NEVER）
+  _Atomic(uint64_t) endFrame;       // 停止したミキサーのフレーム位置（再生中はMCIM_MIXER_CLOCK_NEVER）
+  _Atomic(uint64_t) startPosition;  // 32.32固定小数点のソースフレーム位置
+  _Atomic(uint64_t) step;
+  _Atomic(uint32_t) loopStart;
+  _Atomic(uint32_t) loopEnd;
+  _Atomic(uint32_t) frames;
+  _Atomic(uint32_t) sampleRate;  // 0の場合は一度も再生されていない
+} MCIM_VOICE_CLOCK;
+
+typedef struct _MCIM_VOICE {
+  const MCIM_PCM* pcm;
+  MCIDEVICEID id;
+  uint64_t position;  // 32.32固定小数点のソースフレーム位置
+  uint64_t step;      // 32.32固定小数点の出力1フレームあたりの進み幅
+  uint32_t loopStart;
+  uint32_t loopEnd;  // 0の場合はループなし
+  float gain;
+  float targetGain;
+  float trim;  // ラウドネス正規化等による音量変更とは独立した補正ゲイン
+  float targetTrim;
+  float pan[2];  // 左右チャンネル毎のゲイン（pannedがfalseの場合は使わない）
+  float targetPan[2];
+  float rate;  // 再生速度（1.0で等速）
+  float targetRate;
+  uint32_t rateRemaining;  // rateがtargetRateへ到達するまでのフレーム数
+  MCIM_STRETCH* stretch;   // 音程を保って再生速度を変える場合の時間伸縮の状態（NULLの場合はリサンプルで変える）
+  uint32_t fadeTotal;      // 0の場合はフェードなし
+  uint32_t fadeRemaining;
+  MCIM_NOTIFY_FLAGS pendingNotify;  // オフラインレンダリング時の未配送の通知（0の場合はなし）
+  bool notify;
+  bool active;
+  _Atomic(bool) playing;  // activeの写し（ロックを取らずに再生中かを読むために、activeの更新と合わせて書き込む）
+  bool startPending;
+  bool ducked;            // ダッキングの対象とするか
+  bool sidechain;         // ダッキングのトリガーとするか
+  bool panned;            // panによる定位を行うか
+  bool ended;             // 直前のブロックで終端に達した、またはフェードアウトを完了したか
+  LONGLONG startCommand;  // 再生命令時点のQueryPerformanceCounter値
+  MCIM_VOICE_CLOCK clock;
+  MCIM_DSP_CHAIN effects;       // 音量を掛ける前のボイスに適用するインサートエフェクト
+  struct _MCIM_MIXER_BUS* bus;    // 出力先のバス（NULLの場合はマスター）
+  struct _MCIM_MIXER_BUS* route;  // 呼び出し側で最後に指定した出力先のバス（busはレンダリングスレッドが要求の反映時に更新する）
+  MCIM_TAP* tap;                  // 音量を掛けた出力を解析するタップ（NULLの場合は解析しない）
+  struct _MCIM_VOICE* next;
+  struct _MCIM_VOICE* blockNext;  // ブロック毎に作り直す出力先のバスのボイスのリスト
+} MCIM_VOICE;
+
+/**
+ * @brief ボイスの再生終了をMCIManagerへ通知する関数のテンプレート
+ * @note - ミキサーのロックを保持したままレンダリングスレッドから呼ばれるため、ブロックしてはならない
+ */
+typedef void (*mcim_mixer_notify_t)(void* context, MCIM_VOICE* voice, MCIM_NOTIFY_FLAGS flag);
+
+/**
+ * @brief 出力デバイスが実際に再生しているミキサーのフレーム位置
+ * @note - 出力スレッド（オフライン時はmcim_render）が更新し、読み出し側はtimeからの経過時間で補間する
+ */
+typedef struct _MCIM_MIXER_CLOCK {
+  _Atomic(uint32_t) sequence;
+  _Atomic(uint64_t) frame;
+  _Atomic(int64_t) time;    // frameを取得した時点のQueryPerformanceCounter値（0の場合は補間しない）
+  _Atomic(uint64_t) limit;  // 補間で進めてよい上限（デバイスへ書き込み済みのフレーム位置）
+} MCIM_MIXER_CLOCK;
+
+typedef enum _MCIM_MIXER_REQUEST {
+  MCIM_MIXER_REQUEST_GAIN = 0,
+  MCIM_MIXER_REQUEST_TRIM = 1,
+  MCIM_MIXER_REQUEST_DUCKED = 2,
+  MCIM_MIXER_REQUEST_VOICE_BUS = 3,
+  MCIM_MIXER_REQUEST_SFX_BUS = 4,
+  MCIM_MIXER_REQUEST_BUS_GAIN = 5,
+  MCIM_MIXER_REQUEST_BUS_DUCKED = 6,
+  MCIM_MIXER_REQUEST_ADD_BUS = 7,
+  MCIM_MIXER_REQUEST_REMOVE_BUS = 8,
+  MCIM_MIXER_REQUEST_ROUTE_BUS = 9,
+  MCIM_MIXER_REQUEST_RATE = 10,
+  MCIM_MIXER_REQUEST_LOOP = 11,
+  MCIM_MIXER_REQUEST_FADE = 12
+} MCIM_MIXER_REQUEST;
+
+/**
+ * @brief レンダリングスレッドがブロックの先頭で反映するパラメータとバスの構成の変更要求
+ */
+typedef struct _MCIM_MIXER_COMMAND {
+  MCIM_MIXER_REQUEST request;
+  MCIM_VOICE* voice;
+  struct _MCIM_MIXER_BUS* bus;     // 対象のバス（ボイスと効果音の要求では出力先のバス、NULLの場合はマスター）
+  struct _MCIM_MIXER_BUS* parent;  // MCIM_MIXER_REQUEST_ROUTE_BUSでの新しい出力先
+  MCIM_KEY key;                    // MCIM_MIXER_REQUEST_SFX_BUSでの効果音のキー
+  float value;                     // MCIM_MIXER_REQUEST_DUCKEDとMCIM_MIXER_REQUEST_BUS_DUCKEDでは0以外を真とする
+  uint32_t frames;                 // MCIM_MIXER_REQUEST_RATEでのグライド、MCIM_MIXER_REQUEST_FADEでのフェードのフレーム数
+  uint32_t loopStart;              // MCIM_MIXER_REQUEST_LOOPでのループ区間
+  uint32_t loopEnd;
+  MCIM_STRETCH* stretch;           // MCIM_MIXER_REQUEST_RATEでの時間伸縮の状態
+  bool notify;                     // MCIM_MIXER_REQUEST_FADEでの完了時の通知の有無
+} MCIM_MIXER_COMMAND;
+
+typedef struct _MCIM_MIXER_COMMAND_CELL {
+  _Atomic(uint32_t) sequence;
+  MCIM_MIXER_COMMAND command;
+} MCIM_MIXER_COMMAND_CELL;
+
+/**
+ * @brief トリガーとなる効果音の包絡からBGMのゲインを求めるダッカー
+ * @note - 包絡とゲインはブロック単位で更新し、ブロック内ではゲインを線形に補間する
+ */
+typedef struct _MCIM_DUCKER {
+  bool enabled;
+  float threshold;  // ダッキングを開始するトリガーの包絡（線形）
+  float depth;      // 最大の減衰量（dB）
+  float attack;     // 包絡の立ち上がりの時定数（フレーム数）
+  float release;    // 包絡の減衰の時定数（フレーム数）
+  float envelope;
+  float gain;
+  float from;  // 現在のブロックの開始時のゲイン（ブロック内でgainまで線形に補間する）
+} MCIM_DUCKER;
+
+/**
+ * @brief BGMと効果音をまとめて音量とエフェクトを掛けるバス
+ * @note - 出力先を辿るとマスターに至り、経路は循環しない
+ * @note - routeは呼び出し側のスレッドのみが参照し、それ以外の構成とパラメータは変更要求を反映するレンダリングスレッドのみが変更する
+ */
+typedef struct _MCIM_MIXER_BUS {
+  MCIM_KEY key;
+  struct _MCIM_MIXER_BUS* route;   // 呼び出し側から見た出力先のバス（循環の判定に用いる、マスターの場合はNULL）
+  struct _MCIM_MIXER_BUS* parent;  // 出力先のバス（マスターの場合はNULL）
+  uint32_t depth;                  // マスターからの段数（マスターは0）
+  float gain;
+  float targetGain;
+  bool ducked;             // 出力先でミックスする際にダッキングするか
+  MCIM_DSP_CHAIN effects;  // 音量を掛ける前のミックスに適用するインサートエフェクト
+  MCIM_VOICE* head;        // このブロックでレンダリングするボイス
+  MCIM_VOICE* tail;
+  uint32_t voiceCount;
+  uint32_t firstChunk;  // ボイスを分割したジョブの範囲
+  uint32_t chunkCount;
+  bool silent;  // このブロックの出力が無音であり、outを書き込んでいないか
+  float out[MCIM_MIXER_CHANNELS * MCIM_MIXER_BLOCK_FRAMES];
+} MCIM_MIXER_BUS;
+
+/**
+ * @brief ミキサーに設置した解析タップ
+ * @note - busがNULLの場合はボイスのタップであり、ボイスがmcim_tap_inputへミックスした内容を解析する
+ */
+typedef struct _MCIM_MIXER_TAP {
+  MCIM_TAP* tap;
+  MCIM_MIXER_BUS* bus;  // 音量を掛けた出力を解析するバス
+  MCIM_VOICE* voice;
+} MCIM_MIXER_TAP;
+
+/**
+ * @brief 1つのバスのボイスの一部をレンダリングするジョブ
+ * @note - ジョブ毎に別のバッファへミックスし、バスのミックス時にジョブの順に合算することで、結果を処理の順序によらず一定にする
+ */
+typedef struct _MCIM_MIXER_CHUNK {
+  MCIM_MIXER_BUS* bus;
+  MCIM_VOICE* first;
+  uint32_t count;
+  bool ducked;     // duckへミックスしたボイスがあるか
+  bool sidechain;  // sideへミックスしたボイスがあるか
+  float out[MCIM_MIXER_CHANNELS * MCIM_MIXER_BLOCK_FRAMES];
+  float duck[MCIM_MIXER_CHANNELS * MCIM_MIXER_BLOCK_FRAMES];  // ダッキングの対象とするボイスのミックス
+  float side[MCIM_MIXER_CHANNELS * MCIM_MIXER_BLOCK_FRAMES];  // ダッキングのトリガーとするボイスのミックス
+} MCIM_MIXER_CHUNK;
+
+/**
+ * @brief レンダリングに用いる作業領域
+ */
+typedef struct _MCIM_MIXER_WORKSPACE {
+  MCIM_MIXER_CHUNK chunks[MCIM_MIXER_MAX_CHUNKS];
+  float scratch[MCIM_JOBS_MAX_THREADS + 1][MCIM_MIXER_CHANNELS * MCIM_MIXER_BLOCK_FRAMES];  // 処理するスレッド毎のボイスの補間結果
+  float trigger[MCIM_MIXER_CHANNELS * MCIM_MIXER_BLOCK_FRAMES];                             // 全てのジョブのsideの合計
+} MCIM_MIXER_WORKSPACE;
+
+typedef struct _MCIM_MIXER {
+  uint32_t sampleRate;
+  const MCIM_KERNELS* kernels;
+  MCIM_VOICE* voices;
+  struct _MCIM_SFX_POOL* sfx;  // 効果音用のボイスプール（未使用時はNULL）
+  mcim_mixer_notify_t notify;
+  void* notifyContext;
+  uint64_t renderedFrames;
+  bool latencyPending;
+  uint64_t latencyFrame;    // 直近に再生開始したボイスの最初のサンプルのフレーム位置
+  LONGLONG latencyCommand;  // 上記ボイスの再生命令時点のQueryPerformanceCounter値
+  MCIM_MIXER_CLOCK clock;
+  LARGE_INTEGER clockFreq;
+  MCIM_DUCKER ducker;
+  MCIM_MIXER_BUS master;                          // ミックス後の出力（effectsはミックス後の出力に適用する）
+  MCIM_MIXER_BUS* registry[MCIM_MIXER_MAX_BUSES];  // 呼び出し側のスレッドのみが参照する作成順のサブミックスバス
+  uint32_t registryCount;
+  MCIM_MIXER_BUS* buses[MCIM_MIXER_MAX_BUSES];    // レンダリングに反映済みの作成順のサブミックスバス
+  MCIM_MIXER_BUS* schedule[MCIM_MIXER_MAX_BUSES];  // マスターから遠い順（同じ段では作成順）に並べたサブミックスバス
+  uint32_t busCount;
+  MCIM_MIXER_TAP taps[MCIM_MIXER_MAX_TAPS];  // 設置順の解析タップ
+  uint32_t tapCount;
+  bool streamWait;                  // ストリーミング再生で読み込みの完了を待つか（締め切りのないオフラインレンダリングのみtrue）
+  MCIM_JOBS* jobs;                  // レンダリングを分担するスレッド（NULLの場合はレンダリングスレッドのみで処理する）
+  MCIM_MIXER_WORKSPACE* workspace;  // mcim_mixer_prepareで作成する
+  // 音量やバスの構成等の変更要求のキュー（書き込み側はロックを取らず、読み出しはミキサーのロックを保持して行う）
+  MCIM_MIXER_COMMAND_CELL commands[MCIM_MIXER_COMMAND_QUEUE_SIZE];
+  _Atomic(uint32_t) commandEnqueuePos;
+  uint32_t commandDequeuePos;
+  CRITICAL_SECTION mutex;
+} MCIM_MIXER;
+
+void mcim_mixer_init(MCIM_MIXER* mixer, uint32_t sampleRate, mcim_mixer_notify_t notify, void* notifyContext);
+
+/**
+ * @brief ミキサーに作業領域が無ければ作成する
+ * @note - レンダリングを開始する前に呼ぶ必要がある
+ */
+bool mcim_mixer_prepare(MCIM_MIXER* mixer, mcim_allocator_t allocator);
+
+/**
+ * @brief 作業領域とレンダリングを分担するスレッドを解放する
+ * @note - レンダリングスレッドの停止後に呼ぶ必要がある
+ */
+void mcim_mixer_destroy(MCIM_MIXER* mixer, mcim_deallocator_t deallocator);
+
+/**
+ * @brief レンダリングを分担するスレッドを差し替える
+ * @return MCIM_JOBS* 差し替える前のスレッド（呼び出し側で解放する）
+ */
+MCIM_JOBS* mcim_mixer_set_jobs(MCIM_MIXER* restrict mixer, MCIM_JOBS* restrict jobs);
+
+/**
+ * @brief サブミックスバスを追加する
+ * @param parent 出力先のバス（ミキサーに追加済みのバスまたはmixer->master）
+ * @return bool バスの数が上限に達している場合はfalse
+ * @note - 追加したバスはmcim_mixer_remove_busで取り除くまで解放してはならない
+ * @note - レンダリングへは次のブロックの先頭で反映され、この関数はレンダリングの完了を待たない
+ */
+bool mcim_mixer_add_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, MCIM_KEY key, MCIM_MIXER_BUS* restrict parent);
+
+/**
+ * @brief サブミックスバスを取り除き、出力していたバスと効果音を出力先へ付け替える
+ * @note - BGMのボイスの出力先は呼び出し側でmcim_mixer_set_voice_busにより付け替えておく
+ * @note - バスのエフェクトは取り除かないため、呼び出し側で解放する
+ * @note - 戻った時点でレンダリングスレッドから参照されないよう、レンダリング中のブロックの完了を待って反映する
+ */
+void mcim_mixer_remove_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus);
+
+/**
+ * @brief キーに対応するバスを探す
+ * @return MCIM_MIXER_BUS* MCIM_MASTER_KEYの場合はmixer->master、存在しない場合はNULL
+ * @note - バスの追加と削除を行うスレッドから呼ぶ必要がある（ロックを取らない）
+ */
+MCIM_MIXER_BUS* mcim_mixer_find_bus(MCIM_MIXER* mixer, MCIM_KEY key);
+
+/**
+ * @brief サブミックスバスの出力先を変更する
+ * @return bool 経路が循環する場合はfalse
+ * @note - 循環の判定は呼び出し側から見た経路で行い、レンダリングへは次のブロックの先頭で反映する
+ */
+bool mcim_mixer_route_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, MCIM_MIXER_BUS* restrict parent);
+
+/**
+ * @brief バスの音量を設定する
+ * @note - 次のレンダリングブロック内で線形に補間される
+ */
+void mcim_mixer_set_bus_gain(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, float gain);
+
+/**
+ * @brief バスの出力をダッキングの対象とするかを設定する
+ * @note - 次のレンダリングブロックの先頭で反映される
+ */
+void mcim_mixer_set_bus_ducked(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, bool ducked);
+
+/**
+ * @brief ボイスの出力先のバスを設定する
+ * @param bus 出力先のバス（NULLまたはmixer->masterの場合はマスター）
+ * @note - 次のレンダリングブロックの先頭で反映されるため、呼び出し側はvoice->routeで設定した出力先を参照する
+ */
+void mcim_mixer_set_voice_bus(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, MCIM_MIXER_BUS* restrict bus);
+
+/**
+ * @brief 効果音の出力先のバスを設定する
+ * @param bus 出力先のバス（NULLまたはmixer->masterの場合はマスター）
+ * @note - 次のレンダリングブロックの先頭で反映され、それ以降に発音した効果音から適用される
+ */
+void mcim_mixer_set_sfx_bus(MCIM_MIXER* restrict mixer, MCIM_KEY key, MCIM_MIXER_BUS* restrict bus);
+
+/**
+ * @brief 解析タップを設置する
+ * @param bus 解析するバス（ボイスを解析する場合はNULL）
+ * @param voice 解析するボイス（バスを解析する場合はNULL）
+ * @return bool タップの数が上限に達している場合はfalse
+ * @note - 設置したタップはmcim_mixer_remove_tapで取り除くまで解放してはならない
+ */
+bool mcim_mixer_add_tap(MCIM_MIXER* restrict mixer, MCIM_TAP* restrict tap, MCIM_MIXER_BUS* restrict bus, MCIM_VOICE* restrict voice);
+
+/**
+ * @brief キーに対応する解析タップを取り除く
+ * @return MCIM_TAP* 取り除いたタップ（呼び出し側で解放する）、存在しない場合はNULL
+ */
+MCIM_TAP* mcim_mixer_remove_tap(MCIM_MIXER* mixer, MCIM_KEY key);
+
+/**
+ * @brief キーに対応する解析タップを探す
+ * @return MCIM_TAP* 存在しない場合はNULL
+ * @note - ロックを取らないため、タップの設置と取り外しを行うスレッドから呼ぶ必要がある
+ */
+MCIM_TAP* mcim_mixer_find_tap(const MCIM_MIXER* mixer, MCIM_KEY key);
+
+void mcim_mixer_start_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, const MCIM_PCM* restrict pcm, uint32_t from, bool notify);
+
+/**
+ * @brief ボイスを停止する
+ * @note - 積まれている変更要求を先に反映するため、戻った後はボイスのPCMを解放してよい
+ */
+void mcim_mixer_stop_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice);
+
+/**
+ * @brief ボイスが再生中かを取得する
+ * @note - ロックを取らずにレンダリングスレッドが公開した状態を読むため、レンダリング中も待たずに返る
+ */
+bool mcim_mixer_voice_is_active(MCIM_MIXER* restrict mixer, const MCIM_VOICE* restrict voice);
+
+/**
+ * @brief ボイスのループ区間を設定
+ * @note - mcim_mixer_set_gainと同じキューを経由して反映し、再生中の場合は反映した位置から新しい区間でループする
+ */
+void mcim_mixer_set_loop(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, uint32_t loopStart, uint32_t loopEnd);
+
+/**
+ * @brief ボイスのゲインを設定
+ * @note - ロックを取らずに変更要求をキューへ積み、次のレンダリングブロックの先頭（またはmcim_mixer_start_voice）で反映する
+ * @note - キューが溢れた場合に限りロックを取り、積まれている要求と合わせて直接反映する
+ */
+void mcim_mixer_set_gain(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, float gain);
+
+/**
+ * @brief ボイスの補正ゲインを設定
+ * @note - ゲインと同様に次のレンダリングブロック内で線形に補間され、実際の音量はgain * trimとなる
+ * @note - mcim_mixer_set_gainと同じキューを経由して反映する
+ */
+void mcim_mixer_set_trim(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, float trim);
+
+/**
+ * @brief ボイスの再生速度を設定
+ * @param glide 現在の速度からrateへ線形に変化させるフレーム数（0の場合は次のブロックから反映する）
+ * @param stretch 音程を保つ場合の時間伸縮の状態（NULLの場合は音程も変わる）
+ * @note - mcim_mixer_set_gainと同じキューを経由して反映する
+ * @note - stretchはNULLを指定した要求が反映されるまで（ボイスを停止した後でも）解放してはならない
+ */
+void mcim_mixer_set_rate(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, float rate, uint32_t glide, MCIM_STRETCH* restrict stretch);
+
+/**
+ * @brief ダッキングの設定を変更する
+ * @param threshold ダッキングを開始するトリガーの包絡（dBFS）
+ * @param depth 最大の減衰量（dB）
+ * @param attack 包絡の立ち上がりの時定数（ミリ秒）
+ * @param release 包絡の減衰の時定数（ミリ秒）
+ * @note - 無効にした場合はゲインを即座に戻す
+ */
+void mcim_mixer_set_ducking(MCIM_MIXER* mixer, bool enabled, float threshold, float depth, float attack, float release);
+
+/**
+ * @brief ボイスをダッキングの対象とするかを設定する
+ * @note - mcim_mixer_set_gainと同じキューを経由して反映する
+ */
+void mcim_mixer_set_ducked(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, bool ducked);
+
+/**
+ * @brief インサートエフェクトをチェーンの末尾に追加する
+ * @param chain 追加先のボイスまたはバスのチェーン
+ * @param[out] index チェーン内の位置
+ * @return bool チェーンが上限に達している場合はfalse
+ * @note - 追加したエフェクトはmcim_mixer_clear_effectsで取り除くまで解放してはならない
+ */
+bool mcim_mixer_add_effect(MCIM_MIXER* restrict mixer, MCIM_DSP_CHAIN* restrict chain, MCIM_DSP_EFFECT* restrict effect, uint32_t* restrict index);
+
+/**
+ * @brief チェーン内のindex番目のエフェクトを取得する
+ * @return MCIM_DSP_EFFECT* 存在しない場合はNULL
+ * @note - ミキサーのロックを取らないため、レンダリング中も待たずに返る
+ * @note - パラメータの更新もロックを取らずに行えるため、取得したエフェクトへ直接反映する
+ * @note - 同じチェーンのmcim_mixer_clear_effectsと同時に呼び出してはならない
+ */
+MCIM_DSP_EFFECT* mcim_mixer_get_effect(const MCIM_DSP_CHAIN* chain, uint32_t index);
+
+/**
+ * @brief チェーンから全てのエフェクトを取り除く
+ * @param[out] removed 取り除いたエフェクト（MCIM_DSP_MAX_EFFECTS個分の領域が必要）
+ * @return uint32_t 取り除いたエフェクトの数
+ * @note - 取り除いたエフェクトは呼び出し側で解放する
+ */
+uint32_t mcim_mixer_clear_effects(MCIM_MIXER* restrict mixer, MCIM_DSP_CHAIN* restrict chain, MCIM_DSP_EFFECT** restrict removed);
+
+/**
+ * @brief 再生中のボイスをframesフレームかけて線形にフェードアウトし、終了後に停止する
+ * @note - フェードアウト完了時はnotifyがtrueであればMCIM_NOTIFY_SUCCESSFULを通知する
+ * @note - mcim_mixer_set_gainと同じキューを経由して反映し、反映時点で停止しているボイスへの要求は無視する
+ */
+void mcim_mixer_fade_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, uint32_t frames, bool notify);
+
+/**
+ * @brief 直近に再生開始したボイスの最初のサンプル位置と再生命令時刻を取り出す
+ * @note - 一度取り出した情報は次のボイスが再生開始されるまで取り出せない
+ */
+bool mcim_mixer_take_latency_mark(MCIM_MIXER* restrict mixer, uint64_t* restrict frame, LONGLONG* restrict command);
+
+/**
+ * @brief 出力デバイスが再生しているフレーム位置を公開する
+ * @param frame 再生中のミキサーのフレーム位置
+ * @param time frameを取得した時点のQueryPerformanceCounter値（0の場合は補間しない）
+ * @param limit 補間で進めてよい上限のフレーム位置
+ * @note - 同時に呼び出せるのは1スレッドのみ
+ */
+void mcim_mixer_publish_clock(MCIM_MIXER* mixer, uint64_t frame, int64_t time, uint64_t limit);
+
+/**
+ * @brief ボイスの現在の再生位置を秒単位で取得
+ * @return double ループ中はループ区間内へ折り返した位置、一度も再生されていない場合は0
+ * @note - ロックを取らず、任意のスレッドから呼び出せる
+ * @note - 再生開始前は開始位置、停止後は停止した位置を返す
+ */
+double mcim_mixer_get_position(const MCIM_MIXER* restrict mixer, const MCIM_VOICE* restrict voice);
+
+/**
+ * @brief 再生中の全ボイスをミックスし、framesフレーム分の出力を生成
+ * @note - outはMCIM_MIXER_CHANNELS * framesサンプル分の領域を持つ必要がある
+ * @note - ボイスを分割したジョブと同じ段のバスは、mixer->jobsのスレッドと分担して処理する
+ */
+void mcim_mixer_render(MCIM_MIXER* restrict mixer, float* restrict out, uint32_t frames);
+
+#endif  // ___MCIMANAGER_MIXER_H__
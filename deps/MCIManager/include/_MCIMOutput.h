@@ -0,0 +1,46 @@
+﻿#ifndef ___MCIMANAGER_OUTPUT_H__
+#define ___MCIMANAGER_OUTPUT_H__
+
+#include "_MCIMMixer.h"
+
+#include <stdatomic.h>
+
+typedef struct _MCIM_OUTPUT {
+  HWAVEOUT hwo;
+  HANDLE doneEvent;
+  HANDLE stopEvent;
+  HANDLE hthread;
+  MCIM_MIXER* mixer;
+  MCIM_OUTPUT_CONFIG config;
+  WAVEHDR* headers;
+  uint32_t nextHeader;
+  int16_t* buffer;
+  float* mixBuffer;
+  LARGE_INTEGER timerFreq;
+  uint64_t clockBase;  // デバイスを開いた時点のmixer->renderedFrames
+  _Atomic(uint64_t) writtenFrames;
+  bool measuring;
+  uint64_t measureFrame;
+  LONGLONG measureCommand;
+  _Atomic(int64_t) measuredLatency;  // QueryPerformanceCounter単位、未計測時は負数
+  mcim_deallocator_t deallocator;
+} MCIM_OUTPUT;
+
+/**
+ * @brief waveOutデバイスを開き、ミキサーの出力を再生するレンダリングスレッドを開始
+ * @note - 失敗時はNULLを返す
+ */
+ATTRIB_MALLOC MCIM_OUTPUT* mcim_output_open(MCIM_MIXER* restrict mixer,
+                                            const MCIM_OUTPUT_CONFIG* restrict config,
+                                            mcim_allocator_t allocator,
+                                            mcim_deallocator_t deallocator);
+
+void mcim_output_close(MCIM_OUTPUT* output);
+
+/**
+ * @brief 出力段の遅延情報を取得
+ * @note - outputがNULLの場合は設定値のみから求める
+ */
+void mcim_output_get_latency(MCIM_OUTPUT* restrict output, const MCIM_OUTPUT_CONFIG* restrict config, MCIM_LATENCY_INFO* restrict info);
+
+#endif  // ___MCIMANAGER_OUTPUT_H__
@@ -0,0 +1,79 @@
+﻿#ifndef ___MCIMANAGER_PREFETCH_H__
+#define ___MCIMANAGER_PREFETCH_H__
+
+#include "MCIManager/MCIManager.h"
+#include "_MCIMWave.h"
+#include "_MCIMWorker.h"
+
+#include <stdatomic.h>
+
+typedef enum _MCIM_PREFETCH_STATE {
+  MCIM_PREFETCH_QUEUED = 0,
+  MCIM_PREFETCH_LOADING = 1,
+  MCIM_PREFETCH_READY = 2,
+  MCIM_PREFETCH_FAILED = 3
+} MCIM_PREFETCH_STATE;
+
+/**
+ * @brief マニフェストの1ファイル分の先読み
+ * @note - LOADINGの間はワーカーがfilepathを参照するため、取り消された場合もワーカーが解放する
+ */
+typedef struct _MCIM_PREFETCH_ITEM {
+  wchar_t* filepath;
+  int32_t priority;
+  MCIM_RESIDENCY residency;
+  MCIM_PREFETCH_STATE state;
+  atomic_bool canceled;  // LOADINGの間にマニフェストから外された
+  bool listed;           // マニフェストの差し替え時の作業用
+  MCIM_PCM* pcm;         // 先読みしたPCM（MCIで再生するファイルの場合はNULL）
+  struct _MCIM_PREFETCH_ITEM* next;
+} MCIM_PREFETCH_ITEM;
+
+/**
+ * @brief マニフェストに従ってファイルを先読みする
+ * @note - 読み込みは全MCIMオブジェクトで共有するワーカーの低優先度のスレッドで、一つのタスクで一件ずつ行う
+ * @note - itemsは優先度の降順に並べ、ワーカーは常に先頭の未処理の項目から読み込む
+ */
+typedef struct _MCIM_PREFETCHER {
+  MCIM_WORKER_TASK task;  // 先頭に置き、タスクから先読み器を求める
+  bool scheduled;         // taskがワーカーに積まれているか
+  atomic_bool terminate;
+  CRITICAL_SECTION mutex;
+  CONDITION_VARIABLE loaded;  // LOADINGの項目の読み込み完了
+  MCIM_PREFETCH_ITEM* items;
+  uint32_t hits;
+  uint32_t lateHits;
+  uint32_t misses;
+  uint32_t canceled;
+  mcim_allocator_t allocator;
+  mcim_deallocator_t deallocator;
+} MCIM_PREFETCHER;
+
+void mcim_prefetcher_init(MCIM_PREFETCHER* prefetcher, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+
+/**
+ * @brief 先読み器を破棄する
+ * @note - 読み込み中の項目は完了を待ってから、先読み済みのPCMと共に解放する
+ */
+void mcim_prefetcher_destroy(MCIM_PREFETCHER* prefetcher);
+
+/**
+ * @brief マニフェストを差し替える
+ * @note - 新しいマニフェストに含まれない項目は取り消し、先読み済みのPCMは解放する
+ * @note - 既に先読みした項目は優先度のみ更新する
+ * @note - メモリを確保できない場合やワーカーのスレッドを作成できない場合は失敗する（確保できた分は有効）
+ */
+bool mcim_prefetcher_submit(MCIM_PREFETCHER* restrict prefetcher, const MCIM_PREFETCH_ENTRY* restrict manifest, uint32_t count, MCIM_RESIDENCY residency);
+
+/**
+ * @brief 先読みの結果を引き取る
+ * @param[out] pcm 先読みしたPCM（呼び出し側で所有する）、MCIで再生するファイルの場合はNULL
+ * @return bool 先読みが完了していた場合true
+ * @note - 読み込み中の場合は完了を待つ
+ * @note - ヒット率の集計のため、ロードの度に呼ぶ必要がある
+ */
+bool mcim_prefetcher_take(MCIM_PREFETCHER* restrict prefetcher, const wchar_t* restrict filepath, MCIM_PCM** restrict pcm);
+
+void mcim_prefetcher_get_stats(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_STATS* restrict stats);
+
+#endif  // ___MCIMANAGER_PREFETCH_H__
@@ -0,0 +1,190 @@
+﻿#ifndef ___MCIMANAGER_SFX_H__
+#define ___MCIMANAGER_SFX_H__
+
+#include "_MCIMMixer.h"
+
+#include <stdatomic.h>
+
+// ボイスプールのスロット数（同時発音数の上限に、ボイススティールでリリース中のボイス分を加える）
+#define MCIM_SFX_VOICE_COUNT (256 + 32)
+
+// 発音要求キューの長さ（2の冪である必要がある）
+// 定位された全てのボイスを毎フレーム移動させても溢れないよう、移動要求の分も見込む
+#define MCIM_SFX_QUEUE_SIZE 1024
+
+// 発音IDからスロットを引く表の長さ（2の冪である必要がある）
+#define MCIM_SFX_INSTANCE_TABLE_SIZE 1024
+
+// ボイススティール時に奪われたボイスをフェードアウトさせるフレーム数
+#define MCIM_SFX_STEAL_FADE_FRAMES 64
+
+typedef enum _MCIM_SFX_REQUEST {
+  MCIM_SFX_REQUEST_PLAY = 0,
+  MCIM_SFX_REQUEST_PLAY_AT = 1,  // 位置を指定して発音する
+  MCIM_SFX_REQUEST_MOVE = 2      // 発音中のボイスの位置を変更する
+} MCIM_SFX_REQUEST;
+
+typedef struct _MCIM_SFX_TRIGGER {
+  MCIM_SFX_REQUEST request;
+  MCIM_KEY key;
+  float gain;
+  int32_t priority;
+  uint32_t instance;  // MCIM_SFX_REQUEST_PLAY_ATおよびMCIM_SFX_REQUEST_MOVEの発音ID
+  float x;
+  float y;
+  LONGLONG command;  // 発音要求時点のQueryPerformanceCounter値
+} MCIM_SFX_TRIGGER;
+
+typedef struct _MCIM_SFX_QUEUE_CELL {
+  _Atomic(uint32_t) sequence;
+  MCIM_SFX_TRIGGER trigger;
+} MCIM_SFX_QUEUE_CELL;
+
+typedef struct _MCIM_SFX_SAMPLE {
+  MCIM_PCM* pcm;
+  bool sidechain;       // ダッキングのトリガーとするか
+  MCIM_MIXER_BUS* bus;  // 出力先のバス（NULLの場合はマスター）
+} MCIM_SFX_SAMPLE;
+
+typedef struct _MCIM_SFX_SLOT {
+  MCIM_VOICE voice;
+  int32_t priority;
+  uint64_t startFrame;
+  uint32_t instance;  // 位置を指定して発音した場合の発音ID（それ以外は0）
+  bool releasing;
+} MCIM_SFX_SLOT;
+
+/**
+ * @brief 定位の計算に用いるスロット毎の値（構造体配列ではなく配列の構造体として持ち、ブロック毎に一括で計算する）
+ */
+typedef struct _MCIM_SFX_SPATIAL {
+  float x[MCIM_SFX_VOICE_COUNT];
+  float y[MCIM_SFX_VOICE_COUNT];
+  float left[MCIM_SFX_VOICE_COUNT];  // 距離減衰を含む左チャンネルのゲイン
+  float right[MCIM_SFX_VOICE_COUNT];
+} MCIM_SFX_SPATIAL;
+
+/**
+ * @brief 定位の基準となる聴取者
+ */
+typedef struct _MCIM_SFX_LISTENER {
+  float x;
+  float y;
+  float invPanWidth;  // 聴取者から左右の端までの距離の逆数
+  float reference;    // 減衰が始まる距離
+  float rolloff;      // 距離減衰の強さ（0の場合は減衰しない）
+} MCIM_SFX_LISTENER;
+
+/**
+ * @brief 短い効果音用のボイスプール
+ * @note - 発音要求はロックフリーのキューに積まれ、レンダリングスレッドがブロックの先頭で取り出して発音する
+ * @note - キュー以外のメンバはミキサーのロックで保護される
+ */
+typedef struct _MCIM_SFX_POOL {
+  MCIM_SFX_QUEUE_CELL queue[MCIM_SFX_QUEUE_SIZE];
+  _Atomic(uint32_t) enqueuePos;
+  uint32_t dequeuePos;
+  _Atomic(uint32_t) polyphony;
+  _Atomic(uint32_t) nextInstance;
+  MCIM_SFX_SAMPLE* samples;
+  uint32_t sampleCount;
+  uint32_t sampleCapacity;
+  MCIM_SFX_SLOT slots[MCIM_SFX_VOICE_COUNT];
+  uint16_t active[MCIM_SFX_VOICE_COUNT];
+  uint16_t idle[MCIM_SFX_VOICE_COUNT];
+  uint32_t activeCount;
+  uint32_t idleCount;
+  uint32_t playingCount;                                 // activeのうちリリース中でないボイスの数
+  uint32_t pannedCount;                                  // activeのうち位置を指定して発音したボイスの数
+  uint16_t instanceSlots[MCIM_SFX_INSTANCE_TABLE_SIZE];  // 発音IDの下位ビットからスロット番号+1を引く表（0の場合は空き）
+  MCIM_SFX_LISTENER listener;
+  MCIM_SFX_SPATIAL spatial;
+} MCIM_SFX_POOL;
+
+/**
+ * @brief ミキサーにボイスプールが無ければ作成する
+ */
+bool mcim_sfx_pool_prepare(MCIM_MIXER* mixer, uint32_t polyphony, mcim_allocator_t allocator);
+
+/**
+ * @brief ボイスプールとロード済みの全サンプルを解放する
+ * @note - レンダリングスレッドの停止後に呼ぶ必要がある
+ */
+void mcim_sfx_pool_destroy(MCIM_MIXER* mixer, mcim_deallocator_t deallocator);
+
+/**
+ * @brief デコード済みのサンプルを登録する
+ * @note - 成功時はpcmの所有権がボイスプールに移る
+ */
+MCIM_KEY mcim_sfx_pool_add_sample(MCIM_MIXER* restrict mixer, MCIM_PCM* restrict pcm, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+
+/**
+ * @brief サンプルの登録を解除し、発音中のボイスを停止する
+ * @return MCIM_PCM* 登録されていたサンプル（呼び出し側で解放する）、存在しない場合はNULL
+ */
+MCIM_PCM* mcim_sfx_pool_remove_sample(MCIM_MIXER* mixer, MCIM_KEY key);
+
+/**
+ * @brief サンプルをダッキングのトリガーとするかを設定する
+ * @note - 発音中のボイスには反映されず、次の発音から反映される
+ */
+bool mcim_sfx_pool_set_sidechain(MCIM_MIXER* mixer, MCIM_KEY key, bool sidechain);
+
+/**
+ * @brief サンプルの出力先のバスを設定する
+ * @note - 発音中のボイスには反映されず、次の発音から反映される
+ */
+bool mcim_sfx_pool_set_bus(MCIM_MIXER* restrict mixer, MCIM_KEY key, MCIM_MIXER_BUS* restrict bus);
+
+/**
+ * @brief 出力先がfromであるサンプルと発音中のボイスをtoへ付け替える
+ * @note - ミキサーのロックを保持した状態で呼ぶ必要がある
+ */
+void mcim_sfx_pool_reroute(MCIM_SFX_POOL* restrict pool, const MCIM_MIXER_BUS* restrict from, MCIM_MIXER_BUS* restrict to);
+
+/**
+ * @brief 発音中のボイスと未処理の発音要求を全て破棄する
+ */
+void mcim_sfx_pool_clear(MCIM_MIXER* mixer);
+
+/**
+ * @brief 発音要求をキューに積む
+ * @note - ロックおよびメモリ確保を行わないため、任意のスレッドから呼び出せる
+ * @note - キューが満杯の場合は失敗する
+ */
+bool mcim_sfx_pool_trigger(MCIM_SFX_POOL* pool, MCIM_KEY key, float gain, int32_t priority);
+
+/**
+ * @brief 位置を指定した発音要求をキューに積む
+ * @return uint32_t 発音ID（キューが満杯の場合は0）
+ * @note - mcim_sfx_pool_triggerと同様に任意のスレッドから呼び出せる
+ */
+uint32_t mcim_sfx_pool_trigger_at(MCIM_SFX_POOL* pool, MCIM_KEY key, float gain, int32_t priority, float x, float y);
+
+/**
+ * @brief 発音中のボイスの位置を変更する要求をキューに積む
+ * @note - mcim_sfx_pool_triggerと同様に任意のスレッドから呼び出せる
+ * @note - 既に終了した発音IDへの要求は取り出し時に無視される
+ */
+bool mcim_sfx_pool_move(MCIM_SFX_POOL* pool, uint32_t instance, float x, float y);
+
+/**
+ * @brief 定位の基準となる聴取者を設定する
+ * @note - 次のブロックから全ての定位されたボイスに反映される
+ */
+void mcim_sfx_pool_set_listener(MCIM_MIXER* restrict mixer, const MCIM_SFX_LISTENER* restrict listener);
+
+/**
+ * @brief 発音要求を処理し、発音中のボイスの定位をこのブロックの値に更新する
+ * @note - ミキサーのロックを保持した状態で、ブロックのレンダリング前に呼ぶ必要がある
+ * @note - 発音中のボイスはactiveの順にミキサーがレンダリングする
+ */
+void mcim_sfx_pool_update(MCIM_SFX_POOL* restrict pool, MCIM_MIXER* restrict mixer);
+
+/**
+ * @brief レンダリング中に終端に達したボイスを解放する
+ * @note - ミキサーのロックを保持した状態で、ブロックのレンダリング後に呼ぶ必要がある
+ */
+void mcim_sfx_pool_collect(MCIM_SFX_POOL* pool);
+
+#endif  // ___MCIMANAGER_SFX_H__
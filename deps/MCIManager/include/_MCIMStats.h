@@ -0,0 +1,75 @@
+﻿#ifndef ___MCIMANAGER_STATS_H__
+#define ___MCIMANAGER_STATS_H__
+
+#include "MCIManager/MCIManager.h"
+
+/**
+ * @brief MCIコマンドの呼び出しを記録
+ * @param ticks 呼び出しに要した時間（QueryPerformanceCounter単位）
+ */
+void mcim_stats_record_command(MCIM_COMMAND command, LONGLONG ticks, bool succeeded);
+
+/**
+ * @brief PCMのデコードを記録
+ * @param ticks デコードに要した時間（QueryPerformanceCounter単位）
+ * @note - レンダリングスレッドから呼ばれるため、待機しない
+ */
+void mcim_stats_record_decode(uint32_t frames, uint32_t sampleRate, LONGLONG ticks);
+
+void mcim_stats_record_underrun(void);
+
+/**
+ * @brief インサートエフェクトの1ブロック分の処理を記録
+ * @param ticks 処理に要した時間（QueryPerformanceCounter単位）
+ * @note - レンダリングスレッドから呼ばれるため、待機しない
+ */
+void mcim_stats_record_effect(MCIM_EFFECT_TYPE type, uint32_t frames, LONGLONG ticks);
+
+/**
+ * @brief 時間伸縮したボイスの1ブロック分の処理を記録
+ * @param ticks 処理に要した時間（QueryPerformanceCounter単位）
+ * @note - レンダリングスレッドから呼ばれるため、待機しない
+ */
+void mcim_stats_record_stretch(uint32_t frames, LONGLONG ticks);
+
+/**
+ * @brief ミキサーの1ブロック分のレンダリングを記録
+ * @param ticks レンダリングに要した時間（QueryPerformanceCounter単位、並列に処理した場合も経過時間とする）
+ * @note - レンダリングスレッドから呼ばれるため、待機しない
+ */
+void mcim_stats_record_mix(uint32_t frames, LONGLONG ticks);
+
+/**
+ * @brief 解析タップの1ブロック分の処理を記録
+ * @param ticks 処理に要した時間（QueryPerformanceCounter単位、FFTを行ったブロックはその時間を含む）
+ * @note - レンダリングスレッドから呼ばれるため、待機しない
+ */
+void mcim_stats_record_analysis(uint32_t frames, LONGLONG ticks);
+
+/**
+ * @brief ストリーミング再生でデコード済みの区間を読み込んだことを記録
+ * @param prefetched 先行して発行した読み込みを使用したか
+ * @param ticks 読み込みの完了を待った時間（QueryPerformanceCounter単位）
+ * @note - レンダリングスレッドから呼ばれるため、待機しない
+ */
+void mcim_stats_record_stream(bool prefetched, uint32_t bytes, LONGLONG ticks);
+
+/**
+ * @brief ストリーミング再生で読み込みが間に合わず、無音としたことを記録
+ * @note - レンダリングスレッドから呼ばれるため、待機しない
+ */
+void mcim_stats_record_stream_underrun(void);
+
+/**
+ * @brief 所要時間をMCIM_STATS_LATENCY_BUCKETSのヒストグラムの区間に振り分ける
+ * @param ticks 所要時間（QueryPerformanceCounter単位）
+ */
+uint32_t mcim_stats_latency_bucket(LONGLONG ticks);
+
+/**
+ * @brief 全MCIMオブジェクトで共有するカウンタを読み出す
+ * @note - MCIMオブジェクト毎の値は設定しない
+ */
+void mcim_stats_get(MCIM_STATS* stats);
+
+#endif  // ___MCIMANAGER_STATS_H__
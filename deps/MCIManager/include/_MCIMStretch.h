@@ -0,0 +1,76 @@
+﻿#ifndef ___MCIMANAGER_STRETCH_H__
+#define ___MCIMANAGER_STRETCH_H__
+
+#include "_MCIMKernels.h"
+
+// WSOLAの粒の長さ（出力はこの半分ずつ重ね合わせる）
+#define MCIM_STRETCH_WINDOW_FRAMES 1024
+#define MCIM_STRETCH_HOP_FRAMES (MCIM_STRETCH_WINDOW_FRAMES / 2)
+
+// 粒の位置を探索する範囲（前後のフレーム数）と、類似度を求める区間の長さ
+#define MCIM_STRETCH_SEEK_FRAMES 128
+#define MCIM_STRETCH_CORRELATION_FRAMES 256
+
+// 粗い探索の刻み（最良の候補の前後は1フレーム刻みで探索し直す）
+#define MCIM_STRETCH_COARSE_STEP 4
+
+/**
+ * @brief 時間伸縮の入力となるソースを読み出す関数のテンプレート
+ * @param position 32.32固定小数点のソースフレーム位置
+ * @return uint32_t 読み出せたフレーム数（ループなしで終端に達した場合はframes未満となり、残りは無音で埋める）
+ * @note - ソースの元の音程のまま（ソースのサンプリング周波数をミキサーの周波数へ変換して）ステレオで出力する
+ */
+typedef uint32_t (*mcim_stretch_read_t)(void* context, uint64_t position, float* dst, uint32_t frames);
+
+/**
+ * @brief WSOLAによる音程を保った時間伸縮の状態
+ * @note - 出力のホップ長ごとに、ソース上で再生速度分だけ進めた位置の近傍から直前の粒と最も滑らかにつながる粒を選び、窓を掛けて重ね合わせる
+ * @note - ソース位置はすべて32.32固定小数点であり、ループ区間への折り返しは呼び出し側で行う
+ */
+typedef struct _MCIM_STRETCH {
+  uint64_t analysis;      // 次の粒を探索する基準のソース位置
+  uint64_t continuation;  // 直前の粒の自然な続きのソース位置
+  uint64_t grainStart;    // 直前の粒の先頭のソース位置
+  bool primed;            // falseの場合は次の粒を探索せず窓も掛けずに出力する（開始や切り替え時の不連続を防ぐ）
+  bool ended;             // ソースの終端に達し、残りは重ね合わせ途中の粒のみ
+  uint32_t outputPosition;
+  uint32_t outputCount;
+  float output[2 * MCIM_STRETCH_HOP_FRAMES];                                     // 出力待ちのフレーム
+  float tail[2 * MCIM_STRETCH_HOP_FRAMES];                                       // 直前の粒の後半に窓を掛けたもの
+  float grain[2 * MCIM_STRETCH_WINDOW_FRAMES];                                   // 読み出した粒（探索時の作業領域を兼ねる）
+  float pattern[MCIM_STRETCH_CORRELATION_FRAMES];                                // 直前の粒の続きのモノラル
+  float search[MCIM_STRETCH_CORRELATION_FRAMES + 2 * MCIM_STRETCH_SEEK_FRAMES];  // 探索範囲のモノラル
+  float window[MCIM_STRETCH_HOP_FRAMES];                                         // Hann窓の前半（後半は1から引いたもの）
+} MCIM_STRETCH;
+
+/**
+ * @brief 時間伸縮の状態を作成
+ */
+ATTRIB_MALLOC MCIM_STRETCH* mcim_stretch_create(mcim_allocator_t allocator);
+
+/**
+ * @brief 出力をソース位置positionから再開する
+ * @note - 次の粒は探索を行わず、positionから途切れずにつながる
+ */
+void mcim_stretch_reset(MCIM_STRETCH* stretch, uint64_t position);
+
+/**
+ * @brief 再生速度rateで時間伸縮した出力をframesフレーム分dstへ書き出す
+ * @param step 32.32固定小数点のソースの元の音程での出力1フレームあたりの進み幅
+ * @return uint32_t 出力したフレーム数（ソースの終端に達した場合はframes未満となる）
+ */
+uint32_t mcim_stretch_render(MCIM_STRETCH* restrict stretch,
+                             const MCIM_KERNELS* restrict kernels,
+                             mcim_stretch_read_t read,
+                             void* context,
+                             uint64_t step,
+                             float rate,
+                             float* restrict dst,
+                             uint32_t frames);
+
+/**
+ * @brief 次に出力するフレームに対応するソース位置を取得
+ */
+uint64_t mcim_stretch_position(const MCIM_STRETCH* stretch, uint64_t step);
+
+#endif  // ___MCIMANAGER_STRETCH_H__
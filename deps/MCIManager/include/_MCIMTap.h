@@ -0,0 +1,73 @@
+﻿#ifndef ___MCIMANAGER_TAP_H__
+#define ___MCIMANAGER_TAP_H__
+
+#include "_MCIMKernels.h"
+
+#include <stdatomic.h>
+
+// 入力を受け取るブロックの長さの上限（ミキサーのブロック長に合わせる）
+#define MCIM_TAP_BLOCK_FRAMES 256
+
+// FFTの点数の上限（MCIM_ANALYSIS_MAX_FFT_SIZEと同じ値とする）
+#define MCIM_TAP_MAX_SIZE (2 * MCIM_ANALYSIS_MAX_BINS)
+
+// 3重バッファで未読のスナップショットを表すビット（下位ビットはスナップショットの添字）
+#define MCIM_TAP_FRESH 4u
+
+/**
+ * @brief レベルとスペクトルを解析し、3重バッファで公開するタップ
+ * @note - 入力と解析はレンダリング中に1スレッドずつ行い、公開したスナップショットはロックを取らずに1スレッドから読み出す
+ * @note - 直近size点のモノラルの履歴をリングバッファに保持し、hopフレーム毎にHann窓を掛けて基数2のFFTを行う
+ */
+typedef struct _MCIM_TAP {
+  MCIM_KEY key;
+  uint32_t size;  // FFTの点数（2の冪）
+  uint32_t hop;   // FFTの間隔（フレーム数）
+  uint32_t sampleRate;
+  uint32_t writePosition;  // historyの次に書き込む位置
+  uint32_t pending;        // 前回のFFT以降に書き込んだフレーム数
+  uint32_t levelFrames;    // peakとsumを集計したフレーム数
+  float peak[2];
+  float sum[2];                            // チャンネル毎の二乗和
+  bool inputUsed;                          // このブロックでinputへミックスしたか
+  float input[2 * MCIM_TAP_BLOCK_FRAMES];  // ボイスのタップのミックス先
+  float history[MCIM_TAP_MAX_SIZE];
+  float window[MCIM_TAP_MAX_SIZE];
+  float twiddleRe[MCIM_TAP_MAX_SIZE];  // 半分の長さがhalfの段の回転因子をtwiddle[half]から並べたもの
+  float twiddleIm[MCIM_TAP_MAX_SIZE];
+  float re[MCIM_TAP_MAX_SIZE];
+  float im[MCIM_TAP_MAX_SIZE];
+  uint16_t reversed[MCIM_TAP_MAX_SIZE];  // ビット反転した添字
+  MCIM_ANALYSIS snapshots[3];
+  _Atomic(uint32_t) middle;  // 書き込み側と読み出し側が交換するスナップショット（MCIM_TAP_FRESHは未読を表す）
+  uint32_t back;             // 書き込み側が次に書き込むスナップショット
+  uint32_t front;            // 読み出し側が最後に読み出したスナップショット
+} MCIM_TAP;
+
+/**
+ * @brief 解析タップを作成
+ * @param size FFTの点数（MCIM_ANALYSIS_MIN_FFT_SIZE以上MCIM_TAP_MAX_SIZE以下の2の冪）
+ */
+ATTRIB_MALLOC MCIM_TAP* mcim_tap_create(MCIM_KEY key, uint32_t size, uint32_t sampleRate, mcim_allocator_t allocator);
+
+/**
+ * @brief このブロックの入力のミックス先を取得
+ * @return float* ブロックで初めての呼び出しであればframesフレーム分を無音で初期化したバッファ
+ */
+float* mcim_tap_input(MCIM_TAP* tap, uint32_t frames);
+
+/**
+ * @brief 1ブロック分の入力を解析し、FFTの間隔に達していればスナップショットを公開する
+ * @param src ステレオの入力（NULLの場合はmcim_tap_inputへミックスした内容、ミックスしていない場合は無音とする）
+ * @param frame ブロックの末尾のミキサーのフレーム位置
+ * @note - framesはhop以下であり、1ブロックあたりのFFTは高々1回となる（点数毎の所要時間はtests/BenchTapで計測する）
+ */
+void mcim_tap_process(MCIM_TAP* restrict tap, const MCIM_KERNELS* restrict kernels, const float* restrict src, uint32_t frames, uint64_t frame);
+
+/**
+ * @brief 最新のスナップショットを読み出す
+ * @note - 待機せず、同時に呼び出せるのは1スレッドのみ
+ */
+void mcim_tap_read(MCIM_TAP* restrict tap, MCIM_ANALYSIS* restrict analysis);
+
+#endif  // ___MCIMANAGER_TAP_H__
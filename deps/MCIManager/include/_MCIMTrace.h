@@ -0,0 +1,133 @@
+﻿#ifndef ___MCIMANAGER_TRACE_H__
+#define ___MCIMANAGER_TRACE_H__
+
+#include "MCIManager/MCIManager.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+// トレースファイルの形式を変更した場合は更新する（異なるバージョンのファイルは再生できない）
+#define MCIM_TRACE_VERSION 3
+
+// 呼び出し元から書き出し用のスレッドへ記録を渡すリングバッファの容量（2の冪）
+#define MCIM_TRACE_CAPACITY 2048
+
+// 書き出し用のスレッドがリングバッファを確認する間隔（ミリ秒）
+#define MCIM_TRACE_FLUSH_INTERVAL 50
+
+// 記録をファイルへ書き出す単位（バイト）
+#define MCIM_TRACE_BUFFER_SIZE 65536
+
+// リングバッファのスロットに直接格納する付加データの上限（バイト、これを超えるfilepathは複製を確保する）
+#define MCIM_TRACE_INLINE_SIZE sizeof(MCIM_EQ_PARAMS)
+
+#define MCIM_TRACE_FLAG_SUCCEEDED 0x01
+#define MCIM_TRACE_FLAG_CALLBACK 0x02  // コールバック付きの呼び出し（関数ポインタは記録しない）
+#define MCIM_TRACE_FLAG_STRETCH 0x04   // mcim_set_rateのmodeがMCIM_RATE_STRETCH
+#define MCIM_TRACE_FLAG_ENABLED 0x08   // mcim_set_duckedのduckedがtrue
+
+/**
+ * @brief API呼び出し1回分の記録
+ * @note - ファイル上ではレコードの直後に付加データ（extraSizeバイト）が続く
+ * @note - 付加データはロードのfilepath（終端なし）、またはエフェクトのパラメータの構造体そのものである
+ * @note - floatの引数はビット列のままargsに格納する
+ */
+typedef struct _MCIM_TRACE_RECORD {
+  uint64_t time;       // 記録開始から呼び出しまでの時間（ナノ秒）
+  uint32_t latency;    // 呼び出しに要した時間（ナノ秒、UINT32_MAXで飽和）
+  uint8_t call;        // MCIM_TRACE_CALL
+  uint8_t flags;       // MCIM_TRACE_FLAG_*
+  uint16_t extraSize;  // 付加データの長さ（バイト、付加データを持たない呼び出しやパラメータがNULLの場合は0）
+  uint32_t key;        // 引数のキー（mcim_sfx_moveはインスタンス）
+  uint32_t result;     // MCIM_KEYまたはインスタンスを返す呼び出しは返り値、エフェクトを挿入する呼び出しはindex、それ以外は0
+  uint32_t args[4];
+} MCIM_TRACE_RECORD;
+
+/**
+ * @brief 書き出し用のスレッドへ記録を渡すリングバッファのスロット
+ */
+typedef struct _MCIM_TRACE_SLOT {
+  _Atomic(uint32_t) sequence;  // 書き込み可能な位置、または書き込み済みの位置 + 1
+  MCIM_TRACE_RECORD record;
+  uint8_t* extra;  // 付加データがMCIM_TRACE_INLINE_SIZEを超える場合に確保した複製（書き出し用のスレッドが解放する）
+  uint8_t inlineExtra[MCIM_TRACE_INLINE_SIZE];
+} MCIM_TRACE_SLOT;
+
+/**
+ * @brief API呼び出しをトレースファイルへ記録する
+ * @note - 記録は呼び出しの完了順にリングバッファへ積み、ファイルへの書き出しは書き出し用のスレッドのみが行う
+ * @note - リングバッファが満杯の場合は呼び出し元を待たせずに記録を破棄し、droppedに数える
+ */
+typedef struct _MCIM_TRACE_RECORDER {
+  HANDLE file;
+  HANDLE thread;
+  HANDLE stopEvent;
+  LONGLONG base;  // 記録開始時点（QueryPerformanceCounter単位）
+  LONGLONG freq;
+  MCIM_TRACE_SLOT* slots;
+  _Atomic(uint32_t) enqueuePos;
+  uint32_t dequeuePos;  // 書き出し用のスレッドのみが更新する
+  _Atomic(uint64_t) dropped;
+  uint8_t* buffer;
+  size_t length;
+  bool failed;  // 書き出しに失敗した（以後の記録は破棄する、書き出し用のスレッドのみが更新する）
+  mcim_allocator_t allocator;
+  mcim_deallocator_t deallocator;
+} MCIM_TRACE_RECORDER;
+
+static inline uint32_t mcim_trace_float_bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static inline float mcim_trace_bits_float(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ * @brief トレースファイルを作成し、記録を開始する
+ * @note - 既存のファイルは上書きする
+ */
+MCIM_TRACE_RECORDER* mcim_trace_open(const wchar_t* filepath, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+
+/**
+ * @brief 書き出し用のスレッドを止め、残りの記録を書き出してトレースファイルを閉じる
+ * @return bool 全ての記録を破棄せずに書き出せた場合true
+ */
+bool mcim_trace_close(MCIM_TRACE_RECORDER* recorder, mcim_deallocator_t deallocator);
+
+/**
+ * @brief 呼び出しの開始時点を返す
+ * @note - recorderがNULLの場合は時刻を取得せず0を返す
+ */
+LONGLONG mcim_trace_begin(const MCIM_TRACE_RECORDER* recorder);
+
+/**
+ * @brief 完了した呼び出しを記録する
+ * @param begin mcim_trace_beginの返り値
+ * @param extra 付加データ（NULLの場合は付加データを持たない）
+ * @param extraSize 付加データの長さ（バイト）
+ * @note - record->time、record->latencyおよびrecord->extraSizeは上書きする
+ * @note - ファイルへは書き出さず、付加データがMCIM_TRACE_INLINE_SIZEを超える場合のみメモリを確保する
+ */
+void mcim_trace_record(MCIM_TRACE_RECORDER* restrict recorder,
+                       LONGLONG begin,
+                       MCIM_TRACE_RECORD* restrict record,
+                       const void* restrict extra,
+                       size_t extraSize);
+
+/**
+ * @brief トレースファイルの呼び出しを再現する
+ * @note - ファイルは全体を読み込んでから再生し、再生中にディスクを読まない
+ */
+bool mcim_trace_replay(MCIM_DATA* restrict data,
+                       const wchar_t* restrict filepath,
+                       MCIM_TRACE_PACE pace,
+                       MCIM_TRACE_REPORT* restrict report,
+                       mcim_allocator_t allocator,
+                       mcim_deallocator_t deallocator);
+
+#endif  // ___MCIMANAGER_TRACE_H__
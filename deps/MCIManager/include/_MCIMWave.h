@@ -0,0 +1,133 @@
+﻿#ifndef ___MCIMANAGER_WAVE_H__
+#define ___MCIMANAGER_WAVE_H__
+
+#include "MCIManager/MCIManager.h"
+#include "_MCIMCache.h"
+
+// 非常駐のPCMを再生する際に一度にデコードするフレーム数
+#define MCIM_PCM_WINDOW_FRAMES 8192
+
+// ストリーミング時に先行して発行しておく読み込みの数（一つの読み込みはMCIM_PCM_WINDOW_FRAMESフレーム分）
+#define MCIM_PCM_READAHEAD_COUNT 4
+
+// ストリーミング時に読み込みが間に合わなかった場合に無音とするフレーム数（この区間を過ぎると再び読み込みの完了を確かめる）
+#define MCIM_PCM_LATE_FRAMES 1024
+
+typedef enum _MCIM_PCM_STORAGE {
+  MCIM_PCM_STORAGE_DECODED = 0,  // samplesにfloatへデコードして常駐
+  MCIM_PCM_STORAGE_ENCODED = 1,  // encodedにdataチャンクをファイル上の形式のまま常駐
+  MCIM_PCM_STORAGE_STREAMED = 2  // 再生中にファイルから読み込む
+} MCIM_PCM_STORAGE;
+
+/**
+ * @brief ストリーミング時の非同期の読み込み
+ * @note - 読み込みはそれぞれ専用のイベントを持つため、同じファイルに対して同時に複数発行できる
+ */
+typedef struct _MCIM_PCM_READ {
+  OVERLAPPED overlapped;
+  uint8_t* raw;    // ファイルから読み込んだデコード前のデータ
+  uint32_t start;  // raw[0]のフレーム位置
+  uint32_t count;  // 0の場合は未発行（取り消した読み込みはpendingの間はバッファを再利用できない）
+  bool failed;     // 発行または読み込みに失敗した
+  bool pending;    // 発行した読み込みの完了をまだ確かめていない
+} MCIM_PCM_READ;
+
+/**
+ * @brief 非常駐のPCMを再生するためのデコード済み区間
+ * @note - ストリーミング時は現在の区間に続く区間の読み込みを先行して発行しておき、区間を移る際にその完了を確かめる
+ */
+typedef struct _MCIM_PCM_WINDOW {
+  float* samples;
+  uint32_t start;                                 // samples[0]のフレーム位置
+  uint32_t end;                                   // start == endの場合は空
+  uint32_t loopStart;                             // 先読みする区間の予測に用いるループ区間
+  uint32_t loopEnd;                               // 0の場合はループなし
+  MCIM_PCM_READ reads[MCIM_PCM_READAHEAD_COUNT];  // ストリーミング時のみ
+} MCIM_PCM_WINDOW;
+
+/**
+ * @brief PCMデータ
+ * @note - samplesはchannels個のサンプルをインターリーブしたframes個のフレームからなる
+ * @note - DECODED以外の場合、デコード済みの区間はwindowを介して参照する（同時に再生できるボイスは一つのみ）
+ */
+typedef struct _MCIM_PCM {
+  float* samples;
+  uint32_t frames;
+  uint32_t sampleRate;
+  uint16_t channels;
+  uint32_t loopStart;
+  uint32_t loopEnd;
+  MCIM_PCM_STORAGE storage;
+  uint16_t formatTag;
+  uint16_t bitsPerSample;
+  uint16_t blockAlign;
+  uint8_t* encoded;
+  HANDLE file;
+  uint64_t dataOffset;  // ファイル内のdataチャンクの位置
+  size_t residentBytes;
+  MCIM_PCM_WINDOW* window;
+  MCIM_CACHE_VIEW cache;  // samplesがディスクキャッシュをメモリマップしたものである場合に使用
+} MCIM_PCM;
+
+/**
+ * @brief ファイルがレンダリングパスで再生可能なWAVファイルか判定
+ * @note - RIFFヘッダのみを確認するため、ファイル全体は読み込まない
+ */
+bool mcim_wave_probe(const wchar_t* filepath);
+
+/**
+ * @brief WAVファイルを読み込み、指定された方式で保持する
+ * @param[in] residency 常駐方式
+ * @param[in] streamable メモリ予算を超える場合にストリーミング再生へ切り替えてよいか
+ * @note - 対応形式はPCM（8/16/24/32bit）およびIEEE float（32bit）、チャンネル数は1または2
+ * @note - smplチャンクにループ区間が存在する場合はloopStart/loopEndへ設定する
+ * @note - streamableがfalseの場合は予算を超えてもresidencyの方式で常駐させる
+ * @note - デコードして常駐させる場合、ディスクキャッシュが有効であればキャッシュをメモリマップし、無ければデコード後に作成する
+ * @note - 失敗時はNULLを返す
+ */
+ATTRIB_MALLOC MCIM_PCM* mcim_wave_load(const wchar_t* filepath,
+                                       MCIM_RESIDENCY residency,
+                                       bool streamable,
+                                       mcim_allocator_t allocator,
+                                       mcim_deallocator_t deallocator);
+
+/**
+ * @brief WAVファイルをメモリへ常駐させずに開く
+ * @note - 再生以外の用途（解析等）でファイル全体を順に読むためのもので、メモリ予算は使用しない
+ * @note - 失敗時はNULLを返す
+ */
+ATTRIB_MALLOC MCIM_PCM* mcim_wave_open(const wchar_t* filepath, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+
+void mcim_wave_free(MCIM_PCM* pcm, mcim_deallocator_t deallocator);
+
+/**
+ * @brief frameとその次のフレームを含むデコード済みの区間を取得
+ * @param[out] start 返り値の先頭のフレーム位置
+ * @param[out] end 返り値の終端のフレーム位置（この位置を含まない）
+ * @param wait ストリーミング時に読み込みの完了を待つか
+ * @note - DECODEDの場合は全体を返し、それ以外はwindowへ必要な区間をデコードしてから返す
+ * @note - ストリーミング時の読み込みに失敗した区間は無音となる
+ * @note - ストリーミング時は次に必要となる区間の読み込みを非同期に発行してから返る
+ * @note - waitがfalseの場合は読み込みの完了を待たず、間に合わなかった場合はframeからMCIM_PCM_LATE_FRAMESフレームを無音として返す
+ */
+const float* mcim_wave_map(const MCIM_PCM* restrict pcm, uint32_t frame, uint32_t* restrict start, uint32_t* restrict end, bool wait);
+
+/**
+ * @brief ストリーミング時に先読みする区間の予測に用いるループ区間を設定
+ * @note - loopEndが0の場合はループなしとして、ファイルの終端まで順に先読みする
+ */
+void mcim_wave_set_loop_hint(const MCIM_PCM* pcm, uint32_t loopStart, uint32_t loopEnd);
+
+/**
+ * @brief 常駐するPCMデータの合計に対する予算を設定（0の場合は無制限）
+ */
+void mcim_wave_set_budget(size_t bytes);
+
+void mcim_wave_get_stats(MCIM_MEMORY_STATS* stats);
+
+/**
+ * @brief ステレオのfloat PCMをIEEE float形式のWAVファイルとして書き出す
+ */
+bool mcim_wave_save(const wchar_t* restrict filepath, const float* restrict samples, uint32_t frames, uint32_t sampleRate);
+
+#endif  // ___MCIMANAGER_WAVE_H__
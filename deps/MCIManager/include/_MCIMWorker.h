@@ -0,0 +1,86 @@
+﻿#ifndef ___MCIMANAGER_WORKER_H__
+#define ___MCIMANAGER_WORKER_H__
+
+#include "MCIManager/MCIManager.h"
+
+#include <stdatomic.h>
+
+/**
+ * @brief バックグラウンドスレッドで実行するタスク
+ * @note - 要求元の構造体に埋め込んで使用する
+ * @note - runがtrueを返した場合はキューの末尾に積み直し、他のタスクと交互に実行する
+ */
+typedef struct _MCIM_WORKER_TASK {
+  bool (*run)(struct _MCIM_WORKER_TASK* task);
+  struct _MCIM_WORKER_TASK* next;
+} MCIM_WORKER_TASK;
+
+/**
+ * @brief フレーム毎に進めるタイマー（フェードアウトなど）
+ * @note - 要求元の構造体に埋め込んで使用する
+ * @note - stepがfalseを返した場合はタイマーを終了する
+ * @note - stepはフレームレート毎に共有するSyncFPSのティッカーのスレッドから呼ばれる
+ */
+typedef struct _MCIM_WORKER_TIMER {
+  bool (*step)(struct _MCIM_WORKER_TIMER* timer);
+  _Atomic(uint64_t) registration;  // 登録先のティッカーの番号と登録識別子（0の場合は未登録）
+  bool paused;                     // フレームレート0で止めている
+} MCIM_WORKER_TIMER;
+
+/**
+ * @brief 全MCIMオブジェクトで共有するワーカーへの参照を追加
+ * @note - スレッドは最初のタスクの追加時、ティッカーはそのフレームレートの最初のタイマーの開始時に作成する
+ */
+void mcim_worker_acquire(void);
+
+/**
+ * @brief ワーカーへの参照を解除
+ * @note - 参照が無くなった場合はスレッドとティッカーを停止する
+ */
+void mcim_worker_release(void);
+
+/**
+ * @brief タスクをバックグラウンドスレッドのキューに積む
+ * @note - スレッドを作成できない場合は失敗する
+ */
+bool mcim_worker_post(MCIM_WORKER_TASK* task);
+
+/**
+ * @brief タスクをキューから取り除く
+ * @note - 実行中の場合は完了するまで待機する（タスク自身から呼ばれた場合を除く）
+ */
+void mcim_worker_cancel(MCIM_WORKER_TASK* task);
+
+/**
+ * @brief タイマーを開始
+ * @param[in] fps stepを呼ぶ頻度（1秒あたりの回数）
+ * @note - 同じフレームレートのタイマーは一つのティッカーを共有し、最初のstepはそのティッカーの次のティックで呼ばれる
+ * @note - ティッカーの数は上限があり、上限に達した後は最も近いフレームレートのティッカーで進める
+ * @note - fpsが0の場合は一時停止した状態で開始する
+ * @note - ティッカーを作成できない場合は失敗する
+ * @note - stepの中から同じタイマーを開始し直してもよい
+ */
+bool mcim_worker_start_timer(MCIM_WORKER_TIMER* timer, double fps);
+
+/**
+ * @brief 動作中のタイマーのフレームレートを変更
+ * @return bool タイマーが動作中であった場合true
+ * @note - 次のstepは変更後のフレームレートのティッカーの次のティックで呼ばれる
+ * @note - fpsが0の場合は再び変更されるまでstepを呼ばない
+ * @note - stepの実行中の場合は完了するまで待機する
+ */
+bool mcim_worker_set_timer_rate(MCIM_WORKER_TIMER* timer, double fps);
+
+/**
+ * @brief タイマーを停止
+ * @return bool タイマーが動作中であった場合true
+ * @note - stepの実行中の場合は完了するまで待機する（そのティッカーのstepの中から呼ばれた場合を除く）
+ */
+bool mcim_worker_stop_timer(MCIM_WORKER_TIMER* timer);
+
+/**
+ * @brief 現在動作しているワーカースレッドとティッカーのスレッドの数
+ */
+uint32_t mcim_worker_thread_count(void);
+
+#endif  // ___MCIMANAGER_WORKER_H__
@@ -2,6 +2,15 @@
 #define ___MCIMANAGER_H__
 
 #include "MCIManager/MCIManager.h"
+#include "_MCIMCache.h"
+#include "_MCIMLog.h"
+#include "_MCIMLoudness.h"
+#include "_MCIMOutput.h"
+#include "_MCIMPrefetch.h"
+#include "_MCIMSfx.h"
+#include "_MCIMStats.h"
+#include "_MCIMTrace.h"
+#include "_MCIMWorker.h"
 #include "uthash.h"
 
 #include <digitalv.h>
@@ -11,6 +20,12 @@
 // 定数以外（const変数を含む）でAtomic変数を初期化できないため
 #define MCIM_INITIAL_KEY_VALUE 0
 
+// レンダリングパスのエントリにはMCIが払い出すIDと衝突しない疑似デバイスIDを割り当てる
+#define MCIM_INITIAL_RENDER_ID_VALUE 0x80000000
+
+// レンダリングパスのエントリの基準音量（MCIのMCI_DGV_STATUS_NOMINALの既定値に合わせる）
+#define MCIM_RENDER_NOMINAL_VOLUME 1000
+
 typedef enum _MCIM_STATUS {
   MCIM_STATUS_UNLOADED = 0,
   MCIM_STATUS_LOADED = 1,
@@ -18,28 +33,60 @@ typedef enum _MCIM_STATUS {
   MCIM_STATUS_FADINGOUT = 3
 } MCIM_STATUS;
 
+typedef enum _MCIM_BACKEND {
+  MCIM_BACKEND_MCI = 0,
+  MCIM_BACKEND_RENDER = 1
+} MCIM_BACKEND;
+
+/**
+ * @brief オンライン時のフェードアウト
+ * @note - 全MCIMオブジェクトで共有するワーカーのタイマーとして進める
+ */
+typedef struct _MCIM_FADEOUT {
+  MCIM_WORKER_TIMER timer;  // 先頭に置き、タイマーからフェードアウトを求める
+  struct _MCIM_MUSIC_ENTRY* entry;
+  struct _MCIM_DATA_INTERNAL* data;
+  int32_t time;   // フレーム数
+  int32_t count;  // 経過フレーム数
+} MCIM_FADEOUT;
+
 typedef struct _MCIM_MUSIC_ENTRY {
   MCIM_KEY key;
   MCIDEVICEID id;
   MCIM_STATUS status;
+  MCIM_BACKEND backend;
   uint32_t volume;
   wchar_t* filepath;
+  MCIM_PCM* pcm;
+  MCIM_VOICE voice;
+  MCIM_STRETCH* stretch;  // MCIM_RATE_STRETCHで再生する場合の時間伸縮の状態（一度作成したらmcim_exitまで保持する）
+  MCIM_LOUDNESS_REQUEST loudness;
+  MCIM_FADEOUT fade;
   struct _MCIM_MUSIC_ENTRY* next;
+  _Atomic(struct _MCIM_MUSIC_ENTRY*) positionNext;  // positionsで次に辿るエントリ
 } MCIM_MUSIC_ENTRY;
 
-typedef struct _MCIM_THREAD_DATA {
-  HANDLE hthread;
-  uint32_t threadId;
-  HANDLE initializedEvent;
-  atomic_uintptr_t wait;
-} MCIM_THREAD_DATA;
-
 typedef struct _MCIM_DATA_INTERNAL {
   MCIM_MUSIC_ENTRY* bgmlist;
+  // mcim_get_positionがロックなしでkeyからボイスの再生位置を引くための、レンダリングパスのエントリのリスト
+  // エントリはmcim_exitまで解放されないため、先頭への追加をreleaseで公開すれば任意のスレッドから辿れる
+  _Atomic(MCIM_MUSIC_ENTRY*) positions;
   HWND hwnd;
   mcim_allocator_t allocator;
   mcim_deallocator_t deallocator;
-  MCIM_THREAD_DATA th;
+  MCIM_MIXER mixer;
+  MCIM_OUTPUT* output;
+  MCIM_OUTPUT_CONFIG outputConfig;
+  MCIM_RESIDENCY residency;
+  MCIM_ANALYZER analyzer;
+  MCIM_PREFETCHER prefetcher;
+  MCIM_TRACE_RECORDER* trace;  // mcim_start_traceで記録中の場合のみ非NULL
+  bool loudnessEnabled;        // loudnessEnabledとloudnessTargetは解析スレッドのロックで保護される
+  double loudnessTarget;
+  MCIM_STARTUP_TIMINGS timings;  // threadCountはmcim_get_startup_timingsで都度求める
+  bool hooked;                   // このインスタンスがメッセージのHookを参照しているか
+  bool offline;
+  double offlineFps;
 } MCIM_DATA_INTERNAL;
 
 typedef struct _MCIM_CALLBACK_TABLE_ENTRY {
@@ -48,9 +95,7 @@ typedef struct _MCIM_CALLBACK_TABLE_ENTRY {
   UT_hash_handle hh;
 } MCIM_CALLBACK_TABLE_ENTRY;
 
-typedef enum _MCIM_THREAD_MESSAGES {
-  MCIM_TM_TERMINATE = (WM_USER + 0x10),
-  MCIM_TM_FADEOUT
-} MCIM_THREAD_MESSAGES;
+// オフラインレンダリング時に通知を配送する間隔（フレーム単位）
+#define MCIM_OFFLINE_BLOCK_FRAMES 256
 
 #endif  // ___MCIMANAGER_H__
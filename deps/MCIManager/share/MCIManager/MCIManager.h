@@ -54,9 +54,391 @@ typedef enum _MCIM_NOTIFY_FLAGS {
 typedef void (*MCIM_CALLBACK_PROC)(MCIM_NOTIFY_FLAGS flag);
 
 /**
- * @brief 待機関数のテンプレート
+ * @brief レンダリングパスの出力段の設定
+ * @note - 出力段の遅延はおよそperiodFrames * bufferCountフレームとなる
+ * @note - 値を小さくするほど低遅延となるが、アンダーランが発生しやすくなる
  */
-typedef void (*MCIM_WAIT_NEXT_FRAME)(void);
+typedef struct _MCIM_OUTPUT_CONFIG {
+  uint32_t periodFrames;  // 1バッファあたりのフレーム数（44100Hz）
+  uint32_t bufferCount;   // デバイスのキューに積むバッファ数
+} MCIM_OUTPUT_CONFIG;
+
+static const uint32_t MCIM_OUTPUT_MIN_PERIOD_FRAMES = 32;
+static const uint32_t MCIM_OUTPUT_MAX_PERIOD_FRAMES = 16384;
+static const uint32_t MCIM_OUTPUT_MAX_BUFFER_COUNT = 32;
+static const MCIM_OUTPUT_CONFIG MCIM_DEFAULT_OUTPUT_CONFIG = {.periodFrames = 441, .bufferCount = 4};
+
+/**
+ * @brief レンダリングパスで再生するBGMのメモリへの常駐方式
+ * @note - いずれの方式でもメモリ予算（mcim_set_memory_budget）を超える場合は常駐させず、再生中にファイルから読み込む
+ * @note - ENCODEDおよびINT16の16bit PCMはDECODEDの半分のメモリで常駐し、再生中にSIMDで一区間ずつfloatへ変換してミックスする
+ * @note - INT16への変換は最近接丸めで飽和させ、ディザは掛けない
+ * @note - 常駐メモリ、ロード時間およびレンダリングの費用の方式毎の違いはtests/BenchResidencyで計測する
+ */
+typedef enum _MCIM_RESIDENCY {
+  MCIM_RESIDENCY_DECODED = 0,  // ロード時にfloatへデコードして常駐させる（既定）
+  MCIM_RESIDENCY_ENCODED = 1,  // ファイル上の形式（16bit PCM等）のまま常駐させ、再生中にデコードする
+  MCIM_RESIDENCY_INT16 = 2     // 24/32bit PCMおよびIEEE floatのファイルは16bit PCMへ変換して常駐させ、それ以外はENCODEDと同じ
+} MCIM_RESIDENCY;
+
+/**
+ * @brief レンダリングパスのメモリ使用状況（全MCIMオブジェクトの合計）
+ * @note - MCIで再生されるBGMは含まない
+ */
+typedef struct _MCIM_MEMORY_STATS {
+  size_t budget;           // 常駐するPCMデータの予算（0の場合は無制限）
+  size_t residentBytes;    // 常駐しているPCMデータの合計（予算の対象）
+  size_t windowBytes;      // 常駐しないBGMの再生中デコード用バッファの合計
+  uint32_t decodedCount;   // デコード済みで常駐しているBGMおよび効果音の数
+  uint32_t encodedCount;   // ファイル上の形式または16bit PCMで常駐しているBGMの数（ENCODEDおよびINT16）
+  uint32_t streamedCount;  // ファイルから読み込みながら再生するBGMの数
+} MCIM_MEMORY_STATS;
+
+/**
+ * @brief ディスクキャッシュの使用状況（全MCIMオブジェクトの合計）
+ * @note - キャッシュはデコードして常駐させるBGMおよび効果音のロードで使用される
+ */
+typedef struct _MCIM_CACHE_STATS {
+  uint32_t hits;         // キャッシュをメモリマップしたロードの数
+  uint32_t misses;       // デコードしてキャッシュを作成したロードの数
+  uint32_t invalidated;  // 元ファイルの更新や破損により作り直したキャッシュの数
+  double hitLoadTime;    // キャッシュを使用したロードに要した時間の合計（秒）
+  double missLoadTime;   // デコードとキャッシュの作成に要した時間の合計（秒）
+} MCIM_CACHE_STATS;
+
+/**
+ * @brief 先読みするBGMのマニフェストの項目
+ */
+typedef struct _MCIM_PREFETCH_ENTRY {
+  const wchar_t* filepath;  // mcim_loadに渡すものと同じパス
+  int32_t priority;         // 値が大きいほど先に読み込む
+} MCIM_PREFETCH_ENTRY;
+
+/**
+ * @brief 先読みの状況とヒット率
+ * @note - hits、lateHitsおよびmissesはmcim_loadで実際にファイルを読み込む必要があった回数の内訳
+ */
+typedef struct _MCIM_PREFETCH_STATS {
+  uint32_t pending;   // 未処理または読み込み中の項目の数
+  uint32_t ready;     // 先読みを終えてmcim_loadを待っている項目の数
+  uint32_t hits;      // 先読み済みの結果を使用したロードの数
+  uint32_t lateHits;  // 読み込み中の先読みの完了を待ったロードの数
+  uint32_t misses;    // 先読みされていなかったロードの数
+  uint32_t canceled;  // マニフェストの差し替えにより破棄した先読みの数
+  double hitRate;     // (hits + lateHits) / (hits + lateHits + misses)、ロードが無い場合は0
+} MCIM_PREFETCH_STATS;
+
+/**
+ * @brief ログレベル
+ */
+typedef enum _MCIM_LOG_LEVEL {
+  MCIM_LOG_DEBUG = 0,
+  MCIM_LOG_INFO = 1,
+  MCIM_LOG_WARNING = 2,
+  MCIM_LOG_ERROR = 3
+} MCIM_LOG_LEVEL;
+
+/**
+ * @brief BGMのラウドネス解析の状態
+ */
+typedef enum _MCIM_LOUDNESS_STATUS {
+  MCIM_LOUDNESS_NOT_ANALYZED = 0,  // 解析が要求されていない（MCIで再生するBGMは常にこの状態）
+  MCIM_LOUDNESS_PENDING = 1,       // 解析待ちまたは解析中
+  MCIM_LOUDNESS_ANALYZED = 2,      // 解析済み
+  MCIM_LOUDNESS_FAILED = 3         // 解析できなかった（無音、400ms未満、読み込み失敗等）
+} MCIM_LOUDNESS_STATUS;
+
+/**
+ * @brief BGMのラウドネス解析結果
+ */
+typedef struct _MCIM_LOUDNESS_INFO {
+  MCIM_LOUDNESS_STATUS status;
+  double integrated;       // EBU R128の統合ラウドネス（LUFS）
+  double gain;             // 適用中の正規化ゲイン（dB）
+  double analysisTime;     // 解析に要した時間（秒、ファイルの読み込みを含む）
+  double analysisCpuTime;  // 解析に要したCPU時間（秒）
+  bool cached;             // 以前の解析結果を再利用したか（解析時間は元の解析のもの）
+} MCIM_LOUDNESS_INFO;
+
+static const double MCIM_LOUDNESS_DEFAULT_TARGET = -23.0;
+static const double MCIM_LOUDNESS_MIN_GAIN = -24.0;
+static const double MCIM_LOUDNESS_MAX_GAIN = 12.0;
+
+static const uint32_t MCIM_SFX_MAX_POLYPHONY = 256;
+static const uint32_t MCIM_SFX_DEFAULT_POLYPHONY = 32;
+
+/**
+ * @brief 位置を指定して発音した効果音の定位の基準となる聴取者の設定
+ * @note - 座標系は呼び出し側で自由に決めてよい（例えば画面座標を用いる場合、xとyに画面中央、panWidthに画面幅の半分を指定する）
+ * @note - 聴取者からの横方向の距離がpanWidth以上の音は左右どちらかのチャンネルのみから聞こえる
+ * @note - 聴取者からの距離がreferenceDistanceを超えた分だけ、rolloffに応じて逆数則で減衰する
+ */
+typedef struct _MCIM_SFX_LISTENER_CONFIG {
+  float x;
+  float y;
+  float panWidth;           // 聴取者から左右の端までの距離
+  float referenceDistance;  // 減衰が始まる距離
+  float rolloff;            // 距離減衰の強さ（0の場合は減衰しない）
+} MCIM_SFX_LISTENER_CONFIG;
+
+/**
+ * @brief レンダリングパスの遅延情報（秒単位）
+ */
+typedef struct _MCIM_LATENCY_INFO {
+  double configured;            // 設定値から求めた出力段の遅延
+  double outputDelay;           // 現在レンダリング済みのサンプルが再生されるまでの遅延
+  double commandToFirstSample;  // 直近のmcim_play系呼び出しから最初のサンプルが再生されるまでの実測値（未計測時は負数）
+} MCIM_LATENCY_INFO;
+
+/**
+ * @brief 効果音をトリガーとしてBGMの音量を自動で下げるダッキングの設定
+ * @note - トリガーのピークを包絡で追従し、thresholdを超えた分だけ（最大depthまで）BGMを減衰させる
+ */
+typedef struct _MCIM_DUCKING_CONFIG {
+  float threshold;  // ダッキングを開始するトリガーの包絡（dBFS）
+  float depth;      // 最大の減衰量（dB）
+  float attack;     // 包絡の立ち上がりの時定数（ミリ秒）
+  float release;    // 包絡の減衰の時定数（ミリ秒）
+} MCIM_DUCKING_CONFIG;
+
+/**
+ * @brief インサートエフェクトの種類
+ */
+typedef enum _MCIM_EFFECT_TYPE {
+  MCIM_EFFECT_EQ = 0,       // 双二次フィルタの縦続接続によるイコライザ
+  MCIM_EFFECT_LIMITER = 1,  // 先読みリミッター
+  MCIM_EFFECT_TYPE_COUNT = 2
+} MCIM_EFFECT_TYPE;
+
+/**
+ * @brief イコライザの各バンドのフィルタ特性
+ */
+typedef enum _MCIM_EQ_FILTER {
+  MCIM_EQ_LOWPASS = 0,
+  MCIM_EQ_HIGHPASS = 1,
+  MCIM_EQ_PEAKING = 2,
+  MCIM_EQ_LOWSHELF = 3,
+  MCIM_EQ_HIGHSHELF = 4
+} MCIM_EQ_FILTER;
+
+// イコライザのバンド数の上限
+#define MCIM_EQ_MAX_BANDS 4
+
+typedef struct _MCIM_EQ_BAND {
+  MCIM_EQ_FILTER filter;
+  float frequency;  // 中心周波数またはカットオフ周波数（Hz）
+  float q;
+  float gain;  // MCIM_EQ_PEAKING、MCIM_EQ_LOWSHELFおよびMCIM_EQ_HIGHSHELFの増幅量（dB）
+} MCIM_EQ_BAND;
+
+typedef struct _MCIM_EQ_PARAMS {
+  uint32_t bandCount;
+  MCIM_EQ_BAND bands[MCIM_EQ_MAX_BANDS];
+} MCIM_EQ_PARAMS;
+
+typedef struct _MCIM_LIMITER_PARAMS {
+  float ceiling;    // 出力の上限（dBFS）
+  float lookahead;  // 先読み時間（ミリ秒、この分だけ出力が遅延する）
+  float release;    // ゲインが戻る時定数（ミリ秒）
+} MCIM_LIMITER_PARAMS;
+
+// 先読み時間の上限（ミリ秒）
+static const float MCIM_LIMITER_MAX_LOOKAHEAD = 10.0f;
+
+/**
+ * @brief 再生速度を変える方式
+ */
+typedef enum _MCIM_RATE_MODE {
+  MCIM_RATE_RESAMPLE = 0,  // リサンプルにより音程も再生速度に比例して変わる
+  MCIM_RATE_STRETCH = 1    // WSOLAによる時間伸縮で音程を保つ
+} MCIM_RATE_MODE;
+
+// 再生速度の範囲
+static const float MCIM_RATE_MIN = 0.25f;
+static const float MCIM_RATE_MAX = 4.0f;
+
+// 再生速度を変化させる時間の上限（ミリ秒）
+static const float MCIM_RATE_MAX_GLIDE = 60000.0f;
+
+// フェードアウトを進めるフレームレートの上限
+static const double MCIM_FADEOUT_MAX_FPS = 1000.0;
+
+// サブミックスバスの数の上限（マスターを含まない）
+static const uint32_t MCIM_BUS_MAX_COUNT = 16;
+
+// レンダリングを分担するスレッド数の上限（レンダリングスレッド自身を含まない）
+static const uint32_t MCIM_RENDER_MAX_THREADS = 16;
+
+// 解析タップのFFTの点数の範囲（2の冪）と、同時に設置できるタップの数の上限
+static const uint32_t MCIM_ANALYSIS_MIN_FFT_SIZE = 512;
+static const uint32_t MCIM_ANALYSIS_MAX_FFT_SIZE = 4096;
+static const uint32_t MCIM_ANALYSIS_MAX_TAPS = 8;
+
+// 解析結果のスペクトルのビン数の上限（MCIM_ANALYSIS_MAX_FFT_SIZEの半分）
+#define MCIM_ANALYSIS_MAX_BINS 2048
+
+/**
+ * @brief 解析タップが公開するレベルとスペクトルのスナップショット
+ * @note - 値はすべて線形であり、フルスケールの正弦波のピーク、スペクトルの振幅がおよそ1.0となる
+ */
+typedef struct _MCIM_ANALYSIS {
+  uint64_t frame;                          // 解析した区間の末尾のミキサーのフレーム位置（未解析の場合は0）
+  float peak[2];                           // 前回のスナップショット以降のチャンネル毎のピーク
+  float rms[2];                            // 前回のスナップショット以降のチャンネル毎のRMS
+  uint32_t binCount;                       // spectrumの有効な要素数（FFTの点数の半分）
+  float binWidth;                          // ビン1つあたりの周波数幅（Hz）
+  float spectrum[MCIM_ANALYSIS_MAX_BINS];  // モノラルにダウンミックスしてHann窓を掛けた振幅スペクトル（spectrum[i]は周波数i * binWidth）
+} MCIM_ANALYSIS;
+
+/**
+ * @brief MCIMオブジェクトの初期化および遅延作成されるリソースの所要時間（秒単位）
+ * @note - 未作成のリソースの所要時間は負数となる
+ */
+typedef struct _MCIM_STARTUP_TIMINGS {
+  double init;           // mcim_init系の呼び出し
+  double hook;           // メッセージのHookの設置（他のMCIMオブジェクトが設置済みの場合は参照の追加のみ）
+  double fadeoutThread;  // 最初のフェードアウトの開始（全MCIMオブジェクトで共有するスレッドが未作成の場合はその作成を含む）
+  double output;         // 出力デバイスおよびレンダリングスレッドの作成
+  uint32_t threadCount;  // このMCIMオブジェクトが使用しているスレッドの数（全MCIMオブジェクトで共有するスレッドを含む）
+} MCIM_STARTUP_TIMINGS;
+
+/**
+ * @brief 統計情報を記録するMCIコマンドの種類
+ */
+typedef enum _MCIM_COMMAND {
+  MCIM_COMMAND_OPEN = 0,
+  MCIM_COMMAND_STATUS = 1,
+  MCIM_COMMAND_SETAUDIO = 2,
+  MCIM_COMMAND_SET = 3,
+  MCIM_COMMAND_PLAY = 4,
+  MCIM_COMMAND_STOP = 5,
+  MCIM_COMMAND_CLOSE = 6,
+  MCIM_COMMAND_COUNT = 7
+} MCIM_COMMAND;
+
+// MCIコマンドの所要時間のヒストグラムの区間数
+#define MCIM_STATS_LATENCY_BUCKETS 16
+
+/**
+ * @brief MCIコマンド毎の呼び出し回数と所要時間
+ */
+typedef struct _MCIM_COMMAND_STATS {
+  uint64_t calls;
+  uint64_t failures;
+  double totalTime;                              // 所要時間の合計（秒）
+  uint64_t latency[MCIM_STATS_LATENCY_BUCKETS];  // latency[i]は所要時間が[2^i, 2^(i+1))マイクロ秒の呼び出し回数（0は2マイクロ秒未満、最後は上限なし）
+} MCIM_COMMAND_STATS;
+
+/**
+ * @brief インサートエフェクトの種類毎の処理量と所要時間
+ */
+typedef struct _MCIM_EFFECT_STATS {
+  uint64_t blocks;   // 処理したブロック数
+  uint64_t frames;   // 処理したフレーム数
+  double totalTime;  // 所要時間の合計（秒）
+} MCIM_EFFECT_STATS;
+
+/**
+ * @brief ストリーミング再生の読み込みの統計
+ */
+typedef struct _MCIM_STREAM_STATS {
+  uint64_t reads;                             // デコード済みの区間を読み込んだ回数
+  uint64_t readaheadHits;                     // 先行して発行した読み込みを使用できた回数（それ以外はその場で読み込んだ）
+  uint64_t bytes;                             // 読み込んだデータ量（バイト）
+  double waitTime;                            // 読み込みの完了を確かめるのに要した時間の合計（秒、オフラインレンダリング以外では完了を待たない）
+  uint64_t underruns;                         // 読み込みが間に合わず、MCIM_PCM_LATE_FRAMESフレームを無音とした回数
+  uint64_t wait[MCIM_STATS_LATENCY_BUCKETS];  // wait[i]は待ち時間が[2^i, 2^(i+1))マイクロ秒の回数（0は2マイクロ秒未満、最後は上限なし）
+} MCIM_STREAM_STATS;
+
+/**
+ * @brief 実行時の統計情報
+ * @note - MCIMオブジェクト毎の値と、全MCIMオブジェクトの合計値からなる
+ */
+typedef struct _MCIM_STATS {
+  uint32_t loadedCount;                               // ロード済みのBGMの数
+  uint32_t playingCount;                              // 再生中（フェードアウト中を含む）のBGMの数
+  uint32_t fadingCount;                               // フェードアウト中のBGMの数
+  uint32_t callbackCount;                             // コールバックテーブルの登録数（全MCIMオブジェクトの合計）
+  MCIM_COMMAND_STATS commands[MCIM_COMMAND_COUNT];    // MCIコマンド毎の統計（全MCIMオブジェクトの合計）
+  double decodedAudio;                                // デコードしたPCMの長さの合計（秒、全MCIMオブジェクトの合計）
+  double decodeTime;                                  // デコードに要した時間の合計（秒、全MCIMオブジェクトの合計）
+  double decodeRealtimeFactor;                        // decodedAudio / decodeTime（未デコード時は0）
+  uint64_t underruns;                                 // 出力段のアンダーランの回数（全MCIMオブジェクトの合計）
+  size_t memoryBytes;                                 // レンダリングパスのPCMデータが使用しているメモリ（全MCIMオブジェクトの合計）
+  MCIM_EFFECT_STATS effects[MCIM_EFFECT_TYPE_COUNT];  // インサートエフェクトの種類毎の統計（全MCIMオブジェクトの合計）
+  MCIM_EFFECT_STATS stretch;                          // 時間伸縮の統計（ボイス毎のブロック単位、全MCIMオブジェクトの合計）
+  MCIM_EFFECT_STATS mix;                              // ミックス全体の統計（ブロック単位の経過時間、全MCIMオブジェクトの合計）
+  MCIM_EFFECT_STATS analysis;                         // 解析タップの統計（タップ毎のブロック単位、全MCIMオブジェクトの合計）
+  MCIM_STREAM_STATS stream;                           // ストリーミング再生の読み込みの統計（全MCIMオブジェクトの合計）
+} MCIM_STATS;
+
+/**
+ * @brief トレースに記録されるAPI呼び出しの種類
+ * @note - 再生、ミックスおよびエフェクトの状態を変える呼び出しを記録する
+ * @note - 初期化時に一度だけ行う設定（ポリフォニー、常駐形式、出力先、ラウドネス正規化、ダッキングと聴取者の設定等）、解析タップおよび取得系の呼び出しは記録しない
+ */
+typedef enum _MCIM_TRACE_CALL {
+  MCIM_TRACE_LOAD = 0,
+  MCIM_TRACE_UNLOAD = 1,
+  MCIM_TRACE_SET_LOOP = 2,
+  MCIM_TRACE_PLAY = 3,
+  MCIM_TRACE_PLAY_FROM = 4,
+  MCIM_TRACE_STOP = 5,
+  MCIM_TRACE_FADEOUT = 6,
+  MCIM_TRACE_SET_RATE = 7,
+  MCIM_TRACE_SFX_LOAD = 8,
+  MCIM_TRACE_SFX_UNLOAD = 9,
+  MCIM_TRACE_SFX_PLAY = 10,
+  MCIM_TRACE_SFX_STOP_ALL = 11,
+  MCIM_TRACE_RENDER = 12,
+  MCIM_TRACE_SFX_PLAY_AT = 13,
+  MCIM_TRACE_SFX_MOVE = 14,
+  MCIM_TRACE_SET_DUCKED = 15,
+  MCIM_TRACE_ADD_EQ = 16,
+  MCIM_TRACE_SET_EQ = 17,
+  MCIM_TRACE_ADD_LIMITER = 18,
+  MCIM_TRACE_SET_LIMITER = 19,
+  MCIM_TRACE_CLEAR_EFFECTS = 20,
+  MCIM_TRACE_CREATE_BUS = 21,
+  MCIM_TRACE_DESTROY_BUS = 22,
+  MCIM_TRACE_ROUTE_BUS = 23,
+  MCIM_TRACE_SET_BUS_GAIN = 24,
+  MCIM_TRACE_SET_BUS = 25,
+  MCIM_TRACE_SET_SFX_BUS = 26,
+  MCIM_TRACE_SET_RENDER_THREADS = 27,
+  MCIM_TRACE_SET_FADEOUT_FPS = 28,
+  MCIM_TRACE_CALL_COUNT = 29
+} MCIM_TRACE_CALL;
+
+/**
+ * @brief トレースを再生する速さ
+ */
+typedef enum _MCIM_TRACE_PACE {
+  MCIM_TRACE_PACE_RECORDED = 0,    // 記録時の呼び出し間隔を再現する
+  MCIM_TRACE_PACE_UNTHROTTLED = 1  // 待機せずに続けて呼び出す
+} MCIM_TRACE_PACE;
+
+/**
+ * @brief トレースの再生で計測した呼び出しの種類毎の所要時間
+ */
+typedef struct _MCIM_TRACE_CALL_STATS {
+  uint64_t calls;
+  uint64_t mismatches;                           // 成否が記録時と異なった回数
+  double totalTime;                              // 所要時間の合計（秒）
+  double maxTime;                                // 所要時間の最大値（秒）
+  double recordedTime;                           // 記録時の所要時間の合計（秒）
+  uint64_t latency[MCIM_STATS_LATENCY_BUCKETS];  // latency[i]は所要時間が[2^i, 2^(i+1))マイクロ秒の呼び出し回数（0は2マイクロ秒未満、最後は上限なし）
+} MCIM_TRACE_CALL_STATS;
+
+/**
+ * @brief トレースの再生結果
+ */
+typedef struct _MCIM_TRACE_REPORT {
+  uint64_t records;  // 再生した呼び出しの数
+  double duration;   // 再生に要した時間（秒）
+  double maxLag;     // 記録時の呼び出し時刻からの遅れの最大値（秒、MCIM_TRACE_PACE_RECORDEDの場合のみ）
+  MCIM_TRACE_CALL_STATS calls[MCIM_TRACE_CALL_COUNT];
+} MCIM_TRACE_REPORT;
 
 /**
  * @brief 指定されたメモリアロケータを使用してMCIMオブジェクトを初期化
@@ -68,6 +450,8 @@ typedef void (*MCIM_WAIT_NEXT_FRAME)(void);
  * @note - callbackWindowがINVALID_HANDLE_VALUEの場合は失敗する
  * @note - allocatorがNULLの場合は失敗する
  * @note - deallocatorがNULLの場合は失敗する
+ * @note - フェードアウトと解析用のスレッド、メッセージのHookおよび出力デバイスは初めて必要になった時点で作成する
+ * @note - フェードアウトと解析用のスレッドは全MCIMオブジェクトで共有する
  */
 ATTRIB_MALLOC MCIM_DATA* mcim_init_al(HWND callbackWindow, void* (*allocator)(size_t), void (*deallocator)(void*));
 
@@ -82,6 +466,34 @@ ATTRIB_MALLOC static inline MCIM_DATA* mcim_init(HWND callbackWindow) {
   return mcim_init_al(callbackWindow, MCIM_DEFAULT_MEMORY_ALLOCATOR, MCIM_DEFAULT_MEMORY_DEALLOCATOR);
 }
 
+/**
+ * @brief 指定されたメモリアロケータを使用してオフラインレンダリング用のMCIMオブジェクトを初期化
+ * @param[in] fps フェードアウト時間（フレーム単位）の換算に用いる仮想フレームレート
+ * @param[in] allocator オブジェクト割り当てに使用するメモリアロケータ
+ * @param[in] deallocator オブジェクト解放に使用するメモリデアロケータ
+ * @return MCIM_DATA* 初期化済みMCIMオブジェクト
+ * @note - 失敗時はNULLを返す
+ * @note - fpsが0以下の場合は失敗する
+ * @note - allocatorがNULLの場合は失敗する
+ * @note - deallocatorがNULLの場合は失敗する
+ * @note - 出力デバイスを持たず、mcim_renderでレンダリングしたフレーム数だけ仮想時間が進む
+ * @note - レンダリングパスで再生できないBGMのmcim_loadは失敗する
+ * @note - コールバックはmcim_renderの呼び出しスレッドからmcim_render内で呼ばれる
+ * @note - mcim_fadeoutに渡したフレームレートは使わず、time / fps秒分のサンプルをかけてフェードアウトする
+ */
+ATTRIB_MALLOC MCIM_DATA* mcim_init_offline_al(double fps, void* (*allocator)(size_t), void (*deallocator)(void*));
+
+/**
+ * @brief オフラインレンダリング用のMCIMオブジェクトを初期化
+ * @param[in] fps フェードアウト時間（フレーム単位）の換算に用いる仮想フレームレート
+ * @return MCIM_DATA* 初期化済みMCIMオブジェクト
+ * @note - 失敗時はNULLを返す
+ * @note - fpsが0以下の場合は失敗する
+ */
+ATTRIB_MALLOC static inline MCIM_DATA* mcim_init_offline(double fps) {
+  return mcim_init_offline_al(fps, MCIM_DEFAULT_MEMORY_ALLOCATOR, MCIM_DEFAULT_MEMORY_DEALLOCATOR);
+}
+
 /**
  * @brief MCIMオブジェクトを解放
  * @param[in,out] data mcim_initの返り値
@@ -102,6 +514,9 @@ bool mcim_exit(MCIM_DATA* data);
  * @note - 同名ファイルを既にロード済みである場合は失敗する
  * @note - dataがNULLであった場合は失敗する
  * @note - filepathがNULLまたは空であった場合は失敗する
+ * @note - PCMまたはIEEE float形式のWAVファイルはメモリ上にデコードし、MCIを介さずレンダリングパスで再生する
+ * @note - WAVファイルのsmplチャンクにループ区間が存在する場合は、mcim_set_loopで設定したものとして扱う
+ * @note - mcim_prefetchで先読みしたファイルは、先読みの結果を使用する
  */
 MCIM_KEY mcim_load(MCIM_DATA* data, const wchar_t* filepath);
 
@@ -117,6 +532,275 @@ MCIM_KEY mcim_load(MCIM_DATA* data, const wchar_t* filepath);
  */
 bool mcim_unload(MCIM_DATA* data, MCIM_KEY key);
 
+/**
+ * @brief 以降にロードするBGMの常駐方式を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] residency 常駐方式
+ * @return bool 成功時true、失敗時false
+ * @note - ロード済みのBGMには影響しない（アンロード後に再度ロードした場合は新しい方式となる）
+ * @note - 効果音（mcim_sfx_load）は常にデコードして常駐させる
+ * @note - dataがNULLであった場合は失敗する
+ * @note - residencyが不正な値の場合は失敗する
+ */
+bool mcim_set_residency(MCIM_DATA* data, MCIM_RESIDENCY residency);
+
+/**
+ * @brief 後でロードするBGMをバックグラウンドで先読み
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] manifest 先読みするBGMの一覧
+ * @param[in] count manifestの項目数（0の場合は全ての先読みを取り消す）
+ * @return bool 成功時true、失敗時false
+ * @note - 先読みは優先度の高い順に一件ずつ行い、後から優先度の高い項目が追加された場合は次の一件として割り込む
+ * @note - WAVファイルはmcim_loadと同様にデコード（ディスクキャッシュの作成を含む）し、常駐させない場合は先頭の区間をデコードしておく
+ * @note - それ以外のファイルはOSのファイルキャッシュに載るよう読み流す
+ * @note - 呼び出す度にマニフェストを差し替え、含まれなくなった先読みは取り消して結果を破棄する（既に先読みした項目は優先度のみ更新する）
+ * @note - 先読みの結果はmcim_loadで引き取られる（読み込み中の場合はその完了を待つ）
+ * @note - 先読みしたPCMはメモリ予算の使用量に含まれる
+ * @note - 常駐方式は呼び出し時点のmcim_set_residencyの設定に従う
+ * @note - dataがNULLであった場合は失敗する
+ * @note - countが0でなくmanifestがNULLの場合、またはfilepathがNULLまたは空の項目がある場合は失敗する
+ * @note - メモリの確保に失敗した場合は失敗する（確保できた項目の先読みは有効）
+ */
+bool mcim_prefetch(MCIM_DATA* data, const MCIM_PREFETCH_ENTRY* manifest, uint32_t count);
+
+/**
+ * @brief 先読みの状況とヒット率を取得
+ * @param[in,out] data mcim_initの返り値
+ * @param[out] stats 先読みの状況
+ * @return bool 成功時true、失敗時false
+ * @note - dataまたはstatsがNULLであった場合は失敗する
+ */
+bool mcim_get_prefetch_stats(MCIM_DATA* data, MCIM_PREFETCH_STATS* stats);
+
+/**
+ * @brief レンダリングパスで常駐させるPCMデータの合計に対する予算を設定
+ * @param[in] bytes 予算（バイト単位、0の場合は無制限）
+ * @note - 全MCIMオブジェクトで共有される
+ * @note - 既にロード済みのBGMおよび効果音は予算を超えても解放されない
+ * @note - 効果音は予算を超えてもデコードして常駐させる（予算の使用量には含まれる）
+ */
+void mcim_set_memory_budget(size_t bytes);
+
+/**
+ * @brief レンダリングパスのメモリ使用状況を取得
+ * @param[out] stats メモリ使用状況
+ * @return bool 成功時true、失敗時false
+ * @note - statsがNULLであった場合は失敗する
+ */
+bool mcim_get_memory_stats(MCIM_MEMORY_STATS* stats);
+
+/**
+ * @brief デコード結果およびラウドネス解析結果をディスクへキャッシュするディレクトリを設定
+ * @param[in] directory キャッシュを保存するディレクトリ（NULLまたは空文字列の場合はキャッシュを使用しない）
+ * @return bool 成功時true、失敗時false
+ * @note - 全MCIMオブジェクトで共有され、既定ではキャッシュを使用しない
+ * @note - キャッシュは元ファイルのパス、サイズおよび更新日時を鍵とし、次回以降のロードではデコードせずにメモリマップする
+ * @note - 元ファイルが更新された場合や、形式のバージョンが異なるまたは破損したキャッシュは作り直される
+ * @note - PCMの破損は保存後の最初のロードでPCM全体のハッシュ値により検出し、以後のロードでは検証を省く
+ * @note - メモリマップしたPCMもメモリ予算の使用量に含まれる
+ * @note - ディレクトリが存在しない場合は作成し、作成できない場合は失敗する
+ * @note - directoryがMAX_PATH - 40文字を超える場合は失敗する
+ */
+bool mcim_set_cache_directory(const wchar_t* directory);
+
+/**
+ * @brief ディスクキャッシュの使用状況を取得
+ * @param[out] stats 使用状況
+ * @return bool 成功時true、失敗時false
+ * @note - statsがNULLであった場合は失敗する
+ */
+bool mcim_get_cache_stats(MCIM_CACHE_STATS* stats);
+
+/**
+ * @brief ログの出力先を設定
+ * @param[in] output ログを書き込むハンドル（NULLの場合はログを記録しない）
+ * @param[in] level 記録する最低のログレベル
+ * @return bool 成功時true、失敗時false
+ * @note - 全MCIMオブジェクトで共有され、既定ではログを記録しない
+ * @note - ログは固定長のレコードとしてロックフリーのリングバッファに積まれ、出力用のスレッドが整形してoutputに書き込む
+ * @note - 出力先を変更または無効にする場合、それまでに積まれたレコードは変更前の出力先に書き込まれる
+ * @note - outputは次に出力先を変更するまで有効である必要がある
+ * @note - outputがINVALID_HANDLE_VALUEの場合はログを無効にした上で失敗する
+ */
+bool mcim_set_log_output(HANDLE output, MCIM_LOG_LEVEL level);
+
+/**
+ * @brief ログを記録
+ * @param[in] level ログレベル
+ * @param[in] event イベント名
+ * @param[in] key0 一つ目の値の名前（NULLの場合は出力しない）
+ * @param[in] value0 一つ目の値
+ * @param[in] key1 二つ目の値の名前（NULLの場合は出力しない）
+ * @param[in] value1 二つ目の値
+ * @return bool 記録した場合true、記録しなかった場合false
+ * @note - 待機もメモリ確保も行わないため、コールバックやレンダリングスレッドから呼び出しても良い
+ * @note - event、key0およびkey1は文字列リテラル等、書き込まれるまで有効な文字列である必要がある
+ * @note - ログが無効な場合やlevelが設定された最低のログレベル未満の場合は記録しない
+ * @note - リングバッファが満杯の場合は破棄して破棄数を加算し、破棄数は次の書き込み時にログに記録される
+ */
+bool mcim_log(MCIM_LOG_LEVEL level, const char* event, const char* key0, int64_t value0, const char* key1, int64_t value1);
+
+/**
+ * @brief リングバッファが満杯のために破棄されたログの数を取得
+ * @return uint64_t 破棄されたログの数（プロセス開始からの合計）
+ */
+uint64_t mcim_get_log_dropped(void);
+
+/**
+ * @brief レンダリングパスのBGMのラウドネス正規化を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] enable 正規化を有効にするか
+ * @param[in] target 目標ラウドネス（LUFS、EBU R128ではMCIM_LOUDNESS_DEFAULT_TARGET）
+ * @return bool 成功時true、失敗時false
+ * @note - 有効な間はロード済みおよび以降にロードするBGMの統合ラウドネスを低優先度の解析スレッドで測定し、目標との差を音量の補正として自動で適用する
+ * @note - 解析は呼び出し元のスレッドでは行わない（解析完了前に再生を始めたBGMには完了時点から適用される）
+ * @note - 解析結果はファイル毎（パス、サイズおよび更新日時）にキャッシュされ、同じファイルは再解析しない（mcim_set_cache_directoryが有効であればプロセスを跨いで再利用する）
+ * @note - 補正量はMCIM_LOUDNESS_MIN_GAIN～MCIM_LOUDNESS_MAX_GAIN dBに制限され、mcim_fadeout等による音量変更とは独立している
+ * @note - 無効にすると補正は解除されるが、解析結果は保持される
+ * @note - オフラインレンダリングではmcim_renderが解析の完了を待ってからレンダリングする
+ * @note - MCIで再生するBGMは対象外
+ * @note - dataがNULLであった場合は失敗する
+ * @note - targetが-70以上0以下でない場合は失敗する
+ */
+bool mcim_set_loudness_normalization(MCIM_DATA* data, bool enable, double target);
+
+/**
+ * @brief BGMのラウドネス解析結果と解析に要したコストを取得
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値
+ * @param[out] info 解析結果
+ * @return bool 成功時true、失敗時false
+ * @note - dataまたはinfoがNULLであった場合は失敗する
+ * @note - keyに対応するBGMが存在しない場合は失敗する
+ */
+bool mcim_get_loudness(MCIM_DATA* data, MCIM_KEY key, MCIM_LOUDNESS_INFO* info);
+
+/**
+ * @brief レンダリングパスの出力段の設定を変更
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] config 出力段の設定
+ * @return bool 成功時true、失敗時false
+ * @note - 出力デバイスが既に開かれている場合は新しい設定で開き直す（再生中のBGMは継続する）
+ * @note - dataまたはconfigがNULLであった場合は失敗する
+ * @note - periodFramesがMCIM_OUTPUT_MIN_PERIOD_FRAMES未満またはMCIM_OUTPUT_MAX_PERIOD_FRAMESを超える場合は失敗する
+ * @note - bufferCountが2未満またはMCIM_OUTPUT_MAX_BUFFER_COUNTを超える場合は失敗する
+ */
+bool mcim_set_output_config(MCIM_DATA* data, const MCIM_OUTPUT_CONFIG* config);
+
+/**
+ * @brief レンダリングパスの遅延情報を取得
+ * @param[in] data mcim_initの返り値
+ * @param[out] info 遅延情報
+ * @return bool 成功時true、失敗時false
+ * @note - dataまたはinfoがNULLであった場合は失敗する
+ * @note - 出力デバイスが開かれていない場合、outputDelayは0、commandToFirstSampleは負数となる
+ */
+bool mcim_get_latency(MCIM_DATA* data, MCIM_LATENCY_INFO* info);
+
+/**
+ * @brief 初期化および遅延作成されたリソースの所要時間を取得
+ * @param[in] data mcim_initの返り値
+ * @param[out] timings 所要時間
+ * @return bool 成功時true、失敗時false
+ * @note - dataまたはtimingsがNULLであった場合は失敗する
+ */
+bool mcim_get_startup_timings(MCIM_DATA* data, MCIM_STARTUP_TIMINGS* timings);
+
+/**
+ * @brief 実行時の統計情報のスナップショットを取得
+ *
+ * @param[in] data mcim_initの返り値
+ * @param[out] stats 統計情報
+ * @return bool 成功時true、失敗時false
+ * @note - 統計情報は常に記録され、記録はロックを取らないアトミックな加算のみで行われる
+ * @note - 個々の値はアトミックに読み出されるが、他スレッドが記録中の値同士は一つの呼び出し分ずれることがある
+ * @note - dataがNULLであった場合は失敗する
+ * @note - statsがNULLであった場合は失敗する
+ */
+bool mcim_get_stats(MCIM_DATA* data, MCIM_STATS* stats);
+
+/**
+ * @brief API呼び出しのトレースの記録を開始
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] filepath 記録先のファイルのパス（既存のファイルは上書きする）
+ * @return bool 成功時true、失敗時false
+ * @note - 以後のMCIM_TRACE_CALLに挙げたAPIの呼び出しを、引数、成否、時刻および所要時間とともに記録する
+ * @note - 記録は呼び出し元のスレッドではファイルへ書き出さず、約50ミリ秒毎に書き出し用のスレッドがまとめて書き出す
+ * @note - 書き出しが追いつかない場合は呼び出し元を待たせずに記録を破棄し、mcim_stop_traceが失敗する
+ * @note - コールバックの関数ポインタは記録せず、指定の有無のみを記録する
+ * @note - 既に記録中の場合は以前の記録を閉じてから開始する
+ * @note - mcim_exitで記録は自動的に終了する
+ * @note - dataがNULLであった場合は失敗する
+ * @note - filepathがNULLまたは空であった場合は失敗する
+ * @note - 同じdataに対する他のAPI呼び出しと同時に呼び出してはならない
+ */
+bool mcim_start_trace(MCIM_DATA* data, const wchar_t* filepath);
+
+/**
+ * @brief API呼び出しのトレースの記録を終了
+ * @param[in,out] data mcim_initの返り値
+ * @return bool 成功時true、失敗時false
+ * @note - 記録中に書き出しに失敗していた場合、または記録を破棄していた場合は失敗する（書き出せた分までのファイルは再生できる）
+ * @note - dataがNULLであった場合は失敗する
+ * @note - 記録中でない場合は失敗する
+ * @note - 同じdataに対する他のAPI呼び出しと同時に呼び出してはならない
+ */
+bool mcim_stop_trace(MCIM_DATA* data);
+
+/**
+ * @brief 記録したトレースの呼び出しを再現し、呼び出し毎の所要時間を計測
+ * @param[in,out] data 呼び出し先のMCIMオブジェクト（mcim_initまたはmcim_init_offlineの返り値）
+ * @param[in] filepath mcim_start_traceで記録したファイルのパス
+ * @param[in] pace 再生する速さ
+ * @param[out] report 再生結果
+ * @return bool 成功時true、失敗時false
+ * @note - 全ての呼び出しを終えるまでリターンしない
+ * @note - 記録時のキー、バスおよびインスタンスは、ロード、mcim_create_busおよびmcim_sfx_play_atの返り値から再生時のものへ読み替える
+ * @note - コールバック付きで記録された呼び出しには何もしないコールバックを渡す
+ * @note - mcim_renderの呼び出しは、dataがオフラインレンダリング用の場合は内部のバッファへレンダリングし、それ以外の場合は失敗として計上する
+ * @note - 個々の呼び出しの失敗では中断せず、記録時と成否が異なった回数をreportに記録する
+ * @note - dataがNULLであった場合は失敗する
+ * @note - filepathが開けない、またはトレースファイルでない場合は失敗する
+ * @note - reportがNULLであった場合は失敗する
+ * @note - ファイルの途中で記録が壊れていた場合は、その直前までを再生して失敗する
+ */
+bool mcim_replay_trace(MCIM_DATA* data, const wchar_t* filepath, MCIM_TRACE_PACE pace, MCIM_TRACE_REPORT* report);
+
+/**
+ * @brief BGMの現在の再生位置を取得
+ *
+ * @param[in] data mcim_initの返り値
+ * @param[in] key 対象BGMのキー
+ * @return double 再生位置（秒単位）、失敗時は負数
+ * @note - 出力デバイスが実際に再生している位置を、デバイスの位置更新の間も経過時間で補間して返す
+ * @note - ロックやMCIへの問い合わせを伴わないため、毎フレーム任意のスレッドから呼び出せる（mcim_load/mcim_unloadとの同時呼び出しも可）
+ * @note - ループ中はループ区間内へ折り返した位置を返す
+ * @note - 再生開始前は開始位置、停止後は停止した位置、一度も再生していない場合は0を返す
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応するBGMがloadされていない場合は失敗する
+ * @note - keyに対応するBGMがレンダリングパスで再生されない（MCIで再生される）場合は失敗する
+ * @note - mcim_exitと同時に呼び出してはならない
+ */
+double mcim_get_position(MCIM_DATA* data, MCIM_KEY key);
+
+/**
+ * @brief ロード済みBGMのループ区間を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値
+ * @param[in] loopStart ループ開始位置（サンプル単位）
+ * @param[in] loopEnd ループ終了位置（サンプル単位、このサンプルの直前でloopStartへ戻る）
+ * @return bool 成功時true、失敗時false
+ * @note - 先頭からloopStartまでをイントロとして一度だけ再生し、以後loopStart～loopEndを隙間なく繰り返す
+ * @note - ループはレンダリングパス内でサンプル単位で行われ、コールバックやデバイスの再起動を伴わない
+ * @note - loopEndが0の場合はループを解除する
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応するBGMがloadされていない場合は失敗する
+ * @note - keyに対応するBGMがレンダリングパスで再生されない（MCIで再生される）場合は失敗する
+ * @note - loopStartがloopEnd以上、またはloopEndがBGMの総サンプル数を超える場合は失敗する
+ * @note - 再生中に変更した場合は次のレンダリングブロックから反映される
+ */
+bool mcim_set_loop(MCIM_DATA* data, MCIM_KEY key, uint32_t loopStart, uint32_t loopEnd);
+
 /**
  * @brief ロード済みBGMを再生
  * @param[in,out] data mcim_initの返り値
@@ -161,20 +845,420 @@ MCIM_KEY mcim_stop(MCIM_DATA* data, MCIM_KEY key);
 /**
  * @brief 再生中のBGMを指定時間かけてフェードアウト
  * @param[in,out] data mcim_initの返り値
- * @param[in] wait 次のフレームまでの待機に用いる関数
  * @param[in] key mcim_loadの返り値またはMCIM_MASTER_KEY
+ * @param[in] fps 呼び出し元のフレームレート（0より大きくMCIM_FADEOUT_MAX_FPS以下）
  * @param[in] time 停止までの時間（フレーム単位）
  * @param[in] callback 停止後に呼ぶコールバック関数
  * @return MCIM_KEY 成功時フェードアウトさせたBGMのMCIM_KEYを、失敗時MCIM_INVALID_KEYを返す
  * @note - フェードアウトは非同期で行われ、フェードアウト終了を待たずリターンする
+ * @note - フェードアウトはフレームレート毎に全MCIMオブジェクトで共有するSyncFPSのティッカーで、1 / fps秒毎に1フレームずつ進む
+ * @note - フレームレートの変化やポーズに追従させる場合はmcim_set_fadeout_fpsで変更する
+ * @note - オフラインレンダリング用のMCIMオブジェクトではfpsの代わりにmcim_init_offlineのfpsで換算する
  * @note - keyにMCIM_MASTER_KEYを指定することで現在再生中のBGMのフェードアウトを試みる
  * @note - dataがNULLであった場合は失敗する
- * @note - waitがNULLであった場合は失敗する
+ * @note - fpsが範囲外の場合は失敗する
  * @note - keyに対応するBGMが存在しない場合は失敗する
  * @note - keyに対応するBGMが再生中でない場合は失敗する
  * @note - timeが負数の場合は失敗する
  * @note - callbackがNULLであった場合はコールバックなしでのフェードアウトを試みる
  */
-MCIM_KEY mcim_fadeout(MCIM_DATA* data, MCIM_KEY key, MCIM_WAIT_NEXT_FRAME wait, int32_t time, MCIM_CALLBACK_PROC callback);
+MCIM_KEY mcim_fadeout(MCIM_DATA* data, MCIM_KEY key, double fps, int32_t time, MCIM_CALLBACK_PROC callback);
+
+/**
+ * @brief フェードアウト中のBGMを進めるフレームレートを変更
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_fadeoutの返り値またはMCIM_MASTER_KEY
+ * @param[in] fps 変更後のフレームレート（0の場合は再び変更されるまでフェードアウトを止める、MCIM_FADEOUT_MAX_FPS以下）
+ * @return bool 成功時true、失敗時false
+ * @note - 経過フレーム数は保持し、変更後の1 / fps秒後から残りのフレームを進める
+ * @note - keyにMCIM_MASTER_KEYを指定した場合はフェードアウト中の全てのBGMに設定する
+ * @note - dataがNULLであった場合は失敗する
+ * @note - dataがオフラインレンダリング用の場合は失敗する
+ * @note - fpsが範囲外の場合は失敗する
+ * @note - keyに対応するBGMがフェードアウト中でない場合は失敗する
+ */
+bool mcim_set_fadeout_fps(MCIM_DATA* data, MCIM_KEY key, double fps);
+
+/**
+ * @brief 効果音（SFX）をロード
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] filepath ロードするWAVファイルのパス
+ * @return MCIM_KEY 失敗時にはMCIM_INVALID_KEYを返す
+ * @note - 効果音はメモリ上にデコードされ、BGMとは別のボイスプールで再生される
+ * @note - 返り値はmcim_sfx_play/mcim_sfx_unload用のキーであり、BGMのキーとは互換性がない
+ * @note - 同じファイルを複数回ロードした場合はそれぞれ別の効果音として扱う
+ * @note - dataがNULLであった場合は失敗する
+ * @note - filepathがNULLまたは空であった場合は失敗する
+ * @note - レンダリングパスで再生できない（PCMまたはIEEE float形式のWAVでない）ファイルの場合は失敗する
+ */
+MCIM_KEY mcim_sfx_load(MCIM_DATA* data, const wchar_t* filepath);
+
+/**
+ * @brief ロード済みの効果音をアンロード
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_sfx_loadの返り値
+ * @return bool 成功時true、失敗時false
+ * @note - keyに対応する効果音を発音中のボイスは即座に停止する
+ * @note - アンロードしたキーは再利用されない
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応する効果音が存在しない場合は失敗する
+ */
+bool mcim_sfx_unload(MCIM_DATA* data, MCIM_KEY key);
+
+/**
+ * @brief 効果音の同時発音数の上限を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] polyphony 同時発音数の上限（既定値はMCIM_SFX_DEFAULT_POLYPHONY）
+ * @return bool 成功時true、失敗時false
+ * @note - 上限を超えて発音した場合は、優先度が最も低いボイス（同じ優先度の場合は最も古いボイス）を短くフェードアウトさせて置き換える
+ * @note - dataがNULLであった場合は失敗する
+ * @note - polyphonyが0またはMCIM_SFX_MAX_POLYPHONYを超える場合は失敗する
+ */
+bool mcim_set_sfx_polyphony(MCIM_DATA* data, uint32_t polyphony);
+
+/**
+ * @brief ロード済みの効果音を発音
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_sfx_loadの返り値
+ * @param[in] gain 音量（1.0で等倍）
+ * @param[in] priority 優先度（値が大きいほど優先され、ボイススティールの対象になりにくい）
+ * @return bool 発音要求を受け付けた場合true、それ以外はfalse
+ * @note - ロックおよびメモリ確保を行わず、ゲームループ等の任意のスレッドから呼び出せる
+ * @note - 発音は次のレンダリングブロックの先頭から開始される
+ * @note - 同時発音数が上限に達しており、全てのボイスの優先度がpriorityより高い場合は発音しない
+ * @note - 未処理の発音要求が多すぎる場合は失敗する
+ * @note - dataがNULLであった場合は失敗する
+ * @note - gainが負数の場合は失敗する
+ * @note - 一度もmcim_sfx_loadが成功していない場合は失敗する
+ * @note - keyに対応する効果音が存在しない場合は何も発音しない
+ */
+bool mcim_sfx_play(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority);
+
+/**
+ * @brief ロード済みの効果音を位置を指定して発音
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_sfx_loadの返り値
+ * @param[in] gain 音量（1.0で等倍）
+ * @param[in] priority 優先度（値が大きいほど優先され、ボイススティールの対象になりにくい）
+ * @param[in] x 音源のx座標
+ * @param[in] y 音源のy座標
+ * @return uint32_t 成功時mcim_sfx_move用の発音IDを、失敗時0を返す
+ * @note - 聴取者（mcim_sfx_set_listener）からの位置に応じて左右の定位と距離減衰を行う
+ * @note - 定位と距離減衰は発音中の全てのボイスについてレンダリングブロック毎に一括で計算され、ブロック内で滑らかに補間される
+ * @note - それ以外はmcim_sfx_playと同様
+ */
+uint32_t mcim_sfx_play_at(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority, float x, float y);
+
+/**
+ * @brief 位置を指定して発音した効果音の位置を変更
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] instance mcim_sfx_play_atの返り値
+ * @param[in] x 音源のx座標
+ * @param[in] y 音源のy座標
+ * @return bool 変更要求を受け付けた場合true、それ以外はfalse
+ * @note - ロックおよびメモリ確保を行わず、ゲームループ等の任意のスレッドから呼び出せる
+ * @note - 変更は次のレンダリングブロックから反映される
+ * @note - 既に発音を終えたinstanceを指定した場合は何もしない
+ * @note - 未処理の要求が多すぎる場合は失敗する
+ * @note - dataがNULLであった場合は失敗する
+ * @note - instanceが0の場合は失敗する
+ * @note - 一度もmcim_sfx_loadが成功していない場合は失敗する
+ */
+bool mcim_sfx_move(MCIM_DATA* data, uint32_t instance, float x, float y);
+
+/**
+ * @brief 位置を指定して発音した効果音の定位の基準となる聴取者を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] config 聴取者の設定（NULLの場合は既定値に戻す）
+ * @return bool 成功時true、失敗時false
+ * @note - 既定値はx=0、y=0、panWidth=1、referenceDistance=1、rolloff=0
+ * @note - 発音中のボイスにも次のレンダリングブロックから反映される
+ * @note - dataがNULLであった場合は失敗する
+ * @note - configのpanWidthまたはreferenceDistanceが0以下の場合は失敗する
+ * @note - configのrolloffが負数の場合は失敗する
+ */
+bool mcim_sfx_set_listener(MCIM_DATA* data, const MCIM_SFX_LISTENER_CONFIG* config);
+
+/**
+ * @brief 発音中の全ての効果音を即座に停止
+ * @param[in,out] data mcim_initの返り値
+ * @return bool 成功時true、失敗時false
+ * @note - 未処理の発音要求も破棄する
+ * @note - dataがNULLであった場合は失敗する
+ */
+bool mcim_sfx_stop_all(MCIM_DATA* data);
+
+/**
+ * @brief ダッキングを設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] config ダッキングの設定（NULLの場合はダッキングを無効にする）
+ * @return bool 成功時true、失敗時false
+ * @note - ダッキングはレンダリングスレッド内で行われ、呼び出し側のスレッドでの音量変更やデバイスへの命令を伴わない
+ * @note - トリガーとする効果音はmcim_set_sfx_sidechain、減衰させるBGMはmcim_set_duckedで指定する
+ * @note - 無効にした場合、減衰させていたBGMの音量は即座に戻る
+ * @note - dataがNULLであった場合は失敗する
+ * @note - configのdepth、attackまたはreleaseが負数の場合は失敗する
+ */
+bool mcim_set_ducking(MCIM_DATA* data, const MCIM_DUCKING_CONFIG* config);
+
+/**
+ * @brief BGMまたはサブミックスバスをダッキングの対象とするかを設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値、mcim_create_busの返り値またはMCIM_MASTER_KEY
+ * @param[in] ducked ダッキングの対象とする場合true
+ * @return bool 成功時true、失敗時false
+ * @note - keyにMCIM_MASTER_KEYを指定した場合はロード済みの全てのBGMに設定する（MCIで再生されるBGMは無視する）
+ * @note - バスを対象とした場合、バスの出力が出力先でミックスされる際に減衰させる
+ * @note - 設定は再生を止めても保持される
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応するBGMまたはバスが存在しない場合は失敗する
+ * @note - keyに対応するBGMがレンダリングパスで再生されない（MCIで再生される）場合は失敗する
+ */
+bool mcim_set_ducked(MCIM_DATA* data, MCIM_KEY key, bool ducked);
+
+/**
+ * @brief 効果音をダッキングのトリガーとするかを設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_sfx_loadの返り値
+ * @param[in] sidechain トリガーとする場合true
+ * @return bool 成功時true、失敗時false
+ * @note - トリガーの判定は出力先のバスによらず、バスの音量やエフェクトを掛ける前の信号で行う
+ * @note - 発音中のボイスには反映されず、次の発音から反映される
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応する効果音が存在しない場合は失敗する
+ */
+bool mcim_set_sfx_sidechain(MCIM_DATA* data, MCIM_KEY key, bool sidechain);
+
+/**
+ * @brief BGMの再生速度を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値またはMCIM_MASTER_KEY
+ * @param[in] rate 再生速度（1.0で等速、MCIM_RATE_MIN以上MCIM_RATE_MAX以下）
+ * @param[in] mode 再生速度を変える方式
+ * @param[in] glide 現在の速度からrateへ線形に変化させる時間（ミリ秒、0の場合は即座に反映する、MCIM_RATE_MAX_GLIDE以下）
+ * @return bool 成功時true、失敗時false
+ * @note - keyにMCIM_MASTER_KEYを指定した場合はロード済みの全てのBGMに設定する（MCIで再生されるBGMは無視する）
+ * @note - 設定は再生を止めても保持され、次の再生はrateから始まる
+ * @note - 再生中に方式を切り替えた場合は現在の再生位置から続ける
+ * @note - MCIM_RATE_STRETCHのCPU時間の予算は1ボイスあたり実時間の0.5%であり（tests/BenchStretchで検査する）、実際の所要時間はmcim_get_statsのstretchで確認できる
+ * @note - MCIM_RATE_STRETCHではWSOLAの粒の長さ（約23ミリ秒）だけ出力が遅れる
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応するBGMがloadされていない、またはレンダリングパスで再生されない場合は失敗する
+ * @note - rateまたはglideが範囲外の場合は失敗する
+ */
+bool mcim_set_rate(MCIM_DATA* data, MCIM_KEY key, float rate, MCIM_RATE_MODE mode, float glide);
+
+/**
+ * @brief BGM、サブミックスバスまたはミックス後の出力にイコライザを挿入
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値、mcim_create_busの返り値、またはミックス後の出力に挿入する場合はMCIM_MASTER_KEY
+ * @param[in] params バンド毎のフィルタ特性
+ * @param[out] index mcim_set_eqで指定するチェーン内の位置
+ * @return bool 成功時true、失敗時false
+ * @note - エフェクトはレンダリングスレッド内でブロック毎に適用され、BGMの場合は音量を掛ける前の信号に適用される
+ * @note - BGMに挿入したエフェクトはunloadで取り除かれる
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応するBGMまたはバスが存在しない、またはBGMがレンダリングパスで再生されない（MCIで再生される）場合は失敗する
+ * @note - チェーンのエフェクト数が上限（8）に達している場合は失敗する
+ * @note - paramsのbandCountがMCIM_EQ_MAX_BANDSを超える場合、周波数が0以下またはナイキスト周波数以上の場合、qが0以下の場合は失敗する
+ */
+bool mcim_add_eq(MCIM_DATA* data, MCIM_KEY key, const MCIM_EQ_PARAMS* params, uint32_t* index);
+
+/**
+ * @brief 挿入済みのイコライザのパラメータを変更
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_add_eqに指定したキー
+ * @param[in] index mcim_add_eqで取得した位置
+ * @param[in] params バンド毎のフィルタ特性
+ * @return bool 成功時true、失敗時false
+ * @note - 変更はロックを取らずにレンダリングスレッドへ渡され、次のブロックから反映される
+ * @note - 同じエフェクトのパラメータを複数のスレッドから同時に変更してはならない
+ * @note - indexの位置のエフェクトがイコライザでない場合は失敗する
+ */
+bool mcim_set_eq(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_EQ_PARAMS* params);
+
+/**
+ * @brief BGM、サブミックスバスまたはミックス後の出力に先読みリミッターを挿入
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値、mcim_create_busの返り値、またはミックス後の出力に挿入する場合はMCIM_MASTER_KEY
+ * @param[in] params リミッターの設定
+ * @param[out] index mcim_set_limiterで指定するチェーン内の位置
+ * @return bool 成功時true、失敗時false
+ * @note - 出力は先読み時間だけ遅延し、BGMに挿入した場合は再生終了時に遅延分の末尾が切り捨てられる
+ * @note - paramsのceilingが正数の場合、lookaheadが0以下またはMCIM_LIMITER_MAX_LOOKAHEADを超える場合、releaseが0以下の場合は失敗する
+ * @note - その他の失敗条件はmcim_add_eqと同様
+ */
+bool mcim_add_limiter(MCIM_DATA* data, MCIM_KEY key, const MCIM_LIMITER_PARAMS* params, uint32_t* index);
+
+/**
+ * @brief 挿入済みの先読みリミッターのパラメータを変更
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_add_limiterに指定したキー
+ * @param[in] index mcim_add_limiterで取得した位置
+ * @param[in] params リミッターの設定
+ * @return bool 成功時true、失敗時false
+ * @note - 先読み時間を変更した場合は遅延線が初期化されるため、変更時点の遅延分の信号が失われる
+ * @note - その他の条件はmcim_set_eqと同様
+ */
+bool mcim_set_limiter(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_LIMITER_PARAMS* params);
+
+/**
+ * @brief BGM、サブミックスバスまたはミックス後の出力の全てのエフェクトを取り除く
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値、mcim_create_busの返り値またはMCIM_MASTER_KEY
+ * @return bool 成功時true、失敗時false
+ * @note - dataがNULLであった場合は失敗する
+ * @note - keyに対応するBGMまたはバスが存在しない、またはBGMがレンダリングパスで再生されない場合は失敗する
+ */
+bool mcim_clear_effects(MCIM_DATA* data, MCIM_KEY key);
+
+/**
+ * @brief BGMと効果音をまとめて音量やエフェクトを掛けるサブミックスバスを作成
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] parent 出力先のバス（mcim_create_busの返り値、またはマスターへ出力する場合はMCIM_MASTER_KEY）
+ * @return MCIM_KEY 成功時は作成したバスのキー、失敗時はMCIM_INVALID_KEY
+ * @note - バスは出力先を辿るとマスターに至る有向非巡回グラフをなし、ブロック毎にマスターから遠いバスから順にミックスされる
+ * @note - バスのキーはmcim_add_eq、mcim_add_limiter、mcim_set_eq、mcim_set_limiter、mcim_clear_effectsおよびmcim_set_duckedにも指定できる
+ * @note - バスのエフェクトはバスへ出力する全てのBGM、効果音およびバスのミックスに適用され、その後にバスの音量が掛けられる
+ * @note - バスの作成、出力先と音量の変更はロックを取らずにレンダリングスレッドへ渡され、次のブロックから反映される
+ * @note - dataがNULLであった場合は失敗する
+ * @note - parentに対応するバスが存在しない場合、バスの数がMCIM_BUS_MAX_COUNTに達している場合は失敗する
+ */
+MCIM_KEY mcim_create_bus(MCIM_DATA* data, MCIM_KEY parent);
+
+/**
+ * @brief サブミックスバスを破棄
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] bus mcim_create_busの返り値
+ * @return bool 成功時true、失敗時false
+ * @note - 破棄したバスへ出力していたBGM、効果音およびバスは、破棄したバスの出力先へ付け替えられる
+ * @note - バスに挿入したエフェクトは取り除かれる
+ * @note - バスを解放するため、レンダリング中のブロックの完了を待ってから戻る
+ * @note - dataがNULLであった場合、busに対応するバスが存在しない場合は失敗する
+ */
+bool mcim_destroy_bus(MCIM_DATA* data, MCIM_KEY bus);
+
+/**
+ * @brief サブミックスバスの出力先を変更
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] bus mcim_create_busの返り値
+ * @param[in] parent 出力先のバス（mcim_create_busの返り値またはMCIM_MASTER_KEY）
+ * @return bool 成功時true、失敗時false
+ * @note - 次のブロックから反映される
+ * @note - dataがNULLであった場合、busまたはparentに対応するバスが存在しない場合は失敗する
+ * @note - parentがbus自身またはbusを出力先に辿るバスである（経路が循環する）場合は失敗する
+ */
+bool mcim_route_bus(MCIM_DATA* data, MCIM_KEY bus, MCIM_KEY parent);
+
+/**
+ * @brief サブミックスバスまたはマスターの音量を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] bus mcim_create_busの返り値またはMCIM_MASTER_KEY
+ * @param[in] gain 線形の音量（1.0で等倍）
+ * @return bool 成功時true、失敗時false
+ * @note - 変更はロックを取らずにレンダリングスレッドへ渡され、音量は次のブロック内で線形に補間される
+ * @note - dataがNULLであった場合、busに対応するバスが存在しない場合、gainが負数の場合は失敗する
+ */
+bool mcim_set_bus_gain(MCIM_DATA* data, MCIM_KEY bus, float gain);
+
+/**
+ * @brief BGMの出力先のバスを設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値またはMCIM_MASTER_KEY
+ * @param[in] bus 出力先のバス（mcim_create_busの返り値またはMCIM_MASTER_KEY）
+ * @return bool 成功時true、失敗時false
+ * @note - keyにMCIM_MASTER_KEYを指定した場合はロード済みの全てのBGMに設定する（MCIで再生されるBGMは無視する）
+ * @note - 設定は再生を止めても保持され、再生中のBGMは次のブロックから反映される
+ * @note - dataがNULLであった場合、busに対応するバスが存在しない場合は失敗する
+ * @note - keyに対応するBGMがloadされていない、またはレンダリングパスで再生されない場合は失敗する
+ */
+bool mcim_set_bus(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus);
+
+/**
+ * @brief 効果音の出力先のバスを設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_sfx_loadの返り値
+ * @param[in] bus 出力先のバス（mcim_create_busの返り値またはMCIM_MASTER_KEY）
+ * @return bool 成功時true、失敗時false
+ * @note - 発音中のボイスには反映されず、次の発音から反映される
+ * @note - dataがNULLであった場合、keyに対応する効果音が存在しない場合、busに対応するバスが存在しない場合は失敗する
+ */
+bool mcim_set_sfx_bus(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus);
+
+/**
+ * @brief レンダリングを分担するスレッドの数を設定
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] count レンダリングスレッドと共にボイスとバスを処理するスレッドの数（0の場合はレンダリングスレッドのみで処理する）
+ * @return bool 成功時true、失敗時false
+ * @note - 再生中のボイスが16以上の場合、ボイスを分割したジョブと同じ段のバスをワークスティーリングで並列に処理する
+ * @note - ミックスの順序はジョブの分割のみで決まるため、出力はスレッド数や処理の順序によらず同じになる
+ * @note - 論理プロセッサ数から1を引いた程度が目安であり、効果はmcim_get_statsのmixで確認できる（スレッド数毎の計測はtests/BenchRenderThreadsで行う）
+ * @note - スレッドは呼び出し時に作成され、既存のスレッドは停止する（既定は0）
+ * @note - dataがNULLであった場合、countがMCIM_RENDER_MAX_THREADSを超える場合、スレッドを作成できない場合は失敗する
+ */
+bool mcim_set_render_threads(MCIM_DATA* data, uint32_t count);
+
+/**
+ * @brief BGM、サブミックスバスまたはミックス後の出力にレベルとスペクトルを解析するタップを設置
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_loadの返り値、mcim_create_busの返り値またはMCIM_MASTER_KEY
+ * @param[in] fftSize FFTの点数（MCIM_ANALYSIS_MIN_FFT_SIZE以上MCIM_ANALYSIS_MAX_FFT_SIZE以下の2の冪）
+ * @return bool 成功時true、失敗時false
+ * @note - BGMは音量と定位を掛けた後（ダッキング前）、バスとマスターは音量を掛けた後の信号を解析する
+ * @note - レンダリングスレッドでfftSize / 2フレーム毎に1回FFTを行い、その度に結果をmcim_get_analysisへ公開する
+ * @note - 解析はミキサーのブロック毎にタップ単位で処理され（mcim_set_render_threadsのスレッドと分担する）、所要時間はmcim_get_statsのanalysisで確認できる
+ * @note - FFTはタップ毎に1ブロックあたり高々1回であり、1ブロックの解析の上限はfftSizeが最大のタップをMCIM_ANALYSIS_MAX_TAPS個処理する場合となる（点数毎の計測はtests/BenchTapで行う）
+ * @note - BGMのタップはmcim_unloadで、バスのタップはmcim_destroy_busで取り除かれる
+ * @note - dataがNULLであった場合、keyに対応するBGMまたはバスが存在しない場合、BGMがレンダリングパスで再生されない場合は失敗する
+ * @note - fftSizeが不正な場合、keyに設置済みの場合、タップの数がMCIM_ANALYSIS_MAX_TAPSに達している場合は失敗する
+ */
+bool mcim_add_analysis(MCIM_DATA* data, MCIM_KEY key, uint32_t fftSize);
+
+/**
+ * @brief 解析タップを取り除く
+ * @param[in,out] data mcim_initの返り値
+ * @param[in] key mcim_add_analysisに指定したキー
+ * @return bool 成功時true、失敗時false
+ * @note - dataがNULLであった場合、keyにタップが設置されていない場合は失敗する
+ */
+bool mcim_remove_analysis(MCIM_DATA* data, MCIM_KEY key);
+
+/**
+ * @brief 解析タップが公開した最新のスナップショットを取得
+ * @param[in] data mcim_initの返り値
+ * @param[in] key mcim_add_analysisに指定したキー
+ * @param[out] analysis 取得先
+ * @return bool 成功時true、失敗時false
+ * @note - 3重バッファをアトミックに交換して読み出すため、レンダリング中でも待機しない
+ * @note - 新しいスナップショットが公開されていない場合は前回と同じ内容を返す（analysis->frameで判別できる）
+ * @note - 他のAPIと同様に、mcim_add_analysisやmcim_remove_analysisと同じスレッドから呼ぶ必要がある
+ * @note - dataまたはanalysisがNULLであった場合、keyにタップが設置されていない場合は失敗する
+ */
+bool mcim_get_analysis(MCIM_DATA* data, MCIM_KEY key, MCIM_ANALYSIS* analysis);
+
+/**
+ * @brief オフラインレンダリング用のMCIMオブジェクトの出力を実時間によらず生成
+ * @param[in,out] data mcim_init_offlineの返り値
+ * @param[out] buffer 出力先（44100Hz、ステレオのfloatをインターリーブ）
+ * @param[in] frames レンダリングするフレーム数
+ * @return bool 成功時true、失敗時false
+ * @note - bufferはframes * 2サンプル分の領域を持つ必要がある
+ * @note - 呼び出し間で行ったmcim_play/mcim_fadeout/mcim_stop等は、次のレンダリング開始位置から反映される
+ * @note - dataがNULLまたはmcim_init_offlineの返り値でない場合は失敗する
+ * @note - bufferがNULLであった場合は失敗する
+ */
+bool mcim_render(MCIM_DATA* data, float* buffer, uint32_t frames);
+
+/**
+ * @brief mcim_renderの出力をWAVファイル（IEEE float）として保存
+ * @param[in] filepath 保存先のファイルパス
+ * @param[in] buffer mcim_renderの出力
+ * @param[in] frames bufferのフレーム数
+ * @return bool 成功時true、失敗時false
+ * @note - filepathがNULLまたは空であった場合は失敗する
+ * @note - bufferがNULLであった場合は失敗する
+ * @note - 既にファイルが存在する場合は上書きする
+ */
+bool mcim_save_wave(const wchar_t* filepath, const float* buffer, uint32_t frames);
 
 #endif  // __MCIMANAGER_H__
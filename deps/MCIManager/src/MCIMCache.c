@@ -0,0 +1,500 @@
+﻿#include "_MCIMCache.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <wctype.h>
+
+#include "_MCIMLog.h"
+
+#define MCIM_CACHE_FLAG_PCM 0x00000001
+#define MCIM_CACHE_FLAG_LOUDNESS 0x00000002
+#define MCIM_CACHE_FLAG_VERIFIED 0x00000004  // PCMのハッシュ値を検証済み
+
+#define MCIM_CACHE_EXTENSION L".mcimcache"
+#define MCIM_CACHE_TEMP_SUFFIX L".tmp"
+
+// ディレクトリ名の後ろに'\\'、16桁のハッシュ値、拡張子および一時ファイルの接尾辞を付けられる長さに制限する
+#define MCIM_CACHE_MAX_DIRECTORY (MAX_PATH - 40)
+
+// WriteFileへ一度に渡すサイズ
+#define MCIM_CACHE_WRITE_CHUNK (16u << 20)
+
+/**
+ * @brief キャッシュファイルのヘッダ
+ * @note - ヘッダの直後に元ファイルのパス（pathLength文字、終端なし）が続き、dataOffsetからデコード済みのfloat PCMが続く
+ * @note - 書き込みは一時ファイルに対して行い、完了後に置き換えるため、途中で中断されたファイルが参照されることはない
+ * @note - PCMの破損はpayloadHashで検出し、ロードの度に全体を読まずに済むよう、保存後の最初のマップで一度だけ検証する
+ */
+typedef struct _MCIM_CACHE_HEADER {
+  uint8_t magic[4];
+  uint32_t version;
+  uint64_t sourceSize;
+  uint64_t sourceWriteTime;
+  uint32_t flags;
+  uint32_t pathLength;
+  uint32_t frames;
+  uint32_t sampleRate;
+  uint16_t channels;
+  uint16_t reserved;
+  uint32_t checksum;  // checksumを0としたヘッダのFNV-1a
+  uint64_t dataOffset;
+  uint64_t dataSize;
+  uint64_t payloadHash;  // dataOffsetからdataSizeバイトのハッシュ値
+  MCIM_CACHE_LOUDNESS loudness;
+} MCIM_CACHE_HEADER;
+
+static const uint8_t MCIM_CACHE_MAGIC[4] = {'M', 'C', 'I', 'C'};
+
+// キャッシュの設定および統計は全MCIMオブジェクトで共有する
+static wchar_t MCIM_CACHE_DIRECTORY[MAX_PATH] = {0};
+static SRWLOCK MCIM_CACHE_LOCK = SRWLOCK_INIT;
+static _Atomic(uint32_t) MCIM_CACHE_HITS = 0;
+static _Atomic(uint32_t) MCIM_CACHE_MISSES = 0;
+static _Atomic(uint32_t) MCIM_CACHE_INVALIDATED = 0;
+static _Atomic(int64_t) MCIM_CACHE_HIT_TICKS = 0;
+static _Atomic(int64_t) MCIM_CACHE_MISS_TICKS = 0;
+
+static bool mcim_cache_filename(const wchar_t* restrict filepath, const wchar_t* restrict suffix, wchar_t* restrict filename);
+static HANDLE mcim_cache_open(const wchar_t* restrict filepath,
+                              const MCIM_CACHE_STAMP* restrict stamp,
+                              DWORD access,
+                              MCIM_CACHE_HEADER* restrict header,
+                              bool* restrict invalid);
+static bool mcim_cache_validate(HANDLE hfile, const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, MCIM_CACHE_HEADER* restrict header);
+static void mcim_cache_write(const wchar_t* restrict filepath, MCIM_CACHE_HEADER* restrict header, const void* restrict data);
+static bool mcim_cache_write_at(HANDLE hfile, uint64_t offset, const void* buffer, uint32_t size);
+static uint32_t mcim_cache_checksum(const MCIM_CACHE_HEADER* header);
+static uint64_t mcim_cache_payload_hash(const void* data, uint64_t size);
+static void mcim_cache_mark_verified(const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, uint64_t payloadHash);
+
+/**************************************************************************************************/
+
+bool mcim_cache_set_directory(const wchar_t* directory) {
+  if (directory == NULL || directory[0] == L'\0') {
+    AcquireSRWLockExclusive(&MCIM_CACHE_LOCK);
+    MCIM_CACHE_DIRECTORY[0] = L'\0';
+    ReleaseSRWLockExclusive(&MCIM_CACHE_LOCK);
+    return true;
+  }
+
+  size_t length = wcslen(directory);
+  if (length > MCIM_CACHE_MAX_DIRECTORY) {
+    return false;
+  }
+  if (CreateDirectoryW(directory, NULL) == 0 && GetLastError() != ERROR_ALREADY_EXISTS) {
+    return false;
+  }
+
+  AcquireSRWLockExclusive(&MCIM_CACHE_LOCK);
+  wcscpy_s(MCIM_CACHE_DIRECTORY, MAX_PATH, directory);
+  while (length > 1 && (MCIM_CACHE_DIRECTORY[length - 1] == L'\\' || MCIM_CACHE_DIRECTORY[length - 1] == L'/')) {
+    MCIM_CACHE_DIRECTORY[--length] = L'\0';
+  }
+  ReleaseSRWLockExclusive(&MCIM_CACHE_LOCK);
+  return true;
+}
+
+bool mcim_cache_enabled(void) {
+  AcquireSRWLockShared(&MCIM_CACHE_LOCK);
+  bool enabled = (MCIM_CACHE_DIRECTORY[0] != L'\0');
+  ReleaseSRWLockShared(&MCIM_CACHE_LOCK);
+  return enabled;
+}
+
+void mcim_cache_get_stats(MCIM_CACHE_STATS* stats) {
+  assert(stats != NULL);
+
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  stats->hits = atomic_load(&MCIM_CACHE_HITS);
+  stats->misses = atomic_load(&MCIM_CACHE_MISSES);
+  stats->invalidated = atomic_load(&MCIM_CACHE_INVALIDATED);
+  stats->hitLoadTime = (double)atomic_load(&MCIM_CACHE_HIT_TICKS) / (double)freq.QuadPart;
+  stats->missLoadTime = (double)atomic_load(&MCIM_CACHE_MISS_TICKS) / (double)freq.QuadPart;
+}
+
+bool mcim_cache_get_stamp(const wchar_t* restrict filepath, MCIM_CACHE_STAMP* restrict stamp) {
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (GetFileAttributesExW(filepath, GetFileExInfoStandard, &attributes) == 0) {
+    return false;
+  }
+  stamp->size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+  stamp->writeTime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
+const float* mcim_cache_map(const wchar_t* restrict filepath,
+                            const MCIM_CACHE_STAMP* restrict stamp,
+                            uint32_t frames,
+                            uint32_t sampleRate,
+                            uint16_t channels,
+                            MCIM_CACHE_VIEW* restrict view) {
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+  assert(view != NULL);
+
+  SecureZeroMemory(view, sizeof(MCIM_CACHE_VIEW));
+
+  MCIM_CACHE_HEADER header;
+  bool invalid = false;
+  HANDLE hfile = mcim_cache_open(filepath, stamp, GENERIC_READ, &header, &invalid);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    if (invalid) {
+      atomic_fetch_add(&MCIM_CACHE_INVALIDATED, 1);
+      mcim_log_write(MCIM_LOG_INFO, "mcim_cache_invalidated", "frames", frames, NULL, 0);
+    }
+    return NULL;
+  }
+
+  // 元ファイルのヘッダから得た形式と一致しない場合も作り直す
+  if ((header.flags & MCIM_CACHE_FLAG_PCM) == 0 || header.frames != frames || header.sampleRate != sampleRate || header.channels != channels) {
+    if ((header.flags & MCIM_CACHE_FLAG_PCM) != 0) {
+      atomic_fetch_add(&MCIM_CACHE_INVALIDATED, 1);
+    }
+    CloseHandle(hfile);
+    return NULL;
+  }
+
+  HANDLE mapping = CreateFileMappingW(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+  const void* base = (mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL);
+  if (base == NULL) {
+    if (mapping != NULL) {
+      CloseHandle(mapping);
+    }
+    CloseHandle(hfile);
+    return NULL;
+  }
+
+  // 保存後の最初のマップではPCM全体を読んで破損を検出し、検証済みであることをヘッダに記録する
+  const float* samples = (const float*)((const uint8_t*)base + header.dataOffset);
+  if ((header.flags & MCIM_CACHE_FLAG_VERIFIED) == 0) {
+    if (mcim_cache_payload_hash(samples, header.dataSize) != header.payloadHash) {
+      UnmapViewOfFile(base);
+      CloseHandle(mapping);
+      CloseHandle(hfile);
+      atomic_fetch_add(&MCIM_CACHE_INVALIDATED, 1);
+      mcim_log_write(MCIM_LOG_WARNING, "mcim_cache_corrupted", "frames", frames, NULL, 0);
+      return NULL;
+    }
+    mcim_cache_mark_verified(filepath, stamp, header.payloadHash);
+  }
+
+  view->file = hfile;
+  view->mapping = mapping;
+  view->base = base;
+  return samples;
+}
+
+void mcim_cache_unmap(MCIM_CACHE_VIEW* view) {
+  assert(view != NULL);
+
+  if (view->base != NULL) {
+    UnmapViewOfFile(view->base);
+    CloseHandle(view->mapping);
+    CloseHandle(view->file);
+  }
+  SecureZeroMemory(view, sizeof(MCIM_CACHE_VIEW));
+}
+
+void mcim_cache_store(const wchar_t* restrict filepath,
+                      const MCIM_CACHE_STAMP* restrict stamp,
+                      const float* restrict samples,
+                      uint32_t frames,
+                      uint32_t sampleRate,
+                      uint16_t channels) {
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+  assert(samples != NULL);
+
+  MCIM_CACHE_HEADER header;
+  SecureZeroMemory(&header, sizeof(MCIM_CACHE_HEADER));
+  if (mcim_cache_find_loudness(filepath, stamp, &(header.loudness))) {
+    header.flags |= MCIM_CACHE_FLAG_LOUDNESS;
+  }
+  header.flags |= MCIM_CACHE_FLAG_PCM;
+  header.sourceSize = stamp->size;
+  header.sourceWriteTime = stamp->writeTime;
+  header.frames = frames;
+  header.sampleRate = sampleRate;
+  header.channels = channels;
+  header.dataSize = sizeof(float) * (uint64_t)frames * channels;
+  header.payloadHash = mcim_cache_payload_hash(samples, header.dataSize);
+  mcim_cache_write(filepath, &header, samples);
+}
+
+bool mcim_cache_find_loudness(const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, MCIM_CACHE_LOUDNESS* restrict loudness) {
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+  assert(loudness != NULL);
+
+  MCIM_CACHE_HEADER header;
+  bool invalid = false;
+  HANDLE hfile = mcim_cache_open(filepath, stamp, GENERIC_READ, &header, &invalid);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  CloseHandle(hfile);
+
+  if ((header.flags & MCIM_CACHE_FLAG_LOUDNESS) == 0) {
+    return false;
+  }
+  *loudness = header.loudness;
+  return true;
+}
+
+void mcim_cache_store_loudness(const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, const MCIM_CACHE_LOUDNESS* restrict loudness) {
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+  assert(loudness != NULL);
+
+  // PCMのキャッシュが有効であればヘッダのみを書き換え、無ければ解析結果のみのキャッシュを作成する
+  MCIM_CACHE_HEADER header;
+  bool invalid = false;
+  HANDLE hfile = mcim_cache_open(filepath, stamp, GENERIC_READ | GENERIC_WRITE, &header, &invalid);
+  if (hfile != INVALID_HANDLE_VALUE) {
+    header.flags |= MCIM_CACHE_FLAG_LOUDNESS;
+    header.loudness = *loudness;
+    header.checksum = mcim_cache_checksum(&header);
+    mcim_cache_write_at(hfile, 0, &header, sizeof(MCIM_CACHE_HEADER));
+    CloseHandle(hfile);
+    return;
+  }
+
+  SecureZeroMemory(&header, sizeof(MCIM_CACHE_HEADER));
+  header.flags = MCIM_CACHE_FLAG_LOUDNESS;
+  header.sourceSize = stamp->size;
+  header.sourceWriteTime = stamp->writeTime;
+  header.loudness = *loudness;
+  mcim_cache_write(filepath, &header, NULL);
+}
+
+void mcim_cache_record_load(bool hit, LONGLONG ticks) {
+  if (hit) {
+    atomic_fetch_add(&MCIM_CACHE_HITS, 1);
+    atomic_fetch_add(&MCIM_CACHE_HIT_TICKS, ticks);
+  } else {
+    atomic_fetch_add(&MCIM_CACHE_MISSES, 1);
+    atomic_fetch_add(&MCIM_CACHE_MISS_TICKS, ticks);
+  }
+}
+
+/**************************************************************************************************/
+
+static bool mcim_cache_filename(const wchar_t* restrict filepath, const wchar_t* restrict suffix, wchar_t* restrict filename) {
+  assert(filepath != NULL);
+  assert(suffix != NULL);
+  assert(filename != NULL);
+
+  AcquireSRWLockShared(&MCIM_CACHE_LOCK);
+  bool enabled = (MCIM_CACHE_DIRECTORY[0] != L'\0');
+  if (enabled) {
+    wcscpy_s(filename, MAX_PATH, MCIM_CACHE_DIRECTORY);
+  }
+  ReleaseSRWLockShared(&MCIM_CACHE_LOCK);
+  if (!enabled) {
+    return false;
+  }
+
+  // Windowsのパスは大文字小文字を区別しないため、小文字に揃えてからハッシュ値を求める
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (const wchar_t* p = filepath; *p != L'\0'; p++) {
+    const uint16_t c = (uint16_t)towlower(*p);
+    hash = (hash ^ (c & 0xFF)) * 0x100000001B3ULL;
+    hash = (hash ^ (c >> 8)) * 0x100000001B3ULL;
+  }
+
+  size_t length = wcslen(filename);
+  filename[length++] = L'\\';
+  for (int i = 15; i >= 0; i--) {
+    filename[length++] = L"0123456789abcdef"[(hash >> (4 * i)) & 0xF];
+  }
+  filename[length] = L'\0';
+  wcscat_s(filename, MAX_PATH, MCIM_CACHE_EXTENSION);
+  wcscat_s(filename, MAX_PATH, suffix);
+  return true;
+}
+
+static HANDLE mcim_cache_open(const wchar_t* restrict filepath,
+                              const MCIM_CACHE_STAMP* restrict stamp,
+                              DWORD access,
+                              MCIM_CACHE_HEADER* restrict header,
+                              bool* restrict invalid) {
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+  assert(header != NULL);
+  assert(invalid != NULL);
+
+  *invalid = false;
+  wchar_t filename[MAX_PATH];
+  if (!mcim_cache_filename(filepath, L"", filename)) {
+    return INVALID_HANDLE_VALUE;
+  }
+
+  // 他のプロセスやMCIMオブジェクトがメモリマップしている間も、解析結果の追記やファイルの置き換えを妨げない
+  HANDLE hfile = CreateFileW(filename, access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return INVALID_HANDLE_VALUE;
+  }
+  if (!mcim_cache_validate(hfile, filepath, stamp, header)) {
+    CloseHandle(hfile);
+    *invalid = true;
+    return INVALID_HANDLE_VALUE;
+  }
+  return hfile;
+}
+
+static bool mcim_cache_validate(HANDLE hfile, const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, MCIM_CACHE_HEADER* restrict header) {
+  assert(hfile != INVALID_HANDLE_VALUE);
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+  assert(header != NULL);
+
+  LARGE_INTEGER fileSize;
+  OVERLAPPED overlapped = {0};
+  DWORD read = 0;
+  if (GetFileSizeEx(hfile, &fileSize) == 0 || (uint64_t)fileSize.QuadPart < sizeof(MCIM_CACHE_HEADER) ||
+      ReadFile(hfile, header, sizeof(MCIM_CACHE_HEADER), &read, &overlapped) == 0 || read != sizeof(MCIM_CACHE_HEADER)) {
+    return false;
+  }
+  if (memcmp(header->magic, MCIM_CACHE_MAGIC, sizeof(MCIM_CACHE_MAGIC)) != 0 || header->version != MCIM_CACHE_VERSION ||
+      header->checksum != mcim_cache_checksum(header)) {
+    return false;
+  }
+
+  // ハッシュ値の衝突に備え、格納されたパスとも比較する
+  const size_t pathLength = wcslen(filepath);
+  wchar_t path[MAX_PATH];
+  if (header->pathLength != pathLength || pathLength >= MAX_PATH) {
+    return false;
+  }
+  overlapped.Offset = sizeof(MCIM_CACHE_HEADER);
+  const DWORD pathSize = (DWORD)(sizeof(wchar_t) * pathLength);
+  if (ReadFile(hfile, path, pathSize, &read, &overlapped) == 0 || read != pathSize) {
+    return false;
+  }
+  path[pathLength] = L'\0';
+  if (_wcsicmp(path, filepath) != 0) {
+    return false;
+  }
+
+  // 元ファイルが更新された場合は古いキャッシュとして扱う
+  if (header->sourceSize != stamp->size || header->sourceWriteTime != stamp->writeTime) {
+    return false;
+  }
+
+  // 書き込み途中の中断は一時ファイルへの書き込みで防いでいるため、PCMの欠けはファイルサイズで検出する
+  if ((header->flags & MCIM_CACHE_FLAG_PCM) != 0) {
+    if (header->dataSize != sizeof(float) * (uint64_t)header->frames * header->channels ||
+        header->dataOffset < sizeof(MCIM_CACHE_HEADER) + pathSize || header->dataOffset + header->dataSize != (uint64_t)fileSize.QuadPart) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void mcim_cache_write(const wchar_t* restrict filepath, MCIM_CACHE_HEADER* restrict header, const void* restrict data) {
+  assert(filepath != NULL);
+  assert(header != NULL);
+  assert(data != NULL || header->dataSize == 0);
+
+  const size_t pathLength = wcslen(filepath);
+  wchar_t filename[MAX_PATH];
+  wchar_t tempname[MAX_PATH];
+  if (pathLength >= MAX_PATH || !mcim_cache_filename(filepath, L"", filename) || !mcim_cache_filename(filepath, MCIM_CACHE_TEMP_SUFFIX, tempname)) {
+    return;
+  }
+
+  // メモリマップ時にサンプルが整列するよう、PCMの位置は16バイト境界に揃える
+  const uint32_t pathSize = (uint32_t)(sizeof(wchar_t) * pathLength);
+  memcpy(header->magic, MCIM_CACHE_MAGIC, sizeof(MCIM_CACHE_MAGIC));
+  header->version = MCIM_CACHE_VERSION;
+  header->pathLength = (uint32_t)pathLength;
+  header->dataOffset = (sizeof(MCIM_CACHE_HEADER) + pathSize + 15) & ~(uint64_t)15;
+  header->checksum = mcim_cache_checksum(header);
+
+  // 同じファイルを同時に書き込もうとした場合は、一時ファイルを開けなかった側が書き込みを諦める
+  HANDLE hfile = CreateFileW(tempname, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return;
+  }
+
+  const uint8_t padding[16] = {0};
+  bool result = mcim_cache_write_at(hfile, 0, header, sizeof(MCIM_CACHE_HEADER)) && mcim_cache_write_at(hfile, sizeof(MCIM_CACHE_HEADER), filepath, pathSize) &&
+                mcim_cache_write_at(hfile, sizeof(MCIM_CACHE_HEADER) + pathSize, padding, (uint32_t)(header->dataOffset - sizeof(MCIM_CACHE_HEADER) - pathSize));
+  for (uint64_t written = 0; result && written < header->dataSize; written += MCIM_CACHE_WRITE_CHUNK) {
+    const uint64_t remaining = header->dataSize - written;
+    const uint32_t size = (uint32_t)(remaining < MCIM_CACHE_WRITE_CHUNK ? remaining : MCIM_CACHE_WRITE_CHUNK);
+    result = mcim_cache_write_at(hfile, header->dataOffset + written, (const uint8_t*)data + written, size);
+  }
+  CloseHandle(hfile);
+
+  if (!result || MoveFileExW(tempname, filename, MOVEFILE_REPLACE_EXISTING) == 0) {
+    DeleteFileW(tempname);
+  }
+}
+
+static bool mcim_cache_write_at(HANDLE hfile, uint64_t offset, const void* buffer, uint32_t size) {
+  assert(hfile != INVALID_HANDLE_VALUE);
+  assert(buffer != NULL);
+
+  OVERLAPPED overlapped = {0};
+  overlapped.Offset = (DWORD)offset;
+  overlapped.OffsetHigh = (DWORD)(offset >> 32);
+  DWORD written = 0;
+  return (size == 0 || (WriteFile(hfile, buffer, size, &written, &overlapped) != 0 && written == size));
+}
+
+static uint32_t mcim_cache_checksum(const MCIM_CACHE_HEADER* header) {
+  assert(header != NULL);
+
+  MCIM_CACHE_HEADER copy = *header;
+  copy.checksum = 0;
+  const uint8_t* p = (const uint8_t*)&copy;
+  uint32_t hash = 0x811C9DC5;
+  for (size_t i = 0; i < sizeof(MCIM_CACHE_HEADER); i++) {
+    hash = (hash ^ p[i]) * 0x01000193;
+  }
+  return hash;
+}
+
+static uint64_t mcim_cache_payload_hash(const void* data, uint64_t size) {
+  assert(data != NULL || size == 0);
+
+  // 数十MBのPCMを一度に検証するため、FNV-1aを8バイト単位で行い、上位ビットを下位へ折り返して拡散させる
+  const uint8_t* p = (const uint8_t*)data;
+  uint64_t hash = 0xCBF29CE484222325ULL ^ size;
+  uint64_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, p + i, sizeof(uint64_t));
+    hash = (hash ^ word) * 0x100000001B3ULL;
+    hash ^= hash >> 29;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ p[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+static void mcim_cache_mark_verified(const wchar_t* restrict filepath, const MCIM_CACHE_STAMP* restrict stamp, uint64_t payloadHash) {
+  assert(filepath != NULL);
+  assert(stamp != NULL);
+
+  // 書き込めない場合は次回のマップで再び検証するだけであるため、失敗は無視する
+  // （検証後に別のプロセスがキャッシュを置き換えていた場合は、ハッシュ値が異なるため印を付けない）
+  MCIM_CACHE_HEADER header;
+  bool invalid = false;
+  HANDLE hfile = mcim_cache_open(filepath, stamp, GENERIC_READ | GENERIC_WRITE, &header, &invalid);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  if ((header.flags & MCIM_CACHE_FLAG_PCM) != 0 && header.payloadHash == payloadHash) {
+    header.flags |= MCIM_CACHE_FLAG_VERIFIED;
+    header.checksum = mcim_cache_checksum(&header);
+    mcim_cache_write_at(hfile, 0, &header, sizeof(MCIM_CACHE_HEADER));
+  }
+  CloseHandle(hfile);
+}
@@ -0,0 +1,332 @@
+﻿#include "_MCIMDsp.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "_MCIMStats.h"
+
+#define MCIM_DSP_PI 3.14159265358979323846
+
+// これより小さいフィルタの状態は0とし、無音時に非正規化数の演算が続くのを防ぐ
+#define MCIM_DSP_DENORMAL_THRESHOLD 1e-15f
+
+static MCIM_DSP_EFFECT* mcim_dsp_create(MCIM_EFFECT_TYPE type, const MCIM_DSP_PARAMS* restrict params, mcim_allocator_t allocator);
+static void mcim_dsp_publish(MCIM_DSP_EFFECT* restrict effect, const MCIM_DSP_PARAMS* restrict params);
+static const MCIM_DSP_PARAMS* mcim_dsp_acquire(MCIM_DSP_EFFECT* effect);
+static bool mcim_dsp_design_eq(const MCIM_EQ_PARAMS* restrict params, uint32_t sampleRate, MCIM_DSP_PARAMS* restrict designed);
+static bool mcim_dsp_design_limiter(const MCIM_LIMITER_PARAMS* restrict params, uint32_t sampleRate, MCIM_DSP_PARAMS* restrict designed);
+static void mcim_dsp_process_eq(MCIM_DSP_EFFECT* restrict effect, const MCIM_DSP_PARAMS* restrict params, const MCIM_KERNELS* restrict kernels, float* restrict buffer, uint32_t frames);
+static void mcim_dsp_process_limiter(MCIM_DSP_EFFECT* restrict effect, const MCIM_DSP_PARAMS* restrict params, float* restrict buffer, uint32_t frames);
+static void mcim_dsp_reset_limiter(MCIM_DSP_LIMITER_STATE* limiter, uint32_t lookahead);
+
+/**************************************************************************************************/
+
+MCIM_DSP_EFFECT* mcim_dsp_create_eq(const MCIM_EQ_PARAMS* restrict params, uint32_t sampleRate, mcim_allocator_t allocator) {
+  assert(params != NULL);
+  assert(allocator != NULL);
+
+  MCIM_DSP_PARAMS designed;
+  if (!mcim_dsp_design_eq(params, sampleRate, &designed)) {
+    return NULL;
+  }
+  return mcim_dsp_create(MCIM_EFFECT_EQ, &designed, allocator);
+}
+
+MCIM_DSP_EFFECT* mcim_dsp_create_limiter(const MCIM_LIMITER_PARAMS* restrict params, uint32_t sampleRate, mcim_allocator_t allocator) {
+  assert(params != NULL);
+  assert(allocator != NULL);
+
+  MCIM_DSP_PARAMS designed;
+  if (!mcim_dsp_design_limiter(params, sampleRate, &designed)) {
+    return NULL;
+  }
+  return mcim_dsp_create(MCIM_EFFECT_LIMITER, &designed, allocator);
+}
+
+bool mcim_dsp_set_eq(MCIM_DSP_EFFECT* restrict effect, const MCIM_EQ_PARAMS* restrict params, uint32_t sampleRate) {
+  assert(effect != NULL);
+  assert(params != NULL);
+
+  MCIM_DSP_PARAMS designed;
+  if (effect->type != MCIM_EFFECT_EQ || !mcim_dsp_design_eq(params, sampleRate, &designed)) {
+    return false;
+  }
+  mcim_dsp_publish(effect, &designed);
+  return true;
+}
+
+bool mcim_dsp_set_limiter(MCIM_DSP_EFFECT* restrict effect, const MCIM_LIMITER_PARAMS* restrict params, uint32_t sampleRate) {
+  assert(effect != NULL);
+  assert(params != NULL);
+
+  MCIM_DSP_PARAMS designed;
+  if (effect->type != MCIM_EFFECT_LIMITER || !mcim_dsp_design_limiter(params, sampleRate, &designed)) {
+    return false;
+  }
+  mcim_dsp_publish(effect, &designed);
+  return true;
+}
+
+void mcim_dsp_process(MCIM_DSP_CHAIN* restrict chain, const MCIM_KERNELS* restrict kernels, float* restrict buffer, uint32_t frames) {
+  assert(chain != NULL);
+  assert(kernels != NULL);
+  assert(buffer != NULL);
+
+  if (frames == 0) {
+    return;
+  }
+  // 構成はロックで保護されているため、緩い順序で読み出してよい
+  const uint32_t count = atomic_load_explicit(&(chain->count), memory_order_relaxed);
+  for (uint32_t i = 0; i < count; i++) {
+    MCIM_DSP_EFFECT* effect = atomic_load_explicit(&(chain->effects[i]), memory_order_relaxed);
+    const MCIM_DSP_PARAMS* params = mcim_dsp_acquire(effect);
+
+    // エフェクト毎の処理コストを種類別に集計する
+    LARGE_INTEGER begin;
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&begin);
+    switch (effect->type) {
+      case MCIM_EFFECT_EQ:
+        mcim_dsp_process_eq(effect, params, kernels, buffer, frames);
+        break;
+      case MCIM_EFFECT_LIMITER:
+        mcim_dsp_process_limiter(effect, params, buffer, frames);
+        break;
+      default:
+        assert(false);
+        break;
+    }
+    QueryPerformanceCounter(&end);
+    mcim_stats_record_effect(effect->type, frames, end.QuadPart - begin.QuadPart);
+  }
+}
+
+/**************************************************************************************************/
+
+static MCIM_DSP_EFFECT* mcim_dsp_create(MCIM_EFFECT_TYPE type, const MCIM_DSP_PARAMS* restrict params, mcim_allocator_t allocator) {
+  assert(params != NULL);
+  assert(allocator != NULL);
+
+  MCIM_DSP_EFFECT* effect = (MCIM_DSP_EFFECT*)allocator(sizeof(MCIM_DSP_EFFECT));
+  if (effect == NULL) {
+    return NULL;
+  }
+  memset(effect, 0, sizeof(MCIM_DSP_EFFECT));
+  effect->type = type;
+  effect->params[0] = *params;
+  effect->front = 0;
+  atomic_init(&(effect->middle), 1);
+  effect->back = 2;
+  return effect;
+}
+
+static void mcim_dsp_publish(MCIM_DSP_EFFECT* restrict effect, const MCIM_DSP_PARAMS* restrict params) {
+  assert(effect != NULL);
+  assert(params != NULL);
+
+  // 書き込み済みのバッファを中間バッファと交換し、レンダリングスレッドが未読であることを示す
+  effect->params[effect->back] = *params;
+  uint32_t previous = atomic_exchange_explicit(&(effect->middle), effect->back | MCIM_DSP_PARAMS_DIRTY, memory_order_acq_rel);
+  effect->back = previous & ~MCIM_DSP_PARAMS_DIRTY;
+}
+
+static const MCIM_DSP_PARAMS* mcim_dsp_acquire(MCIM_DSP_EFFECT* effect) {
+  assert(effect != NULL);
+
+  if (atomic_load_explicit(&(effect->middle), memory_order_relaxed) & MCIM_DSP_PARAMS_DIRTY) {
+    uint32_t previous = atomic_exchange_explicit(&(effect->middle), effect->front, memory_order_acq_rel);
+    effect->front = previous & ~MCIM_DSP_PARAMS_DIRTY;
+  }
+  return &(effect->params[effect->front]);
+}
+
+static bool mcim_dsp_design_eq(const MCIM_EQ_PARAMS* restrict params, uint32_t sampleRate, MCIM_DSP_PARAMS* restrict designed) {
+  assert(params != NULL);
+  assert(designed != NULL);
+
+  if (params->bandCount > MCIM_EQ_MAX_BANDS || sampleRate == 0) {
+    return false;
+  }
+
+  // Robert Bristow-Johnson, "Cookbook formulae for audio EQ biquad filter coefficients"
+  designed->eq.sectionCount = params->bandCount;
+  for (uint32_t i = 0; i < params->bandCount; i++) {
+    const MCIM_EQ_BAND* band = &(params->bands[i]);
+    if (!(band->frequency > 0.0f && band->frequency < (float)sampleRate * 0.5f) || !(band->q > 0.0f) || !isfinite(band->gain)) {
+      return false;
+    }
+
+    const double w0 = 2.0 * MCIM_DSP_PI * (double)band->frequency / (double)sampleRate;
+    const double cosw = cos(w0);
+    const double alpha = sin(w0) / (2.0 * (double)band->q);
+    const double A = pow(10.0, (double)band->gain / 40.0);
+    const double shelf = 2.0 * sqrt(A) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+    switch (band->filter) {
+      case MCIM_EQ_LOWPASS:
+        b0 = (1.0 - cosw) * 0.5;
+        b1 = 1.0 - cosw;
+        b2 = (1.0 - cosw) * 0.5;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cosw;
+        a2 = 1.0 - alpha;
+        break;
+      case MCIM_EQ_HIGHPASS:
+        b0 = (1.0 + cosw) * 0.5;
+        b1 = -(1.0 + cosw);
+        b2 = (1.0 + cosw) * 0.5;
+        a0 = 1.0 + alpha;
+        a1 = -2.0 * cosw;
+        a2 = 1.0 - alpha;
+        break;
+      case MCIM_EQ_PEAKING:
+        b0 = 1.0 + alpha * A;
+        b1 = -2.0 * cosw;
+        b2 = 1.0 - alpha * A;
+        a0 = 1.0 + alpha / A;
+        a1 = -2.0 * cosw;
+        a2 = 1.0 - alpha / A;
+        break;
+      case MCIM_EQ_LOWSHELF:
+        b0 = A * ((A + 1.0) - (A - 1.0) * cosw + shelf);
+        b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * cosw);
+        b2 = A * ((A + 1.0) - (A - 1.0) * cosw - shelf);
+        a0 = (A + 1.0) + (A - 1.0) * cosw + shelf;
+        a1 = -2.0 * ((A - 1.0) + (A + 1.0) * cosw);
+        a2 = (A + 1.0) + (A - 1.0) * cosw - shelf;
+        break;
+      case MCIM_EQ_HIGHSHELF:
+        b0 = A * ((A + 1.0) + (A - 1.0) * cosw + shelf);
+        b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * cosw);
+        b2 = A * ((A + 1.0) + (A - 1.0) * cosw - shelf);
+        a0 = (A + 1.0) - (A - 1.0) * cosw + shelf;
+        a1 = 2.0 * ((A - 1.0) - (A + 1.0) * cosw);
+        a2 = (A + 1.0) - (A - 1.0) * cosw - shelf;
+        break;
+      default:
+        return false;
+    }
+
+    MCIM_BIQUAD_COEFS* section = &(designed->eq.sections[i]);
+    section->b0 = (float)(b0 / a0);
+    section->b1 = (float)(b1 / a0);
+    section->b2 = (float)(b2 / a0);
+    section->a1 = (float)(a1 / a0);
+    section->a2 = (float)(a2 / a0);
+  }
+  return true;
+}
+
+static bool mcim_dsp_design_limiter(const MCIM_LIMITER_PARAMS* restrict params, uint32_t sampleRate, MCIM_DSP_PARAMS* restrict designed) {
+  assert(params != NULL);
+  assert(designed != NULL);
+
+  if (!(params->ceiling <= 0.0f) || !(params->lookahead > 0.0f && params->lookahead <= MCIM_LIMITER_MAX_LOOKAHEAD) || !(params->release > 0.0f) ||
+      !isfinite(params->release) || sampleRate == 0) {
+    return false;
+  }
+
+  const double lookahead = round((double)params->lookahead * (double)sampleRate / 1000.0);
+  if (lookahead >= MCIM_LIMITER_RING_FRAMES) {
+    return false;
+  }
+  designed->limiter.ceiling = powf(10.0f, params->ceiling / 20.0f);
+  designed->limiter.lookahead = (lookahead < 1.0 ? 1 : (uint32_t)lookahead);
+  designed->limiter.release = (float)(1.0 - exp(-1000.0 / ((double)params->release * (double)sampleRate)));
+  return true;
+}
+
+static void mcim_dsp_process_eq(MCIM_DSP_EFFECT* restrict effect, const MCIM_DSP_PARAMS* restrict params, const MCIM_KERNELS* restrict kernels, float* restrict buffer, uint32_t frames) {
+  assert(effect != NULL);
+  assert(params != NULL);
+  assert(kernels != NULL);
+  assert(buffer != NULL);
+
+  // バンド数の変更で追加された区間は無音の状態から始める
+  MCIM_DSP_EQ_STATE* eq = &(effect->eq);
+  for (uint32_t i = eq->sectionCount; i < params->eq.sectionCount; i++) {
+    memset(eq->state[i], 0, sizeof(eq->state[i]));
+  }
+  eq->sectionCount = params->eq.sectionCount;
+
+  for (uint32_t i = 0; i < eq->sectionCount; i++) {
+    kernels->biquad(buffer, frames, &(params->eq.sections[i]), eq->state[i]);
+    for (uint32_t j = 0; j < 4; j++) {
+      if (fabsf(eq->state[i][j]) < MCIM_DSP_DENORMAL_THRESHOLD) {
+        eq->state[i][j] = 0.0f;
+      }
+    }
+  }
+}
+
+static void mcim_dsp_process_limiter(MCIM_DSP_EFFECT* restrict effect, const MCIM_DSP_PARAMS* restrict params, float* restrict buffer, uint32_t frames) {
+  assert(effect != NULL);
+  assert(params != NULL);
+  assert(buffer != NULL);
+
+  MCIM_DSP_LIMITER_STATE* limiter = &(effect->limiter);
+  const uint32_t lookahead = params->limiter.lookahead;
+  const float ceiling = params->limiter.ceiling;
+  const float release = params->limiter.release;
+  if (limiter->lookahead != lookahead) {
+    mcim_dsp_reset_limiter(limiter, lookahead);
+  }
+
+  // 先読み区間（lookahead + 1フレーム）の必要ゲインの最小値をリリース付きで保持し、lookaheadフレームの移動平均で平滑化する
+  // 移動平均の各項は遅延後のフレームを含む区間の最小値以下であるため、出力はceilingを超えない
+  const uint32_t mask = MCIM_LIMITER_RING_FRAMES - 1;
+  const double scale = 1.0 / (double)lookahead;
+  for (uint32_t i = 0; i < frames; i++) {
+    const uint32_t position = limiter->position;
+    const float left = buffer[2 * i];
+    const float right = buffer[2 * i + 1];
+    const float peak = fmaxf(fabsf(left), fabsf(right));
+    const float required = (peak > ceiling ? ceiling / peak : 1.0f);
+
+    while (limiter->minCount > 0 && limiter->minValue[(limiter->minHead + limiter->minCount - 1) & mask] >= required) {
+      limiter->minCount--;
+    }
+    const uint32_t tail = (limiter->minHead + limiter->minCount) & mask;
+    limiter->minValue[tail] = required;
+    limiter->minIndex[tail] = position;
+    limiter->minCount++;
+    if (position - limiter->minIndex[limiter->minHead] > lookahead) {
+      limiter->minHead = (limiter->minHead + 1) & mask;
+      limiter->minCount--;
+    }
+
+    const float minimum = limiter->minValue[limiter->minHead];
+    limiter->held = (minimum < limiter->held ? minimum : limiter->held + (minimum - limiter->held) * release);
+
+    const uint32_t slot = limiter->averagePosition;
+    limiter->averageSum += (double)limiter->held - (double)limiter->average[slot];
+    limiter->average[slot] = limiter->held;
+    limiter->averagePosition = (slot + 1 < lookahead ? slot + 1 : 0);
+    const float gain = fminf((float)(limiter->averageSum * scale), 1.0f);
+
+    const uint32_t delayed = (position - lookahead) & mask;
+    buffer[2 * i] = limiter->delay[2 * delayed] * gain;
+    buffer[2 * i + 1] = limiter->delay[2 * delayed + 1] * gain;
+    limiter->delay[2 * (position & mask)] = left;
+    limiter->delay[2 * (position & mask) + 1] = right;
+    limiter->position = position + 1;
+  }
+}
+
+static void mcim_dsp_reset_limiter(MCIM_DSP_LIMITER_STATE* limiter, uint32_t lookahead) {
+  assert(limiter != NULL);
+  assert(lookahead > 0 && lookahead < MCIM_LIMITER_RING_FRAMES);
+
+  memset(limiter->delay, 0, sizeof(limiter->delay));
+  limiter->lookahead = lookahead;
+  limiter->position = 0;
+  limiter->minHead = 0;
+  limiter->minCount = 0;
+  limiter->held = 1.0f;
+  for (uint32_t i = 0; i < lookahead; i++) {
+    limiter->average[i] = 1.0f;
+  }
+  limiter->averagePosition = 0;
+  limiter->averageSum = (double)lookahead;
+}
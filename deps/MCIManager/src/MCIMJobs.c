@@ -0,0 +1,174 @@
+﻿#include "_MCIMJobs.h"
+
+#include <assert.h>
+#include <process.h>
+
+static void mcim_jobs_work(MCIM_JOBS* restrict jobs, uint32_t participant, uint32_t participants, mcim_jobs_run_t run, void* restrict context);
+static unsigned __stdcall mcim_jobs_thread(void* pargs);
+
+/**************************************************************************************************/
+
+MCIM_JOBS* mcim_jobs_create(uint32_t threadCount, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(threadCount > 0 && threadCount <= MCIM_JOBS_MAX_THREADS);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  MCIM_JOBS* ret = (MCIM_JOBS*)allocator(sizeof(MCIM_JOBS));
+  if (ret == NULL) {
+    return NULL;
+  }
+
+  SecureZeroMemory(ret, sizeof(MCIM_JOBS));
+  InitializeSRWLock(&(ret->lock));
+  InitializeConditionVariable(&(ret->startCond));
+  atomic_init(&(ret->generation), 0);
+  atomic_init(&(ret->remaining), 0);
+  atomic_init(&(ret->entered), 0);
+  for (uint32_t i = 0; i < MCIM_JOBS_MAX_THREADS + 1; i++) {
+    atomic_init(&(ret->ranges[i].next), 0);
+  }
+
+  for (uint32_t i = 0; i < threadCount; i++) {
+    MCIM_JOBS_WORKER* worker = &(ret->workers[i]);
+    worker->jobs = ret;
+    worker->participant = i + 1;
+    worker->hthread = (HANDLE)_beginthreadex(NULL, 0, mcim_jobs_thread, worker, 0, NULL);
+    if (worker->hthread == (HANDLE)0) {
+      worker->hthread = NULL;
+      mcim_jobs_destroy(ret, deallocator);
+      return NULL;
+    }
+    ret->threadCount++;
+  }
+  return ret;
+}
+
+void mcim_jobs_destroy(MCIM_JOBS* jobs, mcim_deallocator_t deallocator) {
+  assert(deallocator != NULL);
+
+  if (jobs == NULL) {
+    return;
+  }
+
+  AcquireSRWLockExclusive(&(jobs->lock));
+  jobs->terminate = true;
+  ReleaseSRWLockExclusive(&(jobs->lock));
+  WakeAllConditionVariable(&(jobs->startCond));
+
+  for (uint32_t i = 0; i < jobs->threadCount; i++) {
+    WaitForSingleObject(jobs->workers[i].hthread, INFINITE);
+    CloseHandle(jobs->workers[i].hthread);
+  }
+  deallocator(jobs);
+}
+
+void mcim_jobs_run(MCIM_JOBS* restrict jobs, uint32_t count, mcim_jobs_run_t run, void* restrict context) {
+  assert(run != NULL);
+
+  uint32_t participants = (jobs != NULL ? jobs->threadCount + 1 : 1);
+  if (participants > count) {
+    participants = count;
+  }
+  if (participants <= 1) {
+    for (uint32_t i = 0; i < count; i++) {
+      run(context, i, 0);
+    }
+    return;
+  }
+
+  // 前回の実行に遅れて参加したスレッドが区間を参照し終えてから、ジョブを参加スレッドへ均等に割り振る
+  // （ロックを保持している間は新たに参加するスレッドは無い）
+  AcquireSRWLockExclusive(&(jobs->lock));
+  while (atomic_load_explicit(&(jobs->entered), memory_order_acquire) != 0) {
+    YieldProcessor();
+  }
+  for (uint32_t i = 0; i < participants; i++) {
+    atomic_store_explicit(&(jobs->ranges[i].next), (uint32_t)((uint64_t)count * i / participants), memory_order_relaxed);
+    jobs->ranges[i].end = (uint32_t)((uint64_t)count * (i + 1) / participants);
+  }
+  jobs->participants = participants;
+  jobs->run = run;
+  jobs->context = context;
+  atomic_store_explicit(&(jobs->remaining), count, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(jobs->generation), 1, memory_order_release);
+  const bool wake = (jobs->sleeping != 0);
+  ReleaseSRWLockExclusive(&(jobs->lock));
+  if (wake) {
+    WakeAllConditionVariable(&(jobs->startCond));
+  }
+
+  // 呼び出し元のスレッドも参加し、自身の区間を終えた後は他のスレッドの区間から奪う
+  // ジョブは短いため、完了は眠らずに待つ
+  mcim_jobs_work(jobs, 0, participants, run, context);
+  while (atomic_load_explicit(&(jobs->remaining), memory_order_acquire) != 0) {
+    YieldProcessor();
+  }
+}
+
+uint32_t mcim_jobs_thread_count(const MCIM_JOBS* jobs) {
+  return (jobs != NULL ? jobs->threadCount : 0);
+}
+
+/**************************************************************************************************/
+
+static void mcim_jobs_work(MCIM_JOBS* restrict jobs, uint32_t participant, uint32_t participants, mcim_jobs_run_t run, void* restrict context) {
+  assert(jobs != NULL);
+  assert(participant < participants);
+  assert(run != NULL);
+
+  for (uint32_t i = 0; i < participants; i++) {
+    MCIM_JOBS_RANGE* range = &(jobs->ranges[(participant + i) % participants]);
+    for (;;) {
+      const uint32_t job = atomic_fetch_add_explicit(&(range->next), 1, memory_order_relaxed);
+      if (job >= range->end) {
+        break;
+      }
+      run(context, job, participant);
+      atomic_fetch_sub_explicit(&(jobs->remaining), 1, memory_order_release);
+    }
+  }
+}
+
+static unsigned __stdcall mcim_jobs_thread(void* pargs) {
+  MCIM_JOBS_WORKER* worker = (MCIM_JOBS_WORKER*)pargs;
+  MCIM_JOBS* jobs = worker->jobs;
+
+  // レンダリングスレッドの処理を分担するため、同じ優先度で動かす
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+  AcquireSRWLockExclusive(&(jobs->lock));
+  uint32_t seen = atomic_load_explicit(&(jobs->generation), memory_order_relaxed);
+  while (!jobs->terminate) {
+    if (atomic_load_explicit(&(jobs->generation), memory_order_relaxed) == seen) {
+      // ブロック毎の実行の間隔は短いため、しばらくは眠らずに次の実行を待つ
+      ReleaseSRWLockExclusive(&(jobs->lock));
+      for (uint32_t i = 0; i < MCIM_JOBS_SPIN_COUNT && atomic_load_explicit(&(jobs->generation), memory_order_relaxed) == seen; i++) {
+        YieldProcessor();
+      }
+      AcquireSRWLockExclusive(&(jobs->lock));
+      if (!jobs->terminate && atomic_load_explicit(&(jobs->generation), memory_order_relaxed) == seen) {
+        jobs->sleeping++;
+        SleepConditionVariableSRW(&(jobs->startCond), &(jobs->lock), INFINITE, 0);
+        jobs->sleeping--;
+      }
+      continue;
+    }
+
+    seen = atomic_load_explicit(&(jobs->generation), memory_order_relaxed);
+    const uint32_t participants = jobs->participants;
+    if (worker->participant >= participants) {
+      continue;
+    }
+    mcim_jobs_run_t run = jobs->run;
+    void* context = jobs->context;
+    atomic_fetch_add_explicit(&(jobs->entered), 1, memory_order_relaxed);
+    ReleaseSRWLockExclusive(&(jobs->lock));
+
+    mcim_jobs_work(jobs, worker->participant, participants, run, context);
+    atomic_fetch_sub_explicit(&(jobs->entered), 1, memory_order_release);
+
+    AcquireSRWLockExclusive(&(jobs->lock));
+  }
+  ReleaseSRWLockExclusive(&(jobs->lock));
+  return 0;
+}
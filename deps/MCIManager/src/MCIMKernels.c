@@ -0,0 +1,239 @@
+﻿#include "_MCIMKernels.h"
+
+#include <math.h>
+#include <stdatomic.h>
+
+#ifdef MCIM_KERNELS_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static const MCIM_KERNELS* _Atomic MCIM_SELECTED_KERNELS = NULL;
+
+#ifdef MCIM_KERNELS_X86
+static void mcim_cpuid(uint32_t info[4], uint32_t leaf, uint32_t subleaf);
+static uint64_t mcim_xgetbv(void);
+#endif
+
+/**************************************************************************************************/
+
+const MCIM_KERNELS MCIM_KERNELS_GENERIC = {
+    .name = "generic",
+    .mix_ramp = mcim_mix_ramp_generic,
+    .mix_pan = mcim_mix_pan_generic,
+    .scale_ramp = mcim_scale_ramp_generic,
+    .peak = mcim_peak_generic,
+    .biquad = mcim_biquad_generic,
+    .dot = mcim_dot_generic,
+    .resample = mcim_resample_generic,
+    .float_to_s16 = mcim_float_to_s16_generic,
+    .s16_to_float = mcim_s16_to_float_generic,
+    .fft_pass = mcim_fft_pass_generic,
+};
+
+const MCIM_KERNELS* mcim_select_kernels(void) {
+  const MCIM_KERNELS* kernels = atomic_load(&MCIM_SELECTED_KERNELS);
+  if (kernels != NULL) {
+    return kernels;
+  }
+
+  // 判定結果は常に同じであるため、複数スレッドから同時に呼ばれても排他は不要
+  kernels = &MCIM_KERNELS_GENERIC;
+#ifdef MCIM_KERNELS_X86
+  uint32_t info[4];
+  mcim_cpuid(info, 0, 0);
+  const uint32_t maxLeaf = info[0];
+
+  mcim_cpuid(info, 1, 0);
+  const bool sse2 = (info[3] & (1u << 26)) != 0;
+  const bool fma = (info[2] & (1u << 12)) != 0;
+  const bool osxsave = (info[2] & (1u << 27)) != 0;
+  const bool avx = (info[2] & (1u << 28)) != 0;
+
+  bool avx2 = false;
+  bool avx512 = false;
+  if (maxLeaf >= 7 && osxsave && avx) {
+    // OSがYMM/ZMMレジスタの退避に対応しているかをXCR0で確認する
+    const uint64_t xcr0 = mcim_xgetbv();
+    const bool ymm = (xcr0 & 0x06) == 0x06;
+    const bool zmm = (xcr0 & 0xE6) == 0xE6;
+    mcim_cpuid(info, 7, 0);
+    avx2 = ymm && fma && (info[1] & (1u << 5)) != 0;
+    avx512 = zmm && avx2 && (info[1] & (1u << 16)) != 0;
+  }
+
+  if (avx512) {
+    kernels = &MCIM_KERNELS_AVX512;
+  } else if (avx2) {
+    kernels = &MCIM_KERNELS_AVX2;
+  } else if (sse2) {
+    kernels = &MCIM_KERNELS_SSE2;
+  }
+#endif
+
+  atomic_store(&MCIM_SELECTED_KERNELS, kernels);
+  return kernels;
+}
+
+/**************************************************************************************************/
+
+void mcim_mix_ramp_generic(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep) {
+  for (uint32_t i = 0; i < frames; i++) {
+    const float g = gain + gainStep * (float)i;
+    dst[2 * i] += src[2 * i] * g;
+    dst[2 * i + 1] += src[2 * i + 1] * g;
+  }
+}
+
+void mcim_mix_pan_generic(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]) {
+  for (uint32_t i = 0; i < frames; i++) {
+    dst[2 * i] += src[2 * i] * (gain[0] + gainStep[0] * (float)i);
+    dst[2 * i + 1] += src[2 * i + 1] * (gain[1] + gainStep[1] * (float)i);
+  }
+}
+
+void mcim_scale_ramp_generic(float* buffer, uint32_t frames, float gain, float gainStep) {
+  for (uint32_t i = 0; i < frames; i++) {
+    const float g = gain + gainStep * (float)i;
+    buffer[2 * i] *= g;
+    buffer[2 * i + 1] *= g;
+  }
+}
+
+float mcim_peak_generic(const float* src, uint32_t count) {
+  float peak = 0.0f;
+  for (uint32_t i = 0; i < count; i++) {
+    const float v = fabsf(src[i]);
+    if (v > peak) {
+      peak = v;
+    }
+  }
+  return peak;
+}
+
+void mcim_biquad_generic(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]) {
+  const float b0 = coefs->b0;
+  const float b1 = coefs->b1;
+  const float b2 = coefs->b2;
+  const float a1 = coefs->a1;
+  const float a2 = coefs->a2;
+  float z1l = state[0];
+  float z1r = state[1];
+  float z2l = state[2];
+  float z2r = state[3];
+  for (uint32_t i = 0; i < frames; i++) {
+    const float xl = buffer[2 * i];
+    const float xr = buffer[2 * i + 1];
+    const float yl = b0 * xl + z1l;
+    const float yr = b0 * xr + z1r;
+    z1l = b1 * xl - a1 * yl + z2l;
+    z1r = b1 * xr - a1 * yr + z2r;
+    z2l = b2 * xl - a2 * yl;
+    z2r = b2 * xr - a2 * yr;
+    buffer[2 * i] = yl;
+    buffer[2 * i + 1] = yr;
+  }
+  state[0] = z1l;
+  state[1] = z1r;
+  state[2] = z2l;
+  state[3] = z2r;
+}
+
+float mcim_dot_generic(const float* a, const float* b, uint32_t count) {
+  float sum = 0.0f;
+  for (uint32_t i = 0; i < count; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+void mcim_resample_generic(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames) {
+  if (channels == 2) {
+    for (uint32_t i = 0; i < frames; i++) {
+      const float* s = src + 2 * (size_t)(position >> 32);
+      const float frac = (float)(uint32_t)position * (1.0f / 4294967296.0f);
+      dst[2 * i] = s[0] + (s[2] - s[0]) * frac;
+      dst[2 * i + 1] = s[1] + (s[3] - s[1]) * frac;
+      position += step;
+    }
+  } else {
+    for (uint32_t i = 0; i < frames; i++) {
+      const float* s = src + (size_t)(position >> 32);
+      const float frac = (float)(uint32_t)position * (1.0f / 4294967296.0f);
+      const float v = s[0] + (s[1] - s[0]) * frac;
+      dst[2 * i] = v;
+      dst[2 * i + 1] = v;
+      position += step;
+    }
+  }
+}
+
+void mcim_float_to_s16_generic(int16_t* restrict dst, const float* restrict src, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    float v = src[i] * 32768.0f;
+    if (v > 32767.0f) {
+      v = 32767.0f;
+    } else if (v < -32768.0f) {
+      v = -32768.0f;
+    }
+    dst[i] = (int16_t)lrintf(v);
+  }
+}
+
+void mcim_s16_to_float_generic(float* restrict dst, const int16_t* restrict src, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    dst[i] = (float)src[i] * (1.0f / 32768.0f);
+  }
+}
+
+void mcim_fft_pass_generic(float* restrict re,
+                           float* restrict im,
+                           const float* restrict twRe,
+                           const float* restrict twIm,
+                           uint32_t count,
+                           uint32_t half) {
+  for (uint32_t base = 0; base < count; base += 2 * half) {
+    float* restrict aRe = re + base;
+    float* restrict aIm = im + base;
+    float* restrict bRe = aRe + half;
+    float* restrict bIm = aIm + half;
+    for (uint32_t k = 0; k < half; k++) {
+      const float tRe = bRe[k] * twRe[k] - bIm[k] * twIm[k];
+      const float tIm = bRe[k] * twIm[k] + bIm[k] * twRe[k];
+      bRe[k] = aRe[k] - tRe;
+      bIm[k] = aIm[k] - tIm;
+      aRe[k] += tRe;
+      aIm[k] += tIm;
+    }
+  }
+}
+
+/**************************************************************************************************/
+
+#ifdef MCIM_KERNELS_X86
+static void mcim_cpuid(uint32_t info[4], uint32_t leaf, uint32_t subleaf) {
+#if defined(_MSC_VER)
+  int regs[4];
+  __cpuidex(regs, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; i++) {
+    info[i] = (uint32_t)regs[i];
+  }
+#else
+  __cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+static uint64_t mcim_xgetbv(void) {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t eax;
+  uint32_t edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+#endif
+}
+#endif
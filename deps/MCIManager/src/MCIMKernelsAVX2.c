@@ -0,0 +1,237 @@
+﻿#include "_MCIMKernels.h"
+
+#ifdef MCIM_KERNELS_X86
+
+#include <immintrin.h>
+
+static void mcim_mix_ramp_avx2(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep);
+static void mcim_mix_pan_avx2(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]);
+static void mcim_scale_ramp_avx2(float* buffer, uint32_t frames, float gain, float gainStep);
+static float mcim_peak_avx2(const float* src, uint32_t count);
+static void mcim_biquad_avx2(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]);
+static float mcim_dot_avx2(const float* a, const float* b, uint32_t count);
+static void mcim_resample_avx2(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames);
+static void mcim_float_to_s16_avx2(int16_t* restrict dst, const float* restrict src, uint32_t count);
+static void mcim_s16_to_float_avx2(float* restrict dst, const int16_t* restrict src, uint32_t count);
+static void mcim_fft_pass_avx2(float* restrict re,
+                               float* restrict im,
+                               const float* restrict twRe,
+                               const float* restrict twIm,
+                               uint32_t count,
+                               uint32_t half);
+
+/**************************************************************************************************/
+
+const MCIM_KERNELS MCIM_KERNELS_AVX2 = {
+    .name = "avx2",
+    .mix_ramp = mcim_mix_ramp_avx2,
+    .mix_pan = mcim_mix_pan_avx2,
+    .scale_ramp = mcim_scale_ramp_avx2,
+    .peak = mcim_peak_avx2,
+    .biquad = mcim_biquad_avx2,
+    .dot = mcim_dot_avx2,
+    .resample = mcim_resample_avx2,
+    .float_to_s16 = mcim_float_to_s16_avx2,
+    .s16_to_float = mcim_s16_to_float_avx2,
+    .fft_pass = mcim_fft_pass_avx2,
+};
+
+/**************************************************************************************************/
+
+// 4フレーム（8サンプル）単位で処理する
+static void mcim_mix_ramp_avx2(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep) {
+  const __m256 offset = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+  __m256 g = _mm256_fmadd_ps(_mm256_set1_ps(gainStep), offset, _mm256_set1_ps(gain));
+  const __m256 inc = _mm256_set1_ps(gainStep * 4.0f);
+  uint32_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    const __m256 s = _mm256_loadu_ps(src + 2 * i);
+    const __m256 d = _mm256_loadu_ps(dst + 2 * i);
+    _mm256_storeu_ps(dst + 2 * i, _mm256_fmadd_ps(s, g, d));
+    g = _mm256_add_ps(g, inc);
+  }
+  mcim_mix_ramp_generic(dst + 2 * i, src + 2 * i, frames - i, gain + gainStep * (float)i, gainStep);
+}
+
+static void mcim_mix_pan_avx2(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]) {
+  const __m256 offset = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+  const __m256 step = _mm256_setr_ps(gainStep[0], gainStep[1], gainStep[0], gainStep[1], gainStep[0], gainStep[1], gainStep[0], gainStep[1]);
+  __m256 g = _mm256_fmadd_ps(step, offset, _mm256_setr_ps(gain[0], gain[1], gain[0], gain[1], gain[0], gain[1], gain[0], gain[1]));
+  const __m256 inc = _mm256_mul_ps(step, _mm256_set1_ps(4.0f));
+  uint32_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    const __m256 s = _mm256_loadu_ps(src + 2 * i);
+    const __m256 d = _mm256_loadu_ps(dst + 2 * i);
+    _mm256_storeu_ps(dst + 2 * i, _mm256_fmadd_ps(s, g, d));
+    g = _mm256_add_ps(g, inc);
+  }
+  const float rest[2] = {gain[0] + gainStep[0] * (float)i, gain[1] + gainStep[1] * (float)i};
+  mcim_mix_pan_generic(dst + 2 * i, src + 2 * i, frames - i, rest, gainStep);
+}
+
+static void mcim_scale_ramp_avx2(float* buffer, uint32_t frames, float gain, float gainStep) {
+  const __m256 offset = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+  __m256 g = _mm256_fmadd_ps(_mm256_set1_ps(gainStep), offset, _mm256_set1_ps(gain));
+  const __m256 inc = _mm256_set1_ps(gainStep * 4.0f);
+  uint32_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    _mm256_storeu_ps(buffer + 2 * i, _mm256_mul_ps(_mm256_loadu_ps(buffer + 2 * i), g));
+    g = _mm256_add_ps(g, inc);
+  }
+  mcim_scale_ramp_generic(buffer + 2 * i, frames - i, gain + gainStep * (float)i, gainStep);
+}
+
+static float mcim_peak_avx2(const float* src, uint32_t count) {
+  const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 m = _mm256_setzero_ps();
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    m = _mm256_max_ps(m, _mm256_and_ps(_mm256_loadu_ps(src + i), mask));
+  }
+  __m128 h = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+  h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+  const float peak = _mm_cvtss_f32(h);
+  const float rest = mcim_peak_generic(src + i, count - i);
+  return (rest > peak ? rest : peak);
+}
+
+// 再帰のためフレーム方向には並列化できず、L/Rの2チャンネルを下位2レーンで同時に処理する
+static void mcim_biquad_avx2(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]) {
+  const __m128 b0 = _mm_set1_ps(coefs->b0);
+  const __m128 b1 = _mm_set1_ps(coefs->b1);
+  const __m128 b2 = _mm_set1_ps(coefs->b2);
+  const __m128 a1 = _mm_set1_ps(coefs->a1);
+  const __m128 a2 = _mm_set1_ps(coefs->a2);
+  __m128 z1 = _mm_setr_ps(state[0], state[1], 0.0f, 0.0f);
+  __m128 z2 = _mm_setr_ps(state[2], state[3], 0.0f, 0.0f);
+  for (uint32_t i = 0; i < frames; i++) {
+    const __m128 x = _mm_castpd_ps(_mm_load_sd((const double*)(buffer + 2 * i)));
+    const __m128 y = _mm_fmadd_ps(b0, x, z1);
+    z1 = _mm_fnmadd_ps(a1, y, _mm_fmadd_ps(b1, x, z2));
+    z2 = _mm_fnmadd_ps(a2, y, _mm_mul_ps(b2, x));
+    _mm_store_sd((double*)(buffer + 2 * i), _mm_castps_pd(y));
+  }
+  float z[4];
+  _mm_storeu_ps(z, _mm_movelh_ps(z1, z2));
+  state[0] = z[0];
+  state[1] = z[1];
+  state[2] = z[2];
+  state[3] = z[3];
+}
+
+static float mcim_dot_avx2(const float* a, const float* b, uint32_t count) {
+  __m256 sum = _mm256_setzero_ps();
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+  }
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+  return _mm_cvtss_f32(h) + mcim_dot_generic(a + i, b + i, count - i);
+}
+
+// 8フレーム分の読み出し位置（整数部）と補間係数（小数部）を求める
+static inline __m256 mcim_positions_avx2(uint64_t position, uint64_t step, int32_t index[8]) {
+  int32_t low[8];
+  for (int k = 0; k < 8; k++) {
+    index[k] = (int32_t)(position >> 32);
+    low[k] = (int32_t)(uint32_t)position;
+    position += step;
+  }
+  const __m256i v = _mm256_srli_epi32(_mm256_loadu_si256((const __m256i*)low), 1);
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(1.0f / 2147483648.0f));
+}
+
+// L/R各8フレームをインターリーブして16サンプル分を書き出す
+static inline void mcim_store_interleaved_avx2(float* dst, __m256 left, __m256 right) {
+  const __m256 lo = _mm256_unpacklo_ps(left, right);
+  const __m256 hi = _mm256_unpackhi_ps(left, right);
+  _mm256_storeu_ps(dst, _mm256_permute2f128_ps(lo, hi, 0x20));
+  _mm256_storeu_ps(dst + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+
+static void mcim_resample_avx2(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames) {
+  uint32_t i = 0;
+  int32_t index[8];
+  for (; i + 8 <= frames; i += 8) {
+    const __m256 frac = mcim_positions_avx2(position, step, index);
+    const __m256i idx = _mm256_loadu_si256((const __m256i*)index);
+    if (channels == 2) {
+      const __m256i base = _mm256_slli_epi32(idx, 1);
+      const __m256 l0 = _mm256_i32gather_ps(src, base, 4);
+      const __m256 r0 = _mm256_i32gather_ps(src + 1, base, 4);
+      const __m256 l1 = _mm256_i32gather_ps(src + 2, base, 4);
+      const __m256 r1 = _mm256_i32gather_ps(src + 3, base, 4);
+      mcim_store_interleaved_avx2(dst + 2 * i, _mm256_fmadd_ps(_mm256_sub_ps(l1, l0), frac, l0), _mm256_fmadd_ps(_mm256_sub_ps(r1, r0), frac, r0));
+    } else {
+      const __m256 v0 = _mm256_i32gather_ps(src, idx, 4);
+      const __m256 v1 = _mm256_i32gather_ps(src + 1, idx, 4);
+      const __m256 v = _mm256_fmadd_ps(_mm256_sub_ps(v1, v0), frac, v0);
+      mcim_store_interleaved_avx2(dst + 2 * i, v, v);
+    }
+    position += step * 8;
+  }
+  mcim_resample_generic(dst + 2 * i, src, channels, position, step, frames - i);
+}
+
+static void mcim_float_to_s16_avx2(int16_t* restrict dst, const float* restrict src, uint32_t count) {
+  const __m256 scale = _mm256_set1_ps(32768.0f);
+  const __m256 maxValue = _mm256_set1_ps(32767.0f);
+  const __m256 minValue = _mm256_set1_ps(-32768.0f);
+  uint32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), minValue), maxValue);
+    const __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale), minValue), maxValue);
+    // packsは128bitレーン単位で詰めるため、並びを戻す
+    const __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+  mcim_float_to_s16_generic(dst + i, src + i, count - i);
+}
+
+static void mcim_s16_to_float_avx2(float* restrict dst, const int16_t* restrict src, uint32_t count) {
+  const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  mcim_s16_to_float_generic(dst + i, src + i, count - i);
+}
+
+// 各ブロックの前半と後半を8点ずつ処理し、halfが8未満の初段は汎用実装に任せる
+static void mcim_fft_pass_avx2(float* restrict re,
+                               float* restrict im,
+                               const float* restrict twRe,
+                               const float* restrict twIm,
+                               uint32_t count,
+                               uint32_t half) {
+  if (half < 8) {
+    mcim_fft_pass_generic(re, im, twRe, twIm, count, half);
+    return;
+  }
+  for (uint32_t base = 0; base < count; base += 2 * half) {
+    float* restrict aRe = re + base;
+    float* restrict aIm = im + base;
+    float* restrict bRe = aRe + half;
+    float* restrict bIm = aIm + half;
+    for (uint32_t k = 0; k < half; k += 8) {
+      const __m256 wRe = _mm256_loadu_ps(twRe + k);
+      const __m256 wIm = _mm256_loadu_ps(twIm + k);
+      const __m256 xRe = _mm256_loadu_ps(bRe + k);
+      const __m256 xIm = _mm256_loadu_ps(bIm + k);
+      const __m256 tRe = _mm256_fmsub_ps(xRe, wRe, _mm256_mul_ps(xIm, wIm));
+      const __m256 tIm = _mm256_fmadd_ps(xRe, wIm, _mm256_mul_ps(xIm, wRe));
+      const __m256 yRe = _mm256_loadu_ps(aRe + k);
+      const __m256 yIm = _mm256_loadu_ps(aIm + k);
+      _mm256_storeu_ps(aRe + k, _mm256_add_ps(yRe, tRe));
+      _mm256_storeu_ps(aIm + k, _mm256_add_ps(yIm, tIm));
+      _mm256_storeu_ps(bRe + k, _mm256_sub_ps(yRe, tRe));
+      _mm256_storeu_ps(bIm + k, _mm256_sub_ps(yIm, tIm));
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,229 @@
+﻿#include "_MCIMKernels.h"
+
+#ifdef MCIM_KERNELS_X86
+
+#include <immintrin.h>
+
+static void mcim_mix_ramp_avx512(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep);
+static void mcim_mix_pan_avx512(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]);
+static void mcim_scale_ramp_avx512(float* buffer, uint32_t frames, float gain, float gainStep);
+static float mcim_peak_avx512(const float* src, uint32_t count);
+static void mcim_biquad_avx512(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]);
+static float mcim_dot_avx512(const float* a, const float* b, uint32_t count);
+static void mcim_resample_avx512(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames);
+static void mcim_float_to_s16_avx512(int16_t* restrict dst, const float* restrict src, uint32_t count);
+static void mcim_s16_to_float_avx512(float* restrict dst, const int16_t* restrict src, uint32_t count);
+static void mcim_fft_pass_avx512(float* restrict re,
+                                 float* restrict im,
+                                 const float* restrict twRe,
+                                 const float* restrict twIm,
+                                 uint32_t count,
+                                 uint32_t half);
+
+/**************************************************************************************************/
+
+const MCIM_KERNELS MCIM_KERNELS_AVX512 = {
+    .name = "avx512",
+    .mix_ramp = mcim_mix_ramp_avx512,
+    .mix_pan = mcim_mix_pan_avx512,
+    .scale_ramp = mcim_scale_ramp_avx512,
+    .peak = mcim_peak_avx512,
+    .biquad = mcim_biquad_avx512,
+    .dot = mcim_dot_avx512,
+    .resample = mcim_resample_avx512,
+    .float_to_s16 = mcim_float_to_s16_avx512,
+    .s16_to_float = mcim_s16_to_float_avx512,
+    .fft_pass = mcim_fft_pass_avx512,
+};
+
+/**************************************************************************************************/
+
+// 8フレーム（16サンプル）単位で処理する
+static void mcim_mix_ramp_avx512(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep) {
+  const __m512 offset = _mm512_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f, 4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f);
+  __m512 g = _mm512_fmadd_ps(_mm512_set1_ps(gainStep), offset, _mm512_set1_ps(gain));
+  const __m512 inc = _mm512_set1_ps(gainStep * 8.0f);
+  uint32_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    const __m512 s = _mm512_loadu_ps(src + 2 * i);
+    const __m512 d = _mm512_loadu_ps(dst + 2 * i);
+    _mm512_storeu_ps(dst + 2 * i, _mm512_fmadd_ps(s, g, d));
+    g = _mm512_add_ps(g, inc);
+  }
+  mcim_mix_ramp_generic(dst + 2 * i, src + 2 * i, frames - i, gain + gainStep * (float)i, gainStep);
+}
+
+static void mcim_mix_pan_avx512(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]) {
+  const __m512 offset = _mm512_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f, 4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f);
+  const __m512 step = _mm512_broadcast_f32x4(_mm_setr_ps(gainStep[0], gainStep[1], gainStep[0], gainStep[1]));
+  __m512 g = _mm512_fmadd_ps(step, offset, _mm512_broadcast_f32x4(_mm_setr_ps(gain[0], gain[1], gain[0], gain[1])));
+  const __m512 inc = _mm512_mul_ps(step, _mm512_set1_ps(8.0f));
+  uint32_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    const __m512 s = _mm512_loadu_ps(src + 2 * i);
+    const __m512 d = _mm512_loadu_ps(dst + 2 * i);
+    _mm512_storeu_ps(dst + 2 * i, _mm512_fmadd_ps(s, g, d));
+    g = _mm512_add_ps(g, inc);
+  }
+  const float rest[2] = {gain[0] + gainStep[0] * (float)i, gain[1] + gainStep[1] * (float)i};
+  mcim_mix_pan_generic(dst + 2 * i, src + 2 * i, frames - i, rest, gainStep);
+}
+
+static void mcim_scale_ramp_avx512(float* buffer, uint32_t frames, float gain, float gainStep) {
+  const __m512 offset = _mm512_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f, 4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f);
+  __m512 g = _mm512_fmadd_ps(_mm512_set1_ps(gainStep), offset, _mm512_set1_ps(gain));
+  const __m512 inc = _mm512_set1_ps(gainStep * 8.0f);
+  uint32_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    _mm512_storeu_ps(buffer + 2 * i, _mm512_mul_ps(_mm512_loadu_ps(buffer + 2 * i), g));
+    g = _mm512_add_ps(g, inc);
+  }
+  mcim_scale_ramp_generic(buffer + 2 * i, frames - i, gain + gainStep * (float)i, gainStep);
+}
+
+static float mcim_peak_avx512(const float* src, uint32_t count) {
+  __m512 m = _mm512_setzero_ps();
+  uint32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    m = _mm512_max_ps(m, _mm512_abs_ps(_mm512_loadu_ps(src + i)));
+  }
+  const float peak = _mm512_reduce_max_ps(m);
+  const float rest = mcim_peak_generic(src + i, count - i);
+  return (rest > peak ? rest : peak);
+}
+
+// 再帰のためフレーム方向には並列化できず、L/Rの2チャンネルを下位2レーンで同時に処理する
+static void mcim_biquad_avx512(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]) {
+  const __m128 b0 = _mm_set1_ps(coefs->b0);
+  const __m128 b1 = _mm_set1_ps(coefs->b1);
+  const __m128 b2 = _mm_set1_ps(coefs->b2);
+  const __m128 a1 = _mm_set1_ps(coefs->a1);
+  const __m128 a2 = _mm_set1_ps(coefs->a2);
+  __m128 z1 = _mm_setr_ps(state[0], state[1], 0.0f, 0.0f);
+  __m128 z2 = _mm_setr_ps(state[2], state[3], 0.0f, 0.0f);
+  for (uint32_t i = 0; i < frames; i++) {
+    const __m128 x = _mm_castpd_ps(_mm_load_sd((const double*)(buffer + 2 * i)));
+    const __m128 y = _mm_fmadd_ps(b0, x, z1);
+    z1 = _mm_fnmadd_ps(a1, y, _mm_fmadd_ps(b1, x, z2));
+    z2 = _mm_fnmadd_ps(a2, y, _mm_mul_ps(b2, x));
+    _mm_store_sd((double*)(buffer + 2 * i), _mm_castps_pd(y));
+  }
+  float z[4];
+  _mm_storeu_ps(z, _mm_movelh_ps(z1, z2));
+  state[0] = z[0];
+  state[1] = z[1];
+  state[2] = z[2];
+  state[3] = z[3];
+}
+
+static float mcim_dot_avx512(const float* a, const float* b, uint32_t count) {
+  __m512 sum = _mm512_setzero_ps();
+  uint32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    sum = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum);
+  }
+  return _mm512_reduce_add_ps(sum) + mcim_dot_generic(a + i, b + i, count - i);
+}
+
+// 16フレーム分の読み出し位置（整数部）と補間係数（小数部）を求める
+static inline __m512 mcim_positions_avx512(uint64_t position, uint64_t step, int32_t index[16]) {
+  uint32_t low[16];
+  for (int k = 0; k < 16; k++) {
+    index[k] = (int32_t)(position >> 32);
+    low[k] = (uint32_t)position;
+    position += step;
+  }
+  const __m512 v = _mm512_cvtepu32_ps(_mm512_loadu_si512(low));
+  return _mm512_mul_ps(v, _mm512_set1_ps(1.0f / 4294967296.0f));
+}
+
+// L/R各16フレームをインターリーブして32サンプル分を書き出す
+static inline void mcim_store_interleaved_avx512(float* dst, __m512 left, __m512 right) {
+  const __m512 lo = _mm512_unpacklo_ps(left, right);
+  const __m512 hi = _mm512_unpackhi_ps(left, right);
+  const __m512 first = _mm512_shuffle_f32x4(lo, hi, _MM_SHUFFLE(1, 0, 1, 0));
+  const __m512 second = _mm512_shuffle_f32x4(lo, hi, _MM_SHUFFLE(3, 2, 3, 2));
+  _mm512_storeu_ps(dst, _mm512_shuffle_f32x4(first, first, _MM_SHUFFLE(3, 1, 2, 0)));
+  _mm512_storeu_ps(dst + 16, _mm512_shuffle_f32x4(second, second, _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+static void mcim_resample_avx512(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames) {
+  uint32_t i = 0;
+  int32_t index[16];
+  for (; i + 16 <= frames; i += 16) {
+    const __m512 frac = mcim_positions_avx512(position, step, index);
+    const __m512i idx = _mm512_loadu_si512(index);
+    if (channels == 2) {
+      const __m512i base = _mm512_slli_epi32(idx, 1);
+      const __m512 l0 = _mm512_i32gather_ps(base, src, 4);
+      const __m512 r0 = _mm512_i32gather_ps(base, src + 1, 4);
+      const __m512 l1 = _mm512_i32gather_ps(base, src + 2, 4);
+      const __m512 r1 = _mm512_i32gather_ps(base, src + 3, 4);
+      mcim_store_interleaved_avx512(dst + 2 * i, _mm512_fmadd_ps(_mm512_sub_ps(l1, l0), frac, l0), _mm512_fmadd_ps(_mm512_sub_ps(r1, r0), frac, r0));
+    } else {
+      const __m512 v0 = _mm512_i32gather_ps(idx, src, 4);
+      const __m512 v1 = _mm512_i32gather_ps(idx, src + 1, 4);
+      const __m512 v = _mm512_fmadd_ps(_mm512_sub_ps(v1, v0), frac, v0);
+      mcim_store_interleaved_avx512(dst + 2 * i, v, v);
+    }
+    position += step * 16;
+  }
+  mcim_resample_generic(dst + 2 * i, src, channels, position, step, frames - i);
+}
+
+static void mcim_float_to_s16_avx512(int16_t* restrict dst, const float* restrict src, uint32_t count) {
+  const __m512 scale = _mm512_set1_ps(32768.0f);
+  const __m512 maxValue = _mm512_set1_ps(32767.0f);
+  const __m512 minValue = _mm512_set1_ps(-32768.0f);
+  uint32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(src + i), scale), minValue), maxValue);
+    _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(v)));
+  }
+  mcim_float_to_s16_generic(dst + i, src + i, count - i);
+}
+
+static void mcim_s16_to_float_avx512(float* restrict dst, const int16_t* restrict src, uint32_t count) {
+  const __m512 scale = _mm512_set1_ps(1.0f / 32768.0f);
+  uint32_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m512i v = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(src + i)));
+    _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+  }
+  mcim_s16_to_float_generic(dst + i, src + i, count - i);
+}
+
+// 各ブロックの前半と後半を16点ずつ処理し、halfが16未満の段は汎用実装に任せる
+static void mcim_fft_pass_avx512(float* restrict re,
+                                 float* restrict im,
+                                 const float* restrict twRe,
+                                 const float* restrict twIm,
+                                 uint32_t count,
+                                 uint32_t half) {
+  if (half < 16) {
+    mcim_fft_pass_generic(re, im, twRe, twIm, count, half);
+    return;
+  }
+  for (uint32_t base = 0; base < count; base += 2 * half) {
+    float* restrict aRe = re + base;
+    float* restrict aIm = im + base;
+    float* restrict bRe = aRe + half;
+    float* restrict bIm = aIm + half;
+    for (uint32_t k = 0; k < half; k += 16) {
+      const __m512 wRe = _mm512_loadu_ps(twRe + k);
+      const __m512 wIm = _mm512_loadu_ps(twIm + k);
+      const __m512 xRe = _mm512_loadu_ps(bRe + k);
+      const __m512 xIm = _mm512_loadu_ps(bIm + k);
+      const __m512 tRe = _mm512_fmsub_ps(xRe, wRe, _mm512_mul_ps(xIm, wIm));
+      const __m512 tIm = _mm512_fmadd_ps(xRe, wIm, _mm512_mul_ps(xIm, wRe));
+      const __m512 yRe = _mm512_loadu_ps(aRe + k);
+      const __m512 yIm = _mm512_loadu_ps(aIm + k);
+      _mm512_storeu_ps(aRe + k, _mm512_add_ps(yRe, tRe));
+      _mm512_storeu_ps(aIm + k, _mm512_add_ps(yIm, tIm));
+      _mm512_storeu_ps(bRe + k, _mm512_sub_ps(yRe, tRe));
+      _mm512_storeu_ps(bIm + k, _mm512_sub_ps(yIm, tIm));
+    }
+  }
+}
+
+#endif
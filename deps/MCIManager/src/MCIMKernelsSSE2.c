@@ -0,0 +1,233 @@
+﻿#include "_MCIMKernels.h"
+
+#ifdef MCIM_KERNELS_X86
+
+#include <emmintrin.h>
+
+static void mcim_mix_ramp_sse2(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep);
+static void mcim_mix_pan_sse2(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]);
+static void mcim_scale_ramp_sse2(float* buffer, uint32_t frames, float gain, float gainStep);
+static float mcim_peak_sse2(const float* src, uint32_t count);
+static void mcim_biquad_sse2(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]);
+static float mcim_dot_sse2(const float* a, const float* b, uint32_t count);
+static void mcim_resample_sse2(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames);
+static void mcim_float_to_s16_sse2(int16_t* restrict dst, const float* restrict src, uint32_t count);
+static void mcim_s16_to_float_sse2(float* restrict dst, const int16_t* restrict src, uint32_t count);
+static void mcim_fft_pass_sse2(float* restrict re,
+                               float* restrict im,
+                               const float* restrict twRe,
+                               const float* restrict twIm,
+                               uint32_t count,
+                               uint32_t half);
+
+/**************************************************************************************************/
+
+const MCIM_KERNELS MCIM_KERNELS_SSE2 = {
+    .name = "sse2",
+    .mix_ramp = mcim_mix_ramp_sse2,
+    .mix_pan = mcim_mix_pan_sse2,
+    .scale_ramp = mcim_scale_ramp_sse2,
+    .peak = mcim_peak_sse2,
+    .biquad = mcim_biquad_sse2,
+    .dot = mcim_dot_sse2,
+    .resample = mcim_resample_sse2,
+    .float_to_s16 = mcim_float_to_s16_sse2,
+    .s16_to_float = mcim_s16_to_float_sse2,
+    .fft_pass = mcim_fft_pass_sse2,
+};
+
+/**************************************************************************************************/
+
+// 2フレーム（4サンプル）単位で処理する
+static void mcim_mix_ramp_sse2(float* restrict dst, const float* restrict src, uint32_t frames, float gain, float gainStep) {
+  __m128 g = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set1_ps(gainStep), _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f)));
+  const __m128 inc = _mm_set1_ps(gainStep * 2.0f);
+  uint32_t i = 0;
+  for (; i + 2 <= frames; i += 2) {
+    const __m128 s = _mm_loadu_ps(src + 2 * i);
+    const __m128 d = _mm_loadu_ps(dst + 2 * i);
+    _mm_storeu_ps(dst + 2 * i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+    g = _mm_add_ps(g, inc);
+  }
+  mcim_mix_ramp_generic(dst + 2 * i, src + 2 * i, frames - i, gain + gainStep * (float)i, gainStep);
+}
+
+static void mcim_mix_pan_sse2(float* restrict dst, const float* restrict src, uint32_t frames, const float gain[2], const float gainStep[2]) {
+  const __m128 step = _mm_setr_ps(gainStep[0], gainStep[1], gainStep[0], gainStep[1]);
+  __m128 g = _mm_add_ps(_mm_setr_ps(gain[0], gain[1], gain[0], gain[1]), _mm_mul_ps(step, _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f)));
+  const __m128 inc = _mm_add_ps(step, step);
+  uint32_t i = 0;
+  for (; i + 2 <= frames; i += 2) {
+    const __m128 s = _mm_loadu_ps(src + 2 * i);
+    const __m128 d = _mm_loadu_ps(dst + 2 * i);
+    _mm_storeu_ps(dst + 2 * i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+    g = _mm_add_ps(g, inc);
+  }
+  const float rest[2] = {gain[0] + gainStep[0] * (float)i, gain[1] + gainStep[1] * (float)i};
+  mcim_mix_pan_generic(dst + 2 * i, src + 2 * i, frames - i, rest, gainStep);
+}
+
+static void mcim_scale_ramp_sse2(float* buffer, uint32_t frames, float gain, float gainStep) {
+  __m128 g = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set1_ps(gainStep), _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f)));
+  const __m128 inc = _mm_set1_ps(gainStep * 2.0f);
+  uint32_t i = 0;
+  for (; i + 2 <= frames; i += 2) {
+    _mm_storeu_ps(buffer + 2 * i, _mm_mul_ps(_mm_loadu_ps(buffer + 2 * i), g));
+    g = _mm_add_ps(g, inc);
+  }
+  mcim_scale_ramp_generic(buffer + 2 * i, frames - i, gain + gainStep * (float)i, gainStep);
+}
+
+// 符号ビットを落として絶対値とし、4レーンの最大値を最後にまとめる
+static float mcim_peak_sse2(const float* src, uint32_t count) {
+  const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 m = _mm_setzero_ps();
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(src + i), mask));
+  }
+  m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+  m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+  const float peak = _mm_cvtss_f32(m);
+  const float rest = mcim_peak_generic(src + i, count - i);
+  return (rest > peak ? rest : peak);
+}
+
+// 再帰のためフレーム方向には並列化できず、L/Rの2チャンネルを下位2レーンで同時に処理する
+static void mcim_biquad_sse2(float* buffer, uint32_t frames, const MCIM_BIQUAD_COEFS* coefs, float state[4]) {
+  const __m128 b0 = _mm_set1_ps(coefs->b0);
+  const __m128 b1 = _mm_set1_ps(coefs->b1);
+  const __m128 b2 = _mm_set1_ps(coefs->b2);
+  const __m128 a1 = _mm_set1_ps(coefs->a1);
+  const __m128 a2 = _mm_set1_ps(coefs->a2);
+  __m128 z1 = _mm_setr_ps(state[0], state[1], 0.0f, 0.0f);
+  __m128 z2 = _mm_setr_ps(state[2], state[3], 0.0f, 0.0f);
+  for (uint32_t i = 0; i < frames; i++) {
+    const __m128 x = _mm_castpd_ps(_mm_load_sd((const double*)(buffer + 2 * i)));
+    const __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+    z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+    z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+    _mm_store_sd((double*)(buffer + 2 * i), _mm_castps_pd(y));
+  }
+  float z[4];
+  _mm_storeu_ps(z, _mm_movelh_ps(z1, z2));
+  state[0] = z[0];
+  state[1] = z[1];
+  state[2] = z[2];
+  state[3] = z[3];
+}
+
+static float mcim_dot_sse2(const float* a, const float* b, uint32_t count) {
+  __m128 sum = _mm_setzero_ps();
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  }
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum) + mcim_dot_generic(a + i, b + i, count - i);
+}
+
+// SSE2には符号なし変換が無いため、位置の小数部を1bit落としてから変換する（floatの精度には影響しない）
+static inline __m128 mcim_frac_sse2(__m128i low) {
+  return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(low, 1)), _mm_set1_ps(1.0f / 2147483648.0f));
+}
+
+static void mcim_resample_sse2(float* restrict dst, const float* restrict src, uint16_t channels, uint64_t position, uint64_t step, uint32_t frames) {
+  uint32_t i = 0;
+  if (channels == 2) {
+    // 1フレーム目のL/Rと次フレームのL/Rを1回のロードで取り出し、2フレーム分をまとめて補間する
+    for (; i + 2 <= frames; i += 2) {
+      const uint64_t p0 = position;
+      const uint64_t p1 = position + step;
+      const __m128 a = _mm_loadu_ps(src + 2 * (size_t)(p0 >> 32));
+      const __m128 b = _mm_loadu_ps(src + 2 * (size_t)(p1 >> 32));
+      const __m128 lo = _mm_movelh_ps(a, b);
+      const __m128 hi = _mm_movehl_ps(b, a);
+      const __m128 frac = mcim_frac_sse2(_mm_setr_epi32((int)(uint32_t)p0, (int)(uint32_t)p0, (int)(uint32_t)p1, (int)(uint32_t)p1));
+      _mm_storeu_ps(dst + 2 * i, _mm_add_ps(lo, _mm_mul_ps(_mm_sub_ps(hi, lo), frac)));
+      position += step * 2;
+    }
+  } else {
+    for (; i + 4 <= frames; i += 4) {
+      const uint64_t p0 = position;
+      const uint64_t p1 = p0 + step;
+      const uint64_t p2 = p1 + step;
+      const uint64_t p3 = p2 + step;
+      const float* s0 = src + (size_t)(p0 >> 32);
+      const float* s1 = src + (size_t)(p1 >> 32);
+      const float* s2 = src + (size_t)(p2 >> 32);
+      const float* s3 = src + (size_t)(p3 >> 32);
+      const __m128 lo = _mm_setr_ps(s0[0], s1[0], s2[0], s3[0]);
+      const __m128 hi = _mm_setr_ps(s0[1], s1[1], s2[1], s3[1]);
+      const __m128 frac = mcim_frac_sse2(_mm_setr_epi32((int)(uint32_t)p0, (int)(uint32_t)p1, (int)(uint32_t)p2, (int)(uint32_t)p3));
+      const __m128 v = _mm_add_ps(lo, _mm_mul_ps(_mm_sub_ps(hi, lo), frac));
+      _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(v, v));
+      _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(v, v));
+      position = p3 + step;
+    }
+  }
+  mcim_resample_generic(dst + 2 * i, src, channels, position, step, frames - i);
+}
+
+static void mcim_float_to_s16_sse2(int16_t* restrict dst, const float* restrict src, uint32_t count) {
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  const __m128 maxValue = _mm_set1_ps(32767.0f);
+  const __m128 minValue = _mm_set1_ps(-32768.0f);
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    // 変換前にクランプしておかないと範囲外の値が0x80000000になり符号が反転する
+    const __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), minValue), maxValue);
+    const __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), minValue), maxValue);
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+  }
+  mcim_float_to_s16_generic(dst + i, src + i, count - i);
+}
+
+static void mcim_s16_to_float_sse2(float* restrict dst, const int16_t* restrict src, uint32_t count) {
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+    const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  mcim_s16_to_float_generic(dst + i, src + i, count - i);
+}
+
+// 各ブロックの前半と後半を4点ずつ処理し、halfが4未満の初段は汎用実装に任せる
+static void mcim_fft_pass_sse2(float* restrict re,
+                               float* restrict im,
+                               const float* restrict twRe,
+                               const float* restrict twIm,
+                               uint32_t count,
+                               uint32_t half) {
+  if (half < 4) {
+    mcim_fft_pass_generic(re, im, twRe, twIm, count, half);
+    return;
+  }
+  for (uint32_t base = 0; base < count; base += 2 * half) {
+    float* restrict aRe = re + base;
+    float* restrict aIm = im + base;
+    float* restrict bRe = aRe + half;
+    float* restrict bIm = aIm + half;
+    for (uint32_t k = 0; k < half; k += 4) {
+      const __m128 wRe = _mm_loadu_ps(twRe + k);
+      const __m128 wIm = _mm_loadu_ps(twIm + k);
+      const __m128 xRe = _mm_loadu_ps(bRe + k);
+      const __m128 xIm = _mm_loadu_ps(bIm + k);
+      const __m128 tRe = _mm_sub_ps(_mm_mul_ps(xRe, wRe), _mm_mul_ps(xIm, wIm));
+      const __m128 tIm = _mm_add_ps(_mm_mul_ps(xRe, wIm), _mm_mul_ps(xIm, wRe));
+      const __m128 yRe = _mm_loadu_ps(aRe + k);
+      const __m128 yIm = _mm_loadu_ps(aIm + k);
+      _mm_storeu_ps(aRe + k, _mm_add_ps(yRe, tRe));
+      _mm_storeu_ps(aIm + k, _mm_add_ps(yIm, tIm));
+      _mm_storeu_ps(bRe + k, _mm_sub_ps(yRe, tRe));
+      _mm_storeu_ps(bIm + k, _mm_sub_ps(yIm, tIm));
+    }
+  }
+}
+
+#endif
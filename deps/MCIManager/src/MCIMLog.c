@@ -0,0 +1,248 @@
+﻿#include "_MCIMLog.h"
+
+#include <assert.h>
+#include <process.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+// リングバッファの容量（2の冪）
+#define MCIM_LOG_CAPACITY 2048
+
+// 出力用のスレッドがリングバッファを確認する間隔（ミリ秒）
+#define MCIM_LOG_FLUSH_INTERVAL 50
+
+// 整形したログを書き込む単位（バイト）
+#define MCIM_LOG_BUFFER_SIZE 8192
+#define MCIM_LOG_LINE_SIZE 256
+
+typedef struct _MCIM_LOG_RECORD {
+  LONGLONG time;  // QueryPerformanceCounter
+  DWORD threadId;
+  MCIM_LOG_LEVEL level;
+  const char* event;
+  const char* keys[2];
+  int64_t values[2];
+} MCIM_LOG_RECORD;
+
+typedef struct _MCIM_LOG_SLOT {
+  _Atomic(uint32_t) sequence;  // 書き込み可能な位置、または書き込み済みの位置 + 1
+  MCIM_LOG_RECORD record;
+} MCIM_LOG_SLOT;
+
+// 書き込みは複数スレッドから、読み出しは出力用のスレッドのみから行う有界キュー
+static MCIM_LOG_SLOT MCIM_LOG_RING[MCIM_LOG_CAPACITY];
+static _Atomic(uint32_t) MCIM_LOG_WRITE_POSITION = 0;
+static uint32_t MCIM_LOG_READ_POSITION = 0;
+static atomic_flag MCIM_LOG_RING_INITIALIZED = ATOMIC_FLAG_INIT;
+
+static atomic_bool MCIM_LOG_ENABLED = false;
+static atomic_int MCIM_LOG_MIN_LEVEL = MCIM_LOG_INFO;
+static _Atomic(uint64_t) MCIM_LOG_DROPPED = 0;
+
+// 出力先の変更はmcim_log_set_outputのみが行う
+static SRWLOCK MCIM_LOG_OUTPUT_LOCK = SRWLOCK_INIT;
+static HANDLE MCIM_LOG_OUTPUT = NULL;
+static HANDLE MCIM_LOG_THREAD = NULL;
+static HANDLE MCIM_LOG_STOP_EVENT = NULL;
+static LARGE_INTEGER MCIM_LOG_TIME_BASE = {0};
+static LARGE_INTEGER MCIM_LOG_TIME_FREQ = {0};
+static uint64_t MCIM_LOG_REPORTED_DROPPED = 0;
+
+static void mcim_log_stop_thread(void);
+static unsigned __stdcall mcim_log_thread(void* pargs);
+static void mcim_log_flush(HANDLE output);
+static int mcim_log_format(const MCIM_LOG_RECORD* restrict record, char* restrict line, size_t size);
+static void mcim_log_output(HANDLE output, const char* buffer, size_t length);
+
+/**************************************************************************************************/
+
+bool mcim_log_set_output(HANDLE output, MCIM_LOG_LEVEL level) {
+  if (!atomic_flag_test_and_set(&MCIM_LOG_RING_INITIALIZED)) {
+    for (uint32_t i = 0; i < MCIM_LOG_CAPACITY; i++) {
+      atomic_init(&(MCIM_LOG_RING[i].sequence), i);
+    }
+  }
+
+  AcquireSRWLockExclusive(&MCIM_LOG_OUTPUT_LOCK);
+
+  // 変更前の出力先にそれまでのレコードを書き出してから切り替える
+  atomic_store(&MCIM_LOG_ENABLED, false);
+  mcim_log_stop_thread();
+  if (output == NULL || output == INVALID_HANDLE_VALUE) {
+    ReleaseSRWLockExclusive(&MCIM_LOG_OUTPUT_LOCK);
+    return (output == NULL);
+  }
+
+  MCIM_LOG_STOP_EVENT = CreateEventW(NULL, TRUE, FALSE, NULL);
+  if (MCIM_LOG_STOP_EVENT == NULL) {
+    ReleaseSRWLockExclusive(&MCIM_LOG_OUTPUT_LOCK);
+    return false;
+  }
+  MCIM_LOG_OUTPUT = output;
+  QueryPerformanceFrequency(&MCIM_LOG_TIME_FREQ);
+  QueryPerformanceCounter(&MCIM_LOG_TIME_BASE);
+  MCIM_LOG_THREAD = (HANDLE)_beginthreadex(NULL, 0, mcim_log_thread, output, 0, NULL);
+  if (MCIM_LOG_THREAD == (HANDLE)0) {
+    MCIM_LOG_THREAD = NULL;
+    MCIM_LOG_OUTPUT = NULL;
+    CloseHandle(MCIM_LOG_STOP_EVENT);
+    MCIM_LOG_STOP_EVENT = NULL;
+    ReleaseSRWLockExclusive(&MCIM_LOG_OUTPUT_LOCK);
+    return false;
+  }
+  atomic_store(&MCIM_LOG_MIN_LEVEL, (int)level);
+  atomic_store(&MCIM_LOG_ENABLED, true);
+
+  ReleaseSRWLockExclusive(&MCIM_LOG_OUTPUT_LOCK);
+  return true;
+}
+
+bool mcim_log_write(MCIM_LOG_LEVEL level, const char* event, const char* key0, int64_t value0, const char* key1, int64_t value1) {
+  if (!atomic_load_explicit(&MCIM_LOG_ENABLED, memory_order_relaxed) || (int)level < atomic_load_explicit(&MCIM_LOG_MIN_LEVEL, memory_order_relaxed)) {
+    return false;
+  }
+
+  // 位置をCASで確保し、確保したスロットのsequenceを更新して読み出し側に公開する
+  MCIM_LOG_SLOT* slot;
+  uint32_t position = atomic_load_explicit(&MCIM_LOG_WRITE_POSITION, memory_order_relaxed);
+  for (;;) {
+    slot = &(MCIM_LOG_RING[position & (MCIM_LOG_CAPACITY - 1)]);
+    const uint32_t sequence = atomic_load_explicit(&(slot->sequence), memory_order_acquire);
+    const int32_t diff = (int32_t)(sequence - position);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&MCIM_LOG_WRITE_POSITION, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // 満杯の場合は待機せずに破棄する
+      atomic_fetch_add_explicit(&MCIM_LOG_DROPPED, 1, memory_order_relaxed);
+      return false;
+    } else {
+      position = atomic_load_explicit(&MCIM_LOG_WRITE_POSITION, memory_order_relaxed);
+    }
+  }
+
+  MCIM_LOG_RECORD* record = &(slot->record);
+  QueryPerformanceCounter((LARGE_INTEGER*)&(record->time));
+  record->threadId = GetCurrentThreadId();
+  record->level = level;
+  record->event = (event != NULL ? event : "");
+  record->keys[0] = key0;
+  record->keys[1] = key1;
+  record->values[0] = value0;
+  record->values[1] = value1;
+  atomic_store_explicit(&(slot->sequence), position + 1, memory_order_release);
+  return true;
+}
+
+uint64_t mcim_log_get_dropped(void) {
+  return atomic_load(&MCIM_LOG_DROPPED);
+}
+
+/**************************************************************************************************/
+
+static void mcim_log_stop_thread(void) {
+  if (MCIM_LOG_THREAD == NULL) {
+    return;
+  }
+  SetEvent(MCIM_LOG_STOP_EVENT);
+  WaitForSingleObject(MCIM_LOG_THREAD, INFINITE);
+  CloseHandle(MCIM_LOG_THREAD);
+  CloseHandle(MCIM_LOG_STOP_EVENT);
+  MCIM_LOG_THREAD = NULL;
+  MCIM_LOG_STOP_EVENT = NULL;
+  MCIM_LOG_OUTPUT = NULL;
+}
+
+static unsigned __stdcall mcim_log_thread(void* pargs) {
+  HANDLE output = (HANDLE)pargs;
+
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+  // 書き込み側からは通知せず、一定間隔でリングバッファを確認する
+  while (WaitForSingleObject(MCIM_LOG_STOP_EVENT, MCIM_LOG_FLUSH_INTERVAL) == WAIT_TIMEOUT) {
+    mcim_log_flush(output);
+  }
+  mcim_log_flush(output);
+  return 0;
+}
+
+static void mcim_log_flush(HANDLE output) {
+  char buffer[MCIM_LOG_BUFFER_SIZE];
+  size_t length = 0;
+
+  for (;;) {
+    MCIM_LOG_SLOT* slot = &(MCIM_LOG_RING[MCIM_LOG_READ_POSITION & (MCIM_LOG_CAPACITY - 1)]);
+    const uint32_t sequence = atomic_load_explicit(&(slot->sequence), memory_order_acquire);
+    if ((int32_t)(sequence - (MCIM_LOG_READ_POSITION + 1)) < 0) {
+      break;
+    }
+    MCIM_LOG_RECORD record = slot->record;
+    atomic_store_explicit(&(slot->sequence), MCIM_LOG_READ_POSITION + MCIM_LOG_CAPACITY, memory_order_release);
+    MCIM_LOG_READ_POSITION++;
+
+    if (length + MCIM_LOG_LINE_SIZE > MCIM_LOG_BUFFER_SIZE) {
+      mcim_log_output(output, buffer, length);
+      length = 0;
+    }
+    length += (size_t)mcim_log_format(&record, buffer + length, MCIM_LOG_LINE_SIZE);
+  }
+
+  // 前回の書き出し以降に破棄されたレコードがあれば、その数を記録する
+  const uint64_t dropped = atomic_load(&MCIM_LOG_DROPPED);
+  if (dropped != MCIM_LOG_REPORTED_DROPPED) {
+    MCIM_LOG_RECORD record;
+    QueryPerformanceCounter((LARGE_INTEGER*)&(record.time));
+    record.threadId = GetCurrentThreadId();
+    record.level = MCIM_LOG_WARNING;
+    record.event = "mcim_log_dropped";
+    record.keys[0] = "count";
+    record.keys[1] = "total";
+    record.values[0] = (int64_t)(dropped - MCIM_LOG_REPORTED_DROPPED);
+    record.values[1] = (int64_t)dropped;
+    MCIM_LOG_REPORTED_DROPPED = dropped;
+
+    if (length + MCIM_LOG_LINE_SIZE > MCIM_LOG_BUFFER_SIZE) {
+      mcim_log_output(output, buffer, length);
+      length = 0;
+    }
+    length += (size_t)mcim_log_format(&record, buffer + length, MCIM_LOG_LINE_SIZE);
+  }
+
+  mcim_log_output(output, buffer, length);
+}
+
+static int mcim_log_format(const MCIM_LOG_RECORD* restrict record, char* restrict line, size_t size) {
+  assert(record != NULL);
+  assert(line != NULL);
+
+  static const char* const LEVELS[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+  const char* level = ((uint32_t)(record->level) < 4 ? LEVELS[record->level] : "?");
+  const double time = (double)(record->time - MCIM_LOG_TIME_BASE.QuadPart) / (double)MCIM_LOG_TIME_FREQ.QuadPart;
+
+  int length = snprintf(line, size, "%12.6f [%5lu] %-7s %s", time, (unsigned long)(record->threadId), level, record->event);
+  for (int i = 0; i < 2 && length >= 0 && (size_t)length < size; i++) {
+    if (record->keys[i] != NULL) {
+      length += snprintf(line + length, size - (size_t)length, " %s=%lld", record->keys[i], (long long)(record->values[i]));
+    }
+  }
+
+  // 切り詰めた場合も改行で終える
+  if (length < 0) {
+    return 0;
+  }
+  if ((size_t)length >= size - 1) {
+    length = (int)size - 2;
+  }
+  line[length++] = '\n';
+  line[length] = '\0';
+  return length;
+}
+
+static void mcim_log_output(HANDLE output, const char* buffer, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  DWORD written;
+  WriteFile(output, buffer, (DWORD)length, &written, NULL);
+}
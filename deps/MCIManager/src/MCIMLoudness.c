@@ -0,0 +1,448 @@
+﻿#include "_MCIMLoudness.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include "_MCIMCache.h"
+#include "_MCIMWave.h"
+#include "uthash.h"
+
+#define MCIM_LOUDNESS_PI 3.14159265358979323846
+
+// ITU-R BS.1770のゲート（-70 LUFSの絶対ゲートと、絶対ゲート通過分の平均から-10 LUの相対ゲート）
+#define MCIM_LOUDNESS_ABSOLUTE_GATE (-70.0)
+#define MCIM_LOUDNESS_RELATIVE_GATE (-10.0)
+
+typedef struct _MCIM_BIQUAD {
+  double b0, b1, b2;
+  double a1, a2;
+} MCIM_BIQUAD;
+
+typedef struct _MCIM_LOUDNESS_CACHE_ENTRY {
+  wchar_t* filepath;
+  uint64_t size;
+  uint64_t writeTime;
+  MCIM_LOUDNESS_RESULT result;
+  mcim_deallocator_t deallocator;
+  UT_hash_handle hh;
+} MCIM_LOUDNESS_CACHE_ENTRY;
+
+// 解析結果はファイル毎に全MCIMオブジェクトで共有し、最後の解析スレッドの破棄時に解放する
+static MCIM_LOUDNESS_CACHE_ENTRY* MCIM_LOUDNESS_CACHE = NULL;
+static SRWLOCK MCIM_LOUDNESS_CACHE_LOCK = SRWLOCK_INIT;
+static _Atomic(uint32_t) MCIM_ANALYZER_COUNT = 0;
+
+static MCIM_LOUDNESS_STATUS mcim_analyzer_run(MCIM_ANALYZER* restrict analyzer, const wchar_t* restrict filepath, MCIM_LOUDNESS_RESULT* restrict result);
+static bool mcim_analyzer_task(MCIM_WORKER_TASK* task);
+static bool mcim_loudness_measure(MCIM_ANALYZER* restrict analyzer, const wchar_t* restrict filepath, double* restrict integrated);
+static void mcim_loudness_k_weighting(uint32_t sampleRate, MCIM_BIQUAD* restrict shelf, MCIM_BIQUAD* restrict highpass);
+static bool mcim_loudness_cache_find(const wchar_t* restrict filepath, uint64_t size, uint64_t writeTime, MCIM_LOUDNESS_RESULT* restrict result);
+static void mcim_loudness_cache_store(const wchar_t* restrict filepath,
+                                      uint64_t size,
+                                      uint64_t writeTime,
+                                      const MCIM_LOUDNESS_RESULT* restrict result,
+                                      mcim_allocator_t allocator,
+                                      mcim_deallocator_t deallocator);
+static void mcim_loudness_cache_clear(void);
+
+static inline uint64_t mcim_loudness_filetime(const FILETIME* ft) {
+  return ((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+}
+
+static inline double mcim_loudness_biquad(const MCIM_BIQUAD* restrict filter, double* restrict state, double x) {
+  // 転置直接形II
+  const double y = filter->b0 * x + state[0];
+  state[0] = filter->b1 * x - filter->a1 * y + state[1];
+  state[1] = filter->b2 * x - filter->a2 * y;
+  return y;
+}
+
+/**************************************************************************************************/
+
+bool mcim_analyzer_init(MCIM_ANALYZER* analyzer, mcim_analyzer_done_t done, void* doneContext, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(analyzer != NULL);
+  assert(done != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  SecureZeroMemory(analyzer, sizeof(MCIM_ANALYZER));
+  analyzer->idleEvent = CreateEventW(NULL, TRUE, TRUE, NULL);
+  if (analyzer->idleEvent == NULL) {
+    return false;
+  }
+  analyzer->task.run = mcim_analyzer_task;
+  analyzer->scheduled = false;
+  atomic_init(&(analyzer->terminate), false);
+  InitializeCriticalSection(&(analyzer->mutex));
+  analyzer->done = done;
+  analyzer->doneContext = doneContext;
+  analyzer->allocator = allocator;
+  analyzer->deallocator = deallocator;
+  atomic_fetch_add(&MCIM_ANALYZER_COUNT, 1);
+  return true;
+}
+
+void mcim_analyzer_destroy(MCIM_ANALYZER* analyzer) {
+  assert(analyzer != NULL);
+
+  // 解析中のタスクはterminateを確認して結果を通知せずに終了する
+  atomic_store(&(analyzer->terminate), true);
+  mcim_worker_cancel(&(analyzer->task));
+  analyzer->scheduled = false;
+  CloseHandle(analyzer->idleEvent);
+  DeleteCriticalSection(&(analyzer->mutex));
+  SecureZeroMemory(&(analyzer->mutex), sizeof(CRITICAL_SECTION));
+  analyzer->head = NULL;
+  analyzer->tail = NULL;
+
+  if (atomic_fetch_sub(&MCIM_ANALYZER_COUNT, 1) == 1) {
+    mcim_loudness_cache_clear();
+  }
+}
+
+bool mcim_analyzer_request(MCIM_ANALYZER* restrict analyzer, MCIM_LOUDNESS_REQUEST* restrict request) {
+  assert(analyzer != NULL);
+  assert(request != NULL);
+  assert(request->filepath != NULL);
+
+  EnterCriticalSection(&(analyzer->mutex));
+  if (request->status == MCIM_LOUDNESS_PENDING) {
+    LeaveCriticalSection(&(analyzer->mutex));
+    return true;
+  }
+
+  // 解析器のタスクは要求が残っている間ワーカーに積まれたままとなるため、積まれていない時のみ積む
+  if (!analyzer->scheduled) {
+    if (!mcim_worker_post(&(analyzer->task))) {
+      request->status = MCIM_LOUDNESS_FAILED;
+      LeaveCriticalSection(&(analyzer->mutex));
+      return false;
+    }
+    analyzer->scheduled = true;
+  }
+
+  request->status = MCIM_LOUDNESS_PENDING;
+  request->next = NULL;
+  if (analyzer->tail != NULL) {
+    analyzer->tail->next = request;
+  } else {
+    analyzer->head = request;
+  }
+  analyzer->tail = request;
+  ResetEvent(analyzer->idleEvent);
+  LeaveCriticalSection(&(analyzer->mutex));
+  return true;
+}
+
+void mcim_analyzer_wait(MCIM_ANALYZER* analyzer) {
+  assert(analyzer != NULL);
+
+  WaitForSingleObject(analyzer->idleEvent, INFINITE);
+}
+
+void mcim_analyzer_lock(MCIM_ANALYZER* analyzer) {
+  assert(analyzer != NULL);
+
+  EnterCriticalSection(&(analyzer->mutex));
+}
+
+void mcim_analyzer_unlock(MCIM_ANALYZER* analyzer) {
+  assert(analyzer != NULL);
+
+  LeaveCriticalSection(&(analyzer->mutex));
+}
+
+/**************************************************************************************************/
+
+static MCIM_LOUDNESS_STATUS mcim_analyzer_run(MCIM_ANALYZER* restrict analyzer, const wchar_t* restrict filepath, MCIM_LOUDNESS_RESULT* restrict result) {
+  assert(analyzer != NULL);
+  assert(filepath != NULL);
+  assert(result != NULL);
+
+  SecureZeroMemory(result, sizeof(MCIM_LOUDNESS_RESULT));
+
+  // 同じパスでも内容が変わっている場合は再解析するため、サイズと更新日時もキャッシュのキーとする
+  MCIM_CACHE_STAMP stamp;
+  if (!mcim_cache_get_stamp(filepath, &stamp)) {
+    return MCIM_LOUDNESS_FAILED;
+  }
+  if (mcim_loudness_cache_find(filepath, stamp.size, stamp.writeTime, result)) {
+    result->cached = true;
+    return MCIM_LOUDNESS_ANALYZED;
+  }
+
+  // プロセス内に無ければディスクキャッシュを参照する
+  MCIM_CACHE_LOUDNESS stored;
+  if (mcim_cache_find_loudness(filepath, &stamp, &stored)) {
+    result->integrated = stored.integrated;
+    result->analysisTime = stored.analysisTime;
+    result->analysisCpuTime = stored.analysisCpuTime;
+    mcim_loudness_cache_store(filepath, stamp.size, stamp.writeTime, result, analyzer->allocator, analyzer->deallocator);
+    result->cached = true;
+    return MCIM_LOUDNESS_ANALYZED;
+  }
+
+  // 解析のコストとして、ファイルの読み込みを含む経過時間と解析スレッドのCPU時間を計測する
+  LARGE_INTEGER freq;
+  LARGE_INTEGER begin;
+  LARGE_INTEGER end;
+  FILETIME creationTime;
+  FILETIME exitTime;
+  FILETIME kernelBegin;
+  FILETIME userBegin;
+  FILETIME kernelEnd;
+  FILETIME userEnd;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&begin);
+  GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelBegin, &userBegin);
+
+  bool measured = mcim_loudness_measure(analyzer, filepath, &(result->integrated));
+
+  QueryPerformanceCounter(&end);
+  GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelEnd, &userEnd);
+  const uint64_t cpuTime = (mcim_loudness_filetime(&kernelEnd) - mcim_loudness_filetime(&kernelBegin)) +
+                           (mcim_loudness_filetime(&userEnd) - mcim_loudness_filetime(&userBegin));
+  result->analysisTime = (double)(end.QuadPart - begin.QuadPart) / (double)freq.QuadPart;
+  result->analysisCpuTime = (double)cpuTime * 1e-7;
+  if (!measured) {
+    return MCIM_LOUDNESS_FAILED;
+  }
+
+  mcim_loudness_cache_store(filepath, stamp.size, stamp.writeTime, result, analyzer->allocator, analyzer->deallocator);
+  stored.integrated = result->integrated;
+  stored.analysisTime = result->analysisTime;
+  stored.analysisCpuTime = result->analysisCpuTime;
+  mcim_cache_store_loudness(filepath, &stamp, &stored);
+  return MCIM_LOUDNESS_ANALYZED;
+}
+
+static bool mcim_analyzer_task(MCIM_WORKER_TASK* task) {
+  MCIM_ANALYZER* analyzer = (MCIM_ANALYZER*)task;
+
+  EnterCriticalSection(&(analyzer->mutex));
+  MCIM_LOUDNESS_REQUEST* request = analyzer->head;
+  if (request == NULL || atomic_load(&(analyzer->terminate))) {
+    analyzer->scheduled = false;
+    SetEvent(analyzer->idleEvent);
+    LeaveCriticalSection(&(analyzer->mutex));
+    return false;
+  }
+  analyzer->head = request->next;
+  if (analyzer->head == NULL) {
+    analyzer->tail = NULL;
+  }
+  request->next = NULL;
+  LeaveCriticalSection(&(analyzer->mutex));
+
+  MCIM_LOUDNESS_RESULT result;
+  MCIM_LOUDNESS_STATUS status = mcim_analyzer_run(analyzer, request->filepath, &result);
+  if (atomic_load(&(analyzer->terminate))) {
+    return false;
+  }
+
+  // 次の要求は積み直した後に処理し、他の解析器の要求を待たせないようにする
+  EnterCriticalSection(&(analyzer->mutex));
+  request->status = status;
+  request->result = result;
+  analyzer->done(analyzer->doneContext, request);
+  LeaveCriticalSection(&(analyzer->mutex));
+  return true;
+}
+
+static bool mcim_loudness_measure(MCIM_ANALYZER* restrict analyzer, const wchar_t* restrict filepath, double* restrict integrated) {
+  assert(analyzer != NULL);
+  assert(filepath != NULL);
+  assert(integrated != NULL);
+
+  // 再生用のPCMとは別にファイルを開き、常駐させずに先頭から順に読む
+  MCIM_PCM* pcm = mcim_wave_open(filepath, analyzer->allocator, analyzer->deallocator);
+  if (pcm == NULL) {
+    return false;
+  }
+
+  // 100ms毎の平均二乗値を求め、連続する4区間を75%重複する400msのゲーティングブロックとして扱う
+  const uint32_t segmentFrames = pcm->sampleRate / 10;
+  const uint32_t segmentCount = (segmentFrames > 0 ? pcm->frames / segmentFrames : 0);
+  if (segmentCount < 4) {
+    mcim_wave_free(pcm, analyzer->deallocator);
+    return false;
+  }
+  double* energy = (double*)analyzer->allocator(sizeof(double) * segmentCount);
+  if (energy == NULL) {
+    mcim_wave_free(pcm, analyzer->deallocator);
+    return false;
+  }
+
+  MCIM_BIQUAD shelf;
+  MCIM_BIQUAD highpass;
+  mcim_loudness_k_weighting(pcm->sampleRate, &shelf, &highpass);
+  double state[2][4] = {{0.0}};
+
+  const uint16_t channels = pcm->channels;
+  const uint32_t limit = segmentCount * segmentFrames;
+  uint32_t segment = 0;
+  uint32_t filled = 0;
+  double sum = 0.0;
+  uint32_t frame = 0;
+  bool canceled = false;
+  while (frame < limit) {
+    if (atomic_load(&(analyzer->terminate))) {
+      canceled = true;
+      break;
+    }
+
+    uint32_t start;
+    uint32_t end;
+    const float* span = mcim_wave_map(pcm, frame, &start, &end, true);
+    if (end > limit) {
+      end = limit;
+    }
+    for (; frame < end; frame++) {
+      const float* sample = span + (size_t)(frame - start) * channels;
+      for (uint16_t ch = 0; ch < channels; ch++) {
+        double y = mcim_loudness_biquad(&shelf, state[ch], sample[ch]);
+        y = mcim_loudness_biquad(&highpass, state[ch] + 2, y);
+        sum += y * y;
+      }
+      if (++filled == segmentFrames) {
+        energy[segment++] = sum / segmentFrames;
+        sum = 0.0;
+        filled = 0;
+      }
+    }
+  }
+  mcim_wave_free(pcm, analyzer->deallocator);
+  if (canceled) {
+    analyzer->deallocator(energy);
+    return false;
+  }
+
+  // チャンネルの重みはL/Rとも1.0であるため、ブロックの値は各チャンネルの平均二乗値の和となる
+  const double absoluteGate = pow(10.0, (MCIM_LOUDNESS_ABSOLUTE_GATE + 0.691) / 10.0);
+  double gatedSum = 0.0;
+  uint32_t gatedCount = 0;
+  for (uint32_t i = 3; i < segmentCount; i++) {
+    const double block = (energy[i - 3] + energy[i - 2] + energy[i - 1] + energy[i]) * 0.25;
+    if (block > absoluteGate) {
+      gatedSum += block;
+      gatedCount++;
+    }
+  }
+  if (gatedCount == 0) {
+    analyzer->deallocator(energy);
+    return false;
+  }
+
+  const double relativeGate = (gatedSum / gatedCount) * pow(10.0, MCIM_LOUDNESS_RELATIVE_GATE / 10.0);
+  gatedSum = 0.0;
+  gatedCount = 0;
+  for (uint32_t i = 3; i < segmentCount; i++) {
+    const double block = (energy[i - 3] + energy[i - 2] + energy[i - 1] + energy[i]) * 0.25;
+    if (block > absoluteGate && block > relativeGate) {
+      gatedSum += block;
+      gatedCount++;
+    }
+  }
+  analyzer->deallocator(energy);
+
+  assert(gatedCount > 0);
+  *integrated = -0.691 + 10.0 * log10(gatedSum / gatedCount);
+  return true;
+}
+
+static void mcim_loudness_k_weighting(uint32_t sampleRate, MCIM_BIQUAD* restrict shelf, MCIM_BIQUAD* restrict highpass) {
+  assert(sampleRate > 0);
+  assert(shelf != NULL);
+  assert(highpass != NULL);
+
+  // BS.1770の係数は48kHzでのみ規定されているため、そのアナログ原型から各サンプルレートの係数を求める
+  double f0 = 1681.974450955533;
+  double q = 0.7071752369554196;
+  double k = tan(MCIM_LOUDNESS_PI * f0 / sampleRate);
+  const double vh = pow(10.0, 3.999843853973347 / 20.0);
+  const double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  shelf->b0 = (vh + vb * k / q + k * k) / a0;
+  shelf->b1 = 2.0 * (k * k - vh) / a0;
+  shelf->b2 = (vh - vb * k / q + k * k) / a0;
+  shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+  shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = tan(MCIM_LOUDNESS_PI * f0 / sampleRate);
+  a0 = 1.0 + k / q + k * k;
+  highpass->b0 = 1.0;
+  highpass->b1 = -2.0;
+  highpass->b2 = 1.0;
+  highpass->a1 = 2.0 * (k * k - 1.0) / a0;
+  highpass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+static bool mcim_loudness_cache_find(const wchar_t* restrict filepath, uint64_t size, uint64_t writeTime, MCIM_LOUDNESS_RESULT* restrict result) {
+  assert(filepath != NULL);
+  assert(result != NULL);
+
+  AcquireSRWLockShared(&MCIM_LOUDNESS_CACHE_LOCK);
+  MCIM_LOUDNESS_CACHE_ENTRY* entry = NULL;
+  HASH_FIND(hh, MCIM_LOUDNESS_CACHE, filepath, sizeof(wchar_t) * wcslen(filepath), entry);
+  bool found = (entry != NULL && entry->size == size && entry->writeTime == writeTime);
+  if (found) {
+    *result = entry->result;
+  }
+  ReleaseSRWLockShared(&MCIM_LOUDNESS_CACHE_LOCK);
+  return found;
+}
+
+static void mcim_loudness_cache_store(const wchar_t* restrict filepath,
+                                      uint64_t size,
+                                      uint64_t writeTime,
+                                      const MCIM_LOUDNESS_RESULT* restrict result,
+                                      mcim_allocator_t allocator,
+                                      mcim_deallocator_t deallocator) {
+  assert(filepath != NULL);
+  assert(result != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  const size_t pathlen = wcslen(filepath);
+  AcquireSRWLockExclusive(&MCIM_LOUDNESS_CACHE_LOCK);
+  MCIM_LOUDNESS_CACHE_ENTRY* entry = NULL;
+  HASH_FIND(hh, MCIM_LOUDNESS_CACHE, filepath, sizeof(wchar_t) * pathlen, entry);
+  if (entry == NULL) {
+    entry = (MCIM_LOUDNESS_CACHE_ENTRY*)allocator(sizeof(MCIM_LOUDNESS_CACHE_ENTRY));
+    wchar_t* path = (wchar_t*)allocator(sizeof(wchar_t) * (pathlen + 1));
+    if (entry == NULL || path == NULL || wcscpy_s(path, pathlen + 1, filepath) != 0) {
+      if (entry != NULL) {
+        deallocator(entry);
+      }
+      if (path != NULL) {
+        deallocator(path);
+      }
+      ReleaseSRWLockExclusive(&MCIM_LOUDNESS_CACHE_LOCK);
+      return;
+    }
+    SecureZeroMemory(entry, sizeof(MCIM_LOUDNESS_CACHE_ENTRY));
+    entry->filepath = path;
+    entry->deallocator = deallocator;
+    HASH_ADD_KEYPTR(hh, MCIM_LOUDNESS_CACHE, entry->filepath, sizeof(wchar_t) * pathlen, entry);
+  }
+  entry->size = size;
+  entry->writeTime = writeTime;
+  entry->result = *result;
+  entry->result.cached = false;
+  ReleaseSRWLockExclusive(&MCIM_LOUDNESS_CACHE_LOCK);
+}
+
+static void mcim_loudness_cache_clear(void) {
+  AcquireSRWLockExclusive(&MCIM_LOUDNESS_CACHE_LOCK);
+  MCIM_LOUDNESS_CACHE_ENTRY* entry;
+  MCIM_LOUDNESS_CACHE_ENTRY* temp;
+  HASH_ITER(hh, MCIM_LOUDNESS_CACHE, entry, temp) {
+    HASH_DEL(MCIM_LOUDNESS_CACHE, entry);
+    mcim_deallocator_t deallocator = entry->deallocator;
+    deallocator(entry->filepath);
+    deallocator(entry);
+  }
+  ReleaseSRWLockExclusive(&MCIM_LOUDNESS_CACHE_LOCK);
+}
@@ -0,0 +1,1374 @@
+﻿#include "_MCIMMixer.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "_MCIMSfx.h"
+#include "_MCIMStats.h"
+
+// 時間伸縮の入力としてボイスのソースを読み出すための情報
+typedef struct _MCIM_MIXER_SOURCE {
+  const MCIM_KERNELS* kernels;
+  const MCIM_VOICE* voice;
+  bool wait;  // ストリーミング再生で読み込みの完了を待つか
+} MCIM_MIXER_SOURCE;
+
+// ブロック内の各段のジョブに渡す情報
+typedef struct _MCIM_MIXER_PASS {
+  MCIM_MIXER* mixer;
+  uint32_t frames;
+  uint32_t first;  // ミックスする段のバスのscheduleでの先頭
+} MCIM_MIXER_PASS;
+
+static void mcim_mixer_render_block(MCIM_MIXER* restrict mixer, float* restrict out, uint32_t frames);
+static void mcim_mixer_post(MCIM_MIXER* restrict mixer, const MCIM_MIXER_COMMAND* restrict command);
+static bool mcim_mixer_enqueue_command(MCIM_MIXER* restrict mixer, const MCIM_MIXER_COMMAND* restrict command);
+static void mcim_mixer_apply_commands(MCIM_MIXER* mixer);
+static void mcim_mixer_apply_command(MCIM_MIXER* restrict mixer, const MCIM_MIXER_COMMAND* restrict command);
+static void mcim_mixer_apply_rate(MCIM_MIXER* restrict mixer,
+                                  MCIM_VOICE* restrict voice,
+                                  float rate,
+                                  uint32_t glide,
+                                  MCIM_STRETCH* restrict stretch);
+static void mcim_mixer_apply_loop(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, uint32_t loopStart, uint32_t loopEnd);
+static void mcim_mixer_unlink_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus);
+static void mcim_mixer_enqueue_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice);
+static uint32_t mcim_mixer_split_voices(MCIM_MIXER* mixer);
+static void mcim_mixer_render_chunk(void* context, uint32_t job, uint32_t participant);
+static void mcim_mixer_mix_level(void* context, uint32_t job, uint32_t participant);
+static void mcim_mixer_mix_bus(MCIM_MIXER* mixer, MCIM_MIXER_BUS* bus, uint32_t frames);
+static void mcim_mixer_update_schedule(MCIM_MIXER* mixer);
+static void mcim_mixer_analyze_tap(void* context, uint32_t job, uint32_t participant);
+static bool mcim_mixer_render_voice(MCIM_MIXER* restrict mixer,
+                                    MCIM_VOICE* restrict voice,
+                                    float* restrict scratch,
+                                    float* restrict out,
+                                    uint32_t frames);
+static void mcim_mixer_publish_voice(MCIM_VOICE* voice, uint64_t startFrame, uint64_t endFrame, uint64_t startPosition);
+static void mcim_mixer_duck(MCIM_MIXER* mixer, uint32_t frames);
+static uint64_t mcim_mixer_voice_step(const MCIM_VOICE* voice);
+static uint64_t mcim_mixer_wrap(const MCIM_VOICE* voice, uint64_t position);
+static uint32_t mcim_mixer_read_source(void* context, uint64_t position, float* dst, uint32_t frames);
+static uint32_t mcim_mixer_resample(const MCIM_KERNELS* restrict kernels,
+                                    const MCIM_VOICE* restrict voice,
+                                    uint64_t* restrict pposition,
+                                    uint64_t step,
+                                    float* restrict dst,
+                                    uint32_t frames,
+                                    bool wait);
+
+/**************************************************************************************************/
+
+void mcim_mixer_init(MCIM_MIXER* mixer, uint32_t sampleRate, mcim_mixer_notify_t notify, void* notifyContext) {
+  assert(mixer != NULL);
+  assert(sampleRate > 0);
+
+  mixer->sampleRate = sampleRate;
+  mixer->kernels = mcim_select_kernels();
+  mixer->voices = NULL;
+  mixer->sfx = NULL;
+  mixer->notify = notify;
+  mixer->notifyContext = notifyContext;
+  mixer->renderedFrames = 0;
+  mixer->latencyPending = false;
+  atomic_init(&(mixer->clock.sequence), 0);
+  atomic_init(&(mixer->clock.frame), 0);
+  atomic_init(&(mixer->clock.time), 0);
+  atomic_init(&(mixer->clock.limit), 0);
+  QueryPerformanceFrequency(&(mixer->clockFreq));
+  SecureZeroMemory(&(mixer->ducker), sizeof(MCIM_DUCKER));
+  mixer->ducker.gain = 1.0f;
+  mixer->ducker.from = 1.0f;
+  SecureZeroMemory(&(mixer->master), sizeof(MCIM_MIXER_BUS));
+  mixer->master.key = MCIM_MASTER_KEY;
+  mixer->master.gain = 1.0f;
+  mixer->master.targetGain = 1.0f;
+  mixer->registryCount = 0;
+  mixer->busCount = 0;
+  mixer->tapCount = 0;
+  mixer->streamWait = false;
+  mixer->jobs = NULL;
+  mixer->workspace = NULL;
+  for (uint32_t i = 0; i < MCIM_MIXER_COMMAND_QUEUE_SIZE; i++) {
+    atomic_init(&(mixer->commands[i].sequence), i);
+  }
+  atomic_init(&(mixer->commandEnqueuePos), 0);
+  mixer->commandDequeuePos = 0;
+  InitializeCriticalSectionAndSpinCount(&(mixer->mutex), 0x400);
+}
+
+bool mcim_mixer_prepare(MCIM_MIXER* mixer, mcim_allocator_t allocator) {
+  assert(mixer != NULL);
+  assert(allocator != NULL);
+
+  if (mixer->workspace != NULL) {
+    return true;
+  }
+
+  MCIM_MIXER_WORKSPACE* workspace = (MCIM_MIXER_WORKSPACE*)allocator(sizeof(MCIM_MIXER_WORKSPACE));
+  if (workspace == NULL) {
+    return false;
+  }
+  SecureZeroMemory(workspace, sizeof(MCIM_MIXER_WORKSPACE));
+
+  EnterCriticalSection(&(mixer->mutex));
+  mixer->workspace = workspace;
+  LeaveCriticalSection(&(mixer->mutex));
+  return true;
+}
+
+void mcim_mixer_destroy(MCIM_MIXER* mixer, mcim_deallocator_t deallocator) {
+  assert(mixer != NULL);
+  assert(deallocator != NULL);
+
+  mcim_jobs_destroy(mixer->jobs, deallocator);
+  mixer->jobs = NULL;
+  if (mixer->workspace != NULL) {
+    deallocator(mixer->workspace);
+    mixer->workspace = NULL;
+  }
+  mixer->voices = NULL;
+  mixer->registryCount = 0;
+  mixer->busCount = 0;
+  mixer->tapCount = 0;
+  DeleteCriticalSection(&(mixer->mutex));
+  SecureZeroMemory(&(mixer->mutex), sizeof(CRITICAL_SECTION));
+}
+
+MCIM_JOBS* mcim_mixer_set_jobs(MCIM_MIXER* restrict mixer, MCIM_JOBS* restrict jobs) {
+  assert(mixer != NULL);
+
+  EnterCriticalSection(&(mixer->mutex));
+  MCIM_JOBS* old = mixer->jobs;
+  mixer->jobs = jobs;
+  LeaveCriticalSection(&(mixer->mutex));
+  return old;
+}
+
+bool mcim_mixer_add_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, MCIM_KEY key, MCIM_MIXER_BUS* restrict parent) {
+  assert(mixer != NULL);
+  assert(bus != NULL);
+  assert(parent != NULL);
+
+  if (mixer->registryCount >= MCIM_MIXER_MAX_BUSES) {
+    return false;
+  }
+
+  // レンダリングスレッドは追加の要求を反映するまでbusを参照しないため、初期化はロック外で行える
+  SecureZeroMemory(bus, sizeof(MCIM_MIXER_BUS));
+  bus->key = key;
+  bus->route = (parent != &(mixer->master) ? parent : NULL);
+  bus->parent = parent;
+  bus->gain = 1.0f;
+  bus->targetGain = 1.0f;
+  mixer->registry[mixer->registryCount++] = bus;
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_ADD_BUS, .bus = bus};
+  mcim_mixer_post(mixer, &command);
+  return true;
+}
+
+void mcim_mixer_remove_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus) {
+  assert(mixer != NULL);
+  assert(bus != NULL);
+  assert(bus != &(mixer->master));
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < mixer->registryCount; i++) {
+    MCIM_MIXER_BUS* other = mixer->registry[i];
+    if (other == bus) {
+      continue;
+    }
+    if (other->route == bus) {
+      other->route = bus->route;
+    }
+    mixer->registry[count++] = other;
+  }
+  mixer->registryCount = count;
+
+  // 呼び出し側は戻った後にbusを解放するため、レンダリング中のブロックの完了を待って反映する
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_REMOVE_BUS, .bus = bus};
+  mcim_mixer_post(mixer, &command);
+  EnterCriticalSection(&(mixer->mutex));
+  mcim_mixer_apply_commands(mixer);
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+MCIM_MIXER_BUS* mcim_mixer_find_bus(MCIM_MIXER* mixer, MCIM_KEY key) {
+  assert(mixer != NULL);
+
+  if (key == MCIM_MASTER_KEY) {
+    return &(mixer->master);
+  }
+
+  // 登録表はこの関数の呼び出し元のスレッドでのみ変更されるため、ロックを取らずに読み出せる
+  for (uint32_t i = 0; i < mixer->registryCount; i++) {
+    if (mixer->registry[i]->key == key) {
+      return mixer->registry[i];
+    }
+  }
+  return NULL;
+}
+
+bool mcim_mixer_route_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, MCIM_MIXER_BUS* restrict parent) {
+  assert(mixer != NULL);
+  assert(bus != NULL);
+  assert(parent != NULL);
+
+  // 新しい出力先からマスターまでの経路にbus自身が含まれる場合は循環する
+  // 経路は要求を積んだ順に反映されるため、呼び出し側から見た経路で判定すればレンダリング側でも循環しない
+  MCIM_MIXER_BUS* route = (parent != &(mixer->master) ? parent : NULL);
+  for (const MCIM_MIXER_BUS* p = route; p != NULL; p = p->route) {
+    if (p == bus) {
+      return false;
+    }
+  }
+  bus->route = route;
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_ROUTE_BUS, .bus = bus, .parent = parent};
+  mcim_mixer_post(mixer, &command);
+  return true;
+}
+
+void mcim_mixer_set_bus_gain(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, float gain) {
+  assert(mixer != NULL);
+  assert(bus != NULL);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_BUS_GAIN, .bus = bus, .value = gain};
+  mcim_mixer_post(mixer, &command);
+}
+
+void mcim_mixer_set_bus_ducked(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus, bool ducked) {
+  assert(mixer != NULL);
+  assert(bus != NULL);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_BUS_DUCKED, .bus = bus, .value = (ducked ? 1.0f : 0.0f)};
+  mcim_mixer_post(mixer, &command);
+}
+
+void mcim_mixer_set_voice_bus(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, MCIM_MIXER_BUS* restrict bus) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  voice->route = (bus != &(mixer->master) ? bus : NULL);
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_VOICE_BUS, .voice = voice, .bus = voice->route};
+  mcim_mixer_post(mixer, &command);
+}
+
+void mcim_mixer_set_sfx_bus(MCIM_MIXER* restrict mixer, MCIM_KEY key, MCIM_MIXER_BUS* restrict bus) {
+  assert(mixer != NULL);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_SFX_BUS, .bus = (bus != &(mixer->master) ? bus : NULL), .key = key};
+  mcim_mixer_post(mixer, &command);
+}
+
+bool mcim_mixer_add_tap(MCIM_MIXER* restrict mixer, MCIM_TAP* restrict tap, MCIM_MIXER_BUS* restrict bus, MCIM_VOICE* restrict voice) {
+  assert(mixer != NULL);
+  assert(tap != NULL);
+  assert((bus == NULL) != (voice == NULL));
+
+  // 解析するバスの追加が反映されていない場合があるため、積まれている要求を先に反映する
+  bool ret = false;
+  EnterCriticalSection(&(mixer->mutex));
+  mcim_mixer_apply_commands(mixer);
+  if (mixer->tapCount < MCIM_MIXER_MAX_TAPS) {
+    MCIM_MIXER_TAP* entry = &(mixer->taps[mixer->tapCount++]);
+    entry->tap = tap;
+    entry->bus = bus;
+    entry->voice = voice;
+    if (voice != NULL) {
+      voice->tap = tap;
+    }
+    ret = true;
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+  return ret;
+}
+
+MCIM_TAP* mcim_mixer_remove_tap(MCIM_MIXER* mixer, MCIM_KEY key) {
+  assert(mixer != NULL);
+
+  MCIM_TAP* ret = NULL;
+  EnterCriticalSection(&(mixer->mutex));
+  for (uint32_t i = 0; i < mixer->tapCount; i++) {
+    MCIM_MIXER_TAP* entry = &(mixer->taps[i]);
+    if (entry->tap->key != key) {
+      continue;
+    }
+    ret = entry->tap;
+    if (entry->voice != NULL) {
+      entry->voice->tap = NULL;
+    }
+    mixer->tapCount--;
+    for (uint32_t j = i; j < mixer->tapCount; j++) {
+      mixer->taps[j] = mixer->taps[j + 1];
+    }
+    break;
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+  return ret;
+}
+
+MCIM_TAP* mcim_mixer_find_tap(const MCIM_MIXER* mixer, MCIM_KEY key) {
+  assert(mixer != NULL);
+
+  // タップの構成はこの関数の呼び出し元のスレッドでのみ変更されるため、ロックを取らずに読み出せる
+  for (uint32_t i = 0; i < mixer->tapCount; i++) {
+    if (mixer->taps[i].tap->key == key) {
+      return mixer->taps[i].tap;
+    }
+  }
+  return NULL;
+}
+
+void mcim_mixer_start_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, const MCIM_PCM* restrict pcm, uint32_t from, bool notify) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+  assert(pcm != NULL);
+
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+
+  // 再生開始前に設定された音量を補間せずに反映するため、積まれている変更要求を先に反映する
+  EnterCriticalSection(&(mixer->mutex));
+  mcim_mixer_apply_commands(mixer);
+  voice->pcm = pcm;
+  voice->ended = false;
+  voice->startPending = true;
+  voice->startCommand = now.QuadPart;
+  voice->position = (uint64_t)from << 32;
+  voice->step = ((uint64_t)pcm->sampleRate << 32) / mixer->sampleRate;
+  voice->gain = voice->targetGain;
+  voice->trim = voice->targetTrim;
+  voice->rate = voice->targetRate;
+  voice->rateRemaining = 0;
+  voice->fadeTotal = 0;
+  voice->fadeRemaining = 0;
+  voice->notify = notify;
+  if (voice->stretch != NULL) {
+    mcim_stretch_reset(voice->stretch, voice->position);
+  }
+  if (!voice->active) {
+    voice->active = true;
+    atomic_store_explicit(&(voice->playing), true, memory_order_release);
+    voice->next = mixer->voices;
+    mixer->voices = voice;
+  }
+  mcim_mixer_publish_voice(voice, MCIM_MIXER_CLOCK_NEVER, MCIM_MIXER_CLOCK_NEVER, voice->position);
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+void mcim_mixer_stop_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  // 停止後に呼び出し側がPCMを解放できるよう、ボイスを参照する積まれている要求を先に反映する
+  EnterCriticalSection(&(mixer->mutex));
+  mcim_mixer_apply_commands(mixer);
+  if (voice->active) {
+    MCIM_VOICE** pvoice = &(mixer->voices);
+    while (*pvoice != NULL) {
+      if (*pvoice == voice) {
+        *pvoice = voice->next;
+        break;
+      }
+      pvoice = &((*pvoice)->next);
+    }
+    voice->active = false;
+    atomic_store_explicit(&(voice->playing), false, memory_order_release);
+    voice->next = NULL;
+    mcim_mixer_publish_voice(voice, atomic_load_explicit(&(voice->clock.startFrame), memory_order_relaxed), mixer->renderedFrames,
+                             atomic_load_explicit(&(voice->clock.startPosition), memory_order_relaxed));
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+bool mcim_mixer_voice_is_active(MCIM_MIXER* restrict mixer, const MCIM_VOICE* restrict voice) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  return atomic_load_explicit(&(voice->playing), memory_order_acquire);
+}
+
+void mcim_mixer_set_loop(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, uint32_t loopStart, uint32_t loopEnd) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+  assert(loopEnd == 0 || loopStart < loopEnd);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_LOOP, .voice = voice, .loopStart = loopStart, .loopEnd = loopEnd};
+  mcim_mixer_post(mixer, &command);
+}
+
+void mcim_mixer_set_gain(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, float gain) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  // 実際のゲインは次のレンダリングブロック内で線形に補間される
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_GAIN, .voice = voice, .value = gain};
+  mcim_mixer_post(mixer, &command);
+}
+
+void mcim_mixer_set_trim(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, float trim) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_TRIM, .voice = voice, .value = trim};
+  mcim_mixer_post(mixer, &command);
+}
+
+void mcim_mixer_set_rate(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, float rate, uint32_t glide, MCIM_STRETCH* restrict stretch) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+  assert(rate > 0.0f);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_RATE, .voice = voice, .value = rate, .frames = glide, .stretch = stretch};
+  mcim_mixer_post(mixer, &command);
+}
+
+void mcim_mixer_set_ducking(MCIM_MIXER* mixer, bool enabled, float threshold, float depth, float attack, float release) {
+  assert(mixer != NULL);
+  assert(depth >= 0.0f);
+  assert(attack >= 0.0f);
+  assert(release >= 0.0f);
+
+  const float framesPerMs = (float)mixer->sampleRate / 1000.0f;
+  EnterCriticalSection(&(mixer->mutex));
+  MCIM_DUCKER* ducker = &(mixer->ducker);
+  if (!enabled) {
+    ducker->envelope = 0.0f;
+    ducker->gain = 1.0f;
+    ducker->from = 1.0f;
+  }
+  ducker->enabled = enabled;
+  ducker->threshold = powf(10.0f, threshold / 20.0f);
+  ducker->depth = depth;
+  ducker->attack = attack * framesPerMs;
+  ducker->release = release * framesPerMs;
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+void mcim_mixer_set_ducked(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, bool ducked) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_DUCKED, .voice = voice, .value = (ducked ? 1.0f : 0.0f)};
+  mcim_mixer_post(mixer, &command);
+}
+
+bool mcim_mixer_add_effect(MCIM_MIXER* restrict mixer, MCIM_DSP_CHAIN* restrict chain, MCIM_DSP_EFFECT* restrict effect, uint32_t* restrict index) {
+  assert(mixer != NULL);
+  assert(chain != NULL);
+  assert(effect != NULL);
+  assert(index != NULL);
+
+  bool ret = false;
+  EnterCriticalSection(&(mixer->mutex));
+  const uint32_t count = atomic_load_explicit(&(chain->count), memory_order_relaxed);
+  if (count < MCIM_DSP_MAX_EFFECTS) {
+    *index = count;
+    atomic_store_explicit(&(chain->effects[count]), effect, memory_order_relaxed);
+    atomic_store_explicit(&(chain->count), count + 1, memory_order_release);
+    ret = true;
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+  return ret;
+}
+
+MCIM_DSP_EFFECT* mcim_mixer_get_effect(const MCIM_DSP_CHAIN* chain, uint32_t index) {
+  assert(chain != NULL);
+
+  // レンダリング中もロックを待たずに引けるよう、countをacquireで読んでから公開済みのエフェクトを読む
+  if (index >= atomic_load_explicit(&(chain->count), memory_order_acquire)) {
+    return NULL;
+  }
+  return atomic_load_explicit(&(chain->effects[index]), memory_order_relaxed);
+}
+
+uint32_t mcim_mixer_clear_effects(MCIM_MIXER* restrict mixer, MCIM_DSP_CHAIN* restrict chain, MCIM_DSP_EFFECT** restrict removed) {
+  assert(mixer != NULL);
+  assert(chain != NULL);
+  assert(removed != NULL);
+
+  EnterCriticalSection(&(mixer->mutex));
+  const uint32_t count = atomic_load_explicit(&(chain->count), memory_order_relaxed);
+  atomic_store_explicit(&(chain->count), 0, memory_order_release);
+  for (uint32_t i = 0; i < count; i++) {
+    removed[i] = atomic_load_explicit(&(chain->effects[i]), memory_order_relaxed);
+    atomic_store_explicit(&(chain->effects[i]), NULL, memory_order_relaxed);
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+  return count;
+}
+
+void mcim_mixer_fade_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, uint32_t frames, bool notify) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  MCIM_MIXER_COMMAND command = {.request = MCIM_MIXER_REQUEST_FADE, .voice = voice, .frames = frames, .notify = notify};
+  mcim_mixer_post(mixer, &command);
+}
+
+bool mcim_mixer_take_latency_mark(MCIM_MIXER* restrict mixer, uint64_t* restrict frame, LONGLONG* restrict command) {
+  assert(mixer != NULL);
+  assert(frame != NULL);
+  assert(command != NULL);
+
+  EnterCriticalSection(&(mixer->mutex));
+  bool pending = mixer->latencyPending;
+  if (pending) {
+    mixer->latencyPending = false;
+    *frame = mixer->latencyFrame;
+    *command = mixer->latencyCommand;
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+  return pending;
+}
+
+void mcim_mixer_publish_clock(MCIM_MIXER* mixer, uint64_t frame, int64_t time, uint64_t limit) {
+  assert(mixer != NULL);
+
+  MCIM_MIXER_CLOCK* clock = &(mixer->clock);
+  uint32_t sequence = atomic_load_explicit(&(clock->sequence), memory_order_relaxed);
+  atomic_store_explicit(&(clock->sequence), sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&(clock->frame), frame, memory_order_relaxed);
+  atomic_store_explicit(&(clock->time), time, memory_order_relaxed);
+  atomic_store_explicit(&(clock->limit), limit, memory_order_relaxed);
+  atomic_store_explicit(&(clock->sequence), sequence + 2, memory_order_release);
+}
+
+double mcim_mixer_get_position(const MCIM_MIXER* restrict mixer, const MCIM_VOICE* restrict voice) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  // 書き込み中（sequenceが奇数）または読み出し中に更新された場合は読み直す
+  const MCIM_MIXER_CLOCK* clock = &(mixer->clock);
+  uint32_t sequence;
+  uint64_t frame;
+  int64_t time;
+  uint64_t limit;
+  do {
+    sequence = atomic_load_explicit(&(clock->sequence), memory_order_acquire);
+    frame = atomic_load_explicit(&(clock->frame), memory_order_relaxed);
+    time = atomic_load_explicit(&(clock->time), memory_order_relaxed);
+    limit = atomic_load_explicit(&(clock->limit), memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+  } while ((sequence & 1) != 0 || atomic_load_explicit(&(clock->sequence), memory_order_relaxed) != sequence);
+
+  const MCIM_VOICE_CLOCK* vclock = &(voice->clock);
+  uint64_t startFrame;
+  uint64_t endFrame;
+  uint64_t startPosition;
+  uint64_t step;
+  uint32_t loopStart;
+  uint32_t loopEnd;
+  uint32_t frames;
+  uint32_t sampleRate;
+  do {
+    sequence = atomic_load_explicit(&(vclock->sequence), memory_order_acquire);
+    startFrame = atomic_load_explicit(&(vclock->startFrame), memory_order_relaxed);
+    endFrame = atomic_load_explicit(&(vclock->endFrame), memory_order_relaxed);
+    startPosition = atomic_load_explicit(&(vclock->startPosition), memory_order_relaxed);
+    step = atomic_load_explicit(&(vclock->step), memory_order_relaxed);
+    loopStart = atomic_load_explicit(&(vclock->loopStart), memory_order_relaxed);
+    loopEnd = atomic_load_explicit(&(vclock->loopEnd), memory_order_relaxed);
+    frames = atomic_load_explicit(&(vclock->frames), memory_order_relaxed);
+    sampleRate = atomic_load_explicit(&(vclock->sampleRate), memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+  } while ((sequence & 1) != 0 || atomic_load_explicit(&(vclock->sequence), memory_order_relaxed) != sequence);
+
+  if (sampleRate == 0) {
+    return 0.0;
+  }
+
+  // デバイスの再生位置は更新間隔が粗いため、取得時点からの経過時間で補間する
+  double playing = (double)frame;
+  if (time != 0) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    if (now.QuadPart > time) {
+      playing += (double)(now.QuadPart - time) * mixer->sampleRate / (double)(mixer->clockFreq).QuadPart;
+    }
+    if (playing > (double)limit) {
+      playing = (double)limit;
+    }
+  }
+
+  const double scale = 1.0 / 4294967296.0;
+  double position = (double)startPosition * scale;
+  if (startFrame != MCIM_MIXER_CLOCK_NEVER && playing > (double)startFrame) {
+    if (endFrame != MCIM_MIXER_CLOCK_NEVER && playing > (double)endFrame) {
+      playing = (double)endFrame;
+    }
+    position += (playing - (double)startFrame) * ((double)step * scale);
+  }
+
+  if (loopEnd != 0 && position >= (double)loopEnd) {
+    position = loopStart + fmod(position - loopEnd, (double)(loopEnd - loopStart));
+  } else if (position > (double)frames) {
+    position = (double)frames;
+  }
+  return position / sampleRate;
+}
+
+void mcim_mixer_render(MCIM_MIXER* restrict mixer, float* restrict out, uint32_t frames) {
+  assert(mixer != NULL);
+  assert(mixer->workspace != NULL);
+  assert(out != NULL);
+
+  SecureZeroMemory(out, sizeof(float) * MCIM_MIXER_CHANNELS * frames);
+
+  EnterCriticalSection(&(mixer->mutex));
+  for (uint32_t done = 0; done < frames; done += MCIM_MIXER_BLOCK_FRAMES) {
+    uint32_t count = frames - done;
+    if (count > MCIM_MIXER_BLOCK_FRAMES) {
+      count = MCIM_MIXER_BLOCK_FRAMES;
+    }
+    mcim_mixer_render_block(mixer, out + MCIM_MIXER_CHANNELS * (size_t)done, count);
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+/**************************************************************************************************/
+
+static void mcim_mixer_render_block(MCIM_MIXER* restrict mixer, float* restrict out, uint32_t frames) {
+  assert(mixer != NULL);
+  assert(out != NULL);
+  assert(frames <= MCIM_MIXER_BLOCK_FRAMES);
+
+  LARGE_INTEGER begin;
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&begin);
+
+  mcim_mixer_apply_commands(mixer);
+
+  // ボイスを出力先のバス毎のリストに振り分ける
+  for (uint32_t i = 0; i <= mixer->busCount; i++) {
+    MCIM_MIXER_BUS* bus = (i < mixer->busCount ? mixer->schedule[i] : &(mixer->master));
+    bus->head = NULL;
+    bus->tail = NULL;
+    bus->voiceCount = 0;
+  }
+  uint32_t voiceCount = 0;
+  for (MCIM_VOICE* voice = mixer->voices; voice != NULL; voice = voice->next) {
+    if (voice->startPending) {
+      voice->startPending = false;
+      mixer->latencyPending = true;
+      mixer->latencyFrame = mixer->renderedFrames;
+      mixer->latencyCommand = voice->startCommand;
+      mcim_mixer_publish_voice(voice, mixer->renderedFrames, MCIM_MIXER_CLOCK_NEVER,
+                               atomic_load_explicit(&(voice->clock.startPosition), memory_order_relaxed));
+    }
+    mcim_mixer_enqueue_voice(mixer, voice);
+    voiceCount++;
+  }
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  if (pool != NULL) {
+    mcim_sfx_pool_update(pool, mixer);
+    for (uint32_t i = 0; i < pool->activeCount; i++) {
+      mcim_mixer_enqueue_voice(mixer, &(pool->slots[pool->active[i]].voice));
+    }
+    voiceCount += pool->activeCount;
+  }
+
+  // ボイスが少ない場合はスレッド間の受け渡しの方が高くつくため、レンダリングスレッドのみで処理する
+  MCIM_JOBS* jobs = (voiceCount >= MCIM_MIXER_PARALLEL_VOICES ? mixer->jobs : NULL);
+  MCIM_MIXER_PASS pass = {.mixer = mixer, .frames = frames, .first = 0};
+  mcim_jobs_run(jobs, mcim_mixer_split_voices(mixer), mcim_mixer_render_chunk, &pass);
+  if (mixer->ducker.enabled) {
+    mcim_mixer_duck(mixer, frames);
+  }
+
+  // 子バスを先にミックスする必要があるため、マスターからの段数が同じバス毎に分担する
+  for (uint32_t first = 0; first < mixer->busCount;) {
+    uint32_t last = first + 1;
+    while (last < mixer->busCount && mixer->schedule[last]->depth == mixer->schedule[first]->depth) {
+      last++;
+    }
+    pass.first = first;
+    mcim_jobs_run(jobs, last - first, mcim_mixer_mix_level, &pass);
+    first = last;
+  }
+  mcim_mixer_mix_bus(mixer, &(mixer->master), frames);
+  if (!mixer->master.silent) {
+    memcpy(out, mixer->master.out, sizeof(float) * MCIM_MIXER_CHANNELS * frames);
+  }
+
+  // 解析はタップ毎のジョブとし、FFTはタップ毎にFFT点数の半分のフレーム毎の1回に限られる
+  mcim_jobs_run(jobs, mixer->tapCount, mcim_mixer_analyze_tap, &pass);
+
+  // 終端に達したボイスはリストから外し、MCIと同様に再生完了を通知する
+  MCIM_VOICE** pvoice = &(mixer->voices);
+  while (*pvoice != NULL) {
+    MCIM_VOICE* voice = *pvoice;
+    if (!voice->ended) {
+      pvoice = &(voice->next);
+      continue;
+    }
+    *pvoice = voice->next;
+    voice->active = false;
+    atomic_store_explicit(&(voice->playing), false, memory_order_release);
+    voice->next = NULL;
+    mcim_mixer_publish_voice(voice, atomic_load_explicit(&(voice->clock.startFrame), memory_order_relaxed), mixer->renderedFrames + frames,
+                             atomic_load_explicit(&(voice->clock.startPosition), memory_order_relaxed));
+    if (voice->notify && mixer->notify != NULL) {
+      mixer->notify(mixer->notifyContext, voice, MCIM_NOTIFY_SUCCESSFUL);
+    }
+  }
+  if (pool != NULL) {
+    mcim_sfx_pool_collect(pool);
+  }
+  mixer->renderedFrames += frames;
+
+  QueryPerformanceCounter(&end);
+  mcim_stats_record_mix(frames, end.QuadPart - begin.QuadPart);
+}
+
+static void mcim_mixer_post(MCIM_MIXER* restrict mixer, const MCIM_MIXER_COMMAND* restrict command) {
+  assert(mixer != NULL);
+  assert(command != NULL);
+
+  if (mcim_mixer_enqueue_command(mixer, command)) {
+    return;
+  }
+
+  // レンダリングが止まっている間にキューが溢れた場合は、順序を保つため積まれている要求を反映してから直接反映する
+  EnterCriticalSection(&(mixer->mutex));
+  mcim_mixer_apply_commands(mixer);
+  mcim_mixer_apply_command(mixer, command);
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+static bool mcim_mixer_enqueue_command(MCIM_MIXER* restrict mixer, const MCIM_MIXER_COMMAND* restrict command) {
+  assert(mixer != NULL);
+  assert(command != NULL);
+
+  // 効果音の発音要求キューと同じ、複数の書き込み側と単一の読み出し側からなる有界キュー
+  uint32_t pos = atomic_load_explicit(&(mixer->commandEnqueuePos), memory_order_relaxed);
+  for (;;) {
+    MCIM_MIXER_COMMAND_CELL* cell = &(mixer->commands[pos & (MCIM_MIXER_COMMAND_QUEUE_SIZE - 1)]);
+    uint32_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+    int32_t diff = (int32_t)(sequence - pos);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&(mixer->commandEnqueuePos), &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+        cell->command = *command;
+        atomic_store_explicit(&(cell->sequence), pos + 1, memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = atomic_load_explicit(&(mixer->commandEnqueuePos), memory_order_relaxed);
+    }
+  }
+}
+
+static void mcim_mixer_apply_commands(MCIM_MIXER* mixer) {
+  assert(mixer != NULL);
+
+  // 読み出しはミキサーのロックを保持したスレッドに限られるため、読み出し側は常に1つとなる
+  for (;;) {
+    uint32_t pos = mixer->commandDequeuePos;
+    MCIM_MIXER_COMMAND_CELL* cell = &(mixer->commands[pos & (MCIM_MIXER_COMMAND_QUEUE_SIZE - 1)]);
+    uint32_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+    if ((int32_t)(sequence - (pos + 1)) < 0) {
+      return;
+    }
+    MCIM_MIXER_COMMAND command = cell->command;
+    atomic_store_explicit(&(cell->sequence), pos + MCIM_MIXER_COMMAND_QUEUE_SIZE, memory_order_release);
+    mixer->commandDequeuePos = pos + 1;
+    mcim_mixer_apply_command(mixer, &command);
+  }
+}
+
+static void mcim_mixer_apply_command(MCIM_MIXER* restrict mixer, const MCIM_MIXER_COMMAND* restrict command) {
+  assert(mixer != NULL);
+  assert(command != NULL);
+
+  MCIM_VOICE* voice = command->voice;
+  MCIM_MIXER_BUS* bus = command->bus;
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  switch (command->request) {
+    case MCIM_MIXER_REQUEST_GAIN:
+      voice->targetGain = command->value;
+      if (!voice->active) {
+        voice->gain = command->value;
+      }
+      break;
+    case MCIM_MIXER_REQUEST_TRIM:
+      voice->targetTrim = command->value;
+      if (!voice->active) {
+        voice->trim = command->value;
+      }
+      break;
+    case MCIM_MIXER_REQUEST_DUCKED:
+      voice->ducked = (command->value != 0.0f);
+      break;
+    case MCIM_MIXER_REQUEST_VOICE_BUS:
+      voice->bus = bus;
+      break;
+    case MCIM_MIXER_REQUEST_SFX_BUS:
+      // 要求を積んだ後にサンプルが解除された場合は無視する
+      if (pool != NULL && command->key < pool->sampleCount && pool->samples[command->key].pcm != NULL) {
+        pool->samples[command->key].bus = bus;
+      }
+      break;
+    case MCIM_MIXER_REQUEST_BUS_GAIN:
+      bus->targetGain = command->value;
+      break;
+    case MCIM_MIXER_REQUEST_BUS_DUCKED:
+      bus->ducked = (command->value != 0.0f);
+      break;
+    case MCIM_MIXER_REQUEST_ADD_BUS:
+      assert(mixer->busCount < MCIM_MIXER_MAX_BUSES);
+      mixer->buses[mixer->busCount++] = bus;
+      mcim_mixer_update_schedule(mixer);
+      break;
+    case MCIM_MIXER_REQUEST_REMOVE_BUS:
+      mcim_mixer_unlink_bus(mixer, bus);
+      break;
+    case MCIM_MIXER_REQUEST_ROUTE_BUS:
+      bus->parent = command->parent;
+      mcim_mixer_update_schedule(mixer);
+      break;
+    case MCIM_MIXER_REQUEST_RATE:
+      mcim_mixer_apply_rate(mixer, voice, command->value, command->frames, command->stretch);
+      break;
+    case MCIM_MIXER_REQUEST_LOOP:
+      mcim_mixer_apply_loop(mixer, voice, command->loopStart, command->loopEnd);
+      break;
+    case MCIM_MIXER_REQUEST_FADE:
+      if (voice->active) {
+        voice->fadeTotal = (command->frames > 0 ? command->frames : 1);
+        voice->fadeRemaining = command->frames;
+        voice->notify = command->notify;
+      }
+      break;
+    default:
+      assert(false);
+      break;
+  }
+}
+
+static void mcim_mixer_apply_rate(MCIM_MIXER* restrict mixer,
+                                  MCIM_VOICE* restrict voice,
+                                  float rate,
+                                  uint32_t glide,
+                                  MCIM_STRETCH* restrict stretch) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+  assert(rate > 0.0f);
+
+  voice->targetRate = rate;
+  voice->rateRemaining = (voice->active ? glide : 0);
+  if (voice->rateRemaining == 0) {
+    voice->rate = rate;
+  }
+
+  // 時間伸縮への切り替えは現在位置から途切れずに始め、解除時は出力済みの位置からリサンプルを続ける
+  if (stretch != voice->stretch) {
+    if (voice->stretch != NULL) {
+      voice->position = mcim_mixer_wrap(voice, mcim_stretch_position(voice->stretch, voice->step));
+    }
+    if (stretch != NULL) {
+      mcim_stretch_reset(stretch, voice->position);
+    }
+    voice->stretch = stretch;
+  }
+
+  uint64_t startFrame = atomic_load_explicit(&(voice->clock.startFrame), memory_order_relaxed);
+  if (voice->active && voice->pcm != NULL && startFrame != MCIM_MIXER_CLOCK_NEVER) {
+    mcim_mixer_publish_voice(voice, mixer->renderedFrames, MCIM_MIXER_CLOCK_NEVER, voice->position);
+  }
+}
+
+static void mcim_mixer_apply_loop(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice, uint32_t loopStart, uint32_t loopEnd) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+  assert(loopEnd == 0 || loopStart < loopEnd);
+
+  voice->loopStart = loopStart;
+  voice->loopEnd = loopEnd;
+
+  // 再生中のループ区間の変更は現在位置から反映されるため、時計の起点をここへ移す
+  // 変更前にレンダリング済みの区間の再生中は、起点の位置で止まって見える
+  uint64_t startFrame = atomic_load_explicit(&(voice->clock.startFrame), memory_order_relaxed);
+  uint64_t endFrame = atomic_load_explicit(&(voice->clock.endFrame), memory_order_relaxed);
+  uint64_t startPosition = atomic_load_explicit(&(voice->clock.startPosition), memory_order_relaxed);
+  if (voice->active && startFrame != MCIM_MIXER_CLOCK_NEVER) {
+    startFrame = mixer->renderedFrames;
+    startPosition = voice->position;
+  }
+  if (voice->pcm != NULL) {
+    mcim_mixer_publish_voice(voice, startFrame, endFrame, startPosition);
+  }
+}
+
+static void mcim_mixer_unlink_bus(MCIM_MIXER* restrict mixer, MCIM_MIXER_BUS* restrict bus) {
+  assert(mixer != NULL);
+  assert(bus != NULL);
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < mixer->busCount; i++) {
+    MCIM_MIXER_BUS* other = mixer->buses[i];
+    if (other == bus) {
+      continue;
+    }
+    if (other->parent == bus) {
+      other->parent = bus->parent;
+    }
+    mixer->buses[count++] = other;
+  }
+  mixer->busCount = count;
+  if (mixer->sfx != NULL) {
+    mcim_sfx_pool_reroute(mixer->sfx, bus, bus->parent);
+  }
+  mcim_mixer_update_schedule(mixer);
+}
+
+static void mcim_mixer_enqueue_voice(MCIM_MIXER* restrict mixer, MCIM_VOICE* restrict voice) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+
+  MCIM_MIXER_BUS* bus = (voice->bus != NULL ? voice->bus : &(mixer->master));
+  voice->blockNext = NULL;
+  if (bus->tail != NULL) {
+    bus->tail->blockNext = voice;
+  } else {
+    bus->head = voice;
+  }
+  bus->tail = voice;
+  bus->voiceCount++;
+}
+
+static uint32_t mcim_mixer_split_voices(MCIM_MIXER* mixer) {
+  assert(mixer != NULL);
+  assert(mixer->workspace != NULL);
+
+  // ジョブの数が上限に収まるまで1ジョブあたりのボイス数を倍にする
+  // （バスの数は上限より少ないため、ボイスを持つバス毎に1ジョブとなるまでには収まる）
+  uint32_t per = MCIM_MIXER_CHUNK_VOICES;
+  for (;;) {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i <= mixer->busCount; i++) {
+      const MCIM_MIXER_BUS* bus = (i < mixer->busCount ? mixer->schedule[i] : &(mixer->master));
+      total += (bus->voiceCount + per - 1) / per;
+    }
+    if (total <= MCIM_MIXER_MAX_CHUNKS) {
+      break;
+    }
+    per *= 2;
+  }
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i <= mixer->busCount; i++) {
+    MCIM_MIXER_BUS* bus = (i < mixer->busCount ? mixer->schedule[i] : &(mixer->master));
+    const uint32_t chunks = (bus->voiceCount + per - 1) / per;
+    bus->firstChunk = count;
+    bus->chunkCount = chunks;
+
+    // バスのボイスを各ジョブへ均等に振り分ける
+    MCIM_VOICE* voice = bus->head;
+    for (uint32_t j = 0; j < chunks; j++) {
+      MCIM_MIXER_CHUNK* chunk = &(mixer->workspace->chunks[count++]);
+      chunk->bus = bus;
+      chunk->first = voice;
+      chunk->count = bus->voiceCount * (j + 1) / chunks - bus->voiceCount * j / chunks;
+      for (uint32_t k = 0; k < chunk->count; k++) {
+        voice = voice->blockNext;
+      }
+    }
+  }
+  return count;
+}
+
+static void mcim_mixer_render_chunk(void* context, uint32_t job, uint32_t participant) {
+  assert(context != NULL);
+  assert(participant <= MCIM_JOBS_MAX_THREADS);
+
+  const MCIM_MIXER_PASS* pass = (const MCIM_MIXER_PASS*)context;
+  MCIM_MIXER* mixer = pass->mixer;
+  MCIM_MIXER_CHUNK* chunk = &(mixer->workspace->chunks[job]);
+  float* scratch = mixer->workspace->scratch[participant];
+  const uint32_t frames = pass->frames;
+  const size_t bytes = sizeof(float) * MCIM_MIXER_CHANNELS * frames;
+  const bool ducking = mixer->ducker.enabled;
+
+  // ダッキング中は対象のボイスとトリガーのボイスを別のバッファへミックスし、ゲインを求めた後にバスで合算する
+  SecureZeroMemory(chunk->out, bytes);
+  chunk->ducked = false;
+  chunk->sidechain = false;
+  MCIM_VOICE* voice = chunk->first;
+  for (uint32_t i = 0; i < chunk->count; i++, voice = voice->blockNext) {
+    float* dst = chunk->out;
+    if (ducking && voice->ducked) {
+      if (!chunk->ducked) {
+        SecureZeroMemory(chunk->duck, bytes);
+        chunk->ducked = true;
+      }
+      dst = chunk->duck;
+    } else if (ducking && voice->sidechain) {
+      if (!chunk->sidechain) {
+        SecureZeroMemory(chunk->side, bytes);
+        chunk->sidechain = true;
+      }
+      dst = chunk->side;
+    }
+    voice->ended = !mcim_mixer_render_voice(mixer, voice, scratch, dst, frames);
+  }
+}
+
+static void mcim_mixer_mix_level(void* context, uint32_t job, uint32_t participant) {
+  assert(context != NULL);
+  (void)participant;
+
+  const MCIM_MIXER_PASS* pass = (const MCIM_MIXER_PASS*)context;
+  mcim_mixer_mix_bus(pass->mixer, pass->mixer->schedule[pass->first + job], pass->frames);
+}
+
+static void mcim_mixer_mix_bus(MCIM_MIXER* mixer, MCIM_MIXER_BUS* bus, uint32_t frames) {
+  assert(mixer != NULL);
+  assert(bus != NULL);
+
+  // ボイスも出力中の子バスもエフェクトも無いバスは、ミックスを省いて無音とする
+  bool silent = (bus->chunkCount == 0 && atomic_load_explicit(&(bus->effects.count), memory_order_relaxed) == 0);
+  for (uint32_t i = 0; i < mixer->busCount && silent; i++) {
+    silent = (mixer->schedule[i]->parent != bus || mixer->schedule[i]->silent);
+  }
+  bus->silent = silent;
+  if (silent) {
+    bus->gain = bus->targetGain;
+    return;
+  }
+
+  // ジョブと子バスを常に同じ順に合算し、スレッド数によらず同じ結果とする
+  const MCIM_KERNELS* kernels = mixer->kernels;
+  const MCIM_DUCKER* ducker = &(mixer->ducker);
+  const float duckStep = (ducker->gain - ducker->from) / (float)frames;
+  SecureZeroMemory(bus->out, sizeof(float) * MCIM_MIXER_CHANNELS * frames);
+  for (uint32_t i = 0; i < bus->chunkCount; i++) {
+    const MCIM_MIXER_CHUNK* chunk = &(mixer->workspace->chunks[bus->firstChunk + i]);
+    kernels->mix_ramp(bus->out, chunk->out, frames, 1.0f, 0.0f);
+    if (chunk->sidechain) {
+      kernels->mix_ramp(bus->out, chunk->side, frames, 1.0f, 0.0f);
+    }
+    if (chunk->ducked) {
+      kernels->mix_ramp(bus->out, chunk->duck, frames, ducker->from, duckStep);
+    }
+  }
+  for (uint32_t i = 0; i < mixer->busCount; i++) {
+    const MCIM_MIXER_BUS* child = mixer->schedule[i];
+    if (child->parent != bus || child->silent) {
+      continue;
+    }
+    if (ducker->enabled && child->ducked) {
+      kernels->mix_ramp(bus->out, child->out, frames, ducker->from, duckStep);
+    } else {
+      kernels->mix_ramp(bus->out, child->out, frames, 1.0f, 0.0f);
+    }
+  }
+
+  if (atomic_load_explicit(&(bus->effects.count), memory_order_relaxed) != 0) {
+    mcim_dsp_process(&(bus->effects), kernels, bus->out, frames);
+  }
+  if (bus->gain != 1.0f || bus->targetGain != 1.0f) {
+    kernels->scale_ramp(bus->out, frames, bus->gain, (bus->targetGain - bus->gain) / (float)frames);
+  }
+  bus->gain = bus->targetGain;
+}
+
+static void mcim_mixer_update_schedule(MCIM_MIXER* mixer) {
+  assert(mixer != NULL);
+
+  // 子バスを親より先にミックスするため、マスターからの段数の降順に並べる（同じ段では作成順を保つ）
+  for (uint32_t i = 0; i < mixer->busCount; i++) {
+    MCIM_MIXER_BUS* bus = mixer->buses[i];
+    bus->depth = 0;
+    for (const MCIM_MIXER_BUS* p = bus; p->parent != NULL; p = p->parent) {
+      bus->depth++;
+    }
+
+    uint32_t j = i;
+    while (j > 0 && mixer->schedule[j - 1]->depth < bus->depth) {
+      mixer->schedule[j] = mixer->schedule[j - 1];
+      j--;
+    }
+    mixer->schedule[j] = bus;
+  }
+}
+
+static void mcim_mixer_analyze_tap(void* context, uint32_t job, uint32_t participant) {
+  assert(context != NULL);
+  (void)participant;
+
+  const MCIM_MIXER_PASS* pass = (const MCIM_MIXER_PASS*)context;
+  MCIM_MIXER* mixer = pass->mixer;
+  const MCIM_MIXER_TAP* entry = &(mixer->taps[job]);
+
+  LARGE_INTEGER begin;
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&begin);
+
+  // ボイスのタップはレンダリング時にミックスした内容を、無音のバスは無音を解析する
+  const float* src = NULL;
+  if (entry->bus != NULL && !entry->bus->silent) {
+    src = entry->bus->out;
+  }
+  mcim_tap_process(entry->tap, mixer->kernels, src, pass->frames, mixer->renderedFrames + pass->frames);
+
+  QueryPerformanceCounter(&end);
+  mcim_stats_record_analysis(pass->frames, end.QuadPart - begin.QuadPart);
+}
+
+static bool mcim_mixer_render_voice(MCIM_MIXER* restrict mixer,
+                                    MCIM_VOICE* restrict voice,
+                                    float* restrict scratch,
+                                    float* restrict out,
+                                    uint32_t frames) {
+  assert(mixer != NULL);
+  assert(voice != NULL);
+  assert(voice->pcm != NULL);
+  assert(scratch != NULL);
+  assert(out != NULL);
+
+  const MCIM_KERNELS* kernels = mixer->kernels;
+
+  // フェードアウトはブロック単位の包絡として、音量変更による補間と掛け合わせる
+  float fadeStart = 1.0f;
+  float fadeEnd = 1.0f;
+  if (voice->fadeTotal != 0) {
+    uint32_t remaining = (voice->fadeRemaining > frames ? voice->fadeRemaining - frames : 0);
+    fadeStart = (float)voice->fadeRemaining / (float)voice->fadeTotal;
+    fadeEnd = (float)remaining / (float)voice->fadeTotal;
+    voice->fadeRemaining = remaining;
+  }
+
+  // 再生速度の変更はブロック単位で目標へ線形に近づけ、変化した分だけ時計の起点を移す
+  if (voice->rateRemaining != 0) {
+    const uint32_t advance = (frames < voice->rateRemaining ? frames : voice->rateRemaining);
+    voice->rate += (voice->targetRate - voice->rate) * (float)advance / (float)voice->rateRemaining;
+    voice->rateRemaining -= advance;
+    mcim_mixer_publish_voice(voice, mixer->renderedFrames, MCIM_MIXER_CLOCK_NEVER, voice->position);
+  }
+
+  const float gain = voice->gain * voice->trim * fadeStart;
+  const float gainStep = (voice->targetGain * voice->targetTrim * fadeEnd - gain) / (float)frames;
+  uint64_t position = voice->position;
+  bool playing = (voice->fadeTotal == 0 || voice->fadeRemaining > 0);
+
+  uint32_t produced;
+  if (voice->stretch != NULL) {
+    LARGE_INTEGER begin;
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&begin);
+    MCIM_MIXER_SOURCE source = {.kernels = kernels, .voice = voice, .wait = mixer->streamWait};
+    MCIM_STRETCH* stretch = voice->stretch;
+    produced = mcim_stretch_render(stretch, kernels, mcim_mixer_read_source, &source, voice->step, voice->rate, scratch, frames);
+    stretch->analysis = mcim_mixer_wrap(voice, stretch->analysis);
+    stretch->continuation = mcim_mixer_wrap(voice, stretch->continuation);
+    stretch->grainStart = mcim_mixer_wrap(voice, stretch->grainStart);
+    position = mcim_mixer_wrap(voice, mcim_stretch_position(stretch, voice->step));
+    QueryPerformanceCounter(&end);
+    mcim_stats_record_stretch(frames, end.QuadPart - begin.QuadPart);
+  } else {
+    produced = mcim_mixer_resample(kernels, voice, &position, mcim_mixer_voice_step(voice), scratch, frames, mixer->streamWait);
+  }
+  if (produced < frames) {
+    playing = false;
+  }
+
+  if (atomic_load_explicit(&(voice->effects.count), memory_order_relaxed) != 0) {
+    mcim_dsp_process(&(voice->effects), kernels, scratch, produced);
+  }
+  float* tap = (voice->tap != NULL ? mcim_tap_input(voice->tap, frames) : NULL);
+  if (voice->panned) {
+    // 定位はチャンネル毎のゲインとして音量と掛け合わせ、ブロック内で同様に補間する
+    const float targetGain = voice->targetGain * voice->targetTrim * fadeEnd;
+    const float pan[2] = {gain * voice->pan[0], gain * voice->pan[1]};
+    const float panStep[2] = {(targetGain * voice->targetPan[0] - pan[0]) / (float)frames, (targetGain * voice->targetPan[1] - pan[1]) / (float)frames};
+    kernels->mix_pan(out, scratch, produced, pan, panStep);
+    if (tap != NULL) {
+      kernels->mix_pan(tap, scratch, produced, pan, panStep);
+    }
+    voice->pan[0] = voice->targetPan[0];
+    voice->pan[1] = voice->targetPan[1];
+  } else {
+    kernels->mix_ramp(out, scratch, produced, gain, gainStep);
+    if (tap != NULL) {
+      kernels->mix_ramp(tap, scratch, produced, gain, gainStep);
+    }
+  }
+
+  voice->position = position;
+  voice->gain = voice->targetGain;
+  voice->trim = voice->targetTrim;
+  return playing;
+}
+
+static void mcim_mixer_publish_voice(MCIM_VOICE* voice, uint64_t startFrame, uint64_t endFrame, uint64_t startPosition) {
+  assert(voice != NULL);
+  assert(voice->pcm != NULL);
+
+  MCIM_VOICE_CLOCK* clock = &(voice->clock);
+  uint32_t sequence = atomic_load_explicit(&(clock->sequence), memory_order_relaxed);
+  atomic_store_explicit(&(clock->sequence), sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&(clock->startFrame), startFrame, memory_order_relaxed);
+  atomic_store_explicit(&(clock->endFrame), endFrame, memory_order_relaxed);
+  atomic_store_explicit(&(clock->startPosition), startPosition, memory_order_relaxed);
+  atomic_store_explicit(&(clock->step), mcim_mixer_voice_step(voice), memory_order_relaxed);
+  atomic_store_explicit(&(clock->loopStart), voice->loopStart, memory_order_relaxed);
+  atomic_store_explicit(&(clock->loopEnd), voice->loopEnd, memory_order_relaxed);
+  atomic_store_explicit(&(clock->frames), voice->pcm->frames, memory_order_relaxed);
+  atomic_store_explicit(&(clock->sampleRate), voice->pcm->sampleRate, memory_order_relaxed);
+  atomic_store_explicit(&(clock->sequence), sequence + 2, memory_order_release);
+}
+
+static void mcim_mixer_duck(MCIM_MIXER* mixer, uint32_t frames) {
+  assert(mixer != NULL);
+  assert(mixer->workspace != NULL);
+
+  // トリガーは全てのジョブのトリガーのミックスをジョブの順に合算したものとする
+  MCIM_MIXER_WORKSPACE* workspace = mixer->workspace;
+  SecureZeroMemory(workspace->trigger, sizeof(float) * MCIM_MIXER_CHANNELS * frames);
+  for (uint32_t i = 0; i <= mixer->busCount; i++) {
+    const MCIM_MIXER_BUS* bus = (i < mixer->busCount ? mixer->schedule[i] : &(mixer->master));
+    for (uint32_t j = 0; j < bus->chunkCount; j++) {
+      const MCIM_MIXER_CHUNK* chunk = &(workspace->chunks[bus->firstChunk + j]);
+      if (chunk->sidechain) {
+        mixer->kernels->mix_ramp(workspace->trigger, chunk->side, frames, 1.0f, 0.0f);
+      }
+    }
+  }
+
+  // トリガーのブロック内のピークを包絡で追従し、閾値を超えた分だけ（最大depthまで）BGMを減衰させる
+  // 対象のボイスとバスは、各バスのミックス時にfromからgainへ補間したゲインを掛けて合算する
+  MCIM_DUCKER* ducker = &(mixer->ducker);
+  const float peak = mixer->kernels->peak(workspace->trigger, MCIM_MIXER_CHANNELS * frames);
+  const float time = (peak > ducker->envelope ? ducker->attack : ducker->release);
+  const float coef = (time > 0.0f ? 1.0f - expf(-(float)frames / time) : 1.0f);
+  ducker->envelope += (peak - ducker->envelope) * coef;
+
+  float gain = 1.0f;
+  if (ducker->envelope > ducker->threshold) {
+    float reduction = 20.0f * log10f(ducker->envelope / ducker->threshold);
+    if (reduction > ducker->depth) {
+      reduction = ducker->depth;
+    }
+    gain = powf(10.0f, -reduction / 20.0f);
+  }
+  ducker->from = ducker->gain;
+  ducker->gain = gain;
+}
+
+static uint32_t mcim_mixer_resample(const MCIM_KERNELS* restrict kernels,
+                                    const MCIM_VOICE* restrict voice,
+                                    uint64_t* restrict pposition,
+                                    uint64_t step,
+                                    float* restrict dst,
+                                    uint32_t frames,
+                                    bool wait) {
+  assert(kernels != NULL);
+  assert(voice != NULL);
+  assert(voice->pcm != NULL);
+  assert(pposition != NULL);
+  assert(dst != NULL);
+
+  const MCIM_PCM* pcm = voice->pcm;
+  const uint16_t channels = pcm->channels;
+  const uint32_t total = pcm->frames;
+  const uint32_t loopStart = voice->loopStart;
+  const uint32_t loopEnd = voice->loopEnd;
+  const uint64_t loopLength = (uint64_t)(loopEnd - loopStart) << 32;
+  uint64_t position = *pposition;
+  mcim_wave_set_loop_hint(pcm, loopStart, loopEnd);
+
+  uint32_t produced = 0;
+  while (produced < frames) {
+    uint32_t index = (uint32_t)(position >> 32);
+
+    // ループ終端を越えた分はloopStartからの位置に持ち越すことで、
+    // 継ぎ目でもソースのサンプル間隔が保たれる
+    if (loopEnd != 0) {
+      while (index >= loopEnd) {
+        position -= loopLength;
+        index = (uint32_t)(position >> 32);
+      }
+    } else if (index >= total) {
+      break;
+    }
+
+    // 次のサンプルも範囲内に収まる区間はカーネルでまとめて補間する
+    // 常駐していないPCMではデコード済みの区間の終端でも区切る
+    const uint32_t limit = (loopEnd != 0 ? loopEnd : total);
+    uint32_t spanStart;
+    uint32_t spanEnd;
+    const float* span = mcim_wave_map(pcm, index, &spanStart, &spanEnd, wait);
+    const uint32_t runLimit = (spanEnd < limit ? spanEnd : limit);
+    if (index + 1 < runLimit) {
+      const uint64_t available = (((uint64_t)(runLimit - 1) << 32) - position + step - 1) / step;
+      const uint32_t count = (uint32_t)(available < frames - produced ? available : frames - produced);
+      kernels->resample(dst + 2 * produced, span, channels, position - ((uint64_t)spanStart << 32), step, count);
+      position += step * count;
+      produced += count;
+      continue;
+    }
+    assert(index + 1 == limit);
+
+    // 末尾のフレームでは、補間に使う次のサンプルをループ終端ならloopStartのサンプルとする
+    const float frac = (float)(uint32_t)position * (1.0f / 4294967296.0f);
+    const float* s0 = span + (size_t)(index - spanStart) * channels;
+    const float left0 = s0[0];
+    const float right0 = (channels == 2 ? s0[1] : left0);
+    float left1 = left0;
+    float right1 = right0;
+    if (loopEnd != 0) {
+      const float* s1 = mcim_wave_map(pcm, loopStart, &spanStart, &spanEnd, wait);
+      s1 += (size_t)(loopStart - spanStart) * channels;
+      left1 = s1[0];
+      right1 = (channels == 2 ? s1[1] : left1);
+    }
+    const float left = left0 + (left1 - left0) * frac;
+    const float right = right0 + (right1 - right0) * frac;
+    dst[2 * produced] = left;
+    dst[2 * produced + 1] = right;
+    position += step;
+    produced++;
+  }
+
+  *pposition = position;
+  return produced;
+}
+
+static uint64_t mcim_mixer_voice_step(const MCIM_VOICE* voice) {
+  assert(voice != NULL);
+
+  // 時間伸縮時も平均的なソースの進み幅は同じになる
+  return (uint64_t)((double)voice->step * (double)voice->rate);
+}
+
+static uint64_t mcim_mixer_wrap(const MCIM_VOICE* voice, uint64_t position) {
+  assert(voice != NULL);
+
+  if (voice->loopEnd != 0) {
+    const uint64_t loopEnd = (uint64_t)voice->loopEnd << 32;
+    const uint64_t loopLength = (uint64_t)(voice->loopEnd - voice->loopStart) << 32;
+    if (position >= loopEnd) {
+      position -= ((position - loopEnd) / loopLength + 1) * loopLength;
+    }
+  }
+  return position;
+}
+
+static uint32_t mcim_mixer_read_source(void* context, uint64_t position, float* dst, uint32_t frames) {
+  assert(context != NULL);
+  assert(dst != NULL);
+
+  const MCIM_MIXER_SOURCE* source = (const MCIM_MIXER_SOURCE*)context;
+  const uint32_t produced = mcim_mixer_resample(source->kernels, source->voice, &position, source->voice->step, dst, frames, source->wait);
+  if (produced < frames) {
+    SecureZeroMemory(dst + 2 * produced, sizeof(float) * 2 * (frames - produced));
+  }
+  return produced;
+}
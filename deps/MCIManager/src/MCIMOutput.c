@@ -0,0 +1,269 @@
+﻿#include "_MCIMOutput.h"
+
+#include <assert.h>
+#include <process.h>
+
+#include "_MCIMLog.h"
+#include "_MCIMStats.h"
+
+static void mcim_output_fill(MCIM_OUTPUT* output, WAVEHDR* header);
+static bool mcim_output_played_frames(MCIM_OUTPUT* restrict output, uint64_t* restrict played);
+static void mcim_output_measure(MCIM_OUTPUT* output);
+static void mcim_output_publish_clock(MCIM_OUTPUT* output);
+static unsigned __stdcall mcim_output_thread(void* pargs);
+
+/**************************************************************************************************/
+
+MCIM_OUTPUT* mcim_output_open(MCIM_MIXER* restrict mixer,
+                              const MCIM_OUTPUT_CONFIG* restrict config,
+                              mcim_allocator_t allocator,
+                              mcim_deallocator_t deallocator) {
+  assert(mixer != NULL);
+  assert(config != NULL);
+  assert(config->periodFrames >= MCIM_OUTPUT_MIN_PERIOD_FRAMES && config->periodFrames <= MCIM_OUTPUT_MAX_PERIOD_FRAMES);
+  assert(config->bufferCount >= 2 && config->bufferCount <= MCIM_OUTPUT_MAX_BUFFER_COUNT);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  MCIM_OUTPUT* ret = (MCIM_OUTPUT*)allocator(sizeof(MCIM_OUTPUT));
+  if (ret == NULL) {
+    return NULL;
+  }
+  SecureZeroMemory(ret, sizeof(MCIM_OUTPUT));
+  ret->mixer = mixer;
+  ret->config = *config;
+  ret->deallocator = deallocator;
+  QueryPerformanceFrequency(&(ret->timerFreq));
+  atomic_init(&(ret->writtenFrames), 0);
+  atomic_init(&(ret->measuredLatency), -1);
+
+  const uint32_t period = config->periodFrames;
+  const uint32_t count = config->bufferCount;
+  ret->headers = (WAVEHDR*)allocator(sizeof(WAVEHDR) * count);
+  ret->buffer = (int16_t*)allocator(sizeof(int16_t) * MCIM_MIXER_CHANNELS * period * count);
+  ret->mixBuffer = (float*)allocator(sizeof(float) * MCIM_MIXER_CHANNELS * period);
+  ret->doneEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+  ret->stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+  if (ret->headers == NULL || ret->buffer == NULL || ret->mixBuffer == NULL || ret->doneEvent == NULL || ret->stopEvent == NULL) {
+    mcim_output_close(ret);
+    return NULL;
+  }
+  SecureZeroMemory(ret->headers, sizeof(WAVEHDR) * count);
+
+  WAVEFORMATEX format = {
+      .wFormatTag = WAVE_FORMAT_PCM,
+      .nChannels = MCIM_MIXER_CHANNELS,
+      .nSamplesPerSec = mixer->sampleRate,
+      .nAvgBytesPerSec = mixer->sampleRate * MCIM_MIXER_CHANNELS * sizeof(int16_t),
+      .nBlockAlign = MCIM_MIXER_CHANNELS * sizeof(int16_t),
+      .wBitsPerSample = 16,
+      .cbSize = 0,
+  };
+  if (waveOutOpen(&(ret->hwo), WAVE_MAPPER, &format, (DWORD_PTR)(ret->doneEvent), 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+    ret->hwo = NULL;
+    mcim_output_close(ret);
+    return NULL;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    WAVEHDR* header = &(ret->headers[i]);
+    header->lpData = (char*)(ret->buffer + (size_t)MCIM_MIXER_CHANNELS * period * i);
+    header->dwBufferLength = sizeof(int16_t) * MCIM_MIXER_CHANNELS * period;
+    if (waveOutPrepareHeader(ret->hwo, header, sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
+      mcim_output_close(ret);
+      return NULL;
+    }
+  }
+
+  ret->hthread = (HANDLE)_beginthreadex(NULL, 0, mcim_output_thread, ret, 0, NULL);
+  if (ret->hthread == (HANDLE)0) {
+    ret->hthread = NULL;
+    mcim_output_close(ret);
+    return NULL;
+  }
+
+  return ret;
+}
+
+void mcim_output_close(MCIM_OUTPUT* output) {
+  if (output == NULL) {
+    return;
+  }
+
+  if (output->hthread != NULL) {
+    SetEvent(output->stopEvent);
+    WaitForSingleObject(output->hthread, INFINITE);
+    CloseHandle(output->hthread);
+  }
+  if (output->hwo != NULL) {
+    waveOutReset(output->hwo);
+    for (uint32_t i = 0; i < output->config.bufferCount; i++) {
+      if ((output->headers[i].dwFlags & WHDR_PREPARED) != 0) {
+        waveOutUnprepareHeader(output->hwo, &(output->headers[i]), sizeof(WAVEHDR));
+      }
+    }
+    waveOutClose(output->hwo);
+  }
+  if (output->stopEvent != NULL) {
+    CloseHandle(output->stopEvent);
+  }
+  if (output->doneEvent != NULL) {
+    CloseHandle(output->doneEvent);
+  }
+
+  mcim_deallocator_t deallocator = output->deallocator;
+  if (output->mixBuffer != NULL) {
+    deallocator(output->mixBuffer);
+  }
+  if (output->buffer != NULL) {
+    deallocator(output->buffer);
+  }
+  if (output->headers != NULL) {
+    deallocator(output->headers);
+  }
+  deallocator(output);
+}
+
+void mcim_output_get_latency(MCIM_OUTPUT* restrict output, const MCIM_OUTPUT_CONFIG* restrict config, MCIM_LATENCY_INFO* restrict info) {
+  assert(config != NULL);
+  assert(info != NULL);
+
+  const double rate = (double)MCIM_MIXER_SAMPLE_RATE;
+  info->configured = (double)config->periodFrames * config->bufferCount / rate;
+  info->outputDelay = 0.0;
+  info->commandToFirstSample = -1.0;
+  if (output == NULL) {
+    return;
+  }
+
+  uint64_t played;
+  uint64_t written = atomic_load(&(output->writtenFrames));
+  if (mcim_output_played_frames(output, &played) && written > played) {
+    info->outputDelay = (double)(written - played) / rate;
+  }
+
+  int64_t measured = atomic_load(&(output->measuredLatency));
+  if (measured >= 0) {
+    info->commandToFirstSample = (double)measured / (double)(output->timerFreq).QuadPart;
+  }
+}
+
+/**************************************************************************************************/
+
+static void mcim_output_fill(MCIM_OUTPUT* output, WAVEHDR* header) {
+  assert(output != NULL);
+  assert(header != NULL);
+
+  const uint32_t period = output->config.periodFrames;
+  const uint32_t count = MCIM_MIXER_CHANNELS * period;
+  float* mix = output->mixBuffer;
+  int16_t* dst = (int16_t*)(header->lpData);
+
+  mcim_mixer_render(output->mixer, mix, period);
+  output->mixer->kernels->float_to_s16(dst, mix, count);
+
+  // このブロックで再生開始したボイスがあれば、その最初のサンプルが再生される時刻を計測対象とする
+  uint64_t frame;
+  LONGLONG command;
+  if (mcim_mixer_take_latency_mark(output->mixer, &frame, &command)) {
+    output->measuring = true;
+    output->measureFrame = frame - output->clockBase;
+    output->measureCommand = command;
+  }
+
+  header->dwFlags &= ~WHDR_DONE;
+  waveOutWrite(output->hwo, header, sizeof(WAVEHDR));
+  atomic_fetch_add(&(output->writtenFrames), period);
+}
+
+static bool mcim_output_played_frames(MCIM_OUTPUT* restrict output, uint64_t* restrict played) {
+  assert(output != NULL);
+  assert(played != NULL);
+
+  MMTIME mmt = {.wType = TIME_SAMPLES};
+  if (waveOutGetPosition(output->hwo, &mmt, sizeof(MMTIME)) != MMSYSERR_NOERROR || mmt.wType != TIME_SAMPLES) {
+    return false;
+  }
+
+  // TIME_SAMPLESは32bitで折り返すため、書き込み済みフレーム数から上位ビットを補う
+  uint64_t written = atomic_load(&(output->writtenFrames));
+  uint64_t value = (written & ~(uint64_t)UINT32_MAX) | mmt.u.sample;
+  if (value > written) {
+    value -= ((uint64_t)1 << 32);
+  }
+  *played = value;
+  return true;
+}
+
+static void mcim_output_measure(MCIM_OUTPUT* output) {
+  assert(output != NULL);
+
+  if (!output->measuring) {
+    return;
+  }
+
+  uint64_t played;
+  if (!mcim_output_played_frames(output, &played) || played < output->measureFrame) {
+    return;
+  }
+
+  // 再生位置の通知はバッファ単位でしか得られないため、
+  // 対象フレームを通り過ぎた分を差し引いて再生開始時刻を推定する
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  LONGLONG overshoot = (LONGLONG)((played - output->measureFrame) * (uint64_t)(output->timerFreq).QuadPart / MCIM_MIXER_SAMPLE_RATE);
+  LONGLONG latency = now.QuadPart - overshoot - output->measureCommand;
+  atomic_store(&(output->measuredLatency), (latency > 0 ? latency : 0));
+  output->measuring = false;
+}
+
+static void mcim_output_publish_clock(MCIM_OUTPUT* output) {
+  assert(output != NULL);
+
+  // 再生位置と取得時刻の組を公開し、次の更新までの位置は読み出し側で補間させる
+  uint64_t played;
+  if (!mcim_output_played_frames(output, &played)) {
+    return;
+  }
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  uint64_t written = atomic_load(&(output->writtenFrames));
+  mcim_mixer_publish_clock(output->mixer, output->clockBase + played, now.QuadPart, output->clockBase + written);
+}
+
+static unsigned __stdcall mcim_output_thread(void* pargs) {
+  MCIM_OUTPUT* output = (MCIM_OUTPUT*)pargs;
+  HANDLE handles[2] = {output->stopEvent, output->doneEvent};
+  const uint32_t count = output->config.bufferCount;
+
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+  // 全バッファを先に埋めてキューに積み、以後は再生完了したバッファから順に再利用する
+  output->clockBase = output->mixer->renderedFrames;
+  for (uint32_t i = 0; i < count; i++) {
+    mcim_output_fill(output, &(output->headers[i]));
+  }
+  output->nextHeader = 0;
+  mcim_output_publish_clock(output);
+
+  while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+    mcim_output_measure(output);
+
+    // doneEventは自動リセットであり、一度の通知で複数のバッファが完了している場合がある
+    uint32_t filled = 0;
+    while ((output->headers[output->nextHeader].dwFlags & WHDR_DONE) != 0) {
+      mcim_output_fill(output, &(output->headers[output->nextHeader]));
+      output->nextHeader = (output->nextHeader + 1) % count;
+      filled++;
+    }
+    mcim_output_publish_clock(output);
+
+    // 全てのバッファが再生し終わっていた場合はデバイスが無音となっていた可能性がある
+    if (filled >= count) {
+      mcim_stats_record_underrun();
+      mcim_log_write(MCIM_LOG_WARNING, "mcim_output_underrun", "buffers", filled, "period", output->config.periodFrames);
+    }
+  }
+
+  return 0;
+}
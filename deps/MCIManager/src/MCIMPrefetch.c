@@ -0,0 +1,355 @@
+﻿#include "_MCIMPrefetch.h"
+
+#include <assert.h>
+
+// MCIで再生するファイルをOSのファイルキャッシュへ読み流す際の読み込み単位
+#define MCIM_PREFETCH_WARM_BYTES (64 * 1024)
+
+static bool mcim_prefetcher_task(MCIM_WORKER_TASK* task);
+static bool mcim_prefetcher_run(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item, MCIM_PCM** restrict pcm);
+static bool mcim_prefetcher_warm(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item);
+static MCIM_PREFETCH_ITEM* mcim_prefetcher_find(MCIM_PREFETCHER* restrict prefetcher, const wchar_t* restrict filepath);
+static void mcim_prefetcher_unlink(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item);
+static void mcim_prefetcher_free_item(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item);
+static void mcim_prefetcher_sort(MCIM_PREFETCHER* prefetcher);
+
+/**************************************************************************************************/
+
+void mcim_prefetcher_init(MCIM_PREFETCHER* prefetcher, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(prefetcher != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  SecureZeroMemory(prefetcher, sizeof(MCIM_PREFETCHER));
+  prefetcher->task.run = mcim_prefetcher_task;
+  prefetcher->scheduled = false;
+  atomic_init(&(prefetcher->terminate), false);
+  InitializeCriticalSection(&(prefetcher->mutex));
+  InitializeConditionVariable(&(prefetcher->loaded));
+  prefetcher->items = NULL;
+  prefetcher->allocator = allocator;
+  prefetcher->deallocator = deallocator;
+}
+
+void mcim_prefetcher_destroy(MCIM_PREFETCHER* prefetcher) {
+  assert(prefetcher != NULL);
+
+  // 読み込み中のタスクの完了を待つため、以降は項目を参照するスレッドは無い
+  atomic_store(&(prefetcher->terminate), true);
+  mcim_worker_cancel(&(prefetcher->task));
+  prefetcher->scheduled = false;
+
+  while (prefetcher->items != NULL) {
+    MCIM_PREFETCH_ITEM* item = prefetcher->items;
+    prefetcher->items = item->next;
+    mcim_prefetcher_free_item(prefetcher, item);
+  }
+  DeleteCriticalSection(&(prefetcher->mutex));
+  SecureZeroMemory(&(prefetcher->mutex), sizeof(CRITICAL_SECTION));
+}
+
+bool mcim_prefetcher_submit(MCIM_PREFETCHER* restrict prefetcher, const MCIM_PREFETCH_ENTRY* restrict manifest, uint32_t count, MCIM_RESIDENCY residency) {
+  assert(prefetcher != NULL);
+  assert(manifest != NULL || count == 0);
+
+  bool result = true;
+  EnterCriticalSection(&(prefetcher->mutex));
+  MCIM_PREFETCH_ITEM** ptail = &(prefetcher->items);
+  for (MCIM_PREFETCH_ITEM* item = prefetcher->items; item != NULL; item = item->next) {
+    item->listed = false;
+    ptail = &(item->next);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    MCIM_PREFETCH_ITEM* item = mcim_prefetcher_find(prefetcher, manifest[i].filepath);
+    if (item != NULL) {
+      item->priority = manifest[i].priority;
+      item->listed = true;
+      continue;
+    }
+
+    const size_t pathlen = wcslen(manifest[i].filepath);
+    item = (MCIM_PREFETCH_ITEM*)prefetcher->allocator(sizeof(MCIM_PREFETCH_ITEM));
+    wchar_t* path = (wchar_t*)prefetcher->allocator(sizeof(wchar_t) * (pathlen + 1));
+    if (item == NULL || path == NULL || wcscpy_s(path, pathlen + 1, manifest[i].filepath) != 0) {
+      if (item != NULL) {
+        prefetcher->deallocator(item);
+      }
+      if (path != NULL) {
+        prefetcher->deallocator(path);
+      }
+      result = false;
+      continue;
+    }
+    SecureZeroMemory(item, sizeof(MCIM_PREFETCH_ITEM));
+    item->filepath = path;
+    item->priority = manifest[i].priority;
+    item->residency = residency;
+    item->state = MCIM_PREFETCH_QUEUED;
+    atomic_init(&(item->canceled), false);
+    item->listed = true;
+    item->next = NULL;
+    *ptail = item;
+    ptail = &(item->next);
+  }
+
+  // マニフェストから外れた項目は取り消す（読み込み中の項目は完了時にワーカーが解放する）
+  MCIM_PREFETCH_ITEM** pitem = &(prefetcher->items);
+  while (*pitem != NULL) {
+    MCIM_PREFETCH_ITEM* item = *pitem;
+    if (item->listed || atomic_load(&(item->canceled))) {
+      pitem = &(item->next);
+      continue;
+    }
+    if (item->state == MCIM_PREFETCH_LOADING) {
+      atomic_store(&(item->canceled), true);
+      pitem = &(item->next);
+      continue;
+    }
+    if (item->state != MCIM_PREFETCH_FAILED) {
+      prefetcher->canceled++;
+    }
+    *pitem = item->next;
+    mcim_prefetcher_free_item(prefetcher, item);
+  }
+
+  mcim_prefetcher_sort(prefetcher);
+
+  // タスクは未処理の項目が残っている間ワーカーに積まれたままとなるため、積まれていない時のみ積む
+  bool queued = false;
+  for (MCIM_PREFETCH_ITEM* item = prefetcher->items; item != NULL; item = item->next) {
+    queued = queued || item->state == MCIM_PREFETCH_QUEUED;
+  }
+  if (queued && !prefetcher->scheduled) {
+    if (mcim_worker_post(&(prefetcher->task))) {
+      prefetcher->scheduled = true;
+    } else {
+      result = false;
+    }
+  }
+  LeaveCriticalSection(&(prefetcher->mutex));
+  return result;
+}
+
+bool mcim_prefetcher_take(MCIM_PREFETCHER* restrict prefetcher, const wchar_t* restrict filepath, MCIM_PCM** restrict pcm) {
+  assert(prefetcher != NULL);
+  assert(filepath != NULL);
+  assert(pcm != NULL);
+
+  *pcm = NULL;
+  bool hit = false;
+  bool waited = false;
+  EnterCriticalSection(&(prefetcher->mutex));
+  for (;;) {
+    MCIM_PREFETCH_ITEM* item = mcim_prefetcher_find(prefetcher, filepath);
+    if (item == NULL) {
+      prefetcher->misses++;
+      break;
+    }
+
+    // 読み込み中であれば、最初から読み直すより完了を待つ方が早い
+    if (item->state == MCIM_PREFETCH_LOADING) {
+      waited = true;
+      SleepConditionVariableCS(&(prefetcher->loaded), &(prefetcher->mutex), INFINITE);
+      continue;
+    }
+
+    // 未処理の項目は呼び出し側で同期的に読み込むため、先読みを取り消す
+    mcim_prefetcher_unlink(prefetcher, item);
+    if (item->state == MCIM_PREFETCH_READY) {
+      hit = true;
+      *pcm = item->pcm;
+      item->pcm = NULL;
+      if (waited) {
+        prefetcher->lateHits++;
+      } else {
+        prefetcher->hits++;
+      }
+    } else {
+      prefetcher->misses++;
+    }
+    mcim_prefetcher_free_item(prefetcher, item);
+    break;
+  }
+  LeaveCriticalSection(&(prefetcher->mutex));
+  return hit;
+}
+
+void mcim_prefetcher_get_stats(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_STATS* restrict stats) {
+  assert(prefetcher != NULL);
+  assert(stats != NULL);
+
+  SecureZeroMemory(stats, sizeof(MCIM_PREFETCH_STATS));
+  EnterCriticalSection(&(prefetcher->mutex));
+  for (const MCIM_PREFETCH_ITEM* item = prefetcher->items; item != NULL; item = item->next) {
+    if (atomic_load(&(item->canceled))) {
+      continue;
+    }
+    if (item->state == MCIM_PREFETCH_READY) {
+      stats->ready++;
+    } else if (item->state != MCIM_PREFETCH_FAILED) {
+      stats->pending++;
+    }
+  }
+  stats->hits = prefetcher->hits;
+  stats->lateHits = prefetcher->lateHits;
+  stats->misses = prefetcher->misses;
+  stats->canceled = prefetcher->canceled;
+  LeaveCriticalSection(&(prefetcher->mutex));
+
+  const uint32_t loads = stats->hits + stats->lateHits + stats->misses;
+  stats->hitRate = (loads > 0 ? (double)(stats->hits + stats->lateHits) / (double)loads : 0.0);
+}
+
+/**************************************************************************************************/
+
+static bool mcim_prefetcher_task(MCIM_WORKER_TASK* task) {
+  MCIM_PREFETCHER* prefetcher = (MCIM_PREFETCHER*)task;
+
+  // 項目は優先度の降順に並んでいるため、先頭の未処理の項目が最も優先度が高い
+  // 一件毎にワーカーへ戻るため、後から積まれた優先度の高い項目は次の一件として読み込まれる
+  EnterCriticalSection(&(prefetcher->mutex));
+  MCIM_PREFETCH_ITEM* item = prefetcher->items;
+  while (item != NULL && item->state != MCIM_PREFETCH_QUEUED) {
+    item = item->next;
+  }
+  if (item == NULL || atomic_load(&(prefetcher->terminate))) {
+    prefetcher->scheduled = false;
+    LeaveCriticalSection(&(prefetcher->mutex));
+    return false;
+  }
+  item->state = MCIM_PREFETCH_LOADING;
+  LeaveCriticalSection(&(prefetcher->mutex));
+
+  MCIM_PCM* pcm = NULL;
+  bool result = mcim_prefetcher_run(prefetcher, item, &pcm);
+
+  EnterCriticalSection(&(prefetcher->mutex));
+  if (atomic_load(&(item->canceled))) {
+    mcim_prefetcher_unlink(prefetcher, item);
+    if (pcm != NULL) {
+      mcim_wave_free(pcm, prefetcher->deallocator);
+    }
+    mcim_prefetcher_free_item(prefetcher, item);
+    prefetcher->canceled++;
+  } else {
+    item->pcm = pcm;
+    item->state = (result ? MCIM_PREFETCH_READY : MCIM_PREFETCH_FAILED);
+  }
+  WakeAllConditionVariable(&(prefetcher->loaded));
+  LeaveCriticalSection(&(prefetcher->mutex));
+  return !atomic_load(&(prefetcher->terminate));
+}
+
+static bool mcim_prefetcher_run(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item, MCIM_PCM** restrict pcm) {
+  assert(prefetcher != NULL);
+  assert(item != NULL);
+  assert(pcm != NULL);
+
+  if (!mcim_wave_probe(item->filepath)) {
+    return mcim_prefetcher_warm(prefetcher, item);
+  }
+
+  // デコードして常駐させる場合はディスクキャッシュの作成も含めてロードと同じ処理を行う
+  *pcm = mcim_wave_load(item->filepath, item->residency, true, prefetcher->allocator, prefetcher->deallocator);
+  if (*pcm == NULL) {
+    return false;
+  }
+
+  // 常駐させない場合は再生開始位置の区間を先にデコードし、最初のブロックでファイルの読み込みを待たないようにする
+  if ((*pcm)->window != NULL) {
+    uint32_t start;
+    uint32_t end;
+    mcim_wave_map(*pcm, 0, &start, &end, true);
+  }
+  return true;
+}
+
+static bool mcim_prefetcher_warm(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item) {
+  assert(prefetcher != NULL);
+  assert(item != NULL);
+
+  HANDLE hfile = CreateFileW(item->filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  uint8_t* buffer = (uint8_t*)prefetcher->allocator(MCIM_PREFETCH_WARM_BYTES);
+  if (buffer == NULL) {
+    CloseHandle(hfile);
+    return false;
+  }
+
+  // 読み込み単位毎に取り消しを確認し、不要になった大きなファイルを最後まで読まないようにする
+  bool result = true;
+  for (;;) {
+    if (atomic_load(&(prefetcher->terminate)) || atomic_load(&(item->canceled))) {
+      result = false;
+      break;
+    }
+    DWORD read = 0;
+    if (ReadFile(hfile, buffer, MCIM_PREFETCH_WARM_BYTES, &read, NULL) == 0) {
+      result = false;
+      break;
+    }
+    if (read < MCIM_PREFETCH_WARM_BYTES) {
+      break;
+    }
+  }
+  prefetcher->deallocator(buffer);
+  CloseHandle(hfile);
+  return result;
+}
+
+static MCIM_PREFETCH_ITEM* mcim_prefetcher_find(MCIM_PREFETCHER* restrict prefetcher, const wchar_t* restrict filepath) {
+  assert(prefetcher != NULL);
+  assert(filepath != NULL);
+
+  for (MCIM_PREFETCH_ITEM* item = prefetcher->items; item != NULL; item = item->next) {
+    if (!atomic_load(&(item->canceled)) && wcscmp(item->filepath, filepath) == 0) {
+      return item;
+    }
+  }
+  return NULL;
+}
+
+static void mcim_prefetcher_unlink(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item) {
+  assert(prefetcher != NULL);
+  assert(item != NULL);
+
+  MCIM_PREFETCH_ITEM** pitem = &(prefetcher->items);
+  while (*pitem != item) {
+    assert(*pitem != NULL);
+    pitem = &((*pitem)->next);
+  }
+  *pitem = item->next;
+  item->next = NULL;
+}
+
+static void mcim_prefetcher_free_item(MCIM_PREFETCHER* restrict prefetcher, MCIM_PREFETCH_ITEM* restrict item) {
+  assert(prefetcher != NULL);
+  assert(item != NULL);
+
+  if (item->pcm != NULL) {
+    mcim_wave_free(item->pcm, prefetcher->deallocator);
+  }
+  prefetcher->deallocator(item->filepath);
+  prefetcher->deallocator(item);
+}
+
+static void mcim_prefetcher_sort(MCIM_PREFETCHER* prefetcher) {
+  assert(prefetcher != NULL);
+
+  // マニフェストは高々数十件であるため、安定な挿入ソートで足りる
+  MCIM_PREFETCH_ITEM* sorted = NULL;
+  while (prefetcher->items != NULL) {
+    MCIM_PREFETCH_ITEM* item = prefetcher->items;
+    prefetcher->items = item->next;
+    MCIM_PREFETCH_ITEM** pitem = &sorted;
+    while (*pitem != NULL && (*pitem)->priority >= item->priority) {
+      pitem = &((*pitem)->next);
+    }
+    item->next = *pitem;
+    *pitem = item;
+  }
+  prefetcher->items = sorted;
+}
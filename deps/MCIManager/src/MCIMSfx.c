@@ -0,0 +1,519 @@
+﻿#include "_MCIMSfx.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+static bool mcim_sfx_pool_enqueue(MCIM_SFX_POOL* restrict pool, const MCIM_SFX_TRIGGER* restrict trigger);
+static bool mcim_sfx_pool_dequeue(MCIM_SFX_POOL* restrict pool, MCIM_SFX_TRIGGER* restrict trigger);
+static void mcim_sfx_pool_start(MCIM_SFX_POOL* restrict pool, MCIM_MIXER* restrict mixer, const MCIM_SFX_TRIGGER* restrict trigger);
+static void mcim_sfx_pool_place(MCIM_SFX_POOL* pool, const MCIM_SFX_TRIGGER* trigger);
+static void mcim_sfx_pool_spatialize(MCIM_SFX_POOL* pool);
+static uint32_t mcim_sfx_pool_find_victim(const MCIM_SFX_POOL* pool);
+static void mcim_sfx_pool_retire(MCIM_SFX_POOL* pool, uint32_t index);
+
+/**************************************************************************************************/
+
+bool mcim_sfx_pool_prepare(MCIM_MIXER* mixer, uint32_t polyphony, mcim_allocator_t allocator) {
+  assert(mixer != NULL);
+  assert(polyphony > 0 && polyphony <= MCIM_SFX_VOICE_COUNT);
+  assert(allocator != NULL);
+
+  if (mixer->sfx != NULL) {
+    return true;
+  }
+
+  MCIM_SFX_POOL* pool = (MCIM_SFX_POOL*)allocator(sizeof(MCIM_SFX_POOL));
+  if (pool == NULL) {
+    return false;
+  }
+
+  SecureZeroMemory(pool, sizeof(MCIM_SFX_POOL));
+  for (uint32_t i = 0; i < MCIM_SFX_QUEUE_SIZE; i++) {
+    atomic_init(&(pool->queue[i].sequence), i);
+  }
+  atomic_init(&(pool->enqueuePos), 0);
+  atomic_init(&(pool->polyphony), polyphony);
+  atomic_init(&(pool->nextInstance), 0);
+  pool->listener.invPanWidth = 1.0f;
+  pool->listener.reference = 1.0f;
+  for (uint32_t i = 0; i < MCIM_SFX_VOICE_COUNT; i++) {
+    pool->idle[i] = (uint16_t)(MCIM_SFX_VOICE_COUNT - 1 - i);
+  }
+  pool->idleCount = MCIM_SFX_VOICE_COUNT;
+
+  EnterCriticalSection(&(mixer->mutex));
+  mixer->sfx = pool;
+  LeaveCriticalSection(&(mixer->mutex));
+  return true;
+}
+
+void mcim_sfx_pool_destroy(MCIM_MIXER* mixer, mcim_deallocator_t deallocator) {
+  assert(mixer != NULL);
+  assert(deallocator != NULL);
+
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  if (pool == NULL) {
+    return;
+  }
+
+  EnterCriticalSection(&(mixer->mutex));
+  mixer->sfx = NULL;
+  LeaveCriticalSection(&(mixer->mutex));
+
+  for (uint32_t i = 0; i < pool->sampleCount; i++) {
+    if (pool->samples[i].pcm != NULL) {
+      mcim_wave_free(pool->samples[i].pcm, deallocator);
+    }
+  }
+  if (pool->samples != NULL) {
+    deallocator(pool->samples);
+  }
+  deallocator(pool);
+}
+
+MCIM_KEY mcim_sfx_pool_add_sample(MCIM_MIXER* restrict mixer, MCIM_PCM* restrict pcm, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(mixer != NULL);
+  assert(mixer->sfx != NULL);
+  assert(pcm != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  MCIM_SFX_SAMPLE* old = NULL;
+
+  // サンプル表の拡張はロック外で確保し、差し替えのみをロック内で行う
+  // （サンプルの登録と解除は呼び出し元のスレッドからのみ行われる）
+  if (pool->sampleCount == pool->sampleCapacity) {
+    uint32_t capacity = (pool->sampleCapacity == 0 ? 16 : pool->sampleCapacity * 2);
+    if (capacity <= pool->sampleCapacity || capacity >= MCIM_INVALID_KEY) {
+      return MCIM_INVALID_KEY;
+    }
+    MCIM_SFX_SAMPLE* samples = (MCIM_SFX_SAMPLE*)allocator(sizeof(MCIM_SFX_SAMPLE) * capacity);
+    if (samples == NULL) {
+      return MCIM_INVALID_KEY;
+    }
+    if (pool->sampleCount > 0) {
+      memcpy(samples, pool->samples, sizeof(MCIM_SFX_SAMPLE) * pool->sampleCount);
+    }
+
+    EnterCriticalSection(&(mixer->mutex));
+    old = pool->samples;
+    pool->samples = samples;
+    pool->sampleCapacity = capacity;
+    LeaveCriticalSection(&(mixer->mutex));
+  }
+
+  EnterCriticalSection(&(mixer->mutex));
+  MCIM_KEY key = pool->sampleCount;
+  pool->samples[key].pcm = pcm;
+  pool->samples[key].sidechain = false;
+  pool->samples[key].bus = NULL;
+  pool->sampleCount++;
+  LeaveCriticalSection(&(mixer->mutex));
+
+  if (old != NULL) {
+    deallocator(old);
+  }
+  return key;
+}
+
+MCIM_PCM* mcim_sfx_pool_remove_sample(MCIM_MIXER* mixer, MCIM_KEY key) {
+  assert(mixer != NULL);
+
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  // キーは再利用しないため、キューに残っている同じキーの発音要求は取り出し時に無視される
+  EnterCriticalSection(&(mixer->mutex));
+  MCIM_PCM* pcm = NULL;
+  if (key < pool->sampleCount) {
+    pcm = pool->samples[key].pcm;
+    pool->samples[key].pcm = NULL;
+  }
+  if (pcm != NULL) {
+    for (uint32_t i = 0; i < pool->activeCount;) {
+      if (pool->slots[pool->active[i]].voice.pcm == pcm) {
+        mcim_sfx_pool_retire(pool, i);
+      } else {
+        i++;
+      }
+    }
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+  return pcm;
+}
+
+bool mcim_sfx_pool_set_sidechain(MCIM_MIXER* mixer, MCIM_KEY key, bool sidechain) {
+  assert(mixer != NULL);
+
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  if (pool == NULL) {
+    return false;
+  }
+
+  EnterCriticalSection(&(mixer->mutex));
+  bool found = (key < pool->sampleCount && pool->samples[key].pcm != NULL);
+  if (found) {
+    pool->samples[key].sidechain = sidechain;
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+  return found;
+}
+
+bool mcim_sfx_pool_set_bus(MCIM_MIXER* restrict mixer, MCIM_KEY key, MCIM_MIXER_BUS* restrict bus) {
+  assert(mixer != NULL);
+
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  if (pool == NULL) {
+    return false;
+  }
+
+  // サンプルの登録と解除は呼び出し元のスレッドからのみ行われるため、ロックを取らずに判定できる
+  // 出力先はバスの追加や削除と同じ順序で反映する必要があるため、ミキサーの変更要求として積む
+  bool found = (key < pool->sampleCount && pool->samples[key].pcm != NULL);
+  if (found) {
+    mcim_mixer_set_sfx_bus(mixer, key, bus);
+  }
+  return found;
+}
+
+void mcim_sfx_pool_reroute(MCIM_SFX_POOL* restrict pool, const MCIM_MIXER_BUS* restrict from, MCIM_MIXER_BUS* restrict to) {
+  assert(pool != NULL);
+  assert(from != NULL);
+  assert(to != NULL);
+
+  // マスターはNULLとして持つため、付け替え先がマスターの場合もNULLとする
+  MCIM_MIXER_BUS* bus = (to->parent != NULL ? to : NULL);
+  for (uint32_t i = 0; i < pool->sampleCount; i++) {
+    if (pool->samples[i].bus == from) {
+      pool->samples[i].bus = bus;
+    }
+  }
+  for (uint32_t i = 0; i < pool->activeCount; i++) {
+    MCIM_SFX_SLOT* slot = &(pool->slots[pool->active[i]]);
+    if (slot->voice.bus == from) {
+      slot->voice.bus = bus;
+    }
+  }
+}
+
+void mcim_sfx_pool_clear(MCIM_MIXER* mixer) {
+  assert(mixer != NULL);
+
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  if (pool == NULL) {
+    return;
+  }
+
+  EnterCriticalSection(&(mixer->mutex));
+  MCIM_SFX_TRIGGER trigger;
+  while (mcim_sfx_pool_dequeue(pool, &trigger)) {
+  }
+  while (pool->activeCount > 0) {
+    mcim_sfx_pool_retire(pool, pool->activeCount - 1);
+  }
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+bool mcim_sfx_pool_trigger(MCIM_SFX_POOL* pool, MCIM_KEY key, float gain, int32_t priority) {
+  assert(pool != NULL);
+
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+
+  MCIM_SFX_TRIGGER trigger = {.request = MCIM_SFX_REQUEST_PLAY, .key = key, .gain = gain, .priority = priority, .command = now.QuadPart};
+  return mcim_sfx_pool_enqueue(pool, &trigger);
+}
+
+uint32_t mcim_sfx_pool_trigger_at(MCIM_SFX_POOL* pool, MCIM_KEY key, float gain, int32_t priority, float x, float y) {
+  assert(pool != NULL);
+
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+
+  // 発音IDは0を無効値として、周回しても0を返さないように採番する
+  uint32_t instance = atomic_fetch_add_explicit(&(pool->nextInstance), 1, memory_order_relaxed) + 1;
+  if (instance == 0) {
+    instance = atomic_fetch_add_explicit(&(pool->nextInstance), 1, memory_order_relaxed) + 1;
+  }
+
+  MCIM_SFX_TRIGGER trigger = {
+      .request = MCIM_SFX_REQUEST_PLAY_AT, .key = key, .gain = gain, .priority = priority, .instance = instance, .x = x, .y = y, .command = now.QuadPart};
+  return (mcim_sfx_pool_enqueue(pool, &trigger) ? instance : 0);
+}
+
+bool mcim_sfx_pool_move(MCIM_SFX_POOL* pool, uint32_t instance, float x, float y) {
+  assert(pool != NULL);
+
+  if (instance == 0) {
+    return false;
+  }
+
+  MCIM_SFX_TRIGGER trigger = {.request = MCIM_SFX_REQUEST_MOVE, .instance = instance, .x = x, .y = y};
+  return mcim_sfx_pool_enqueue(pool, &trigger);
+}
+
+void mcim_sfx_pool_set_listener(MCIM_MIXER* restrict mixer, const MCIM_SFX_LISTENER* restrict listener) {
+  assert(mixer != NULL);
+  assert(listener != NULL);
+
+  MCIM_SFX_POOL* pool = mixer->sfx;
+  if (pool == NULL) {
+    return;
+  }
+
+  EnterCriticalSection(&(mixer->mutex));
+  pool->listener = *listener;
+  LeaveCriticalSection(&(mixer->mutex));
+}
+
+void mcim_sfx_pool_update(MCIM_SFX_POOL* restrict pool, MCIM_MIXER* restrict mixer) {
+  assert(pool != NULL);
+  assert(mixer != NULL);
+
+  MCIM_SFX_TRIGGER trigger;
+  while (mcim_sfx_pool_dequeue(pool, &trigger)) {
+    if (trigger.request == MCIM_SFX_REQUEST_MOVE) {
+      mcim_sfx_pool_place(pool, &trigger);
+    } else {
+      mcim_sfx_pool_start(pool, mixer, &trigger);
+    }
+  }
+
+  if (pool->pannedCount != 0) {
+    mcim_sfx_pool_spatialize(pool);
+  }
+
+  for (uint32_t i = 0; i < pool->activeCount; i++) {
+    const uint16_t index = pool->active[i];
+    MCIM_SFX_SLOT* slot = &(pool->slots[index]);
+    if (slot->voice.panned) {
+      // 発音直後のブロックは補間せずに目標の定位から始める
+      slot->voice.targetPan[0] = pool->spatial.left[index];
+      slot->voice.targetPan[1] = pool->spatial.right[index];
+      if (slot->startFrame == mixer->renderedFrames) {
+        slot->voice.pan[0] = slot->voice.targetPan[0];
+        slot->voice.pan[1] = slot->voice.targetPan[1];
+      }
+    }
+  }
+}
+
+void mcim_sfx_pool_collect(MCIM_SFX_POOL* pool) {
+  assert(pool != NULL);
+
+  for (uint32_t i = 0; i < pool->activeCount;) {
+    if (pool->slots[pool->active[i]].voice.ended) {
+      mcim_sfx_pool_retire(pool, i);
+    } else {
+      i++;
+    }
+  }
+}
+
+/**************************************************************************************************/
+
+static bool mcim_sfx_pool_enqueue(MCIM_SFX_POOL* restrict pool, const MCIM_SFX_TRIGGER* restrict trigger) {
+  assert(pool != NULL);
+  assert(trigger != NULL);
+
+  // 複数の書き込み側と単一の読み出し側からなる有界キュー
+  // 各セルのsequenceが書き込み可能な周回を示すため、書き込み側はenqueuePosのCASのみで競合を解決できる
+  uint32_t pos = atomic_load_explicit(&(pool->enqueuePos), memory_order_relaxed);
+  for (;;) {
+    MCIM_SFX_QUEUE_CELL* cell = &(pool->queue[pos & (MCIM_SFX_QUEUE_SIZE - 1)]);
+    uint32_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+    int32_t diff = (int32_t)(sequence - pos);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&(pool->enqueuePos), &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+        cell->trigger = *trigger;
+        atomic_store_explicit(&(cell->sequence), pos + 1, memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = atomic_load_explicit(&(pool->enqueuePos), memory_order_relaxed);
+    }
+  }
+}
+
+static bool mcim_sfx_pool_dequeue(MCIM_SFX_POOL* restrict pool, MCIM_SFX_TRIGGER* restrict trigger) {
+  assert(pool != NULL);
+  assert(trigger != NULL);
+
+  uint32_t pos = pool->dequeuePos;
+  MCIM_SFX_QUEUE_CELL* cell = &(pool->queue[pos & (MCIM_SFX_QUEUE_SIZE - 1)]);
+  uint32_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+  if ((int32_t)(sequence - (pos + 1)) < 0) {
+    return false;
+  }
+
+  *trigger = cell->trigger;
+  atomic_store_explicit(&(cell->sequence), pos + MCIM_SFX_QUEUE_SIZE, memory_order_release);
+  pool->dequeuePos = pos + 1;
+  return true;
+}
+
+static void mcim_sfx_pool_start(MCIM_SFX_POOL* restrict pool, MCIM_MIXER* restrict mixer, const MCIM_SFX_TRIGGER* restrict trigger) {
+  assert(pool != NULL);
+  assert(mixer != NULL);
+  assert(trigger != NULL);
+
+  if (trigger->key >= pool->sampleCount || pool->samples[trigger->key].pcm == NULL) {
+    return;
+  }
+
+  // 同時発音数を超える場合は優先度が最も低いボイス（同じ優先度なら最も古いもの）を奪う
+  // 奪われたボイスはプチノイズを避けるため短くフェードアウトさせてから解放する
+  if (pool->playingCount >= atomic_load_explicit(&(pool->polyphony), memory_order_relaxed)) {
+    uint32_t victim = mcim_sfx_pool_find_victim(pool);
+    if (victim == pool->activeCount || pool->slots[pool->active[victim]].priority > trigger->priority) {
+      return;
+    }
+    MCIM_SFX_SLOT* slot = &(pool->slots[pool->active[victim]]);
+    slot->releasing = true;
+    slot->voice.fadeTotal = MCIM_SFX_STEAL_FADE_FRAMES;
+    slot->voice.fadeRemaining = MCIM_SFX_STEAL_FADE_FRAMES;
+    pool->playingCount--;
+  }
+
+  // リリース中のボイスでスロットが埋まっている場合は、最も古いものを即座に解放する
+  if (pool->idleCount == 0) {
+    uint32_t oldest = pool->activeCount;
+    for (uint32_t i = 0; i < pool->activeCount; i++) {
+      const MCIM_SFX_SLOT* slot = &(pool->slots[pool->active[i]]);
+      if (slot->releasing && (oldest == pool->activeCount || slot->startFrame < pool->slots[pool->active[oldest]].startFrame)) {
+        oldest = i;
+      }
+    }
+    assert(oldest != pool->activeCount);
+    mcim_sfx_pool_retire(pool, oldest);
+  }
+
+  uint16_t index = pool->idle[--(pool->idleCount)];
+  MCIM_SFX_SLOT* slot = &(pool->slots[index]);
+  const MCIM_PCM* pcm = pool->samples[trigger->key].pcm;
+  SecureZeroMemory(&(slot->voice), sizeof(MCIM_VOICE));
+  slot->voice.pcm = pcm;
+  slot->voice.step = ((uint64_t)pcm->sampleRate << 32) / mixer->sampleRate;
+  slot->voice.gain = trigger->gain;
+  slot->voice.targetGain = trigger->gain;
+  slot->voice.trim = 1.0f;
+  slot->voice.targetTrim = 1.0f;
+  slot->voice.rate = 1.0f;
+  slot->voice.targetRate = 1.0f;
+  slot->voice.active = true;
+  atomic_store_explicit(&(slot->voice.playing), true, memory_order_release);
+  slot->priority = trigger->priority;
+  slot->startFrame = mixer->renderedFrames;
+  slot->voice.sidechain = pool->samples[trigger->key].sidechain;
+  slot->voice.bus = pool->samples[trigger->key].bus;
+  slot->releasing = false;
+  slot->instance = 0;
+  pool->active[pool->activeCount++] = index;
+  pool->playingCount++;
+
+  if (trigger->request == MCIM_SFX_REQUEST_PLAY_AT) {
+    slot->instance = trigger->instance;
+    slot->voice.panned = true;
+    pool->instanceSlots[trigger->instance & (MCIM_SFX_INSTANCE_TABLE_SIZE - 1)] = (uint16_t)(index + 1);
+    pool->spatial.x[index] = trigger->x;
+    pool->spatial.y[index] = trigger->y;
+    pool->pannedCount++;
+  }
+
+  mixer->latencyPending = true;
+  mixer->latencyFrame = mixer->renderedFrames;
+  mixer->latencyCommand = trigger->command;
+}
+
+static void mcim_sfx_pool_place(MCIM_SFX_POOL* pool, const MCIM_SFX_TRIGGER* trigger) {
+  assert(pool != NULL);
+  assert(trigger != NULL);
+
+  // 表の同じ位置を後から発音したボイスが上書きしている場合のみ、発音中のボイスを線形に探す
+  uint32_t index = pool->instanceSlots[trigger->instance & (MCIM_SFX_INSTANCE_TABLE_SIZE - 1)];
+  if (index == 0 || pool->slots[index - 1].instance != trigger->instance) {
+    index = 0;
+    for (uint32_t i = 0; i < pool->activeCount; i++) {
+      if (pool->slots[pool->active[i]].instance == trigger->instance) {
+        index = pool->active[i] + 1u;
+        break;
+      }
+    }
+    if (index == 0) {
+      return;
+    }
+  }
+  pool->spatial.x[index - 1] = trigger->x;
+  pool->spatial.y[index - 1] = trigger->y;
+}
+
+static void mcim_sfx_pool_spatialize(MCIM_SFX_POOL* pool) {
+  assert(pool != NULL);
+
+  // 発音中かに関わらず全スロットを分岐なしで計算し、コンパイラがベクトル化できる形にする
+  // パンは中央で両チャンネルとも等倍となる等パワー則、距離減衰はreferenceより内側で等倍となる逆数則とする
+  const MCIM_SFX_LISTENER listener = pool->listener;
+  const float* restrict x = pool->spatial.x;
+  const float* restrict y = pool->spatial.y;
+  float* restrict left = pool->spatial.left;
+  float* restrict right = pool->spatial.right;
+  for (uint32_t i = 0; i < MCIM_SFX_VOICE_COUNT; i++) {
+    const float dx = x[i] - listener.x;
+    const float dy = y[i] - listener.y;
+    const float distance = sqrtf(dx * dx + dy * dy);
+    const float excess = (distance > listener.reference ? distance - listener.reference : 0.0f);
+    const float attenuation = listener.reference / (listener.reference + listener.rolloff * excess);
+    float pan = dx * listener.invPanWidth;
+    pan = (pan < -1.0f ? -1.0f : pan);
+    pan = (pan > 1.0f ? 1.0f : pan);
+    left[i] = attenuation * sqrtf(1.0f - pan);
+    right[i] = attenuation * sqrtf(1.0f + pan);
+  }
+}
+
+static uint32_t mcim_sfx_pool_find_victim(const MCIM_SFX_POOL* pool) {
+  assert(pool != NULL);
+
+  uint32_t victim = pool->activeCount;
+  for (uint32_t i = 0; i < pool->activeCount; i++) {
+    const MCIM_SFX_SLOT* slot = &(pool->slots[pool->active[i]]);
+    if (slot->releasing) {
+      continue;
+    }
+    if (victim == pool->activeCount) {
+      victim = i;
+      continue;
+    }
+    const MCIM_SFX_SLOT* current = &(pool->slots[pool->active[victim]]);
+    if (slot->priority < current->priority || (slot->priority == current->priority && slot->startFrame < current->startFrame)) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+static void mcim_sfx_pool_retire(MCIM_SFX_POOL* pool, uint32_t index) {
+  assert(pool != NULL);
+  assert(index < pool->activeCount);
+
+  uint16_t slotIndex = pool->active[index];
+  MCIM_SFX_SLOT* slot = &(pool->slots[slotIndex]);
+  if (!slot->releasing) {
+    pool->playingCount--;
+  }
+  if (slot->voice.panned) {
+    pool->pannedCount--;
+  }
+  slot->instance = 0;
+  slot->voice.active = false;
+  atomic_store_explicit(&(slot->voice.playing), false, memory_order_release);
+  slot->voice.pcm = NULL;
+  pool->active[index] = pool->active[--(pool->activeCount)];
+  pool->idle[pool->idleCount++] = slotIndex;
+}
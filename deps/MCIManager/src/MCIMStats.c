@@ -0,0 +1,171 @@
+﻿#include "_MCIMStats.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "_MCIMWave.h"
+
+typedef struct _MCIM_STATS_COMMAND_COUNTERS {
+  _Atomic(uint64_t) failures;
+  _Atomic(uint64_t) ticks;
+  _Atomic(uint64_t) latency[MCIM_STATS_LATENCY_BUCKETS];  // 呼び出し回数はこの合計とする
+} MCIM_STATS_COMMAND_COUNTERS;
+
+typedef struct _MCIM_STATS_EFFECT_COUNTERS {
+  _Atomic(uint64_t) blocks;
+  _Atomic(uint64_t) frames;
+  _Atomic(uint64_t) ticks;
+} MCIM_STATS_EFFECT_COUNTERS;
+
+// 記録は複数スレッドから行われるため、ロックを取らず個々のカウンタをアトミックに加算する
+static MCIM_STATS_COMMAND_COUNTERS MCIM_STATS_COMMANDS[MCIM_COMMAND_COUNT];
+static _Atomic(uint64_t) MCIM_STATS_DECODED_NANOSECONDS = 0;
+static _Atomic(uint64_t) MCIM_STATS_DECODE_TICKS = 0;
+static _Atomic(uint64_t) MCIM_STATS_UNDERRUNS = 0;
+static MCIM_STATS_EFFECT_COUNTERS MCIM_STATS_EFFECTS[MCIM_EFFECT_TYPE_COUNT];
+static MCIM_STATS_EFFECT_COUNTERS MCIM_STATS_STRETCH;
+static MCIM_STATS_EFFECT_COUNTERS MCIM_STATS_MIX;
+static MCIM_STATS_EFFECT_COUNTERS MCIM_STATS_ANALYSIS;
+static _Atomic(uint64_t) MCIM_STATS_STREAM_HITS = 0;
+static _Atomic(uint64_t) MCIM_STATS_STREAM_BYTES = 0;
+static _Atomic(uint64_t) MCIM_STATS_STREAM_TICKS = 0;
+static _Atomic(uint64_t) MCIM_STATS_STREAM_UNDERRUNS = 0;
+static _Atomic(uint64_t) MCIM_STATS_STREAM_WAIT[MCIM_STATS_LATENCY_BUCKETS];  // 読み込み回数はこの合計とする
+
+/**************************************************************************************************/
+
+void mcim_stats_record_command(MCIM_COMMAND command, LONGLONG ticks, bool succeeded) {
+  assert(command >= 0 && command < MCIM_COMMAND_COUNT);
+
+  MCIM_STATS_COMMAND_COUNTERS* counters = &(MCIM_STATS_COMMANDS[command]);
+  if (ticks < 0) {
+    ticks = 0;
+  }
+  atomic_fetch_add_explicit(&(counters->latency[mcim_stats_latency_bucket(ticks)]), 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(counters->ticks), (uint64_t)ticks, memory_order_relaxed);
+  if (!succeeded) {
+    atomic_fetch_add_explicit(&(counters->failures), 1, memory_order_relaxed);
+  }
+}
+
+void mcim_stats_record_decode(uint32_t frames, uint32_t sampleRate, LONGLONG ticks) {
+  assert(sampleRate > 0);
+
+  uint64_t nanoseconds = (uint64_t)frames * 1000000000 / sampleRate;
+  atomic_fetch_add_explicit(&MCIM_STATS_DECODED_NANOSECONDS, nanoseconds, memory_order_relaxed);
+  atomic_fetch_add_explicit(&MCIM_STATS_DECODE_TICKS, (uint64_t)(ticks > 0 ? ticks : 0), memory_order_relaxed);
+}
+
+void mcim_stats_record_underrun(void) {
+  atomic_fetch_add_explicit(&MCIM_STATS_UNDERRUNS, 1, memory_order_relaxed);
+}
+
+void mcim_stats_record_effect(MCIM_EFFECT_TYPE type, uint32_t frames, LONGLONG ticks) {
+  assert(type >= 0 && type < MCIM_EFFECT_TYPE_COUNT);
+
+  MCIM_STATS_EFFECT_COUNTERS* counters = &(MCIM_STATS_EFFECTS[type]);
+  atomic_fetch_add_explicit(&(counters->blocks), 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(counters->frames), frames, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(counters->ticks), (uint64_t)(ticks > 0 ? ticks : 0), memory_order_relaxed);
+}
+
+void mcim_stats_record_stretch(uint32_t frames, LONGLONG ticks) {
+  atomic_fetch_add_explicit(&(MCIM_STATS_STRETCH.blocks), 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(MCIM_STATS_STRETCH.frames), frames, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(MCIM_STATS_STRETCH.ticks), (uint64_t)(ticks > 0 ? ticks : 0), memory_order_relaxed);
+}
+
+void mcim_stats_record_mix(uint32_t frames, LONGLONG ticks) {
+  atomic_fetch_add_explicit(&(MCIM_STATS_MIX.blocks), 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(MCIM_STATS_MIX.frames), frames, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(MCIM_STATS_MIX.ticks), (uint64_t)(ticks > 0 ? ticks : 0), memory_order_relaxed);
+}
+
+void mcim_stats_record_analysis(uint32_t frames, LONGLONG ticks) {
+  atomic_fetch_add_explicit(&(MCIM_STATS_ANALYSIS.blocks), 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(MCIM_STATS_ANALYSIS.frames), frames, memory_order_relaxed);
+  atomic_fetch_add_explicit(&(MCIM_STATS_ANALYSIS.ticks), (uint64_t)(ticks > 0 ? ticks : 0), memory_order_relaxed);
+}
+
+void mcim_stats_record_stream(bool prefetched, uint32_t bytes, LONGLONG ticks) {
+  if (ticks < 0) {
+    ticks = 0;
+  }
+  atomic_fetch_add_explicit(&(MCIM_STATS_STREAM_WAIT[mcim_stats_latency_bucket(ticks)]), 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&MCIM_STATS_STREAM_TICKS, (uint64_t)ticks, memory_order_relaxed);
+  atomic_fetch_add_explicit(&MCIM_STATS_STREAM_BYTES, bytes, memory_order_relaxed);
+  if (prefetched) {
+    atomic_fetch_add_explicit(&MCIM_STATS_STREAM_HITS, 1, memory_order_relaxed);
+  }
+}
+
+void mcim_stats_record_stream_underrun(void) {
+  atomic_fetch_add_explicit(&MCIM_STATS_STREAM_UNDERRUNS, 1, memory_order_relaxed);
+}
+
+void mcim_stats_get(MCIM_STATS* stats) {
+  assert(stats != NULL);
+
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  const double tick = 1.0 / (double)freq.QuadPart;
+
+  for (uint32_t i = 0; i < MCIM_COMMAND_COUNT; i++) {
+    MCIM_STATS_COMMAND_COUNTERS* counters = &(MCIM_STATS_COMMANDS[i]);
+    MCIM_COMMAND_STATS* command = &(stats->commands[i]);
+    command->calls = 0;
+    for (uint32_t j = 0; j < MCIM_STATS_LATENCY_BUCKETS; j++) {
+      command->latency[j] = atomic_load_explicit(&(counters->latency[j]), memory_order_relaxed);
+      command->calls += command->latency[j];
+    }
+    command->failures = atomic_load_explicit(&(counters->failures), memory_order_relaxed);
+    command->totalTime = (double)atomic_load_explicit(&(counters->ticks), memory_order_relaxed) * tick;
+  }
+
+  stats->decodedAudio = (double)atomic_load_explicit(&MCIM_STATS_DECODED_NANOSECONDS, memory_order_relaxed) * 1e-9;
+  stats->decodeTime = (double)atomic_load_explicit(&MCIM_STATS_DECODE_TICKS, memory_order_relaxed) * tick;
+  stats->decodeRealtimeFactor = (stats->decodeTime > 0.0 ? stats->decodedAudio / stats->decodeTime : 0.0);
+  stats->underruns = atomic_load_explicit(&MCIM_STATS_UNDERRUNS, memory_order_relaxed);
+  for (uint32_t i = 0; i < MCIM_EFFECT_TYPE_COUNT; i++) {
+    MCIM_STATS_EFFECT_COUNTERS* counters = &(MCIM_STATS_EFFECTS[i]);
+    stats->effects[i].blocks = atomic_load_explicit(&(counters->blocks), memory_order_relaxed);
+    stats->effects[i].frames = atomic_load_explicit(&(counters->frames), memory_order_relaxed);
+    stats->effects[i].totalTime = (double)atomic_load_explicit(&(counters->ticks), memory_order_relaxed) * tick;
+  }
+  stats->stretch.blocks = atomic_load_explicit(&(MCIM_STATS_STRETCH.blocks), memory_order_relaxed);
+  stats->stretch.frames = atomic_load_explicit(&(MCIM_STATS_STRETCH.frames), memory_order_relaxed);
+  stats->stretch.totalTime = (double)atomic_load_explicit(&(MCIM_STATS_STRETCH.ticks), memory_order_relaxed) * tick;
+  stats->mix.blocks = atomic_load_explicit(&(MCIM_STATS_MIX.blocks), memory_order_relaxed);
+  stats->mix.frames = atomic_load_explicit(&(MCIM_STATS_MIX.frames), memory_order_relaxed);
+  stats->mix.totalTime = (double)atomic_load_explicit(&(MCIM_STATS_MIX.ticks), memory_order_relaxed) * tick;
+  stats->analysis.blocks = atomic_load_explicit(&(MCIM_STATS_ANALYSIS.blocks), memory_order_relaxed);
+  stats->analysis.frames = atomic_load_explicit(&(MCIM_STATS_ANALYSIS.frames), memory_order_relaxed);
+  stats->analysis.totalTime = (double)atomic_load_explicit(&(MCIM_STATS_ANALYSIS.ticks), memory_order_relaxed) * tick;
+  stats->stream.reads = 0;
+  for (uint32_t i = 0; i < MCIM_STATS_LATENCY_BUCKETS; i++) {
+    stats->stream.wait[i] = atomic_load_explicit(&(MCIM_STATS_STREAM_WAIT[i]), memory_order_relaxed);
+    stats->stream.reads += stats->stream.wait[i];
+  }
+  stats->stream.readaheadHits = atomic_load_explicit(&MCIM_STATS_STREAM_HITS, memory_order_relaxed);
+  stats->stream.bytes = atomic_load_explicit(&MCIM_STATS_STREAM_BYTES, memory_order_relaxed);
+  stats->stream.waitTime = (double)atomic_load_explicit(&MCIM_STATS_STREAM_TICKS, memory_order_relaxed) * tick;
+  stats->stream.underruns = atomic_load_explicit(&MCIM_STATS_STREAM_UNDERRUNS, memory_order_relaxed);
+
+  MCIM_MEMORY_STATS memory;
+  mcim_wave_get_stats(&memory);
+  stats->memoryBytes = memory.residentBytes + memory.windowBytes;
+}
+
+uint32_t mcim_stats_latency_bucket(LONGLONG ticks) {
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+
+  // 区間iは[2^i, 2^(i+1))マイクロ秒（0は2マイクロ秒未満、最後の区間は上限なし）
+  uint64_t microseconds = (uint64_t)ticks * 1000000 / (uint64_t)freq.QuadPart;
+  uint32_t bucket = 0;
+  while (microseconds >= 2 && bucket < MCIM_STATS_LATENCY_BUCKETS - 1) {
+    microseconds >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
@@ -0,0 +1,173 @@
+﻿#include "_MCIMStretch.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define MCIM_STRETCH_PI 3.14159265358979323846
+
+static bool mcim_stretch_next(MCIM_STRETCH* restrict stretch, const MCIM_KERNELS* restrict kernels, mcim_stretch_read_t read, void* context, uint64_t step, float rate);
+static uint64_t mcim_stretch_seek(MCIM_STRETCH* restrict stretch, const MCIM_KERNELS* restrict kernels, mcim_stretch_read_t read, void* context, uint64_t step);
+static float mcim_stretch_similarity(const MCIM_STRETCH* restrict stretch, const MCIM_KERNELS* restrict kernels, uint32_t offset);
+static void mcim_stretch_downmix(float* restrict dst, const float* restrict src, uint32_t frames);
+
+/**************************************************************************************************/
+
+MCIM_STRETCH* mcim_stretch_create(mcim_allocator_t allocator) {
+  assert(allocator != NULL);
+
+  MCIM_STRETCH* stretch = (MCIM_STRETCH*)allocator(sizeof(MCIM_STRETCH));
+  if (stretch == NULL) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < MCIM_STRETCH_HOP_FRAMES; i++) {
+    stretch->window[i] = (float)(0.5 - 0.5 * cos(MCIM_STRETCH_PI * (double)i / (double)MCIM_STRETCH_HOP_FRAMES));
+  }
+  mcim_stretch_reset(stretch, 0);
+  return stretch;
+}
+
+void mcim_stretch_reset(MCIM_STRETCH* stretch, uint64_t position) {
+  assert(stretch != NULL);
+
+  stretch->analysis = position;
+  stretch->continuation = position;
+  stretch->grainStart = position;
+  stretch->primed = false;
+  stretch->ended = false;
+  stretch->outputPosition = 0;
+  stretch->outputCount = 0;
+}
+
+uint32_t mcim_stretch_render(MCIM_STRETCH* restrict stretch,
+                             const MCIM_KERNELS* restrict kernels,
+                             mcim_stretch_read_t read,
+                             void* context,
+                             uint64_t step,
+                             float rate,
+                             float* restrict dst,
+                             uint32_t frames) {
+  assert(stretch != NULL);
+  assert(kernels != NULL);
+  assert(read != NULL);
+  assert(dst != NULL);
+  assert(rate > 0.0f);
+
+  uint32_t produced = 0;
+  while (produced < frames) {
+    if (stretch->outputPosition == stretch->outputCount && !mcim_stretch_next(stretch, kernels, read, context, step, rate)) {
+      break;
+    }
+    const uint32_t available = stretch->outputCount - stretch->outputPosition;
+    const uint32_t count = (available < frames - produced ? available : frames - produced);
+    memcpy(dst + 2 * produced, stretch->output + 2 * stretch->outputPosition, sizeof(float) * 2 * count);
+    stretch->outputPosition += count;
+    produced += count;
+  }
+  return produced;
+}
+
+uint64_t mcim_stretch_position(const MCIM_STRETCH* stretch, uint64_t step) {
+  assert(stretch != NULL);
+
+  return stretch->grainStart + step * stretch->outputPosition;
+}
+
+/**************************************************************************************************/
+
+static bool mcim_stretch_next(MCIM_STRETCH* restrict stretch, const MCIM_KERNELS* restrict kernels, mcim_stretch_read_t read, void* context, uint64_t step, float rate) {
+  assert(stretch != NULL);
+
+  if (stretch->ended) {
+    return false;
+  }
+
+  const uint64_t grainStart = (stretch->primed ? mcim_stretch_seek(stretch, kernels, read, context, step) : stretch->analysis);
+  const uint32_t count = read(context, grainStart, stretch->grain, MCIM_STRETCH_WINDOW_FRAMES);
+  if (count == 0) {
+    // 終端以降の粒は無いため、重ね合わせ途中の後半だけを出力して終える
+    stretch->ended = true;
+    if (!stretch->primed) {
+      return false;
+    }
+    memcpy(stretch->output, stretch->tail, sizeof(stretch->tail));
+  } else if (!stretch->primed) {
+    memcpy(stretch->output, stretch->grain, sizeof(stretch->output));
+    stretch->primed = true;
+  } else {
+    for (uint32_t i = 0; i < MCIM_STRETCH_HOP_FRAMES; i++) {
+      const float w = stretch->window[i];
+      stretch->output[2 * i] = stretch->tail[2 * i] + stretch->grain[2 * i] * w;
+      stretch->output[2 * i + 1] = stretch->tail[2 * i + 1] + stretch->grain[2 * i + 1] * w;
+    }
+  }
+  for (uint32_t i = 0; i < MCIM_STRETCH_HOP_FRAMES; i++) {
+    const float w = 1.0f - stretch->window[i];
+    stretch->tail[2 * i] = stretch->grain[2 * (MCIM_STRETCH_HOP_FRAMES + i)] * w;
+    stretch->tail[2 * i + 1] = stretch->grain[2 * (MCIM_STRETCH_HOP_FRAMES + i) + 1] * w;
+  }
+
+  stretch->grainStart = grainStart;
+  stretch->continuation = grainStart + step * MCIM_STRETCH_HOP_FRAMES;
+  stretch->analysis += (uint64_t)((double)step * (double)MCIM_STRETCH_HOP_FRAMES * (double)rate);
+  stretch->outputPosition = 0;
+  stretch->outputCount = MCIM_STRETCH_HOP_FRAMES;
+  return true;
+}
+
+static uint64_t mcim_stretch_seek(MCIM_STRETCH* restrict stretch, const MCIM_KERNELS* restrict kernels, mcim_stretch_read_t read, void* context, uint64_t step) {
+  assert(stretch != NULL);
+
+  // 直前の粒の続きに最も似ている区間を、analysisの前後から正規化相互相関で探す
+  read(context, stretch->continuation, stretch->grain, MCIM_STRETCH_CORRELATION_FRAMES);
+  mcim_stretch_downmix(stretch->pattern, stretch->grain, MCIM_STRETCH_CORRELATION_FRAMES);
+
+  uint32_t before = MCIM_STRETCH_SEEK_FRAMES;
+  if (stretch->analysis / step < before) {
+    before = (uint32_t)(stretch->analysis / step);
+  }
+  const uint64_t searchStart = stretch->analysis - step * before;
+  const uint32_t candidates = before + MCIM_STRETCH_SEEK_FRAMES + 1;
+  read(context, searchStart, stretch->grain, candidates + MCIM_STRETCH_CORRELATION_FRAMES - 1);
+  mcim_stretch_downmix(stretch->search, stretch->grain, candidates + MCIM_STRETCH_CORRELATION_FRAMES - 1);
+
+  uint32_t best = before;
+  float bestScore = -INFINITY;
+  for (uint32_t offset = 0; offset < candidates; offset += MCIM_STRETCH_COARSE_STEP) {
+    const float score = mcim_stretch_similarity(stretch, kernels, offset);
+    if (score > bestScore) {
+      bestScore = score;
+      best = offset;
+    }
+  }
+  const uint32_t coarse = best;
+  const uint32_t first = (coarse >= MCIM_STRETCH_COARSE_STEP - 1 ? coarse - (MCIM_STRETCH_COARSE_STEP - 1) : 0);
+  for (uint32_t offset = first; offset < coarse + MCIM_STRETCH_COARSE_STEP && offset < candidates; offset++) {
+    if (offset == coarse) {
+      continue;
+    }
+    const float score = mcim_stretch_similarity(stretch, kernels, offset);
+    if (score > bestScore) {
+      bestScore = score;
+      best = offset;
+    }
+  }
+  return searchStart + step * best;
+}
+
+static float mcim_stretch_similarity(const MCIM_STRETCH* restrict stretch, const MCIM_KERNELS* restrict kernels, uint32_t offset) {
+  assert(stretch != NULL);
+  assert(kernels != NULL);
+
+  // パターン側のエネルギーは候補によらず一定のため、候補側のみで正規化する
+  const float* candidate = stretch->search + offset;
+  const float correlation = kernels->dot(stretch->pattern, candidate, MCIM_STRETCH_CORRELATION_FRAMES);
+  const float energy = kernels->dot(candidate, candidate, MCIM_STRETCH_CORRELATION_FRAMES);
+  return correlation / sqrtf(energy + 1e-9f);
+}
+
+static void mcim_stretch_downmix(float* restrict dst, const float* restrict src, uint32_t frames) {
+  for (uint32_t i = 0; i < frames; i++) {
+    dst[i] = src[2 * i] + src[2 * i + 1];
+  }
+}
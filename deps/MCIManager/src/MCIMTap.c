@@ -0,0 +1,166 @@
+﻿#include "_MCIMTap.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define MCIM_TAP_PI 3.14159265358979323846
+
+static void mcim_tap_analyze(MCIM_TAP* restrict tap, const MCIM_KERNELS* restrict kernels, uint64_t frame);
+
+/**************************************************************************************************/
+
+MCIM_TAP* mcim_tap_create(MCIM_KEY key, uint32_t size, uint32_t sampleRate, mcim_allocator_t allocator) {
+  assert(size >= MCIM_ANALYSIS_MIN_FFT_SIZE && size <= MCIM_TAP_MAX_SIZE && (size & (size - 1)) == 0);
+  assert(sampleRate > 0);
+  assert(allocator != NULL);
+
+  MCIM_TAP* tap = (MCIM_TAP*)allocator(sizeof(MCIM_TAP));
+  if (tap == NULL) {
+    return NULL;
+  }
+  SecureZeroMemory(tap, sizeof(MCIM_TAP));
+  tap->key = key;
+  tap->size = size;
+  tap->hop = size / 2;
+  tap->sampleRate = sampleRate;
+
+  uint32_t bits = 0;
+  while ((1u << bits) < size) {
+    bits++;
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    tap->window[i] = (float)(0.5 - 0.5 * cos(2.0 * MCIM_TAP_PI * (double)i / (double)size));
+    uint32_t reversed = 0;
+    for (uint32_t b = 0; b < bits; b++) {
+      reversed |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    tap->reversed[i] = (uint16_t)reversed;
+  }
+  for (uint32_t half = 1; half < size; half *= 2) {
+    for (uint32_t k = 0; k < half; k++) {
+      tap->twiddleRe[half + k] = (float)cos(MCIM_TAP_PI * (double)k / (double)half);
+      tap->twiddleIm[half + k] = (float)-sin(MCIM_TAP_PI * (double)k / (double)half);
+    }
+  }
+
+  // 書き込み側、交換用、読み出し側に1つずつ割り当て、未解析の間も有効なビン数を返せるようにしておく
+  for (uint32_t i = 0; i < 3; i++) {
+    tap->snapshots[i].binCount = size / 2;
+    tap->snapshots[i].binWidth = (float)sampleRate / (float)size;
+  }
+  tap->back = 0;
+  atomic_init(&(tap->middle), 1);
+  tap->front = 2;
+  return tap;
+}
+
+float* mcim_tap_input(MCIM_TAP* tap, uint32_t frames) {
+  assert(tap != NULL);
+  assert(frames <= MCIM_TAP_BLOCK_FRAMES);
+
+  if (!tap->inputUsed) {
+    SecureZeroMemory(tap->input, sizeof(float) * 2 * frames);
+    tap->inputUsed = true;
+  }
+  return tap->input;
+}
+
+void mcim_tap_process(MCIM_TAP* restrict tap, const MCIM_KERNELS* restrict kernels, const float* restrict src, uint32_t frames, uint64_t frame) {
+  assert(tap != NULL);
+  assert(kernels != NULL);
+  assert(frames <= MCIM_TAP_BLOCK_FRAMES && frames <= tap->hop);
+
+  if (src == NULL && tap->inputUsed) {
+    src = tap->input;
+  }
+  tap->inputUsed = false;
+
+  // 履歴の長さはFFTの点数と同じであり、書き込み位置が最も古いフレームとなる
+  const uint32_t mask = tap->size - 1;
+  if (src != NULL) {
+    for (uint32_t i = 0; i < frames; i++) {
+      const float l = src[2 * i];
+      const float r = src[2 * i + 1];
+      tap->peak[0] = fmaxf(tap->peak[0], fabsf(l));
+      tap->peak[1] = fmaxf(tap->peak[1], fabsf(r));
+      tap->sum[0] += l * l;
+      tap->sum[1] += r * r;
+      tap->history[(tap->writePosition + i) & mask] = 0.5f * (l + r);
+    }
+  } else {
+    for (uint32_t i = 0; i < frames; i++) {
+      tap->history[(tap->writePosition + i) & mask] = 0.0f;
+    }
+  }
+  tap->writePosition = (tap->writePosition + frames) & mask;
+  tap->levelFrames += frames;
+
+  // ブロック長はhop以下であるため、FFTはブロック毎に高々1回となる
+  tap->pending += frames;
+  if (tap->pending >= tap->hop) {
+    tap->pending -= tap->hop;
+    mcim_tap_analyze(tap, kernels, frame);
+  }
+}
+
+void mcim_tap_read(MCIM_TAP* restrict tap, MCIM_ANALYSIS* restrict analysis) {
+  assert(tap != NULL);
+  assert(analysis != NULL);
+
+  // 未読のスナップショットがあれば手元のものと交換し、以降は書き込み側から触られないものを読む
+  if ((atomic_load_explicit(&(tap->middle), memory_order_relaxed) & MCIM_TAP_FRESH) != 0) {
+    tap->front = atomic_exchange_explicit(&(tap->middle), tap->front, memory_order_acq_rel) & (MCIM_TAP_FRESH - 1);
+  }
+  const MCIM_ANALYSIS* snapshot = &(tap->snapshots[tap->front]);
+  analysis->frame = snapshot->frame;
+  analysis->peak[0] = snapshot->peak[0];
+  analysis->peak[1] = snapshot->peak[1];
+  analysis->rms[0] = snapshot->rms[0];
+  analysis->rms[1] = snapshot->rms[1];
+  analysis->binCount = snapshot->binCount;
+  analysis->binWidth = snapshot->binWidth;
+  memcpy(analysis->spectrum, snapshot->spectrum, sizeof(float) * snapshot->binCount);
+}
+
+/**************************************************************************************************/
+
+static void mcim_tap_analyze(MCIM_TAP* restrict tap, const MCIM_KERNELS* restrict kernels, uint64_t frame) {
+  assert(tap != NULL);
+  assert(kernels != NULL);
+
+  // 実数列をそのまま複素FFTへ渡し、窓掛けと同時にビット反転の順に並べ替える
+  const uint32_t size = tap->size;
+  const uint32_t mask = size - 1;
+  for (uint32_t i = 0; i < size; i++) {
+    const uint32_t j = tap->reversed[i];
+    tap->re[j] = tap->history[(tap->writePosition + i) & mask] * tap->window[i];
+    tap->im[j] = 0.0f;
+  }
+  for (uint32_t half = 1; half < size; half *= 2) {
+    kernels->fft_pass(tap->re, tap->im, tap->twiddleRe + half, tap->twiddleIm + half, size, half);
+  }
+
+  // Hann窓のコヒーレントゲイン（0.5）と片側スペクトルの分を補正し、フルスケールの正弦波が1.0となるようにする
+  MCIM_ANALYSIS* snapshot = &(tap->snapshots[tap->back]);
+  const float scale = 4.0f / (float)size;
+  const uint32_t bins = size / 2;
+  for (uint32_t i = 0; i < bins; i++) {
+    snapshot->spectrum[i] = sqrtf(tap->re[i] * tap->re[i] + tap->im[i] * tap->im[i]) * scale;
+  }
+  snapshot->spectrum[0] *= 0.5f;
+  snapshot->frame = frame;
+  snapshot->binCount = bins;
+  snapshot->binWidth = (float)tap->sampleRate / (float)size;
+  for (uint32_t c = 0; c < 2; c++) {
+    snapshot->peak[c] = tap->peak[c];
+    snapshot->rms[c] = (tap->levelFrames > 0 ? sqrtf(tap->sum[c] / (float)tap->levelFrames) : 0.0f);
+    tap->peak[c] = 0.0f;
+    tap->sum[c] = 0.0f;
+  }
+  tap->levelFrames = 0;
+
+  // 書き上げたスナップショットを交換用と入れ替え、読み出し側が前回分を読んでいなければそれを次の書き込み先とする
+  const uint32_t old = atomic_exchange_explicit(&(tap->middle), tap->back | MCIM_TAP_FRESH, memory_order_acq_rel);
+  tap->back = old & (MCIM_TAP_FRESH - 1);
+}
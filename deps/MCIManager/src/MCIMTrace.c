@@ -0,0 +1,686 @@
+﻿#include "_MCIMTrace.h"
+
+#include <assert.h>
+#include <process.h>
+#include <string.h>
+
+#include "_MCIMMixer.h"
+#include "_MCIMStats.h"
+
+// 待機時間のうちSleepに任せる分の下限（ミリ秒）、残りはスピンで待つ
+#define MCIM_TRACE_SPIN_THRESHOLD 2
+
+/**
+ * @brief トレースファイルのヘッダ
+ * @note - ヘッダの直後からMCIM_TRACE_RECORDと付加データの組が記録順に続く
+ */
+typedef struct _MCIM_TRACE_HEADER {
+  uint8_t magic[4];
+  uint32_t version;
+  uint32_t recordSize;  // sizeof(MCIM_TRACE_RECORD)
+  uint32_t reserved;
+} MCIM_TRACE_HEADER;
+
+/**
+ * @brief 記録時と再生時で値が変わりうるキーの空間
+ * @note - バスのキーはBGMのキーと同じ列から採番されるため、BGMと同じ空間とする
+ */
+typedef enum _MCIM_TRACE_SPACE {
+  MCIM_TRACE_SPACE_MUSIC = 0,
+  MCIM_TRACE_SPACE_SFX = 1,
+  MCIM_TRACE_SPACE_INSTANCE = 2  // mcim_sfx_play_atの返り値
+} MCIM_TRACE_SPACE;
+
+/**
+ * @brief 記録時のキーと再生時のキーの対応
+ */
+typedef struct _MCIM_TRACE_KEY {
+  MCIM_KEY recorded;
+  MCIM_KEY replayed;
+  MCIM_TRACE_SPACE space;
+} MCIM_TRACE_KEY;
+
+typedef struct _MCIM_TRACE_PLAYER {
+  MCIM_DATA* data;
+  MCIM_TRACE_KEY* keys;
+  uint32_t keyCount;
+  uint32_t keyCapacity;
+  float* buffer;  // mcim_renderの出力先
+  uint32_t bufferFrames;
+  mcim_allocator_t allocator;
+  mcim_deallocator_t deallocator;
+} MCIM_TRACE_PLAYER;
+
+static const uint8_t MCIM_TRACE_MAGIC[4] = {'M', 'C', 'I', 'T'};
+
+static void mcim_trace_free(MCIM_TRACE_RECORDER* recorder, mcim_deallocator_t deallocator);
+static unsigned __stdcall mcim_trace_thread(void* pargs);
+static void mcim_trace_flush(MCIM_TRACE_RECORDER* recorder);
+static bool mcim_trace_write(HANDLE hfile, const void* buffer, size_t size);
+static bool mcim_trace_read(const wchar_t* restrict filepath,
+                            uint8_t** restrict contents,
+                            size_t* restrict size,
+                            mcim_allocator_t allocator,
+                            mcim_deallocator_t deallocator);
+static bool mcim_trace_dispatch(MCIM_TRACE_PLAYER* restrict player,
+                                const MCIM_TRACE_RECORD* restrict record,
+                                const void* restrict extra,
+                                LONGLONG* restrict ticks);
+static MCIM_TRACE_SPACE mcim_trace_key_space(MCIM_TRACE_CALL call);
+static MCIM_KEY mcim_trace_map_key(const MCIM_TRACE_PLAYER* player, MCIM_KEY recorded, MCIM_TRACE_SPACE space);
+static void mcim_trace_add_key(MCIM_TRACE_PLAYER* player, MCIM_KEY recorded, MCIM_KEY replayed, MCIM_TRACE_SPACE space);
+static void mcim_trace_wait_until(LONGLONG target, LONGLONG freq);
+static void mcim_trace_callback(MCIM_NOTIFY_FLAGS flag);
+static uint64_t mcim_trace_nanoseconds(LONGLONG ticks, LONGLONG freq);
+static LONGLONG mcim_trace_ticks(uint64_t nanoseconds, LONGLONG freq);
+
+/**************************************************************************************************/
+
+MCIM_TRACE_RECORDER* mcim_trace_open(const wchar_t* filepath, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(filepath != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  MCIM_TRACE_RECORDER* recorder = (MCIM_TRACE_RECORDER*)allocator(sizeof(MCIM_TRACE_RECORDER));
+  if (recorder == NULL) {
+    return NULL;
+  }
+  SecureZeroMemory(recorder, sizeof(MCIM_TRACE_RECORDER));
+  recorder->allocator = allocator;
+  recorder->deallocator = deallocator;
+  recorder->file = INVALID_HANDLE_VALUE;
+  recorder->buffer = (uint8_t*)allocator(MCIM_TRACE_BUFFER_SIZE);
+  recorder->slots = (MCIM_TRACE_SLOT*)allocator(sizeof(MCIM_TRACE_SLOT) * MCIM_TRACE_CAPACITY);
+  recorder->stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+  if (recorder->buffer == NULL || recorder->slots == NULL || recorder->stopEvent == NULL) {
+    mcim_trace_free(recorder, deallocator);
+    return NULL;
+  }
+  for (uint32_t i = 0; i < MCIM_TRACE_CAPACITY; i++) {
+    atomic_init(&(recorder->slots[i].sequence), i);
+    recorder->slots[i].extra = NULL;
+  }
+  atomic_init(&(recorder->enqueuePos), 0);
+  atomic_init(&(recorder->dropped), 0);
+
+  recorder->file = CreateFileW(filepath, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  MCIM_TRACE_HEADER header = {.version = MCIM_TRACE_VERSION, .recordSize = sizeof(MCIM_TRACE_RECORD), .reserved = 0};
+  memcpy(header.magic, MCIM_TRACE_MAGIC, sizeof(MCIM_TRACE_MAGIC));
+  if (recorder->file == INVALID_HANDLE_VALUE || !mcim_trace_write(recorder->file, &header, sizeof(header))) {
+    mcim_trace_free(recorder, deallocator);
+    return NULL;
+  }
+
+  LARGE_INTEGER now;
+  LARGE_INTEGER freq;
+  QueryPerformanceCounter(&now);
+  QueryPerformanceFrequency(&freq);
+  recorder->base = now.QuadPart;
+  recorder->freq = freq.QuadPart;
+
+  recorder->thread = (HANDLE)_beginthreadex(NULL, 0, mcim_trace_thread, recorder, 0, NULL);
+  if (recorder->thread == (HANDLE)0) {
+    recorder->thread = NULL;
+    mcim_trace_free(recorder, deallocator);
+    return NULL;
+  }
+  return recorder;
+}
+
+bool mcim_trace_close(MCIM_TRACE_RECORDER* recorder, mcim_deallocator_t deallocator) {
+  assert(recorder != NULL);
+  assert(deallocator != NULL);
+
+  // 書き出し用のスレッドは停止の直前にリングバッファを空にし、バッファの残りを書き出す
+  SetEvent(recorder->stopEvent);
+  WaitForSingleObject(recorder->thread, INFINITE);
+  CloseHandle(recorder->thread);
+  recorder->thread = NULL;
+
+  bool result = !recorder->failed && atomic_load(&(recorder->dropped)) == 0;
+  result = (CloseHandle(recorder->file) != 0) && result;
+  recorder->file = INVALID_HANDLE_VALUE;
+  mcim_trace_free(recorder, deallocator);
+  return result;
+}
+
+LONGLONG mcim_trace_begin(const MCIM_TRACE_RECORDER* recorder) {
+  if (recorder == NULL) {
+    return 0;
+  }
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  return now.QuadPart;
+}
+
+void mcim_trace_record(MCIM_TRACE_RECORDER* restrict recorder,
+                       LONGLONG begin,
+                       MCIM_TRACE_RECORD* restrict record,
+                       const void* restrict extra,
+                       size_t extraSize) {
+  assert(recorder != NULL);
+  assert(record != NULL);
+  assert(record->call < MCIM_TRACE_CALL_COUNT);
+  assert(extra != NULL || extraSize == 0);
+
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  const uint64_t latency = mcim_trace_nanoseconds(now.QuadPart - begin, recorder->freq);
+  record->time = mcim_trace_nanoseconds(begin - recorder->base, recorder->freq);
+  record->latency = (uint32_t)(latency < UINT32_MAX ? latency : UINT32_MAX);
+  // filepathを途中で切る場合も文字の境界に揃える
+  record->extraSize = (uint16_t)(extraSize < UINT16_MAX ? extraSize : UINT16_MAX & ~(size_t)(sizeof(wchar_t) - 1));
+
+  // 長いfilepathの複製はロードの呼び出し元で確保し、スロットの確保前に済ませる
+  uint8_t* copy = NULL;
+  if (record->extraSize > MCIM_TRACE_INLINE_SIZE) {
+    copy = (uint8_t*)recorder->allocator(record->extraSize);
+    if (copy == NULL) {
+      atomic_fetch_add_explicit(&(recorder->dropped), 1, memory_order_relaxed);
+      return;
+    }
+    memcpy(copy, extra, record->extraSize);
+  }
+
+  // 記録は呼び出しの完了順となるため、複数スレッドから呼ばれた場合はtimeが前後することがある
+  MCIM_TRACE_SLOT* slot;
+  uint32_t position = atomic_load_explicit(&(recorder->enqueuePos), memory_order_relaxed);
+  for (;;) {
+    slot = &(recorder->slots[position & (MCIM_TRACE_CAPACITY - 1)]);
+    const uint32_t sequence = atomic_load_explicit(&(slot->sequence), memory_order_acquire);
+    const int32_t diff = (int32_t)(sequence - position);
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&(recorder->enqueuePos), &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // 満杯の場合は待機せずに破棄し、mcim_trace_closeで失敗として報告する
+      atomic_fetch_add_explicit(&(recorder->dropped), 1, memory_order_relaxed);
+      if (copy != NULL) {
+        recorder->deallocator(copy);
+      }
+      return;
+    } else {
+      position = atomic_load_explicit(&(recorder->enqueuePos), memory_order_relaxed);
+    }
+  }
+
+  slot->record = *record;
+  slot->extra = copy;
+  if (copy == NULL && record->extraSize > 0) {
+    memcpy(slot->inlineExtra, extra, record->extraSize);
+  }
+  atomic_store_explicit(&(slot->sequence), position + 1, memory_order_release);
+}
+
+bool mcim_trace_replay(MCIM_DATA* restrict data,
+                       const wchar_t* restrict filepath,
+                       MCIM_TRACE_PACE pace,
+                       MCIM_TRACE_REPORT* restrict report,
+                       mcim_allocator_t allocator,
+                       mcim_deallocator_t deallocator) {
+  assert(data != NULL);
+  assert(filepath != NULL);
+  assert(report != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  SecureZeroMemory(report, sizeof(MCIM_TRACE_REPORT));
+  uint8_t* contents = NULL;
+  size_t size = 0;
+  if (!mcim_trace_read(filepath, &contents, &size, allocator, deallocator)) {
+    return false;
+  }
+  MCIM_TRACE_HEADER header;
+  if (size < sizeof(header)) {
+    deallocator(contents);
+    return false;
+  }
+  memcpy(&header, contents, sizeof(header));
+  if (memcmp(header.magic, MCIM_TRACE_MAGIC, sizeof(MCIM_TRACE_MAGIC)) != 0 || header.version != MCIM_TRACE_VERSION ||
+      header.recordSize != sizeof(MCIM_TRACE_RECORD)) {
+    deallocator(contents);
+    return false;
+  }
+
+  MCIM_TRACE_PLAYER player = {.data = data, .allocator = allocator, .deallocator = deallocator};
+  LARGE_INTEGER freq;
+  LARGE_INTEGER begin;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&begin);
+
+  // ファイルは読み込み済みのため、再生中の待ち時間は記録された間隔と呼び出し自体の所要時間のみとなる
+  bool result = true;
+  size_t offset = sizeof(header);
+  while (offset < size) {
+    MCIM_TRACE_RECORD record;
+    if (size - offset < sizeof(record)) {
+      result = false;
+      break;
+    }
+    memcpy(&record, contents + offset, sizeof(record));
+    const size_t extraSize = record.extraSize;
+    if (record.call >= MCIM_TRACE_CALL_COUNT || size - offset - sizeof(record) < extraSize) {
+      result = false;
+      break;
+    }
+
+    // 付加データは境界に揃っている保証がないため、またパスには終端を付けるため複製する
+    uint8_t* extra = NULL;
+    if (extraSize > 0) {
+      extra = (uint8_t*)allocator(extraSize + sizeof(wchar_t));
+      if (extra == NULL) {
+        result = false;
+        break;
+      }
+      memcpy(extra, contents + offset + sizeof(record), extraSize);
+      SecureZeroMemory(extra + extraSize, sizeof(wchar_t));
+    }
+    offset += sizeof(record) + extraSize;
+
+    if (pace == MCIM_TRACE_PACE_RECORDED) {
+      const LONGLONG target = begin.QuadPart + mcim_trace_ticks(record.time, freq.QuadPart);
+      mcim_trace_wait_until(target, freq.QuadPart);
+      LARGE_INTEGER now;
+      QueryPerformanceCounter(&now);
+      const double lag = (double)(now.QuadPart - target) / (double)freq.QuadPart;
+      if (lag > report->maxLag) {
+        report->maxLag = lag;
+      }
+    }
+
+    LONGLONG ticks = 0;
+    const bool succeeded = mcim_trace_dispatch(&player, &record, extra, &ticks);
+    if (extra != NULL) {
+      deallocator(extra);
+    }
+
+    MCIM_TRACE_CALL_STATS* stats = &(report->calls[record.call]);
+    const double elapsed = (double)ticks / (double)freq.QuadPart;
+    stats->calls++;
+    stats->totalTime += elapsed;
+    stats->recordedTime += (double)record.latency / 1e9;
+    stats->latency[mcim_stats_latency_bucket(ticks)]++;
+    if (elapsed > stats->maxTime) {
+      stats->maxTime = elapsed;
+    }
+    if (succeeded != ((record.flags & MCIM_TRACE_FLAG_SUCCEEDED) != 0)) {
+      stats->mismatches++;
+    }
+    report->records++;
+  }
+
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&end);
+  report->duration = (double)(end.QuadPart - begin.QuadPart) / (double)freq.QuadPart;
+
+  if (player.keys != NULL) {
+    deallocator(player.keys);
+  }
+  if (player.buffer != NULL) {
+    deallocator(player.buffer);
+  }
+  deallocator(contents);
+  return result;
+}
+
+/**************************************************************************************************/
+
+static void mcim_trace_free(MCIM_TRACE_RECORDER* recorder, mcim_deallocator_t deallocator) {
+  assert(recorder != NULL);
+  assert(recorder->thread == NULL);
+
+  if (recorder->file != INVALID_HANDLE_VALUE) {
+    CloseHandle(recorder->file);
+  }
+  if (recorder->stopEvent != NULL) {
+    CloseHandle(recorder->stopEvent);
+  }
+  if (recorder->slots != NULL) {
+    deallocator(recorder->slots);
+  }
+  if (recorder->buffer != NULL) {
+    deallocator(recorder->buffer);
+  }
+  deallocator(recorder);
+}
+
+static unsigned __stdcall mcim_trace_thread(void* pargs) {
+  MCIM_TRACE_RECORDER* recorder = (MCIM_TRACE_RECORDER*)pargs;
+
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+  // 呼び出し元からは通知せず、一定間隔でリングバッファを確認する
+  while (WaitForSingleObject(recorder->stopEvent, MCIM_TRACE_FLUSH_INTERVAL) == WAIT_TIMEOUT) {
+    mcim_trace_flush(recorder);
+  }
+  mcim_trace_flush(recorder);
+  return 0;
+}
+
+static void mcim_trace_flush(MCIM_TRACE_RECORDER* recorder) {
+  assert(recorder != NULL);
+
+  for (;;) {
+    MCIM_TRACE_SLOT* slot = &(recorder->slots[recorder->dequeuePos & (MCIM_TRACE_CAPACITY - 1)]);
+    const uint32_t sequence = atomic_load_explicit(&(slot->sequence), memory_order_acquire);
+    if ((int32_t)(sequence - (recorder->dequeuePos + 1)) < 0) {
+      break;
+    }
+    const size_t extraSize = slot->record.extraSize;
+    const uint8_t* extra = (slot->extra != NULL ? slot->extra : slot->inlineExtra);
+    const size_t size = sizeof(MCIM_TRACE_RECORD) + extraSize;
+
+    if (!recorder->failed && recorder->length + size > MCIM_TRACE_BUFFER_SIZE) {
+      recorder->failed = !mcim_trace_write(recorder->file, recorder->buffer, recorder->length);
+      recorder->length = 0;
+    }
+    if (!recorder->failed && size > MCIM_TRACE_BUFFER_SIZE) {
+      // バッファに収まらない長さのパスは直接書き出す
+      recorder->failed = !mcim_trace_write(recorder->file, &(slot->record), sizeof(MCIM_TRACE_RECORD)) ||
+                         !mcim_trace_write(recorder->file, extra, extraSize);
+    } else if (!recorder->failed) {
+      memcpy(recorder->buffer + recorder->length, &(slot->record), sizeof(MCIM_TRACE_RECORD));
+      if (extraSize > 0) {
+        memcpy(recorder->buffer + recorder->length + sizeof(MCIM_TRACE_RECORD), extra, extraSize);
+      }
+      recorder->length += size;
+    }
+
+    if (slot->extra != NULL) {
+      recorder->deallocator(slot->extra);
+      slot->extra = NULL;
+    }
+    atomic_store_explicit(&(slot->sequence), recorder->dequeuePos + MCIM_TRACE_CAPACITY, memory_order_release);
+    recorder->dequeuePos++;
+  }
+
+  // 確認毎に書き出し、記録中のファイルも直前の確認までの呼び出しを再生できるようにする
+  if (!recorder->failed && recorder->length > 0) {
+    recorder->failed = !mcim_trace_write(recorder->file, recorder->buffer, recorder->length);
+  }
+  recorder->length = 0;
+}
+
+static bool mcim_trace_write(HANDLE hfile, const void* buffer, size_t size) {
+  assert(hfile != INVALID_HANDLE_VALUE);
+  assert(buffer != NULL || size == 0);
+
+  DWORD written = 0;
+  return (size == 0 || (WriteFile(hfile, buffer, (DWORD)size, &written, NULL) != 0 && written == size));
+}
+
+static bool mcim_trace_read(const wchar_t* restrict filepath,
+                            uint8_t** restrict contents,
+                            size_t* restrict size,
+                            mcim_allocator_t allocator,
+                            mcim_deallocator_t deallocator) {
+  assert(filepath != NULL);
+  assert(contents != NULL);
+  assert(size != NULL);
+
+  HANDLE hfile = CreateFileW(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  if (GetFileSizeEx(hfile, &fileSize) == 0 || fileSize.QuadPart <= 0 || fileSize.QuadPart > MAXDWORD) {
+    CloseHandle(hfile);
+    return false;
+  }
+  uint8_t* buffer = (uint8_t*)allocator((size_t)fileSize.QuadPart);
+  DWORD read = 0;
+  if (buffer == NULL || ReadFile(hfile, buffer, (DWORD)fileSize.QuadPart, &read, NULL) == 0 || read != (DWORD)fileSize.QuadPart) {
+    if (buffer != NULL) {
+      deallocator(buffer);
+    }
+    CloseHandle(hfile);
+    return false;
+  }
+  CloseHandle(hfile);
+  *contents = buffer;
+  *size = (size_t)fileSize.QuadPart;
+  return true;
+}
+
+static bool mcim_trace_dispatch(MCIM_TRACE_PLAYER* restrict player,
+                                const MCIM_TRACE_RECORD* restrict record,
+                                const void* restrict extra,
+                                LONGLONG* restrict ticks) {
+  assert(player != NULL);
+  assert(record != NULL);
+  assert(ticks != NULL);
+
+  MCIM_DATA* data = player->data;
+  const MCIM_TRACE_CALL call = (MCIM_TRACE_CALL)record->call;
+  const MCIM_KEY key = mcim_trace_map_key(player, record->key, mcim_trace_key_space(call));
+  const MCIM_KEY bus = mcim_trace_map_key(player, record->args[0], MCIM_TRACE_SPACE_MUSIC);  // バスを引数に取る呼び出しのみで用いる
+  const MCIM_CALLBACK_PROC callback = ((record->flags & MCIM_TRACE_FLAG_CALLBACK) != 0 ? mcim_trace_callback : NULL);
+  const wchar_t* filepath = (const wchar_t*)extra;
+
+  // 付加データの長さが構造体と異なる場合はパラメータがNULLであったものとして呼び出す
+  const MCIM_EQ_PARAMS* eq = (record->extraSize == sizeof(MCIM_EQ_PARAMS) ? (const MCIM_EQ_PARAMS*)extra : NULL);
+  const MCIM_LIMITER_PARAMS* limiter = (record->extraSize == sizeof(MCIM_LIMITER_PARAMS) ? (const MCIM_LIMITER_PARAMS*)extra : NULL);
+
+  // レンダリング先のバッファの確保は計測に含めない
+  if (call == MCIM_TRACE_RENDER && record->args[0] > player->bufferFrames) {
+    if (player->buffer != NULL) {
+      player->deallocator(player->buffer);
+    }
+    player->buffer = (float*)player->allocator(sizeof(float) * MCIM_MIXER_CHANNELS * record->args[0]);
+    player->bufferFrames = (player->buffer != NULL ? record->args[0] : 0);
+    if (player->buffer == NULL) {
+      *ticks = 0;
+      return false;
+    }
+  }
+
+  LARGE_INTEGER begin;
+  LARGE_INTEGER end;
+  MCIM_KEY ret = MCIM_INVALID_KEY;
+  uint32_t index = 0;
+  bool succeeded = false;
+  QueryPerformanceCounter(&begin);
+  switch (call) {
+    case MCIM_TRACE_LOAD:
+      ret = mcim_load(data, filepath);
+      succeeded = (ret != MCIM_INVALID_KEY);
+      break;
+    case MCIM_TRACE_UNLOAD:
+      succeeded = mcim_unload(data, key);
+      break;
+    case MCIM_TRACE_SET_LOOP:
+      succeeded = mcim_set_loop(data, key, record->args[0], record->args[1]);
+      break;
+    case MCIM_TRACE_PLAY:
+      succeeded = mcim_play(data, key, callback);
+      break;
+    case MCIM_TRACE_PLAY_FROM:
+      succeeded = mcim_play_from(data, key, (int32_t)record->args[0]);
+      break;
+    case MCIM_TRACE_STOP:
+      succeeded = (mcim_stop(data, key) != MCIM_INVALID_KEY);
+      break;
+    case MCIM_TRACE_FADEOUT:
+      succeeded = (mcim_fadeout(data, key, mcim_trace_bits_float(record->args[1]), (int32_t)record->args[0], callback) != MCIM_INVALID_KEY);
+      break;
+    case MCIM_TRACE_SET_RATE:
+      succeeded = mcim_set_rate(data,
+                                key,
+                                mcim_trace_bits_float(record->args[0]),
+                                ((record->flags & MCIM_TRACE_FLAG_STRETCH) != 0 ? MCIM_RATE_STRETCH : MCIM_RATE_RESAMPLE),
+                                mcim_trace_bits_float(record->args[1]));
+      break;
+    case MCIM_TRACE_SFX_LOAD:
+      ret = mcim_sfx_load(data, filepath);
+      succeeded = (ret != MCIM_INVALID_KEY);
+      break;
+    case MCIM_TRACE_SFX_UNLOAD:
+      succeeded = mcim_sfx_unload(data, key);
+      break;
+    case MCIM_TRACE_SFX_PLAY:
+      succeeded = mcim_sfx_play(data, key, mcim_trace_bits_float(record->args[0]), (int32_t)record->args[1]);
+      break;
+    case MCIM_TRACE_SFX_STOP_ALL:
+      succeeded = mcim_sfx_stop_all(data);
+      break;
+    case MCIM_TRACE_RENDER:
+      succeeded = mcim_render(data, player->buffer, record->args[0]);
+      break;
+    case MCIM_TRACE_SFX_PLAY_AT:
+      ret = mcim_sfx_play_at(data,
+                             key,
+                             mcim_trace_bits_float(record->args[0]),
+                             (int32_t)record->args[1],
+                             mcim_trace_bits_float(record->args[2]),
+                             mcim_trace_bits_float(record->args[3]));
+      succeeded = (ret != 0);
+      break;
+    case MCIM_TRACE_SFX_MOVE:
+      succeeded = mcim_sfx_move(data, key, mcim_trace_bits_float(record->args[0]), mcim_trace_bits_float(record->args[1]));
+      break;
+    case MCIM_TRACE_SET_DUCKED:
+      succeeded = mcim_set_ducked(data, key, (record->flags & MCIM_TRACE_FLAG_ENABLED) != 0);
+      break;
+    case MCIM_TRACE_ADD_EQ:
+      succeeded = mcim_add_eq(data, key, eq, &index);
+      break;
+    case MCIM_TRACE_SET_EQ:
+      succeeded = mcim_set_eq(data, key, record->args[0], eq);
+      break;
+    case MCIM_TRACE_ADD_LIMITER:
+      succeeded = mcim_add_limiter(data, key, limiter, &index);
+      break;
+    case MCIM_TRACE_SET_LIMITER:
+      succeeded = mcim_set_limiter(data, key, record->args[0], limiter);
+      break;
+    case MCIM_TRACE_CLEAR_EFFECTS:
+      succeeded = mcim_clear_effects(data, key);
+      break;
+    case MCIM_TRACE_CREATE_BUS:
+      ret = mcim_create_bus(data, key);
+      succeeded = (ret != MCIM_INVALID_KEY);
+      break;
+    case MCIM_TRACE_DESTROY_BUS:
+      succeeded = mcim_destroy_bus(data, key);
+      break;
+    case MCIM_TRACE_ROUTE_BUS:
+      succeeded = mcim_route_bus(data, key, bus);
+      break;
+    case MCIM_TRACE_SET_BUS_GAIN:
+      succeeded = mcim_set_bus_gain(data, key, mcim_trace_bits_float(record->args[0]));
+      break;
+    case MCIM_TRACE_SET_BUS:
+      succeeded = mcim_set_bus(data, key, bus);
+      break;
+    case MCIM_TRACE_SET_SFX_BUS:
+      succeeded = mcim_set_sfx_bus(data, key, bus);
+      break;
+    case MCIM_TRACE_SET_RENDER_THREADS:
+      succeeded = mcim_set_render_threads(data, record->args[0]);
+      break;
+    case MCIM_TRACE_SET_FADEOUT_FPS:
+      succeeded = mcim_set_fadeout_fps(data, key, mcim_trace_bits_float(record->args[0]));
+      break;
+    default:
+      break;
+  }
+  QueryPerformanceCounter(&end);
+  *ticks = end.QuadPart - begin.QuadPart;
+
+  // 以後の呼び出しでは記録時のキー、バスおよびインスタンスを再生時のものへ読み替える
+  if (succeeded && record->result != MCIM_INVALID_KEY) {
+    if (call == MCIM_TRACE_LOAD || call == MCIM_TRACE_CREATE_BUS) {
+      mcim_trace_add_key(player, record->result, ret, MCIM_TRACE_SPACE_MUSIC);
+    } else if (call == MCIM_TRACE_SFX_LOAD) {
+      mcim_trace_add_key(player, record->result, ret, MCIM_TRACE_SPACE_SFX);
+    } else if (call == MCIM_TRACE_SFX_PLAY_AT) {
+      mcim_trace_add_key(player, record->result, ret, MCIM_TRACE_SPACE_INSTANCE);
+    }
+  }
+  return succeeded;
+}
+
+static MCIM_TRACE_SPACE mcim_trace_key_space(MCIM_TRACE_CALL call) {
+  switch (call) {
+    case MCIM_TRACE_SFX_UNLOAD:
+    case MCIM_TRACE_SFX_PLAY:
+    case MCIM_TRACE_SFX_PLAY_AT:
+    case MCIM_TRACE_SET_SFX_BUS:
+      return MCIM_TRACE_SPACE_SFX;
+    case MCIM_TRACE_SFX_MOVE:
+      return MCIM_TRACE_SPACE_INSTANCE;
+    default:
+      return MCIM_TRACE_SPACE_MUSIC;
+  }
+}
+
+static MCIM_KEY mcim_trace_map_key(const MCIM_TRACE_PLAYER* player, MCIM_KEY recorded, MCIM_TRACE_SPACE space) {
+  assert(player != NULL);
+
+  // 同じキーが再度ロードされた場合は最後の対応を用いる
+  for (uint32_t i = player->keyCount; i > 0; i--) {
+    const MCIM_TRACE_KEY* entry = &(player->keys[i - 1]);
+    if (entry->recorded == recorded && entry->space == space) {
+      return entry->replayed;
+    }
+  }
+  return recorded;
+}
+
+static void mcim_trace_add_key(MCIM_TRACE_PLAYER* player, MCIM_KEY recorded, MCIM_KEY replayed, MCIM_TRACE_SPACE space) {
+  assert(player != NULL);
+
+  if (player->keyCount == player->keyCapacity) {
+    const uint32_t capacity = (player->keyCapacity == 0 ? 16 : player->keyCapacity * 2);
+    MCIM_TRACE_KEY* keys = (MCIM_TRACE_KEY*)player->allocator(sizeof(MCIM_TRACE_KEY) * capacity);
+    if (keys == NULL) {
+      return;
+    }
+    if (player->keys != NULL) {
+      memcpy(keys, player->keys, sizeof(MCIM_TRACE_KEY) * player->keyCount);
+      player->deallocator(player->keys);
+    }
+    player->keys = keys;
+    player->keyCapacity = capacity;
+  }
+  player->keys[player->keyCount++] = (MCIM_TRACE_KEY){.recorded = recorded, .replayed = replayed, .space = space};
+}
+
+static void mcim_trace_wait_until(LONGLONG target, LONGLONG freq) {
+  // Sleepの分解能は粗いため、残りがMCIM_TRACE_SPIN_THRESHOLDを切ってからはスピンで待つ
+  for (;;) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    const LONGLONG remaining = target - now.QuadPart;
+    if (remaining <= 0) {
+      return;
+    }
+    const LONGLONG milliseconds = remaining * 1000 / freq;
+    if (milliseconds > MCIM_TRACE_SPIN_THRESHOLD) {
+      Sleep((DWORD)(milliseconds - MCIM_TRACE_SPIN_THRESHOLD < MAXDWORD - 1 ? milliseconds - MCIM_TRACE_SPIN_THRESHOLD : MAXDWORD - 1));
+    } else {
+      YieldProcessor();
+    }
+  }
+}
+
+static void mcim_trace_callback(MCIM_NOTIFY_FLAGS flag) {
+  (void)flag;
+}
+
+static uint64_t mcim_trace_nanoseconds(LONGLONG ticks, LONGLONG freq) {
+  assert(freq > 0);
+
+  // ticks * 1e9が桁あふれしないよう、秒とその端数に分けて換算する
+  if (ticks <= 0) {
+    return 0;
+  }
+  return (uint64_t)(ticks / freq) * 1000000000 + (uint64_t)(ticks % freq) * 1000000000 / (uint64_t)freq;
+}
+
+static LONGLONG mcim_trace_ticks(uint64_t nanoseconds, LONGLONG freq) {
+  assert(freq > 0);
+
+  return (LONGLONG)(nanoseconds / 1000000000) * freq + (LONGLONG)(nanoseconds % 1000000000) * freq / 1000000000;
+}
@@ -0,0 +1,806 @@
+﻿#include "_MCIMWave.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "_MCIMKernels.h"
+#include "_MCIMStats.h"
+
+#define MCIM_WAVE_FORMAT_PCM 0x0001
+#define MCIM_WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define MCIM_WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+typedef struct _MCIM_WAVE_FORMAT {
+  uint16_t formatTag;
+  uint16_t channels;
+  uint32_t sampleRate;
+  uint16_t blockAlign;
+  uint16_t bitsPerSample;
+} MCIM_WAVE_FORMAT;
+
+// メモリ予算は全MCIMオブジェクトで共有する（0の場合は無制限）
+static _Atomic(size_t) MCIM_WAVE_MEMORY_BUDGET = 0;
+static _Atomic(size_t) MCIM_WAVE_RESIDENT_BYTES = 0;
+static _Atomic(size_t) MCIM_WAVE_WINDOW_BYTES = 0;
+static _Atomic(uint32_t) MCIM_WAVE_STORAGE_COUNT[3] = {0, 0, 0};
+
+static MCIM_PCM* mcim_wave_load_storage(const wchar_t* filepath,
+                                        MCIM_PCM_STORAGE storage,
+                                        bool narrow,
+                                        bool streamable,
+                                        mcim_allocator_t allocator,
+                                        mcim_deallocator_t deallocator);
+static bool mcim_wave_read_at(HANDLE hfile, uint64_t offset, void* buffer, uint32_t size);
+static bool mcim_wave_parse_format(const uint8_t* chunk, uint32_t size, MCIM_WAVE_FORMAT* format);
+static void mcim_wave_parse_sampler(const uint8_t* chunk, uint32_t size, MCIM_PCM* pcm);
+static void mcim_wave_decode(const uint8_t* restrict src, uint16_t formatTag, uint16_t bitsPerSample, size_t count, float* restrict dst);
+static void mcim_wave_decode_frames(const MCIM_PCM* restrict pcm, const uint8_t* restrict src, uint32_t frames, float* restrict dst);
+static bool mcim_wave_narrow(MCIM_PCM* pcm, HANDLE hfile, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+static bool mcim_wave_reserve(size_t bytes, bool force);
+static bool mcim_wave_create_window(MCIM_PCM* pcm, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+static void mcim_wave_stream(const MCIM_PCM* pcm, uint32_t frame, bool wait);
+static void mcim_wave_readahead(const MCIM_PCM* pcm);
+static MCIM_PCM_READ* mcim_wave_acquire(const MCIM_PCM* pcm, bool wait);
+static void mcim_wave_issue(const MCIM_PCM* restrict pcm, MCIM_PCM_READ* restrict read, uint32_t start);
+static bool mcim_wave_complete(const MCIM_PCM* restrict pcm, MCIM_PCM_READ* restrict read, bool wait);
+static void mcim_wave_discard(const MCIM_PCM* restrict pcm, MCIM_PCM_READ* restrict read);
+static void mcim_wave_destroy(MCIM_PCM* pcm, mcim_deallocator_t deallocator);
+
+static inline uint16_t mcim_wave_u16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t mcim_wave_u32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void mcim_wave_put_u16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void mcim_wave_put_u32(uint8_t* p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/**************************************************************************************************/
+
+bool mcim_wave_probe(const wchar_t* filepath) {
+  assert(filepath != NULL);
+
+  HANDLE hfile = CreateFileW(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  uint8_t header[12];
+  DWORD read = 0;
+  BOOL result = ReadFile(hfile, header, sizeof(header), &read, NULL);
+  CloseHandle(hfile);
+
+  return (result != 0 && read == sizeof(header) && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0);
+}
+
+MCIM_PCM* mcim_wave_load(const wchar_t* filepath,
+                         MCIM_RESIDENCY residency,
+                         bool streamable,
+                         mcim_allocator_t allocator,
+                         mcim_deallocator_t deallocator) {
+  assert(filepath != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  // INT16はENCODEDと同様に再生中にデコードし、16bitより大きい形式のファイルは16bit PCMへ変換して常駐させる
+  MCIM_PCM_STORAGE storage = (residency != MCIM_RESIDENCY_DECODED ? MCIM_PCM_STORAGE_ENCODED : MCIM_PCM_STORAGE_DECODED);
+  return mcim_wave_load_storage(filepath, storage, residency == MCIM_RESIDENCY_INT16, streamable, allocator, deallocator);
+}
+
+MCIM_PCM* mcim_wave_open(const wchar_t* filepath, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(filepath != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  return mcim_wave_load_storage(filepath, MCIM_PCM_STORAGE_STREAMED, false, true, allocator, deallocator);
+}
+
+void mcim_wave_free(MCIM_PCM* pcm, mcim_deallocator_t deallocator) {
+  assert(deallocator != NULL);
+
+  if (pcm == NULL) {
+    return;
+  }
+  atomic_fetch_sub(&(MCIM_WAVE_STORAGE_COUNT[pcm->storage]), 1);
+  mcim_wave_destroy(pcm, deallocator);
+}
+
+const float* mcim_wave_map(const MCIM_PCM* restrict pcm, uint32_t frame, uint32_t* restrict start, uint32_t* restrict end, bool wait) {
+  assert(pcm != NULL);
+  assert(frame < pcm->frames);
+  assert(start != NULL);
+  assert(end != NULL);
+
+  MCIM_PCM_WINDOW* window = pcm->window;
+  if (window == NULL) {
+    *start = 0;
+    *end = pcm->frames;
+    return pcm->samples;
+  }
+
+  // 補間に次のフレームも必要となるため、frame + 1が区間外であれば（終端を除き）frameから読み直す
+  bool hit = (window->start <= frame && frame < window->end && (frame + 1 < window->end || window->end == pcm->frames));
+  if (!hit && pcm->storage == MCIM_PCM_STORAGE_STREAMED) {
+    mcim_wave_stream(pcm, frame, wait);
+  } else if (!hit) {
+    uint32_t count = pcm->frames - frame;
+    if (count > MCIM_PCM_WINDOW_FRAMES) {
+      count = MCIM_PCM_WINDOW_FRAMES;
+    }
+    mcim_wave_decode_frames(pcm, pcm->encoded + (size_t)frame * pcm->blockAlign, count, window->samples);
+    window->start = frame;
+    window->end = frame + count;
+  }
+
+  *start = window->start;
+  *end = window->end;
+  return window->samples;
+}
+
+void mcim_wave_set_loop_hint(const MCIM_PCM* pcm, uint32_t loopStart, uint32_t loopEnd) {
+  assert(pcm != NULL);
+
+  if (pcm->window != NULL) {
+    pcm->window->loopStart = loopStart;
+    pcm->window->loopEnd = loopEnd;
+  }
+}
+
+void mcim_wave_set_budget(size_t bytes) {
+  atomic_store(&MCIM_WAVE_MEMORY_BUDGET, bytes);
+}
+
+void mcim_wave_get_stats(MCIM_MEMORY_STATS* stats) {
+  assert(stats != NULL);
+
+  stats->budget = atomic_load(&MCIM_WAVE_MEMORY_BUDGET);
+  stats->residentBytes = atomic_load(&MCIM_WAVE_RESIDENT_BYTES);
+  stats->windowBytes = atomic_load(&MCIM_WAVE_WINDOW_BYTES);
+  stats->decodedCount = atomic_load(&(MCIM_WAVE_STORAGE_COUNT[MCIM_PCM_STORAGE_DECODED]));
+  stats->encodedCount = atomic_load(&(MCIM_WAVE_STORAGE_COUNT[MCIM_PCM_STORAGE_ENCODED]));
+  stats->streamedCount = atomic_load(&(MCIM_WAVE_STORAGE_COUNT[MCIM_PCM_STORAGE_STREAMED]));
+}
+
+bool mcim_wave_save(const wchar_t* restrict filepath, const float* restrict samples, uint32_t frames, uint32_t sampleRate) {
+  assert(filepath != NULL);
+  assert(samples != NULL);
+
+  const uint16_t channels = 2;
+  const uint16_t blockAlign = channels * sizeof(float);
+  const uint64_t dataSize = (uint64_t)frames * blockAlign;
+  if (dataSize > UINT32_MAX - 36) {
+    return false;
+  }
+
+  uint8_t header[44];
+  memcpy(header, "RIFF", 4);
+  mcim_wave_put_u32(header + 4, (uint32_t)(36 + dataSize));
+  memcpy(header + 8, "WAVEfmt ", 8);
+  mcim_wave_put_u32(header + 16, 16);
+  mcim_wave_put_u16(header + 20, MCIM_WAVE_FORMAT_IEEE_FLOAT);
+  mcim_wave_put_u16(header + 22, channels);
+  mcim_wave_put_u32(header + 24, sampleRate);
+  mcim_wave_put_u32(header + 28, sampleRate * blockAlign);
+  mcim_wave_put_u16(header + 32, blockAlign);
+  mcim_wave_put_u16(header + 34, 32);
+  memcpy(header + 36, "data", 4);
+  mcim_wave_put_u32(header + 40, (uint32_t)dataSize);
+
+  HANDLE hfile = CreateFileW(filepath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  DWORD written = 0;
+  bool result = (WriteFile(hfile, header, sizeof(header), &written, NULL) != 0 && written == sizeof(header));
+  if (result && dataSize > 0) {
+    result = (WriteFile(hfile, samples, (DWORD)dataSize, &written, NULL) != 0 && written == (DWORD)dataSize);
+  }
+  CloseHandle(hfile);
+  return result;
+}
+
+/**************************************************************************************************/
+
+static MCIM_PCM* mcim_wave_load_storage(const wchar_t* filepath,
+                                        MCIM_PCM_STORAGE storage,
+                                        bool narrow,
+                                        bool streamable,
+                                        mcim_allocator_t allocator,
+                                        mcim_deallocator_t deallocator) {
+  assert(filepath != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  LARGE_INTEGER begin;
+  QueryPerformanceCounter(&begin);
+
+  // ヘッダ類はファイルポインタに依らない位置指定で読み込む
+  HANDLE hfile = CreateFileW(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+
+  LARGE_INTEGER fileSize;
+  uint8_t header[12];
+  if (GetFileSizeEx(hfile, &fileSize) == 0 || fileSize.QuadPart < 12 || !mcim_wave_read_at(hfile, 0, header, sizeof(header)) ||
+      memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+    CloseHandle(hfile);
+    return NULL;
+  }
+  const uint64_t size = (uint64_t)fileSize.QuadPart;
+
+  MCIM_PCM* pcm = (MCIM_PCM*)allocator(sizeof(MCIM_PCM));
+  if (pcm == NULL) {
+    CloseHandle(hfile);
+    return NULL;
+  }
+  SecureZeroMemory(pcm, sizeof(MCIM_PCM));
+
+  MCIM_WAVE_FORMAT format = {0};
+  bool hasFormat = false;
+  bool hasData = false;
+  uint32_t dataSize = 0;
+
+  // チャンクは2バイト境界に整列されている
+  uint64_t offset = 12;
+  while (offset + 8 <= size) {
+    uint8_t chunk[8];
+    if (!mcim_wave_read_at(hfile, offset, chunk, sizeof(chunk))) {
+      break;
+    }
+    uint32_t chunkSize = mcim_wave_u32(chunk + 4);
+    if (chunkSize > size - offset - 8) {
+      chunkSize = (uint32_t)(size - offset - 8);
+    }
+
+    // fmtチャンクはWAVEFORMATEXTENSIBLEのSubFormatまで、smplチャンクは最初のループまでを読めば足りる
+    uint8_t body[60];
+    uint32_t bodySize = (chunkSize < sizeof(body) ? chunkSize : sizeof(body));
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      hasFormat = mcim_wave_read_at(hfile, offset + 8, body, bodySize) && mcim_wave_parse_format(body, bodySize, &format);
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      hasData = true;
+      pcm->dataOffset = offset + 8;
+      dataSize = chunkSize;
+    } else if (memcmp(chunk, "smpl", 4) == 0) {
+      if (mcim_wave_read_at(hfile, offset + 8, body, bodySize)) {
+        mcim_wave_parse_sampler(body, bodySize, pcm);
+      }
+    }
+    offset += 8 + (uint64_t)chunkSize + (chunkSize & 1);
+  }
+
+  if (!hasFormat || !hasData || format.blockAlign == 0 || dataSize < format.blockAlign) {
+    deallocator(pcm);
+    CloseHandle(hfile);
+    return NULL;
+  }
+
+  pcm->frames = dataSize / format.blockAlign;
+  pcm->sampleRate = format.sampleRate;
+  pcm->channels = format.channels;
+  pcm->formatTag = format.formatTag;
+  pcm->bitsPerSample = format.bitsPerSample;
+  pcm->blockAlign = format.blockAlign;
+  if (pcm->loopEnd > pcm->frames || pcm->loopStart >= pcm->loopEnd) {
+    pcm->loopStart = 0;
+    pcm->loopEnd = 0;
+  }
+
+  // 予算内に収まらない場合はメモリへ常駐させず、再生中にファイルから読み込む
+  const uint32_t encodedSize = pcm->frames * pcm->blockAlign;
+  const size_t decodedSize = sizeof(float) * pcm->frames * pcm->channels;
+  // 8bit PCMは16bitへ変換すると大きくなるため、ファイル上の形式のまま常駐させる
+  narrow = (narrow && storage == MCIM_PCM_STORAGE_ENCODED && (pcm->formatTag == MCIM_WAVE_FORMAT_IEEE_FLOAT || pcm->bitsPerSample > 16));
+  const uint32_t residentEncodedSize = (narrow ? (uint32_t)sizeof(int16_t) * pcm->frames * pcm->channels : encodedSize);
+  pcm->storage = storage;
+  pcm->residentBytes = (storage == MCIM_PCM_STORAGE_ENCODED ? residentEncodedSize : (storage == MCIM_PCM_STORAGE_DECODED ? decodedSize : 0));
+  if (!mcim_wave_reserve(pcm->residentBytes, !streamable)) {
+    pcm->storage = MCIM_PCM_STORAGE_STREAMED;
+    pcm->residentBytes = 0;
+  }
+
+  MCIM_CACHE_STAMP stamp;
+  const bool cacheable = (pcm->storage == MCIM_PCM_STORAGE_DECODED && mcim_cache_enabled() && mcim_cache_get_stamp(filepath, &stamp));
+  bool cached = false;
+  bool result = false;
+  switch (pcm->storage) {
+    case MCIM_PCM_STORAGE_DECODED:
+      // 前回デコードした結果がキャッシュにあれば、デコードせずにメモリマップする
+      if (cacheable) {
+        pcm->samples = (float*)mcim_cache_map(filepath, &stamp, pcm->frames, pcm->sampleRate, pcm->channels, &(pcm->cache));
+        if (pcm->samples != NULL) {
+          cached = true;
+          result = true;
+          break;
+        }
+      }
+      pcm->samples = (float*)allocator(decodedSize);
+      if (pcm->samples == NULL) {
+        break;
+      }
+      if (pcm->formatTag == MCIM_WAVE_FORMAT_IEEE_FLOAT) {
+        result = mcim_wave_read_at(hfile, pcm->dataOffset, pcm->samples, encodedSize);
+      } else {
+        uint8_t* data = (uint8_t*)allocator(encodedSize);
+        if (data != NULL) {
+          result = mcim_wave_read_at(hfile, pcm->dataOffset, data, encodedSize);
+          if (result) {
+            mcim_wave_decode_frames(pcm, data, pcm->frames, pcm->samples);
+          }
+          deallocator(data);
+        }
+      }
+      if (result && cacheable) {
+        mcim_cache_store(filepath, &stamp, pcm->samples, pcm->frames, pcm->sampleRate, pcm->channels);
+      }
+      break;
+    case MCIM_PCM_STORAGE_ENCODED:
+      pcm->encoded = (uint8_t*)allocator(residentEncodedSize);
+      if (pcm->encoded == NULL) {
+        break;
+      }
+      if (narrow) {
+        result = mcim_wave_narrow(pcm, hfile, allocator, deallocator);
+      } else {
+        result = mcim_wave_read_at(hfile, pcm->dataOffset, pcm->encoded, encodedSize);
+      }
+      result = result && mcim_wave_create_window(pcm, allocator, deallocator);
+      break;
+    case MCIM_PCM_STORAGE_STREAMED:
+      // 複数の読み込みを同時に発行するため、ストリーミング用には非同期I/Oのハンドルを開き直す
+      pcm->file = CreateFileW(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+      if (pcm->file == INVALID_HANDLE_VALUE) {
+        pcm->file = NULL;
+        break;
+      }
+      result = mcim_wave_create_window(pcm, allocator, deallocator);
+      break;
+  }
+  if (hfile != INVALID_HANDLE_VALUE) {
+    CloseHandle(hfile);
+  }
+  if (!result) {
+    mcim_wave_destroy(pcm, deallocator);
+    return NULL;
+  }
+  if (cacheable) {
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+    mcim_cache_record_load(cached, end.QuadPart - begin.QuadPart);
+  }
+
+  atomic_fetch_add(&(MCIM_WAVE_STORAGE_COUNT[pcm->storage]), 1);
+  return pcm;
+}
+
+static bool mcim_wave_read_at(HANDLE hfile, uint64_t offset, void* buffer, uint32_t size) {
+  assert(hfile != INVALID_HANDLE_VALUE);
+  assert(buffer != NULL);
+
+  // 同期ハンドルでもOVERLAPPEDで位置を指定すればファイルポインタを共有せずに読み込める
+  OVERLAPPED overlapped = {0};
+  overlapped.Offset = (DWORD)offset;
+  overlapped.OffsetHigh = (DWORD)(offset >> 32);
+  DWORD read = 0;
+  return (ReadFile(hfile, buffer, size, &read, &overlapped) != 0 && read == size);
+}
+
+static bool mcim_wave_parse_format(const uint8_t* chunk, uint32_t size, MCIM_WAVE_FORMAT* format) {
+  assert(chunk != NULL);
+  assert(format != NULL);
+
+  if (size < 16) {
+    return false;
+  }
+
+  format->formatTag = mcim_wave_u16(chunk);
+  format->channels = mcim_wave_u16(chunk + 2);
+  format->sampleRate = mcim_wave_u32(chunk + 4);
+  format->blockAlign = mcim_wave_u16(chunk + 12);
+  format->bitsPerSample = mcim_wave_u16(chunk + 14);
+
+  // WAVEFORMATEXTENSIBLEの場合はSubFormat GUIDの先頭2バイトが実際のフォーマットタグとなる
+  if (format->formatTag == MCIM_WAVE_FORMAT_EXTENSIBLE) {
+    if (size < 26) {
+      return false;
+    }
+    format->formatTag = mcim_wave_u16(chunk + 24);
+  }
+
+  if (format->channels < 1 || format->channels > 2 || format->sampleRate == 0) {
+    return false;
+  }
+  if (format->blockAlign != format->channels * (format->bitsPerSample / 8)) {
+    return false;
+  }
+
+  switch (format->formatTag) {
+    case MCIM_WAVE_FORMAT_PCM:
+      return (format->bitsPerSample == 8 || format->bitsPerSample == 16 || format->bitsPerSample == 24 || format->bitsPerSample == 32);
+    case MCIM_WAVE_FORMAT_IEEE_FLOAT:
+      return (format->bitsPerSample == 32);
+    default:
+      return false;
+  }
+}
+
+static void mcim_wave_parse_sampler(const uint8_t* chunk, uint32_t size, MCIM_PCM* pcm) {
+  assert(chunk != NULL);
+  assert(pcm != NULL);
+
+  // smplチャンクの36バイト目からループ情報（24バイト/個）が並ぶ
+  // 最初のループのみを使用し、dwEndはループ区間の最終サンプルを含む（inclusive）
+  if (size < 36 + 24 || mcim_wave_u32(chunk + 28) == 0) {
+    return;
+  }
+  const uint8_t* loop = chunk + 36;
+  pcm->loopStart = mcim_wave_u32(loop + 8);
+  pcm->loopEnd = mcim_wave_u32(loop + 12) + 1;
+}
+
+static void mcim_wave_decode(const uint8_t* restrict src, uint16_t formatTag, uint16_t bitsPerSample, size_t count, float* restrict dst) {
+  assert(src != NULL);
+  assert(dst != NULL);
+
+  if (formatTag == MCIM_WAVE_FORMAT_IEEE_FLOAT) {
+    memcpy(dst, src, sizeof(float) * count);
+    return;
+  }
+
+  switch (bitsPerSample) {
+    case 8:
+      for (size_t i = 0; i < count; i++) {
+        dst[i] = ((float)src[i] - 128.0f) * (1.0f / 128.0f);
+      }
+      break;
+    case 16:
+      mcim_select_kernels()->s16_to_float(dst, (const int16_t*)src, (uint32_t)count);
+      break;
+    case 24:
+      for (size_t i = 0; i < count; i++) {
+        const uint8_t* p = src + 3 * i;
+        int32_t v = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+        dst[i] = (float)v * (1.0f / 8388608.0f);
+      }
+      break;
+    case 32:
+      for (size_t i = 0; i < count; i++) {
+        dst[i] = (float)((double)(int32_t)mcim_wave_u32(src + 4 * i) * (1.0 / 2147483648.0));
+      }
+      break;
+    default:
+      // 対応形式はロード時に検証済み
+      assert(false);
+      break;
+  }
+}
+
+static void mcim_wave_decode_frames(const MCIM_PCM* restrict pcm, const uint8_t* restrict src, uint32_t frames, float* restrict dst) {
+  assert(pcm != NULL);
+
+  // 再生中のデコードにも使われるため、所要時間の記録はアトミックな加算のみとする
+  LARGE_INTEGER begin;
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&begin);
+  mcim_wave_decode(src, pcm->formatTag, pcm->bitsPerSample, (size_t)frames * pcm->channels, dst);
+  QueryPerformanceCounter(&end);
+  mcim_stats_record_decode(frames, pcm->sampleRate, end.QuadPart - begin.QuadPart);
+}
+
+static bool mcim_wave_narrow(MCIM_PCM* pcm, HANDLE hfile, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(pcm != NULL);
+  assert(pcm->encoded != NULL);
+  assert(hfile != INVALID_HANDLE_VALUE);
+
+  // 全体をfloatへデコードするとその分のメモリを一時的に要するため、区間毎にデコードして16bitへ変換する
+  uint8_t* raw = (uint8_t*)allocator((size_t)MCIM_PCM_WINDOW_FRAMES * pcm->blockAlign);
+  float* decoded = (float*)allocator(sizeof(float) * MCIM_PCM_WINDOW_FRAMES * pcm->channels);
+  bool result = (raw != NULL && decoded != NULL);
+  const MCIM_KERNELS* kernels = mcim_select_kernels();
+  int16_t* dst = (int16_t*)pcm->encoded;
+  for (uint32_t frame = 0; result && frame < pcm->frames; frame += MCIM_PCM_WINDOW_FRAMES) {
+    const uint32_t count = (pcm->frames - frame < MCIM_PCM_WINDOW_FRAMES ? pcm->frames - frame : MCIM_PCM_WINDOW_FRAMES);
+    result = mcim_wave_read_at(hfile, pcm->dataOffset + (uint64_t)frame * pcm->blockAlign, raw, count * pcm->blockAlign);
+    if (result) {
+      mcim_wave_decode_frames(pcm, raw, count, decoded);
+      kernels->float_to_s16(dst + (size_t)frame * pcm->channels, decoded, count * pcm->channels);
+    }
+  }
+  if (raw != NULL) {
+    deallocator(raw);
+  }
+  if (decoded != NULL) {
+    deallocator(decoded);
+  }
+
+  // 以後はencodedを16bit PCMのファイルと同様に扱う
+  pcm->formatTag = MCIM_WAVE_FORMAT_PCM;
+  pcm->bitsPerSample = 16;
+  pcm->blockAlign = (uint16_t)(sizeof(int16_t) * pcm->channels);
+  return result;
+}
+
+static bool mcim_wave_reserve(size_t bytes, bool force) {
+  size_t budget = atomic_load(&MCIM_WAVE_MEMORY_BUDGET);
+  size_t current = atomic_load(&MCIM_WAVE_RESIDENT_BYTES);
+  do {
+    if (!force && budget != 0 && (current > budget || bytes > budget - current)) {
+      return false;
+    }
+  } while (!atomic_compare_exchange_weak(&MCIM_WAVE_RESIDENT_BYTES, &current, current + bytes));
+  return true;
+}
+
+static bool mcim_wave_create_window(MCIM_PCM* pcm, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
+  assert(pcm != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  MCIM_PCM_WINDOW* window = (MCIM_PCM_WINDOW*)allocator(sizeof(MCIM_PCM_WINDOW));
+  if (window == NULL) {
+    return false;
+  }
+  SecureZeroMemory(window, sizeof(MCIM_PCM_WINDOW));
+  window->loopStart = pcm->loopStart;
+  window->loopEnd = pcm->loopEnd;
+
+  // 途中で失敗した場合もmcim_wave_destroyで解放できるよう、先にpcmへ設定する
+  pcm->window = window;
+  const size_t samplesSize = sizeof(float) * MCIM_PCM_WINDOW_FRAMES * pcm->channels;
+  const size_t rawSize = (pcm->storage == MCIM_PCM_STORAGE_STREAMED ? (size_t)MCIM_PCM_WINDOW_FRAMES * pcm->blockAlign : 0);
+  window->samples = (float*)allocator(samplesSize);
+  bool result = (window->samples != NULL);
+  for (uint32_t i = 0; i < MCIM_PCM_READAHEAD_COUNT && rawSize > 0 && result; i++) {
+    MCIM_PCM_READ* read = &(window->reads[i]);
+    read->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    read->raw = (uint8_t*)allocator(rawSize);
+    result = (read->overlapped.hEvent != NULL && read->raw != NULL);
+  }
+
+  atomic_fetch_add(&MCIM_WAVE_WINDOW_BYTES, sizeof(MCIM_PCM_WINDOW) + samplesSize + rawSize * MCIM_PCM_READAHEAD_COUNT);
+  return result;
+}
+
+static void mcim_wave_stream(const MCIM_PCM* pcm, uint32_t frame, bool wait) {
+  assert(pcm != NULL);
+  assert(pcm->window != NULL);
+  assert(pcm->file != NULL);
+
+  MCIM_PCM_WINDOW* window = pcm->window;
+  LARGE_INTEGER begin;
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&begin);
+
+  // 先読みした区間に含まれていればその完了を確かめるだけでよい
+  // 外れた場合（シーク等）は発行済みの読み込みを全て取り消し、frameから読み直す
+  MCIM_PCM_READ* read = NULL;
+  for (uint32_t i = 0; i < MCIM_PCM_READAHEAD_COUNT; i++) {
+    MCIM_PCM_READ* candidate = &(window->reads[i]);
+    const uint32_t readEnd = candidate->start + candidate->count;
+    if (candidate->count != 0 && candidate->start <= frame && (frame + 1 < readEnd || (frame < readEnd && readEnd == pcm->frames))) {
+      read = candidate;
+      break;
+    }
+  }
+  const bool prefetched = (read != NULL);
+  if (read == NULL) {
+    for (uint32_t i = 0; i < MCIM_PCM_READAHEAD_COUNT; i++) {
+      mcim_wave_discard(pcm, &(window->reads[i]));
+    }
+    read = mcim_wave_acquire(pcm, wait);
+    if (read != NULL) {
+      mcim_wave_issue(pcm, read, frame);
+    }
+  }
+
+  // レンダリングスレッドでは読み込みを待たず、間に合わなかった区間は無音として再生を続ける
+  // 読み込みは発行したまま残し、無音の区間を過ぎた時点で改めて完了を確かめる
+  if (read == NULL || !mcim_wave_complete(pcm, read, wait)) {
+    const uint32_t count = (pcm->frames - frame < MCIM_PCM_LATE_FRAMES ? pcm->frames - frame : MCIM_PCM_LATE_FRAMES);
+    SecureZeroMemory(window->samples, sizeof(float) * count * pcm->channels);
+    window->start = frame;
+    window->end = frame + count;
+    mcim_stats_record_stream_underrun();
+    return;
+  }
+  QueryPerformanceCounter(&end);
+  mcim_stats_record_stream(prefetched, read->count * pcm->blockAlign, end.QuadPart - begin.QuadPart);
+
+  if (!read->failed) {
+    mcim_wave_decode_frames(pcm, read->raw, read->count, window->samples);
+  } else {
+    SecureZeroMemory(window->samples, sizeof(float) * read->count * pcm->channels);
+  }
+  window->start = read->start;
+  window->end = read->start + read->count;
+  read->count = 0;
+
+  mcim_wave_readahead(pcm);
+}
+
+static void mcim_wave_readahead(const MCIM_PCM* pcm) {
+  assert(pcm != NULL);
+  assert(pcm->window != NULL);
+
+  // 現在の区間に続いて必要となる区間の先頭を予測する
+  // 補間のため区間の最後のフレームは次の区間の先頭にも含め、ループ終端を含む区間の次はloopStartからとする
+  MCIM_PCM_WINDOW* window = pcm->window;
+  const uint32_t loopEnd = (window->loopEnd <= pcm->frames && window->loopStart < window->loopEnd ? window->loopEnd : 0);
+  uint32_t wanted[MCIM_PCM_READAHEAD_COUNT];
+  uint32_t wantedCount = 0;
+  uint32_t end = window->end;
+  while (wantedCount < MCIM_PCM_READAHEAD_COUNT) {
+    uint32_t next;
+    if (loopEnd != 0 && (end > loopEnd || end == pcm->frames)) {
+      next = window->loopStart;
+    } else if (end < pcm->frames) {
+      next = end - 1;
+    } else {
+      break;
+    }
+
+    // 短いループでは同じ区間が繰り返し予測されるため、既に予測した区間に戻った時点で打ち切る
+    bool duplicated = false;
+    for (uint32_t i = 0; i < wantedCount; i++) {
+      duplicated = duplicated || wanted[i] == next;
+    }
+    if (duplicated) {
+      break;
+    }
+    wanted[wantedCount++] = next;
+    end = next + (pcm->frames - next < MCIM_PCM_WINDOW_FRAMES ? pcm->frames - next : MCIM_PCM_WINDOW_FRAMES);
+  }
+
+  // 予測と一致する発行済みの読み込みはそのまま残し、それ以外は取り消して空いた分を発行する
+  bool kept[MCIM_PCM_READAHEAD_COUNT] = {false};
+  bool issued[MCIM_PCM_READAHEAD_COUNT] = {false};
+  for (uint32_t i = 0; i < wantedCount; i++) {
+    for (uint32_t j = 0; j < MCIM_PCM_READAHEAD_COUNT; j++) {
+      if (!kept[j] && window->reads[j].count != 0 && window->reads[j].start == wanted[i]) {
+        kept[j] = true;
+        issued[i] = true;
+        break;
+      }
+    }
+  }
+  for (uint32_t j = 0; j < MCIM_PCM_READAHEAD_COUNT; j++) {
+    if (!kept[j]) {
+      mcim_wave_discard(pcm, &(window->reads[j]));
+    }
+  }
+  // 取り消した読み込みが完了していない領域は使えないため、発行できなかった分は次に区間を移る際に発行する
+  for (uint32_t i = 0; i < wantedCount; i++) {
+    for (uint32_t j = 0; j < MCIM_PCM_READAHEAD_COUNT && !issued[i]; j++) {
+      if (window->reads[j].count == 0 && mcim_wave_complete(pcm, &(window->reads[j]), false)) {
+        mcim_wave_issue(pcm, &(window->reads[j]), wanted[i]);
+        issued[i] = true;
+      }
+    }
+  }
+}
+
+static MCIM_PCM_READ* mcim_wave_acquire(const MCIM_PCM* pcm, bool wait) {
+  assert(pcm != NULL);
+  assert(pcm->window != NULL);
+
+  MCIM_PCM_WINDOW* window = pcm->window;
+  for (uint32_t i = 0; i < MCIM_PCM_READAHEAD_COUNT; i++) {
+    MCIM_PCM_READ* read = &(window->reads[i]);
+    if (read->count == 0 && mcim_wave_complete(pcm, read, false)) {
+      return read;
+    }
+  }
+  if (!wait) {
+    return NULL;
+  }
+
+  // 全て取り消し中の場合は、その一つの完了を待って使う
+  MCIM_PCM_READ* read = &(window->reads[0]);
+  assert(read->count == 0);
+  mcim_wave_complete(pcm, read, true);
+  return read;
+}
+
+static void mcim_wave_issue(const MCIM_PCM* restrict pcm, MCIM_PCM_READ* restrict read, uint32_t start) {
+  assert(pcm != NULL);
+  assert(read != NULL);
+  assert(read->count == 0);
+  assert(!read->pending);
+  assert(start < pcm->frames);
+
+  const uint32_t count = (pcm->frames - start < MCIM_PCM_WINDOW_FRAMES ? pcm->frames - start : MCIM_PCM_WINDOW_FRAMES);
+  const uint64_t offset = pcm->dataOffset + (uint64_t)start * pcm->blockAlign;
+  HANDLE event = read->overlapped.hEvent;
+  SecureZeroMemory(&(read->overlapped), sizeof(OVERLAPPED));
+  read->overlapped.Offset = (DWORD)offset;
+  read->overlapped.OffsetHigh = (DWORD)(offset >> 32);
+  read->overlapped.hEvent = event;
+  read->start = start;
+  read->count = count;
+  read->failed = (ReadFile(pcm->file, read->raw, count * pcm->blockAlign, NULL, &(read->overlapped)) == 0 && GetLastError() != ERROR_IO_PENDING);
+  read->pending = !read->failed;
+}
+
+static bool mcim_wave_complete(const MCIM_PCM* restrict pcm, MCIM_PCM_READ* restrict read, bool wait) {
+  assert(pcm != NULL);
+  assert(read != NULL);
+
+  if (!read->pending) {
+    return true;
+  }
+  DWORD transferred = 0;
+  if (GetOverlappedResult(pcm->file, &(read->overlapped), &transferred, wait) == 0) {
+    if (GetLastError() == ERROR_IO_INCOMPLETE) {
+      return false;
+    }
+    read->failed = true;
+  } else if (transferred != read->count * pcm->blockAlign) {
+    read->failed = true;
+  }
+  read->pending = false;
+  return true;
+}
+
+static void mcim_wave_discard(const MCIM_PCM* restrict pcm, MCIM_PCM_READ* restrict read) {
+  assert(pcm != NULL);
+  assert(read != NULL);
+
+  // 取り消しの完了は待たず、バッファを再利用する前にmcim_wave_completeで確かめる
+  if (read->count != 0 && read->pending) {
+    CancelIoEx(pcm->file, &(read->overlapped));
+  }
+  read->count = 0;
+}
+
+static void mcim_wave_destroy(MCIM_PCM* pcm, mcim_deallocator_t deallocator) {
+  assert(pcm != NULL);
+  assert(deallocator != NULL);
+
+  if (pcm->window != NULL) {
+    MCIM_PCM_WINDOW* window = pcm->window;
+    const size_t rawSize = (pcm->storage == MCIM_PCM_STORAGE_STREAMED ? (size_t)MCIM_PCM_WINDOW_FRAMES * pcm->blockAlign : 0);
+    atomic_fetch_sub(&MCIM_WAVE_WINDOW_BYTES,
+                     sizeof(MCIM_PCM_WINDOW) + sizeof(float) * MCIM_PCM_WINDOW_FRAMES * pcm->channels + rawSize * MCIM_PCM_READAHEAD_COUNT);
+    for (uint32_t i = 0; i < MCIM_PCM_READAHEAD_COUNT; i++) {
+      MCIM_PCM_READ* read = &(window->reads[i]);
+      mcim_wave_discard(pcm, read);
+      mcim_wave_complete(pcm, read, true);
+      if (read->overlapped.hEvent != NULL) {
+        CloseHandle(read->overlapped.hEvent);
+      }
+      if (read->raw != NULL) {
+        deallocator(read->raw);
+      }
+    }
+    if (window->samples != NULL) {
+      deallocator(window->samples);
+    }
+    deallocator(window);
+  }
+  if (pcm->file != NULL) {
+    CloseHandle(pcm->file);
+  }
+  if (pcm->cache.base != NULL) {
+    mcim_cache_unmap(&(pcm->cache));
+  } else if (pcm->samples != NULL) {
+    deallocator(pcm->samples);
+  }
+  if (pcm->encoded != NULL) {
+    deallocator(pcm->encoded);
+  }
+  atomic_fetch_sub(&MCIM_WAVE_RESIDENT_BYTES, pcm->residentBytes);
+  deallocator(pcm);
+}
@@ -0,0 +1,337 @@
+﻿#include "_MCIMWorker.h"
+
+#include <SyncFPS/Ticker.h>
+#include <assert.h>
+#include <math.h>
+#include <process.h>
+#include <string.h>
+
+// タイマーに用いるティッカーの数の上限（フレームレート毎に一つ作成する）
+#define MCIM_WORKER_TICKER_COUNT 8
+
+typedef struct _MCIM_WORKER_TICKER {
+  double fps;
+  SYNC_TICKER_DATA* ticker;
+} MCIM_WORKER_TICKER;
+
+// バックグラウンドのスレッドはMCIMオブジェクトの数に依らず1本とし、
+// タイマーは同じフレームレートのものをSyncFPSのティッカー1つにまとめて進める
+typedef struct _MCIM_WORKER {
+  SRWLOCK lock;
+  CONDITION_VARIABLE taskCond;
+  CONDITION_VARIABLE doneCond;  // 実行中のタスクの完了
+  HANDLE taskThread;
+  DWORD taskThreadId;
+  bool terminate;
+  MCIM_WORKER_TASK* head;
+  MCIM_WORKER_TASK* tail;
+  MCIM_WORKER_TASK* running;
+  MCIM_WORKER_TICKER tickers[MCIM_WORKER_TICKER_COUNT];  // 作成したティッカーは参照が無くなるまで解放しない
+} MCIM_WORKER;
+
+static MCIM_WORKER MCIM_WORKER_DATA = {
+    .lock = SRWLOCK_INIT,
+    .taskCond = CONDITION_VARIABLE_INIT,
+    .doneCond = CONDITION_VARIABLE_INIT,
+};
+
+// 参照の増減とスレッドの停止が重ならないよう、ワーカー本体とは別のロックで保護する
+static SRWLOCK MCIM_WORKER_REFERENCE_LOCK = SRWLOCK_INIT;
+static uint32_t MCIM_WORKER_REFERENCE_COUNT = 0;
+
+static bool mcim_worker_start_thread(HANDLE* restrict phthread, DWORD* restrict pThreadId, unsigned(__stdcall* proc)(void*));
+static void mcim_worker_unlink_task(MCIM_WORKER_TASK* task);
+static bool mcim_worker_register_timer(MCIM_WORKER_TIMER* timer, double fps);
+static bool mcim_worker_unregister(uint64_t registration);
+static SYNC_TICKER_DATA* mcim_worker_find_ticker(double fps, uint32_t* index);
+static bool mcim_worker_tick(void* context, uint64_t tick);
+static unsigned __stdcall mcim_worker_task_thread(void* pargs);
+
+/**************************************************************************************************/
+
+void mcim_worker_acquire(void) {
+  AcquireSRWLockExclusive(&MCIM_WORKER_REFERENCE_LOCK);
+  MCIM_WORKER_REFERENCE_COUNT++;
+  ReleaseSRWLockExclusive(&MCIM_WORKER_REFERENCE_LOCK);
+}
+
+void mcim_worker_release(void) {
+  MCIM_WORKER* w = &MCIM_WORKER_DATA;
+
+  AcquireSRWLockExclusive(&MCIM_WORKER_REFERENCE_LOCK);
+  assert(MCIM_WORKER_REFERENCE_COUNT > 0);
+  if (--MCIM_WORKER_REFERENCE_COUNT > 0) {
+    ReleaseSRWLockExclusive(&MCIM_WORKER_REFERENCE_LOCK);
+    return;
+  }
+
+  // 参照が無いためタスクとタイマーは全て取り除かれている
+  AcquireSRWLockExclusive(&(w->lock));
+  assert(w->head == NULL);
+  w->terminate = true;
+  HANDLE taskThread = w->taskThread;
+  w->taskThread = NULL;
+  WakeAllConditionVariable(&(w->taskCond));
+  MCIM_WORKER_TICKER tickers[MCIM_WORKER_TICKER_COUNT];
+  memcpy(tickers, w->tickers, sizeof(tickers));
+  SecureZeroMemory(w->tickers, sizeof(w->tickers));
+  ReleaseSRWLockExclusive(&(w->lock));
+
+  if (taskThread != NULL) {
+    WaitForSingleObject(taskThread, INFINITE);
+    CloseHandle(taskThread);
+  }
+  for (uint32_t i = 0; i < MCIM_WORKER_TICKER_COUNT; i++) {
+    free_sync_ticker(tickers[i].ticker);
+  }
+
+  AcquireSRWLockExclusive(&(w->lock));
+  w->terminate = false;
+  w->taskThreadId = 0;
+  ReleaseSRWLockExclusive(&(w->lock));
+  ReleaseSRWLockExclusive(&MCIM_WORKER_REFERENCE_LOCK);
+}
+
+bool mcim_worker_post(MCIM_WORKER_TASK* task) {
+  assert(task != NULL);
+  assert(task->run != NULL);
+
+  MCIM_WORKER* w = &MCIM_WORKER_DATA;
+  AcquireSRWLockExclusive(&(w->lock));
+  if (!mcim_worker_start_thread(&(w->taskThread), &(w->taskThreadId), mcim_worker_task_thread)) {
+    ReleaseSRWLockExclusive(&(w->lock));
+    return false;
+  }
+  task->next = NULL;
+  if (w->tail != NULL) {
+    w->tail->next = task;
+  } else {
+    w->head = task;
+  }
+  w->tail = task;
+  WakeConditionVariable(&(w->taskCond));
+  ReleaseSRWLockExclusive(&(w->lock));
+  return true;
+}
+
+void mcim_worker_cancel(MCIM_WORKER_TASK* task) {
+  assert(task != NULL);
+
+  MCIM_WORKER* w = &MCIM_WORKER_DATA;
+  AcquireSRWLockExclusive(&(w->lock));
+  mcim_worker_unlink_task(task);
+  if (GetCurrentThreadId() != w->taskThreadId) {
+    while (w->running == task) {
+      SleepConditionVariableSRW(&(w->doneCond), &(w->lock), INFINITE, 0);
+    }
+    // 実行中に積み直された場合に備えて再度取り除く
+    mcim_worker_unlink_task(task);
+  }
+  ReleaseSRWLockExclusive(&(w->lock));
+}
+
+bool mcim_worker_start_timer(MCIM_WORKER_TIMER* timer, double fps) {
+  assert(timer != NULL);
+  assert(timer->step != NULL);
+  assert(fps >= 0.0);
+
+  // stepの中から開始し直された場合は以前の登録がまだ残っているため、新しい登録に置き換えてから解除する
+  const uint64_t previous = atomic_exchange(&(timer->registration), 0);
+  timer->paused = (fps == 0.0);
+  const bool ret = (timer->paused || mcim_worker_register_timer(timer, fps));
+  mcim_worker_unregister(previous);
+  return ret;
+}
+
+bool mcim_worker_set_timer_rate(MCIM_WORKER_TIMER* timer, double fps) {
+  assert(timer != NULL);
+  assert(fps >= 0.0);
+
+  // 登録を解除できた場合のみ動作中とみなし、解除の時点で完了していたタイマーは再登録しない
+  if (!timer->paused && !mcim_worker_unregister(atomic_exchange(&(timer->registration), 0))) {
+    return false;
+  }
+  timer->paused = (fps == 0.0);
+  if (timer->paused) {
+    return true;
+  }
+  // 登録できなかった場合は止めたままとし、mcim_worker_stop_timerで動作中として扱う
+  if (!mcim_worker_register_timer(timer, fps)) {
+    timer->paused = true;
+    return false;
+  }
+  return true;
+}
+
+bool mcim_worker_stop_timer(MCIM_WORKER_TIMER* timer) {
+  assert(timer != NULL);
+
+  // stepで完了した場合は動作中でなかったとみなす
+  if (timer->paused) {
+    timer->paused = false;
+    return true;
+  }
+  return mcim_worker_unregister(atomic_exchange(&(timer->registration), 0));
+}
+
+uint32_t mcim_worker_thread_count(void) {
+  MCIM_WORKER* w = &MCIM_WORKER_DATA;
+  AcquireSRWLockShared(&(w->lock));
+  uint32_t ret = (w->taskThread != NULL ? 1 : 0);
+  for (uint32_t i = 0; i < MCIM_WORKER_TICKER_COUNT; i++) {
+    ret += (w->tickers[i].ticker != NULL ? 1 : 0);
+  }
+  ReleaseSRWLockShared(&(w->lock));
+  return ret;
+}
+
+/**************************************************************************************************/
+
+static bool mcim_worker_start_thread(HANDLE* restrict phthread, DWORD* restrict pThreadId, unsigned(__stdcall* proc)(void*)) {
+  assert(phthread != NULL);
+  assert(pThreadId != NULL);
+  assert(proc != NULL);
+
+  // 使用されない種類のスレッドを作成しないよう、最初の要求時に作成する
+  if (*phthread != NULL) {
+    return true;
+  }
+  unsigned threadId = 0;
+  *phthread = (HANDLE)_beginthreadex(NULL, 0, proc, &MCIM_WORKER_DATA, 0, &threadId);
+  if (*phthread == (HANDLE)0) {
+    *phthread = NULL;
+    return false;
+  }
+  *pThreadId = (DWORD)threadId;
+  return true;
+}
+
+static void mcim_worker_unlink_task(MCIM_WORKER_TASK* task) {
+  MCIM_WORKER* w = &MCIM_WORKER_DATA;
+  MCIM_WORKER_TASK* prev = NULL;
+  for (MCIM_WORKER_TASK* t = w->head; t != NULL; prev = t, t = t->next) {
+    if (t != task) {
+      continue;
+    }
+    if (prev != NULL) {
+      prev->next = t->next;
+    } else {
+      w->head = t->next;
+    }
+    if (w->tail == t) {
+      w->tail = prev;
+    }
+    t->next = NULL;
+    return;
+  }
+}
+
+static bool mcim_worker_register_timer(MCIM_WORKER_TIMER* timer, double fps) {
+  assert(timer != NULL);
+  assert(fps > 0.0);
+
+  uint32_t index = 0;
+  SYNC_TICKER_DATA* ticker = mcim_worker_find_ticker(fps, &index);
+  if (ticker == NULL) {
+    return false;
+  }
+  // 登録直後のティックでstepが呼ばれ得るため、tick側は登録情報を参照しない
+  const SYNC_TICKER_HANDLE handle = add_sync_ticker_callback(ticker, mcim_worker_tick, timer);
+  if (handle == SYNC_TICKER_INVALID_HANDLE) {
+    return false;
+  }
+  atomic_store(&(timer->registration), ((uint64_t)(index + 1) << 32) | handle);
+  return true;
+}
+
+static bool mcim_worker_unregister(uint64_t registration) {
+  if (registration == 0) {
+    return false;
+  }
+  MCIM_WORKER* w = &MCIM_WORKER_DATA;
+  AcquireSRWLockShared(&(w->lock));
+  SYNC_TICKER_DATA* ticker = w->tickers[(registration >> 32) - 1].ticker;
+  ReleaseSRWLockShared(&(w->lock));
+
+  // ティッカーは参照が無くなるまで解放しないため、ロックの外で解除する（実行中のstepの完了を待つため）
+  // stepがfalseを返して外れていた場合は失敗する
+  return remove_sync_ticker_callback(ticker, (SYNC_TICKER_HANDLE)(registration & 0xFFFFFFFF));
+}
+
+static SYNC_TICKER_DATA* mcim_worker_find_ticker(double fps, uint32_t* index) {
+  assert(fps > 0.0);
+  assert(index != NULL);
+
+  MCIM_WORKER* w = &MCIM_WORKER_DATA;
+  AcquireSRWLockExclusive(&(w->lock));
+  uint32_t nearest = MCIM_WORKER_TICKER_COUNT;
+  for (uint32_t i = 0; i < MCIM_WORKER_TICKER_COUNT; i++) {
+    MCIM_WORKER_TICKER* slot = &(w->tickers[i]);
+    if (slot->ticker == NULL) {
+      slot->ticker = init_sync_ticker(fps);
+      slot->fps = fps;
+      nearest = i;
+      break;
+    }
+    if (slot->fps == fps) {
+      nearest = i;
+      break;
+    }
+    if (nearest == MCIM_WORKER_TICKER_COUNT || fabs(slot->fps - fps) < fabs(w->tickers[nearest].fps - fps)) {
+      nearest = i;
+    }
+  }
+  SYNC_TICKER_DATA* ret = w->tickers[nearest].ticker;
+  ReleaseSRWLockExclusive(&(w->lock));
+  *index = nearest;
+  return ret;
+}
+
+static bool mcim_worker_tick(void* context, uint64_t tick) {
+  (void)tick;
+
+  MCIM_WORKER_TIMER* timer = (MCIM_WORKER_TIMER*)context;
+  return timer->step(timer);
+}
+
+static unsigned __stdcall mcim_worker_task_thread(void* pargs) {
+  MCIM_WORKER* w = (MCIM_WORKER*)pargs;
+
+  // CPUだけでなくファイルI/Oの優先度も下げ、レンダリングスレッドやゲーム本体の読み込みを妨げないようにする
+  SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+
+  AcquireSRWLockExclusive(&(w->lock));
+  while (!w->terminate) {
+    MCIM_WORKER_TASK* task = w->head;
+    if (task == NULL) {
+      SleepConditionVariableSRW(&(w->taskCond), &(w->lock), INFINITE, 0);
+      continue;
+    }
+    w->head = task->next;
+    if (w->head == NULL) {
+      w->tail = NULL;
+    }
+    task->next = NULL;
+    w->running = task;
+    ReleaseSRWLockExclusive(&(w->lock));
+
+    bool again = task->run(task);
+
+    AcquireSRWLockExclusive(&(w->lock));
+    w->running = NULL;
+    if (again) {
+      if (w->tail != NULL) {
+        w->tail->next = task;
+      } else {
+        w->head = task;
+      }
+      w->tail = task;
+    }
+    WakeAllConditionVariable(&(w->doneCond));
+  }
+  ReleaseSRWLockExclusive(&(w->lock));
+
+  SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+  return 0;
+}
@@ -1,50 +1,77 @@
 ﻿#include "_MCIManager.h"
 
 #include <assert.h>
-#include <process.h>
+#include <math.h>
 
 /**************************************************************************************************/
 
 static _Atomic(MCIM_KEY) MCIM_NEXT_KEY = MCIM_INITIAL_KEY_VALUE;
+static _Atomic(MCIDEVICEID) MCIM_NEXT_RENDER_ID = MCIM_INITIAL_RENDER_ID_VALUE;
 
 static MCIM_CALLBACK_TABLE_ENTRY* MCIM_CALLBACK_TABLE = NULL;
 
-static uint32_t MCIM_INSTANCE_COUNT = 0;
+static uint32_t MCIM_HOOK_COUNT = 0;
 static HHOOK MCIM_HOOK = NULL;
 
 static atomic_flag MCIM_MUTEX_INITIALIZED = ATOMIC_FLAG_INIT;
 static CRITICAL_SECTION MCIM_CALLBACK_TABLE_MUTEX = {0};
-static CRITICAL_SECTION MCIM_INSTANCE_COUNT_MUTEX = {0};
+static CRITICAL_SECTION MCIM_HOOK_MUTEX = {0};
 
 /**************************************************************************************************/
 
-ATTRIB_MALLOC MCIM_MUSIC_ENTRY* mcim_create_loaded_entry(const wchar_t* filepath, mcim_allocator_t allocator, mcim_deallocator_t deallocator);
+ATTRIB_MALLOC MCIM_MUSIC_ENTRY* mcim_create_loaded_entry(const wchar_t* filepath,
+                                                        MCIM_PCM* pcm,
+                                                        bool renderOnly,
+                                                        MCIM_RESIDENCY residency,
+                                                        mcim_allocator_t allocator,
+                                                        mcim_deallocator_t deallocator);
 ATTRIB_PURE static bool mcim_entry_is_playing(const MCIM_MUSIC_ENTRY* entry);
 ATTRIB_PURE static bool mcim_entry_equal(const MCIM_MUSIC_ENTRY* entry, const wchar_t* filepath);
 ATTRIB_CONST static MCIM_NOTIFY_FLAGS mcim_convert_flag(uint32_t mci_flag);
 
-static MCIM_KEY mcim_load_entry(MCIM_MUSIC_ENTRY* entry);
-static bool mcim_unload_entry(MCIM_MUSIC_ENTRY* entry, mcim_deallocator_t deallocator);
-static bool mcim_play_entry(MCIM_MUSIC_ENTRY* entry,
+static MCIM_KEY mcim_load_entry(MCIM_MUSIC_ENTRY* restrict entry,
+                                MCIM_PCM* restrict pcm,
+                                MCIM_RESIDENCY residency,
+                                mcim_allocator_t allocator,
+                                mcim_deallocator_t deallocator);
+static bool mcim_unload_entry(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, mcim_deallocator_t deallocator);
+static bool mcim_play_entry(MCIM_MUSIC_ENTRY* restrict entry,
+                            MCIM_MIXER* restrict mixer,
                             int32_t from,
                             MCIM_CALLBACK_PROC callback,
                             HWND callbackWindow,
                             mcim_allocator_t allocator,
                             mcim_deallocator_t deallocator);
-static bool mcim_stop_entry(MCIM_MUSIC_ENTRY* entry, mcim_deallocator_t deallocator);
+static bool mcim_stop_entry(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, mcim_deallocator_t deallocator);
 static bool mcim_fadeout_entry(MCIM_MUSIC_ENTRY* restrict entry,
-                               MCIM_THREAD_DATA* restrict th,
-                               MCIM_WAIT_NEXT_FRAME wait,
+                               MCIM_DATA_INTERNAL* restrict data,
+                               double fps,
                                int32_t time,
-                               MCIM_CALLBACK_PROC callback,
-                               mcim_allocator_t allocator,
-                               mcim_deallocator_t deallocator);
+                               MCIM_CALLBACK_PROC callback);
 
 static LRESULT CALLBACK mcim_callback(int code, WPARAM wParam, LPARAM lParam);
 static MCIM_CALLBACK_PROC mcim_find_callback(MCIDEVICEID id);
 static bool mcim_add_callback_table(MCIDEVICEID id, MCIM_CALLBACK_PROC callback, mcim_allocator_t allocator);
 static void mcim_del_callback_table(MCIDEVICEID id, mcim_deallocator_t deallocator);
 
+static void mcim_init_global_mutex(void);
+static bool mcim_install_hook(MCIM_DATA_INTERNAL* data);
+static bool mcim_uninstall_hook(MCIM_DATA_INTERNAL* data);
+static double mcim_elapsed_since(const LARGE_INTEGER* begin);
+static bool mcim_open_output(MCIM_DATA_INTERNAL* data);
+static void mcim_post_notify(void* context, MCIM_VOICE* voice, MCIM_NOTIFY_FLAGS flag);
+static void mcim_offline_notify(void* context, MCIM_VOICE* voice, MCIM_NOTIFY_FLAGS flag);
+static void mcim_offline_dispatch(MCIM_DATA_INTERNAL* data);
+static void mcim_request_loudness(MCIM_DATA_INTERNAL* restrict data, MCIM_MUSIC_ENTRY* restrict entry);
+static void mcim_loudness_done(void* context, MCIM_LOUDNESS_REQUEST* request);
+static double mcim_loudness_gain(const MCIM_DATA_INTERNAL* restrict data, const MCIM_LOUDNESS_REQUEST* restrict request);
+static bool mcim_entry_command_play(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, int32_t from, HWND callbackWindow, bool notify);
+static bool mcim_entry_command_set_volume(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, uint32_t volume);
+static bool mcim_entry_command_stop(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer);
+static bool mcim_entry_command_close(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, mcim_deallocator_t deallocator);
+static MCIM_DSP_CHAIN* mcim_find_effect_chain(MCIM_DATA_INTERNAL* data, MCIM_KEY key);
+static void mcim_free_effects(MCIM_MIXER* restrict mixer, MCIM_DSP_CHAIN* restrict chain, mcim_deallocator_t deallocator);
+
 static bool mcim_command_open(MCIDEVICEID* restrict pId, const wchar_t* restrict filepath);
 static bool mcim_command_get_volume(MCIDEVICEID id, uint32_t* pVolume);
 static bool mcim_command_set_volume(MCIDEVICEID id, uint32_t volume);
@@ -53,11 +80,41 @@ static bool mcim_command_play_callback(MCIDEVICEID id, HWND callbackWindow);
 static bool mcim_command_play_from(MCIDEVICEID id, int32_t from);
 static bool mcim_command_stop(MCIDEVICEID id);
 static bool mcim_command_close(MCIDEVICEID id);
-
-static bool mcim_create_fadeout_thread(MCIM_DATA_INTERNAL* data);
-static bool mcim_start_fadeout_thread(MCIM_THREAD_DATA* restrict th, const MCIM_MUSIC_ENTRY* restrict entry, MCIM_WAIT_NEXT_FRAME wait, int32_t time);
-static void mcim_terminate_fadeout_thread(MCIM_THREAD_DATA* th);
-static unsigned __stdcall mcim_fadeout_thread(void* pargs);
+static MCIERROR mcim_command_send(MCIM_COMMAND command, MCIDEVICEID id, UINT message, DWORD_PTR flags, DWORD_PTR param);
+
+static bool mcim_start_fadeout(MCIM_MUSIC_ENTRY* restrict entry, MCIM_DATA_INTERNAL* restrict data, double fps, int32_t time);
+static bool mcim_fadeout_step(MCIM_WORKER_TIMER* timer);
+
+static MCIM_TRACE_RECORDER* mcim_get_trace(MCIM_DATA* data);
+static MCIM_KEY mcim_load_untraced(MCIM_DATA* data, const wchar_t* filepath);
+static bool mcim_unload_untraced(MCIM_DATA* data, MCIM_KEY key);
+static bool mcim_set_loop_untraced(MCIM_DATA* data, MCIM_KEY key, uint32_t loopStart, uint32_t loopEnd);
+static bool mcim_play_untraced(MCIM_DATA* data, MCIM_KEY key, MCIM_CALLBACK_PROC callback);
+static bool mcim_play_from_untraced(MCIM_DATA* data, MCIM_KEY key, int32_t from);
+static MCIM_KEY mcim_stop_untraced(MCIM_DATA* data, MCIM_KEY key);
+static MCIM_KEY mcim_fadeout_untraced(MCIM_DATA* data, MCIM_KEY key, double fps, int32_t time, MCIM_CALLBACK_PROC callback);
+static bool mcim_set_fadeout_fps_untraced(MCIM_DATA* data, MCIM_KEY key, double fps);
+static MCIM_KEY mcim_sfx_load_untraced(MCIM_DATA* data, const wchar_t* filepath);
+static bool mcim_sfx_unload_untraced(MCIM_DATA* data, MCIM_KEY key);
+static bool mcim_sfx_play_untraced(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority);
+static bool mcim_sfx_stop_all_untraced(MCIM_DATA* data);
+static bool mcim_set_rate_untraced(MCIM_DATA* data, MCIM_KEY key, float rate, MCIM_RATE_MODE mode, float glide);
+static bool mcim_render_untraced(MCIM_DATA* data, float* buffer, uint32_t frames);
+static uint32_t mcim_sfx_play_at_untraced(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority, float x, float y);
+static bool mcim_sfx_move_untraced(MCIM_DATA* data, uint32_t instance, float x, float y);
+static bool mcim_set_ducked_untraced(MCIM_DATA* data, MCIM_KEY key, bool ducked);
+static bool mcim_add_eq_untraced(MCIM_DATA* data, MCIM_KEY key, const MCIM_EQ_PARAMS* params, uint32_t* index);
+static bool mcim_set_eq_untraced(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_EQ_PARAMS* params);
+static bool mcim_add_limiter_untraced(MCIM_DATA* data, MCIM_KEY key, const MCIM_LIMITER_PARAMS* params, uint32_t* index);
+static bool mcim_set_limiter_untraced(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_LIMITER_PARAMS* params);
+static bool mcim_clear_effects_untraced(MCIM_DATA* data, MCIM_KEY key);
+static MCIM_KEY mcim_create_bus_untraced(MCIM_DATA* data, MCIM_KEY parent);
+static bool mcim_destroy_bus_untraced(MCIM_DATA* data, MCIM_KEY bus);
+static bool mcim_route_bus_untraced(MCIM_DATA* data, MCIM_KEY bus, MCIM_KEY parent);
+static bool mcim_set_bus_gain_untraced(MCIM_DATA* data, MCIM_KEY bus, float gain);
+static bool mcim_set_bus_untraced(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus);
+static bool mcim_set_sfx_bus_untraced(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus);
+static bool mcim_set_render_threads_untraced(MCIM_DATA* data, uint32_t count);
 
 /**************************************************************************************************/
 
@@ -66,46 +123,105 @@ MCIM_DATA* mcim_init_al(HWND callbackWindow, void* (*allocator)(size_t), void (*
     return NULL;
   }
 
+  // メッセージのHookは初めてコールバック付きで再生する時点で設置するため、ここではウィンドウの有効性のみ確認する
+  if (GetWindowThreadProcessId(callbackWindow, NULL) == 0) {
+    return NULL;
+  }
+
+  LARGE_INTEGER begin;
+  QueryPerformanceCounter(&begin);
+
   MCIM_DATA_INTERNAL* ret = (MCIM_DATA_INTERNAL*)allocator(sizeof(MCIM_DATA_INTERNAL));
   if (ret == NULL) {
     return NULL;
   }
 
+  // フェードアウトと解析は全MCIMオブジェクトで共有するワーカーで行い、
+  // ワーカーのスレッド、メッセージのHookおよび出力デバイスは初めて必要になった時点で作成する
   SecureZeroMemory(ret, sizeof(MCIM_DATA_INTERNAL));
   ret->bgmlist = NULL;
+  atomic_init(&(ret->positions), NULL);
   ret->hwnd = callbackWindow;
   ret->allocator = allocator;
   ret->deallocator = deallocator;
-
-  if (!mcim_create_fadeout_thread(ret)) {
+  ret->output = NULL;
+  ret->outputConfig = MCIM_DEFAULT_OUTPUT_CONFIG;
+  ret->residency = MCIM_RESIDENCY_DECODED;
+  ret->loudnessEnabled = false;
+  ret->loudnessTarget = MCIM_LOUDNESS_DEFAULT_TARGET;
+  ret->trace = NULL;
+
+  ret->timings.hook = -1.0;
+  ret->timings.fadeoutThread = -1.0;
+  ret->timings.output = -1.0;
+  mcim_worker_acquire();
+  if (!mcim_analyzer_init(&(ret->analyzer), mcim_loudness_done, ret, allocator, deallocator)) {
+    mcim_worker_release();
     deallocator(ret);
     return NULL;
   }
+  mcim_prefetcher_init(&(ret->prefetcher), allocator, deallocator);
+  mcim_mixer_init(&(ret->mixer), MCIM_MIXER_SAMPLE_RATE, mcim_post_notify, callbackWindow);
 
-  if (!atomic_flag_test_and_set(&MCIM_MUTEX_INITIALIZED)) {
-    InitializeCriticalSectionAndSpinCount(&MCIM_CALLBACK_TABLE_MUTEX, 0);
-    InitializeCriticalSection(&MCIM_INSTANCE_COUNT_MUTEX);
+  mcim_init_global_mutex();
+
+  ret->timings.init = mcim_elapsed_since(&begin);
+
+  return (MCIM_DATA*)ret;
+}
+
+MCIM_DATA* mcim_init_offline_al(double fps, void* (*allocator)(size_t), void (*deallocator)(void*)) {
+  if (fps <= 0.0 || allocator == NULL || deallocator == NULL) {
+    return NULL;
   }
 
-  // MCIM_INSTANCE_COUNTの操作はatomicだけでは対処できない
-  // ∵ MCIM_HOOKの初期化に失敗した場合にMCIM_INSTANCE_COUNTの巻き戻しが入るため、
-  //   他のMCIM_INSTANCE_COUNTの参照は少なくともMCIM_INSTANCE_COUNT++～MCIM_INSTANCE_COUNT = 0の間は待機する必要がある
-  // また、排他制御する都合上、MCIM_INSTANCE_COUNT自体はatomicにする必要が無くなる
-  EnterCriticalSection(&MCIM_INSTANCE_COUNT_MUTEX);
-  if ((MCIM_INSTANCE_COUNT++) == 0) {
-    assert(MCIM_HOOK == NULL);
+  LARGE_INTEGER begin;
+  QueryPerformanceCounter(&begin);
 
-    DWORD threadId = GetWindowThreadProcessId(callbackWindow, NULL);
-    MCIM_HOOK = SetWindowsHookExW(WH_GETMESSAGE, mcim_callback, NULL, threadId);
-    if (threadId == 0 || MCIM_HOOK == NULL) {
-      MCIM_INSTANCE_COUNT = 0;
-      LeaveCriticalSection(&MCIM_INSTANCE_COUNT_MUTEX);
-      mcim_terminate_fadeout_thread(&(ret->th));
-      deallocator(ret);
-      return NULL;
-    }
+  MCIM_DATA_INTERNAL* ret = (MCIM_DATA_INTERNAL*)allocator(sizeof(MCIM_DATA_INTERNAL));
+  if (ret == NULL) {
+    return NULL;
+  }
+
+  // オフラインレンダリングではウィンドウ、メッセージのHook、フェードアウト用のタイマーおよび出力デバイスを使用しない
+  SecureZeroMemory(ret, sizeof(MCIM_DATA_INTERNAL));
+  ret->bgmlist = NULL;
+  atomic_init(&(ret->positions), NULL);
+  ret->hwnd = NULL;
+  ret->allocator = allocator;
+  ret->deallocator = deallocator;
+  ret->output = NULL;
+  ret->outputConfig = MCIM_DEFAULT_OUTPUT_CONFIG;
+  ret->residency = MCIM_RESIDENCY_DECODED;
+  ret->loudnessEnabled = false;
+  ret->loudnessTarget = MCIM_LOUDNESS_DEFAULT_TARGET;
+  ret->trace = NULL;
+  ret->offline = true;
+  ret->offlineFps = fps;
+  ret->timings.hook = -1.0;
+  ret->timings.fadeoutThread = -1.0;
+  ret->timings.output = -1.0;
+  mcim_worker_acquire();
+  if (!mcim_analyzer_init(&(ret->analyzer), mcim_loudness_done, ret, allocator, deallocator)) {
+    mcim_worker_release();
+    deallocator(ret);
+    return NULL;
+  }
+  mcim_prefetcher_init(&(ret->prefetcher), allocator, deallocator);
+  mcim_mixer_init(&(ret->mixer), MCIM_MIXER_SAMPLE_RATE, mcim_offline_notify, NULL);
+  ret->mixer.streamWait = true;
+  if (!mcim_mixer_prepare(&(ret->mixer), allocator)) {
+    mcim_mixer_destroy(&(ret->mixer), deallocator);
+    mcim_analyzer_destroy(&(ret->analyzer));
+    mcim_prefetcher_destroy(&(ret->prefetcher));
+    mcim_worker_release();
+    deallocator(ret);
+    return NULL;
   }
-  LeaveCriticalSection(&MCIM_INSTANCE_COUNT_MUTEX);
+
+  mcim_init_global_mutex();
+
+  ret->timings.init = mcim_elapsed_since(&begin);
 
   return (MCIM_DATA*)ret;
 }
@@ -117,19 +233,38 @@ bool mcim_exit(MCIM_DATA* data) {
 
   MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
 
-  // fadeout_thread中でentryを参照しているため、
-  // entryの削除はthread削除後である必要がある
-  mcim_terminate_fadeout_thread(&(d->th));
+  // フェードアウトのタイマーはentryを参照しているため、
+  // entryの削除前に停止する必要がある
+  for (MCIM_MUSIC_ENTRY* entry = d->bgmlist; entry != NULL; entry = entry->next) {
+    if (entry->status == MCIM_STATUS_FADINGOUT && !d->offline) {
+      mcim_worker_stop_timer(&(entry->fade.timer));
+    }
+  }
+
+  // 同様にレンダリングスレッドもentry->pcmを参照しているため、先に停止する
+  mcim_output_close(d->output);
+  d->output = NULL;
+
+  // 解析スレッドもentryの解析要求を参照している
+  mcim_analyzer_destroy(&(d->analyzer));
+  mcim_prefetcher_destroy(&(d->prefetcher));
+  if (d->trace != NULL) {
+    mcim_trace_close(d->trace, d->deallocator);
+    d->trace = NULL;
+  }
 
   MCIM_MUSIC_ENTRY* entry = d->bgmlist;
   if (entry != NULL) {
     do {
-      if (!mcim_unload_entry(entry, d->deallocator)) {
+      if (!mcim_unload_entry(entry, &(d->mixer), d->deallocator)) {
         return false;
       }
 
       // entry->filepathは基本的にNULLにはならないためNULLチェックは省略
       d->deallocator(entry->filepath);
+      if (entry->stretch != NULL) {
+        d->deallocator(entry->stretch);
+      }
 
       MCIM_MUSIC_ENTRY* temp = entry->next;
       entry->next = NULL;
@@ -137,583 +272,2132 @@ bool mcim_exit(MCIM_DATA* data) {
       entry = temp;
     } while (entry != NULL);
     d->bgmlist = NULL;
+    atomic_store_explicit(&(d->positions), NULL, memory_order_relaxed);
+  }
+  mcim_sfx_pool_destroy(&(d->mixer), d->deallocator);
+  for (uint32_t i = 0; i < d->mixer.tapCount; i++) {
+    d->deallocator(d->mixer.taps[i].tap);
   }
+  for (uint32_t i = 0; i < d->mixer.registryCount; i++) {
+    mcim_free_effects(&(d->mixer), &(d->mixer.registry[i]->effects), d->deallocator);
+    d->deallocator(d->mixer.registry[i]);
+  }
+  mcim_free_effects(&(d->mixer), &(d->mixer.master.effects), d->deallocator);
+  mcim_mixer_destroy(&(d->mixer), d->deallocator);
+  bool unhooked = mcim_uninstall_hook(d);
   d->deallocator(data);
+  mcim_worker_release();
 
-  // グローバルへの影響を抑えるため、
-  // インスタンスが一つもないときはメッセージのHookを解除する
-  EnterCriticalSection(&MCIM_INSTANCE_COUNT_MUTEX);
-  uint32_t count = --MCIM_INSTANCE_COUNT;
-  LeaveCriticalSection(&MCIM_INSTANCE_COUNT_MUTEX);
-  if (count == 0) {
-    assert(MCIM_HOOK != NULL);
-    if (UnhookWindowsHookEx(MCIM_HOOK) == 0) {
+  return unhooked;
+}
+
+MCIM_KEY mcim_load(MCIM_DATA* data, const wchar_t* filepath) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const MCIM_KEY key = mcim_load_untraced(data, filepath);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(key != MCIM_INVALID_KEY ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_LOAD, .flags = flags, .key = MCIM_INVALID_KEY, .result = key};
+    mcim_trace_record(trace, begin, &record, filepath, (filepath != NULL ? sizeof(wchar_t) * wcslen(filepath) : 0));
+  }
+  return key;
+}
+
+bool mcim_unload(MCIM_DATA* data, MCIM_KEY key) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_unload_untraced(data, key);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_UNLOAD, .flags = flags, .key = key};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
+}
+
+bool mcim_set_residency(MCIM_DATA* data, MCIM_RESIDENCY residency) {
+  if (data == NULL || (residency != MCIM_RESIDENCY_DECODED && residency != MCIM_RESIDENCY_ENCODED && residency != MCIM_RESIDENCY_INT16)) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  d->residency = residency;
+  return true;
+}
+
+bool mcim_prefetch(MCIM_DATA* data, const MCIM_PREFETCH_ENTRY* manifest, uint32_t count) {
+  if (data == NULL || (manifest == NULL && count > 0)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    if (manifest[i].filepath == NULL || manifest[i].filepath[0] == L'\0') {
       return false;
     }
-    MCIM_HOOK = NULL;
   }
 
-  return true;
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  return mcim_prefetcher_submit(&(d->prefetcher), manifest, count, d->residency);
 }
 
-MCIM_KEY mcim_load(MCIM_DATA* data, const wchar_t* filepath) {
-  if (data == NULL || filepath == NULL || filepath[0] == L'\0') {
-    return MCIM_INVALID_KEY;
+bool mcim_get_prefetch_stats(MCIM_DATA* data, MCIM_PREFETCH_STATS* stats) {
+  if (data == NULL || stats == NULL) {
+    return false;
   }
 
   MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
-  MCIM_MUSIC_ENTRY** pentry = &(d->bgmlist);
+  mcim_prefetcher_get_stats(&(d->prefetcher), stats);
+  return true;
+}
 
-  while (*pentry != NULL) {
-    if (mcim_entry_equal(*pentry, filepath)) {
-      return mcim_load_entry(*pentry);
-    }
+void mcim_set_memory_budget(size_t bytes) {
+  mcim_wave_set_budget(bytes);
+}
 
-    pentry = &((*pentry)->next);
+bool mcim_get_memory_stats(MCIM_MEMORY_STATS* stats) {
+  if (stats == NULL) {
+    return false;
   }
 
-  MCIM_MUSIC_ENTRY* new_entry = mcim_create_loaded_entry(filepath, d->allocator, d->deallocator);
-  if (new_entry == NULL) {
-    return MCIM_INVALID_KEY;
+  mcim_wave_get_stats(stats);
+  return true;
+}
+
+bool mcim_set_cache_directory(const wchar_t* directory) {
+  return mcim_cache_set_directory(directory);
+}
+
+bool mcim_get_cache_stats(MCIM_CACHE_STATS* stats) {
+  if (stats == NULL) {
+    return false;
   }
-  *pentry = new_entry;
-  return new_entry->key;
+
+  mcim_cache_get_stats(stats);
+  return true;
 }
 
-bool mcim_unload(MCIM_DATA* data, MCIM_KEY key) {
-  if (data == NULL) {
+bool mcim_set_log_output(HANDLE output, MCIM_LOG_LEVEL level) {
+  return mcim_log_set_output(output, level);
+}
+
+bool mcim_log(MCIM_LOG_LEVEL level, const char* event, const char* key0, int64_t value0, const char* key1, int64_t value1) {
+  return mcim_log_write(level, event, key0, value0, key1, value1);
+}
+
+uint64_t mcim_get_log_dropped(void) {
+  return mcim_log_get_dropped();
+}
+
+bool mcim_set_loudness_normalization(MCIM_DATA* data, bool enable, double target) {
+  if (data == NULL || !(target >= -70.0 && target <= 0.0)) {
     return false;
   }
 
   MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
-  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
-  while (entry != NULL) {
-    if (entry->key == key) {
-      return mcim_unload_entry(entry, d->deallocator);
+  mcim_analyzer_lock(&(d->analyzer));
+  d->loudnessEnabled = enable;
+  d->loudnessTarget = target;
+  for (MCIM_MUSIC_ENTRY* entry = d->bgmlist; entry != NULL; entry = entry->next) {
+    if (entry->backend != MCIM_BACKEND_RENDER) {
+      continue;
     }
-    entry = entry->next;
+    if (entry->loudness.status == MCIM_LOUDNESS_NOT_ANALYZED) {
+      mcim_request_loudness(d, entry);
+    }
+    mcim_mixer_set_trim(&(d->mixer), &(entry->voice), (float)pow(10.0, mcim_loudness_gain(d, &(entry->loudness)) / 20.0));
   }
-
-  return false;
+  mcim_analyzer_unlock(&(d->analyzer));
+  return true;
 }
 
-bool mcim_play(MCIM_DATA* data, MCIM_KEY key, MCIM_CALLBACK_PROC callback) {
-  if (data == NULL) {
+bool mcim_get_loudness(MCIM_DATA* data, MCIM_KEY key, MCIM_LOUDNESS_INFO* info) {
+  if (data == NULL || info == NULL) {
     return false;
   }
 
   MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
-  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
-  while (entry != NULL) {
+  for (MCIM_MUSIC_ENTRY* entry = d->bgmlist; entry != NULL; entry = entry->next) {
     if (entry->key == key) {
-      return mcim_play_entry(entry, 0, callback, d->hwnd, d->allocator, d->deallocator);
+      mcim_analyzer_lock(&(d->analyzer));
+      const MCIM_LOUDNESS_REQUEST* request = &(entry->loudness);
+      info->status = request->status;
+      info->integrated = request->result.integrated;
+      info->gain = mcim_loudness_gain(d, request);
+      info->analysisTime = request->result.analysisTime;
+      info->analysisCpuTime = request->result.analysisCpuTime;
+      info->cached = request->result.cached;
+      mcim_analyzer_unlock(&(d->analyzer));
+      return true;
     }
-    entry = entry->next;
   }
   return false;
 }
 
-bool mcim_play_from(MCIM_DATA* data, MCIM_KEY key, int32_t from) {
-  if (data == NULL) {
+bool mcim_set_output_config(MCIM_DATA* data, const MCIM_OUTPUT_CONFIG* config) {
+  if (data == NULL || config == NULL) {
+    return false;
+  }
+  if (config->periodFrames < MCIM_OUTPUT_MIN_PERIOD_FRAMES || config->periodFrames > MCIM_OUTPUT_MAX_PERIOD_FRAMES) {
+    return false;
+  }
+  if (config->bufferCount < 2 || config->bufferCount > MCIM_OUTPUT_MAX_BUFFER_COUNT) {
     return false;
   }
 
-  if (from < 0) {
-    from = 0;
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  d->outputConfig = *config;
+
+  // ボイスの状態はミキサー側が保持しているため、出力段のみを開き直せば再生は継続する
+  if (d->output != NULL) {
+    mcim_output_close(d->output);
+    d->output = NULL;
+    return mcim_open_output(d);
+  }
+  return true;
+}
+
+bool mcim_get_latency(MCIM_DATA* data, MCIM_LATENCY_INFO* info) {
+  if (data == NULL || info == NULL) {
+    return false;
   }
 
   MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
-  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
-  while (entry != NULL) {
-    if (entry->key == key) {
-      return mcim_play_entry(entry, from, NULL, d->hwnd, d->allocator, d->deallocator);
-    }
-    entry = entry->next;
+  mcim_output_get_latency(d->output, &(d->outputConfig), info);
+  return true;
+}
+
+bool mcim_get_startup_timings(MCIM_DATA* data, MCIM_STARTUP_TIMINGS* timings) {
+  if (data == NULL || timings == NULL) {
+    return false;
   }
-  return false;
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  *timings = d->timings;
+
+  timings->threadCount = mcim_worker_thread_count() + (d->output != NULL ? 1 : 0) + mcim_jobs_thread_count(d->mixer.jobs);
+  return true;
 }
 
-MCIM_KEY mcim_stop(MCIM_DATA* data, MCIM_KEY key) {
+double mcim_get_position(MCIM_DATA* data, MCIM_KEY key) {
   if (data == NULL) {
-    return MCIM_INVALID_KEY;
+    return -1.0;
   }
 
+  // MCIへの問い合わせはメッセージループとの往復でブロックするため、レンダリングパスのみ対応する
+  // bgmlistはload中に書き換わるため、releaseで公開されたレンダリングパスのエントリのみを辿る
   MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
-  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  MCIM_MUSIC_ENTRY* entry = atomic_load_explicit(&(d->positions), memory_order_acquire);
   while (entry != NULL) {
-    if (entry->key == key || (key == MCIM_MASTER_KEY && mcim_entry_is_playing(entry))) {
-      if (mcim_stop_entry(entry, d->deallocator)) {
-        assert(entry->key != MCIM_INVALID_KEY);
-        return entry->key;
-      } else {
-        return MCIM_INVALID_KEY;
-      }
+    if (entry->key == key) {
+      return mcim_mixer_get_position(&(d->mixer), &(entry->voice));
     }
-    entry = entry->next;
+    entry = atomic_load_explicit(&(entry->positionNext), memory_order_acquire);
   }
-  return MCIM_INVALID_KEY;
+  return -1.0;
 }
 
-MCIM_KEY mcim_fadeout(MCIM_DATA* data, MCIM_KEY key, MCIM_WAIT_NEXT_FRAME wait, int32_t time, MCIM_CALLBACK_PROC callback) {
-  if (data == NULL || wait == NULL || time < 0) {
-    return MCIM_INVALID_KEY;
+bool mcim_get_stats(MCIM_DATA* data, MCIM_STATS* stats) {
+  if (data == NULL || stats == NULL) {
+    return false;
   }
 
   MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
-  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
-  while (entry != NULL) {
-    if (entry->key == key || (key == MCIM_MASTER_KEY && mcim_entry_is_playing(entry))) {
-      if (mcim_fadeout_entry(entry, &(d->th), wait, time, callback, d->allocator, d->deallocator)) {
-        assert(entry->key != MCIM_INVALID_KEY);
-        return entry->key;
-      } else {
-        return MCIM_INVALID_KEY;
-      }
+  mcim_stats_get(stats);
+  stats->loadedCount = 0;
+  stats->playingCount = 0;
+  stats->fadingCount = 0;
+  for (const MCIM_MUSIC_ENTRY* entry = d->bgmlist; entry != NULL; entry = entry->next) {
+    if (entry->status >= MCIM_STATUS_LOADED) {
+      stats->loadedCount++;
+    }
+    if (entry->status == MCIM_STATUS_PLAYING || entry->status == MCIM_STATUS_FADINGOUT) {
+      stats->playingCount++;
+    }
+    if (entry->status == MCIM_STATUS_FADINGOUT) {
+      stats->fadingCount++;
     }
-    entry = entry->next;
   }
-  return MCIM_INVALID_KEY;
+
+  EnterCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+  stats->callbackCount = HASH_COUNT(MCIM_CALLBACK_TABLE);
+  LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+  return true;
 }
 
-/**********************************************************/
+bool mcim_start_trace(MCIM_DATA* data, const wchar_t* filepath) {
+  if (data == NULL || filepath == NULL || filepath[0] == L'\0') {
+    return false;
+  }
 
-ATTRIB_MALLOC MCIM_MUSIC_ENTRY* mcim_create_loaded_entry(const wchar_t* filepath, mcim_allocator_t allocator, mcim_deallocator_t deallocator) {
-  assert(filepath != NULL);
-  assert(allocator != NULL);
-  assert(deallocator != NULL);
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (d->trace != NULL) {
+    mcim_trace_close(d->trace, d->deallocator);
+    d->trace = NULL;
+  }
+  d->trace = mcim_trace_open(filepath, d->allocator, d->deallocator);
+  return (d->trace != NULL);
+}
 
-  size_t pathlen = wcslen(filepath);
-  wchar_t* path = (wchar_t*)allocator(sizeof(wchar_t) * (pathlen + 1));
-  if (path == NULL) {
-    return NULL;
+bool mcim_stop_trace(MCIM_DATA* data) {
+  if (data == NULL) {
+    return false;
   }
-  if (wcscpy_s(path, pathlen + 1, filepath) != 0) {
-    deallocator(path);
-    return NULL;
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (d->trace == NULL) {
+    return false;
   }
+  bool result = mcim_trace_close(d->trace, d->deallocator);
+  d->trace = NULL;
+  return result;
+}
 
-  MCIDEVICEID id;
-  if (!mcim_command_open(&id, path)) {
-    deallocator(path);
-    return NULL;
+bool mcim_replay_trace(MCIM_DATA* data, const wchar_t* filepath, MCIM_TRACE_PACE pace, MCIM_TRACE_REPORT* report) {
+  if (data == NULL || filepath == NULL || report == NULL || (pace != MCIM_TRACE_PACE_RECORDED && pace != MCIM_TRACE_PACE_UNTHROTTLED)) {
+    return false;
   }
 
-  uint32_t volume;
-  if (!mcim_command_get_volume(id, &volume)) {
-    mcim_command_close(id);
-    deallocator(path);
-    return NULL;
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  return mcim_trace_replay(data, filepath, pace, report, d->allocator, d->deallocator);
+}
+
+bool mcim_set_loop(MCIM_DATA* data, MCIM_KEY key, uint32_t loopStart, uint32_t loopEnd) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_loop_untraced(data, key, loopStart, loopEnd);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_LOOP, .flags = flags, .key = key, .args = {loopStart, loopEnd}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
+  return result;
+}
 
-  MCIM_MUSIC_ENTRY* entry = (MCIM_MUSIC_ENTRY*)allocator(sizeof(MCIM_MUSIC_ENTRY));
-  if (entry == NULL) {
-    mcim_command_close(id);
-    deallocator(path);
-    return NULL;
+bool mcim_play(MCIM_DATA* data, MCIM_KEY key, MCIM_CALLBACK_PROC callback) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_play_untraced(data, key, callback);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)((result ? MCIM_TRACE_FLAG_SUCCEEDED : 0) | (callback != NULL ? MCIM_TRACE_FLAG_CALLBACK : 0));
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_PLAY, .flags = flags, .key = key};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
-  entry->key = MCIM_NEXT_KEY++;
-  entry->id = id;
-  entry->status = MCIM_STATUS_LOADED;
-  entry->volume = volume;
-  entry->filepath = path;
-  entry->next = NULL;
+  return result;
+}
 
-  assert(entry->key != MCIM_INVALID_KEY);
-  return entry;
+bool mcim_play_from(MCIM_DATA* data, MCIM_KEY key, int32_t from) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_play_from_untraced(data, key, from);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_PLAY_FROM, .flags = flags, .key = key, .args = {(uint32_t)from, 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
 }
 
-ATTRIB_PURE static bool mcim_entry_is_playing(const MCIM_MUSIC_ENTRY* entry) {
-  return (entry->status >= MCIM_STATUS_PLAYING);
+MCIM_KEY mcim_stop(MCIM_DATA* data, MCIM_KEY key) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const MCIM_KEY ret = mcim_stop_untraced(data, key);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(ret != MCIM_INVALID_KEY ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_STOP, .flags = flags, .key = key, .result = ret};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return ret;
 }
 
-ATTRIB_PURE static bool mcim_entry_equal(const MCIM_MUSIC_ENTRY* entry, const wchar_t* filepath) {
-  assert(entry != NULL);
-  assert(entry->filepath != NULL);
-  assert(filepath != NULL);
+MCIM_KEY mcim_fadeout(MCIM_DATA* data, MCIM_KEY key, double fps, int32_t time, MCIM_CALLBACK_PROC callback) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const MCIM_KEY ret = mcim_fadeout_untraced(data, key, fps, time, callback);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)((ret != MCIM_INVALID_KEY ? MCIM_TRACE_FLAG_SUCCEEDED : 0) | (callback != NULL ? MCIM_TRACE_FLAG_CALLBACK : 0));
+    MCIM_TRACE_RECORD record = {
+        .call = MCIM_TRACE_FADEOUT, .flags = flags, .key = key, .result = ret, .args = {(uint32_t)time, mcim_trace_float_bits((float)fps)}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return ret;
+}
 
-  return (wcscmp(entry->filepath, filepath) == 0);
+bool mcim_set_fadeout_fps(MCIM_DATA* data, MCIM_KEY key, double fps) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_fadeout_fps_untraced(data, key, fps);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_FADEOUT_FPS, .flags = flags, .key = key, .args = {mcim_trace_float_bits((float)fps), 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
 }
 
-ATTRIB_CONST static MCIM_NOTIFY_FLAGS mcim_convert_flag(uint32_t mci_flag) {
-  MCIM_NOTIFY_FLAGS mcim_flag;
-  switch (mci_flag) {
-    case MCI_NOTIFY_SUCCESSFUL:
-      mcim_flag = MCIM_NOTIFY_SUCCESSFUL;
-      break;
-    case MCI_NOTIFY_SUPERSEDED:
-      mcim_flag = MCIM_NOTIFY_SUPERSEDED;
-      break;
-    case MCI_NOTIFY_ABORTED:
-      mcim_flag = MCIM_NOTIFY_ABORTED;
-      break;
-    case MCI_NOTIFY_FAILURE:
-      /* fallthrough */
-    default:
-      mcim_flag = MCIM_NOTIFY_FAILURE;
-      break;
+MCIM_KEY mcim_sfx_load(MCIM_DATA* data, const wchar_t* filepath) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const MCIM_KEY key = mcim_sfx_load_untraced(data, filepath);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(key != MCIM_INVALID_KEY ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SFX_LOAD, .flags = flags, .key = MCIM_INVALID_KEY, .result = key};
+    mcim_trace_record(trace, begin, &record, filepath, (filepath != NULL ? sizeof(wchar_t) * wcslen(filepath) : 0));
   }
-  return mcim_flag;
+  return key;
 }
 
-/**************************************************************************************************/
+bool mcim_sfx_unload(MCIM_DATA* data, MCIM_KEY key) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_sfx_unload_untraced(data, key);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SFX_UNLOAD, .flags = flags, .key = key};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
+}
 
-static MCIM_KEY mcim_load_entry(MCIM_MUSIC_ENTRY* entry) {
-  assert(entry != NULL);
-
-  if (entry->status == MCIM_STATUS_UNLOADED) {
-    MCIDEVICEID id;
-    if (!mcim_command_open(&id, entry->filepath)) {
-      return MCIM_INVALID_KEY;
-    }
-    entry->id = id;
-    entry->status = MCIM_STATUS_LOADED;
+bool mcim_set_sfx_polyphony(MCIM_DATA* data, uint32_t polyphony) {
+  if (data == NULL || polyphony == 0 || polyphony > MCIM_SFX_MAX_POLYPHONY) {
+    return false;
   }
 
-  assert(entry->key != MCIM_INVALID_KEY);
-  return entry->key;
-}
-
-static bool mcim_unload_entry(MCIM_MUSIC_ENTRY* entry, mcim_deallocator_t deallocator) {
-  assert(entry != NULL);
-  assert(deallocator != NULL);
-
-  if (entry->status >= MCIM_STATUS_LOADED) {
-    if (!mcim_stop_entry(entry, deallocator)) {
-      return false;
-    }
-    if (!mcim_command_close(entry->id)) {
-      return false;
-    }
-    entry->status = MCIM_STATUS_UNLOADED;
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (!mcim_sfx_pool_prepare(&(d->mixer), polyphony, d->allocator)) {
+    return false;
   }
+  atomic_store(&(d->mixer.sfx->polyphony), polyphony);
   return true;
 }
 
-static bool mcim_play_entry(MCIM_MUSIC_ENTRY* entry,
-                            int32_t from,
-                            MCIM_CALLBACK_PROC callback,
-                            HWND callbackWindow,
-                            mcim_allocator_t allocator,
-                            mcim_deallocator_t deallocator) {
-  assert(entry != NULL);
-  assert(from >= 0);
-  assert(!(from > 0 && callback != NULL));
-  assert(allocator != NULL);
-  assert(deallocator != NULL);
-
-  if (entry->status >= MCIM_STATUS_PLAYING) {
-    return true;
+bool mcim_sfx_play(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_sfx_play_untraced(data, key, gain, priority);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SFX_PLAY, .flags = flags, .key = key, .args = {mcim_trace_float_bits(gain), (uint32_t)priority}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
+  return result;
+}
 
-  // mci_command実行 → table更新の順とすることでsupersededメッセージが
-  // 元のcallbackに正常に送信されるようにしている
-  if (entry->status >= MCIM_STATUS_LOADED) {
-    bool result;
-    if (callback == NULL) {
-      if (from == 0) {
-        result = mcim_command_play(entry->id);
-      } else {
-        result = mcim_command_play_from(entry->id, from);
-      }
-    } else {
-      result = mcim_command_play_callback(entry->id, callbackWindow);
-    }
-    if (result) {
-      entry->status = MCIM_STATUS_PLAYING;
-      if (!mcim_add_callback_table(entry->id, callback, allocator)) {
-        mcim_stop_entry(entry, deallocator);
-        return false;
-      } else {
-        return true;
-      }
-    }
+uint32_t mcim_sfx_play_at(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority, float x, float y) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const uint32_t instance = mcim_sfx_play_at_untraced(data, key, gain, priority, x, y);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(instance != 0 ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SFX_PLAY_AT,
+                                .flags = flags,
+                                .key = key,
+                                .result = instance,
+                                .args = {mcim_trace_float_bits(gain), (uint32_t)priority, mcim_trace_float_bits(x), mcim_trace_float_bits(y)}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
-  return false;
+  return instance;
 }
 
-static bool mcim_stop_entry(MCIM_MUSIC_ENTRY* entry, mcim_deallocator_t deallocator) {
-  assert(entry != NULL);
-  assert(deallocator != NULL);
-
-  // mci_command実行 → table更新の順とすることでabortedメッセージが
-  // 元のcallbackに正常に送信されるようにしている
-  if (entry->status >= MCIM_STATUS_PLAYING) {
-    if (!mcim_command_stop(entry->id)) {
-      return false;
-    }
-    entry->status = MCIM_STATUS_LOADED;
-    mcim_del_callback_table(entry->id, deallocator);
+bool mcim_sfx_move(MCIM_DATA* data, uint32_t instance, float x, float y) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_sfx_move_untraced(data, instance, x, y);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {
+        .call = MCIM_TRACE_SFX_MOVE, .flags = flags, .key = instance, .args = {mcim_trace_float_bits(x), mcim_trace_float_bits(y)}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
-  return true;
+  return result;
 }
 
-static bool mcim_fadeout_entry(MCIM_MUSIC_ENTRY* restrict entry,
-                               MCIM_THREAD_DATA* restrict th,
-                               MCIM_WAIT_NEXT_FRAME wait,
-                               int32_t time,
-                               MCIM_CALLBACK_PROC callback,
-                               mcim_allocator_t allocator,
-                               mcim_deallocator_t deallocator) {
-  assert(entry != NULL);
-  assert(th != NULL);
-  assert(wait != NULL);
-  assert(time >= 0);
-  assert(allocator != NULL);
-  assert(deallocator != NULL);
-
-  if (!mcim_start_fadeout_thread(th, entry, wait, time)) {
+bool mcim_sfx_set_listener(MCIM_DATA* data, const MCIM_SFX_LISTENER_CONFIG* config) {
+  if (data == NULL) {
     return false;
   }
-
-  // fadeoutはmci_commandにはないため、
-  // fadeoutの実行を開始しても元のcallbackにabortedが通知されない
-  // そのため、手動でabortedメッセージを再現する必要がある
-  MCIM_CALLBACK_PROC proc = mcim_find_callback(entry->id);
-  if (proc != NULL) {
-    proc(MCIM_NOTIFY_ABORTED);
+  if (config != NULL && (!(config->panWidth > 0.0f) || !(config->referenceDistance > 0.0f) || !(config->rolloff >= 0.0f))) {
+    return false;
   }
 
-  if (callback == NULL) {
-    mcim_del_callback_table(entry->id, deallocator);
-  } else {
-    if (!mcim_add_callback_table(entry->id, callback, allocator)) {
-      mcim_stop_entry(entry, deallocator);
-      return false;
-    }
+  // 聴取者の設定はボイスプールが持つため、効果音のロード前に設定された場合もここで用意する
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (!mcim_sfx_pool_prepare(&(d->mixer), MCIM_SFX_DEFAULT_POLYPHONY, d->allocator)) {
+    return false;
   }
 
+  MCIM_SFX_LISTENER listener = {.x = 0.0f, .y = 0.0f, .invPanWidth = 1.0f, .reference = 1.0f, .rolloff = 0.0f};
+  if (config != NULL) {
+    listener.x = config->x;
+    listener.y = config->y;
+    listener.invPanWidth = 1.0f / config->panWidth;
+    listener.reference = config->referenceDistance;
+    listener.rolloff = config->rolloff;
+  }
+  mcim_sfx_pool_set_listener(&(d->mixer), &listener);
   return true;
 }
 
-/**************************************************************************************************/
-
-static LRESULT CALLBACK mcim_callback(int code, WPARAM wParam, LPARAM lParam) {
-  if (code == HC_ACTION) {
-    MSG* msg = (MSG*)lParam;
-    if (msg->message == MM_MCINOTIFY) {
-      MCIDEVICEID id = (MCIDEVICEID)(msg->lParam);
-      MCIM_CALLBACK_PROC callback = mcim_find_callback(id);
-      if (callback != NULL) {
-        MCIM_NOTIFY_FLAGS flag = mcim_convert_flag((uint32_t)(msg->wParam));
-        callback(flag);
-        return 0;
-      }
-    }
+bool mcim_sfx_stop_all(MCIM_DATA* data) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_sfx_stop_all_untraced(data);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SFX_STOP_ALL, .flags = flags, .key = MCIM_INVALID_KEY};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
-
-  return CallNextHookEx(MCIM_HOOK, code, wParam, lParam);
+  return result;
 }
 
-static MCIM_CALLBACK_PROC mcim_find_callback(MCIDEVICEID id) {
-  MCIM_CALLBACK_TABLE_ENTRY* item;
-
-  EnterCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-  HASH_FIND_INT(MCIM_CALLBACK_TABLE, (void*)(uintptr_t)id, item);
-  LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-  if (item == NULL) {
-    return NULL;
+bool mcim_set_ducking(MCIM_DATA* data, const MCIM_DUCKING_CONFIG* config) {
+  if (data == NULL) {
+    return false;
   }
-  return item->callback;
-}
-
-static bool mcim_add_callback_table(MCIDEVICEID id, MCIM_CALLBACK_PROC callback, mcim_allocator_t allocator) {
-  assert(allocator != NULL);
 
-  if (callback == NULL) {
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (config == NULL) {
+    mcim_mixer_set_ducking(&(d->mixer), false, 0.0f, 0.0f, 0.0f, 0.0f);
     return true;
   }
-
-  MCIM_CALLBACK_TABLE_ENTRY* item;
-  EnterCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-  HASH_FIND_INT(MCIM_CALLBACK_TABLE, (void*)(uintptr_t)id, item);
-  if (item != NULL) {
-    item->callback = callback;
-    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-    return true;
-  } else {
-    item = (MCIM_CALLBACK_TABLE_ENTRY*)allocator(sizeof(MCIM_CALLBACK_TABLE_ENTRY));
-    if (item == NULL) {
-      LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-      return false;
-    }
-    item->id = id;
-    item->callback = callback;
-    HASH_ADD_INT(MCIM_CALLBACK_TABLE, id, item);
-    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-    return true;
+  if (!(config->depth >= 0.0f) || !(config->attack >= 0.0f) || !(config->release >= 0.0f)) {
+    return false;
   }
+  mcim_mixer_set_ducking(&(d->mixer), true, config->threshold, config->depth, config->attack, config->release);
+  return true;
 }
 
-static void mcim_del_callback_table(MCIDEVICEID id, mcim_deallocator_t deallocator) {
-  assert(deallocator != NULL);
-
-  MCIM_CALLBACK_TABLE_ENTRY* item;
-  EnterCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-  HASH_FIND_INT(MCIM_CALLBACK_TABLE, (void*)(uintptr_t)id, item);
-  if (item != NULL) {
-    HASH_DEL(MCIM_CALLBACK_TABLE, item);
-    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
-    deallocator(item);
-  } else {
-    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+bool mcim_set_ducked(MCIM_DATA* data, MCIM_KEY key, bool ducked) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_ducked_untraced(data, key, ducked);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)((result ? MCIM_TRACE_FLAG_SUCCEEDED : 0) | (ducked ? MCIM_TRACE_FLAG_ENABLED : 0));
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_DUCKED, .flags = flags, .key = key};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
+  return result;
 }
 
-/**************************************************************************************************/
-
-static bool mcim_command_open(MCIDEVICEID* restrict pId, const wchar_t* restrict filepath) {
-  assert(pId != NULL);
-  assert(filepath != NULL);
-
-  MCI_OPEN_PARMSW mop = {.lpstrDeviceType = L"MPEGVideo", .lpstrElementName = filepath};
+bool mcim_set_sfx_sidechain(MCIM_DATA* data, MCIM_KEY key, bool sidechain) {
+  if (data == NULL) {
+    return false;
+  }
 
-  MCIERROR result = mciSendCommandW(0, MCI_OPEN, MCI_OPEN_TYPE | MCI_OPEN_ELEMENT, (DWORD_PTR)(&mop));
-  *pId = mop.wDeviceID;
-  return (result == 0);
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  return mcim_sfx_pool_set_sidechain(&(d->mixer), key, sidechain);
 }
 
-static bool mcim_command_get_volume(MCIDEVICEID id, uint32_t* pVolume) {
-  assert(pVolume != NULL);
+bool mcim_set_rate(MCIM_DATA* data, MCIM_KEY key, float rate, MCIM_RATE_MODE mode, float glide) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_rate_untraced(data, key, rate, mode, glide);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)((result ? MCIM_TRACE_FLAG_SUCCEEDED : 0) | (mode == MCIM_RATE_STRETCH ? MCIM_TRACE_FLAG_STRETCH : 0));
+    MCIM_TRACE_RECORD record = {
+        .call = MCIM_TRACE_SET_RATE, .flags = flags, .key = key, .args = {mcim_trace_float_bits(rate), mcim_trace_float_bits(glide)}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
+}
 
-  MCI_STATUS_PARMS msp = {.dwItem = MCI_DGV_STATUS_VOLUME};
+bool mcim_add_eq(MCIM_DATA* data, MCIM_KEY key, const MCIM_EQ_PARAMS* params, uint32_t* index) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_add_eq_untraced(data, key, params, index);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_ADD_EQ, .flags = flags, .key = key, .result = (result ? *index : 0)};
+    mcim_trace_record(trace, begin, &record, params, (params != NULL ? sizeof(MCIM_EQ_PARAMS) : 0));
+  }
+  return result;
+}
 
-  if (mciSendCommandW(id, MCI_STATUS, MCI_WAIT | MCI_DGV_STATUS_NOMINAL | MCI_STATUS_ITEM, (DWORD_PTR)(&msp)) != 0) {
-    return false;
-  } else {
-    *pVolume = msp.dwReturn;
-    return true;
+bool mcim_set_eq(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_EQ_PARAMS* params) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_eq_untraced(data, key, index, params);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_EQ, .flags = flags, .key = key, .args = {index, 0}};
+    mcim_trace_record(trace, begin, &record, params, (params != NULL ? sizeof(MCIM_EQ_PARAMS) : 0));
   }
+  return result;
 }
 
-static bool mcim_command_set_volume(MCIDEVICEID id, uint32_t volume) {
-  MCI_DGV_SETAUDIO_PARMSW mdsp = {.dwItem = MCI_DGV_SETAUDIO_VOLUME, .dwValue = volume};
+bool mcim_add_limiter(MCIM_DATA* data, MCIM_KEY key, const MCIM_LIMITER_PARAMS* params, uint32_t* index) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_add_limiter_untraced(data, key, params, index);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_ADD_LIMITER, .flags = flags, .key = key, .result = (result ? *index : 0)};
+    mcim_trace_record(trace, begin, &record, params, (params != NULL ? sizeof(MCIM_LIMITER_PARAMS) : 0));
+  }
+  return result;
+}
 
-  return (mciSendCommandW(id, MCI_SETAUDIO, MCI_DGV_SETAUDIO_ITEM | MCI_DGV_SETAUDIO_VALUE, (DWORD_PTR)(&mdsp)) == 0);
+bool mcim_set_limiter(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_LIMITER_PARAMS* params) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_limiter_untraced(data, key, index, params);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_LIMITER, .flags = flags, .key = key, .args = {index, 0}};
+    mcim_trace_record(trace, begin, &record, params, (params != NULL ? sizeof(MCIM_LIMITER_PARAMS) : 0));
+  }
+  return result;
 }
 
-static bool mcim_command_play(MCIDEVICEID id) {
-  return (mciSendCommandW(id, MCI_PLAY, 0, 0) == 0);
+bool mcim_clear_effects(MCIM_DATA* data, MCIM_KEY key) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_clear_effects_untraced(data, key);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_CLEAR_EFFECTS, .flags = flags, .key = key};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
 }
 
-static bool mcim_command_play_callback(MCIDEVICEID id, HWND callbackWindow) {
-  static MCI_PLAY_PARMS mpp = {.dwCallback = 0};
-  if (mpp.dwCallback == 0) {
-    mpp.dwCallback = (DWORD_PTR)callbackWindow;
+MCIM_KEY mcim_create_bus(MCIM_DATA* data, MCIM_KEY parent) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const MCIM_KEY key = mcim_create_bus_untraced(data, parent);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(key != MCIM_INVALID_KEY ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_CREATE_BUS, .flags = flags, .key = parent, .result = key};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
-  return (mciSendCommandW(id, MCI_PLAY, MCI_NOTIFY, (DWORD_PTR)(&mpp)) == 0);
+  return key;
 }
 
-static bool mcim_command_play_from(MCIDEVICEID id, int32_t from) {
-  assert(from >= 0);
+bool mcim_destroy_bus(MCIM_DATA* data, MCIM_KEY bus) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_destroy_bus_untraced(data, bus);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_DESTROY_BUS, .flags = flags, .key = bus};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
+}
 
-  static const MCI_SET_PARMS msp = {.dwTimeFormat = MCI_FORMAT_MILLISECONDS};
-  if (mciSendCommandW(id, MCI_SET, MCI_WAIT | MCI_SET_TIME_FORMAT, (DWORD_PTR)(&msp)) != 0) {
-    return false;
+bool mcim_route_bus(MCIM_DATA* data, MCIM_KEY bus, MCIM_KEY parent) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_route_bus_untraced(data, bus, parent);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_ROUTE_BUS, .flags = flags, .key = bus, .args = {parent, 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
   }
+  return result;
+}
 
-  MCI_PLAY_PARMS mpp = {.dwFrom = from};
-  return (mciSendCommandW(id, MCI_PLAY, MCI_FROM, (DWORD_PTR)(&mpp)) == 0);
+bool mcim_set_bus_gain(MCIM_DATA* data, MCIM_KEY bus, float gain) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_bus_gain_untraced(data, bus, gain);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_BUS_GAIN, .flags = flags, .key = bus, .args = {mcim_trace_float_bits(gain), 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
 }
 
-static bool mcim_command_stop(MCIDEVICEID id) {
-  return (mciSendCommandW(id, MCI_STOP, MCI_WAIT, 0) == 0);
+bool mcim_set_bus(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_bus_untraced(data, key, bus);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_BUS, .flags = flags, .key = key, .args = {bus, 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
 }
 
-static bool mcim_command_close(MCIDEVICEID id) {
-  return (mciSendCommandW(id, MCI_CLOSE, MCI_WAIT, 0) == 0);
+bool mcim_set_sfx_bus(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_sfx_bus_untraced(data, key, bus);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_SFX_BUS, .flags = flags, .key = key, .args = {bus, 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
 }
 
-/**************************************************************************************************/
+bool mcim_set_render_threads(MCIM_DATA* data, uint32_t count) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_set_render_threads_untraced(data, count);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_SET_RENDER_THREADS, .flags = flags, .key = MCIM_INVALID_KEY, .args = {count, 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
+}
 
-static bool mcim_create_fadeout_thread(MCIM_DATA_INTERNAL* data) {
-  (data->th).initializedEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
-  if ((data->th).initializedEvent == NULL) {
+bool mcim_add_analysis(MCIM_DATA* data, MCIM_KEY key, uint32_t fftSize) {
+  if (data == NULL || fftSize < MCIM_ANALYSIS_MIN_FFT_SIZE || fftSize > MCIM_ANALYSIS_MAX_FFT_SIZE || (fftSize & (fftSize - 1)) != 0) {
     return false;
   }
 
-  (data->th).hthread = (HANDLE)_beginthreadex(NULL, 0, mcim_fadeout_thread, data, 0, &((data->th).threadId));
-  if ((data->th).hthread == (HANDLE)0) {
-    CloseHandle((data->th).initializedEvent);
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (mcim_mixer_find_tap(&(d->mixer), key) != NULL) {
     return false;
   }
 
-  if (WaitForSingleObject((data->th).initializedEvent, INFINITE) != WAIT_OBJECT_0) {
-    mcim_terminate_fadeout_thread(&(data->th));
+  // バスとマスターはミックスした出力を、BGMはボイスがタップへ別にミックスしたものを解析する
+  MCIM_MIXER_BUS* bus = mcim_mixer_find_bus(&(d->mixer), key);
+  MCIM_VOICE* voice = NULL;
+  if (bus == NULL) {
+    for (MCIM_MUSIC_ENTRY* entry = d->bgmlist; entry != NULL; entry = entry->next) {
+      if (entry->key == key) {
+        if (entry->backend != MCIM_BACKEND_RENDER || entry->status < MCIM_STATUS_LOADED) {
+          return false;
+        }
+        voice = &(entry->voice);
+        break;
+      }
+    }
+    if (voice == NULL) {
+      return false;
+    }
+  }
+
+  MCIM_TAP* tap = mcim_tap_create(key, fftSize, d->mixer.sampleRate, d->allocator);
+  if (tap == NULL) {
+    return false;
+  }
+  if (!mcim_mixer_add_tap(&(d->mixer), tap, bus, voice)) {
+    d->deallocator(tap);
     return false;
   }
+  return true;
+}
 
-  atomic_init(&((data->th).wait), 0);
+bool mcim_remove_analysis(MCIM_DATA* data, MCIM_KEY key) {
+  if (data == NULL) {
+    return false;
+  }
 
+  // 取り除いた後はレンダリングスレッドから参照されないため、解放してよい
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_TAP* tap = mcim_mixer_remove_tap(&(d->mixer), key);
+  if (tap == NULL) {
+    return false;
+  }
+  d->deallocator(tap);
   return true;
 }
 
-static bool mcim_start_fadeout_thread(MCIM_THREAD_DATA* restrict th,
-                                      const MCIM_MUSIC_ENTRY* restrict entry,
-                                      MCIM_WAIT_NEXT_FRAME wait,
-                                      int32_t time) {
-  assert(th != NULL);
-  assert(entry != NULL);
-  assert(wait != NULL);
+bool mcim_get_analysis(MCIM_DATA* data, MCIM_KEY key, MCIM_ANALYSIS* analysis) {
+  if (data == NULL || analysis == NULL) {
+    return false;
+  }
 
-  atomic_store(&(th->wait), (uintptr_t)wait);
-  return PostThreadMessageW(th->threadId, MCIM_TM_FADEOUT, (WPARAM)entry, (LPARAM)time) != 0;
+  // レンダリング中もミキサーのロックを待たずに読み出せるよう、タップの検索と読み出しはロックを取らない
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_TAP* tap = mcim_mixer_find_tap(&(d->mixer), key);
+  if (tap == NULL) {
+    return false;
+  }
+  mcim_tap_read(tap, analysis);
+  return true;
 }
 
-static void mcim_terminate_fadeout_thread(MCIM_THREAD_DATA* th) {
-  PostThreadMessageW(th->threadId, MCIM_TM_TERMINATE, 0, 0);
-  CloseHandle(th->initializedEvent);
-  WaitForSingleObject(th->hthread, INFINITE);
-  CloseHandle(th->hthread);
+bool mcim_render(MCIM_DATA* data, float* buffer, uint32_t frames) {
+  MCIM_TRACE_RECORDER* trace = mcim_get_trace(data);
+  const LONGLONG begin = mcim_trace_begin(trace);
+  const bool result = mcim_render_untraced(data, buffer, frames);
+  if (trace != NULL) {
+    const uint8_t flags = (uint8_t)(result ? MCIM_TRACE_FLAG_SUCCEEDED : 0);
+    MCIM_TRACE_RECORD record = {.call = MCIM_TRACE_RENDER, .flags = flags, .key = MCIM_INVALID_KEY, .args = {frames, 0}};
+    mcim_trace_record(trace, begin, &record, NULL, 0);
+  }
+  return result;
 }
 
-static unsigned __stdcall mcim_fadeout_thread(void* pargs) {
-  MCIM_DATA_INTERNAL* data = (MCIM_DATA_INTERNAL*)pargs;
-  MCIM_CALLBACK_PROC callback = NULL;
-  MSG msg;
-  PeekMessageW(&msg, (HWND)-1, WM_USER, WM_USER, PM_NOREMOVE);
+bool mcim_save_wave(const wchar_t* filepath, const float* buffer, uint32_t frames) {
+  if (filepath == NULL || filepath[0] == L'\0' || buffer == NULL) {
+    return false;
+  }
 
-  SetEvent((data->th).initializedEvent);
+  return mcim_wave_save(filepath, buffer, frames, MCIM_MIXER_SAMPLE_RATE);
+}
 
-  while (GetMessageW(&msg, (HWND)-1, 0, 0) != 0) {
-    if (msg.message == MCIM_TM_TERMINATE) {
-      break;
-    }
-    if (msg.message != MCIM_TM_FADEOUT) {
-      continue;
-    }
-    MCIM_MUSIC_ENTRY* entry = (MCIM_MUSIC_ENTRY*)(msg.wParam);
-    int32_t time = (int32_t)(msg.lParam);
-    int32_t cnt = 0;
-    MCIM_WAIT_NEXT_FRAME wait = (MCIM_WAIT_NEXT_FRAME)atomic_load(&((data->th).wait));
-    callback = mcim_find_callback(entry->id);
+/**********************************************************/
 
-    while (++cnt > time) {
-      if (PeekMessageW(&msg, (HWND)-1, 0, 0, PM_REMOVE) == 0 || msg.message == MCIM_TM_TERMINATE) {
-        goto finish;
-      }
-      if (entry->status != MCIM_STATUS_FADINGOUT) {
-        break;
-      }
-      int32_t volume = (int32_t)(1.0 * entry->volume * (time - cnt) / time);
-      mcim_command_set_volume(entry->id, volume);
-      wait();
-    }
-    mcim_command_stop(entry->id);
-    mcim_command_set_volume(entry->id, entry->volume);
-    if (callback != NULL) {
-      if (cnt > time) {
-        callback(MCIM_NOTIFY_SUCCESSFUL);
-      } else {
-        callback(MCIM_NOTIFY_ABORTED);
-      }
-      callback = NULL;
-    }
-  }
+ATTRIB_MALLOC MCIM_MUSIC_ENTRY* mcim_create_loaded_entry(const wchar_t* filepath,
+                                                        MCIM_PCM* pcm,
+                                                        bool renderOnly,
+                                                        MCIM_RESIDENCY residency,
+                                                        mcim_allocator_t allocator,
+                                                        mcim_deallocator_t deallocator) {
+  assert(filepath != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
 
-finish:
-  if (callback != NULL) {
-    callback(MCIM_NOTIFY_ABORTED);
+  size_t pathlen = wcslen(filepath);
+  wchar_t* path = (wchar_t*)allocator(sizeof(wchar_t) * (pathlen + 1));
+  if (path == NULL) {
+    mcim_wave_free(pcm, deallocator);
+    return NULL;
   }
-
-  return 0;
+  if (wcscpy_s(path, pathlen + 1, filepath) != 0) {
+    mcim_wave_free(pcm, deallocator);
+    deallocator(path);
+    return NULL;
+  }
+
+  // 対応形式のWAVファイルであればレンダリングパスを使用し、それ以外はMCIで再生する
+  // （先読み済みのPCMが渡された場合はそれを使用する）
+  if (pcm == NULL && mcim_wave_probe(path)) {
+    pcm = mcim_wave_load(path, residency, true, allocator, deallocator);
+  }
+
+  MCIDEVICEID id;
+  uint32_t volume;
+  if (pcm != NULL) {
+    id = MCIM_NEXT_RENDER_ID++;
+    volume = MCIM_RENDER_NOMINAL_VOLUME;
+  } else if (renderOnly) {
+    deallocator(path);
+    return NULL;
+  } else {
+    if (!mcim_command_open(&id, path)) {
+      deallocator(path);
+      return NULL;
+    }
+
+    if (!mcim_command_get_volume(id, &volume)) {
+      mcim_command_close(id);
+      deallocator(path);
+      return NULL;
+    }
+  }
+
+  MCIM_MUSIC_ENTRY* entry = (MCIM_MUSIC_ENTRY*)allocator(sizeof(MCIM_MUSIC_ENTRY));
+  if (entry == NULL) {
+    if (pcm != NULL) {
+      mcim_wave_free(pcm, deallocator);
+    } else {
+      mcim_command_close(id);
+    }
+    deallocator(path);
+    return NULL;
+  }
+  SecureZeroMemory(entry, sizeof(MCIM_MUSIC_ENTRY));
+  atomic_init(&(entry->positionNext), NULL);
+  entry->key = MCIM_NEXT_KEY++;
+  entry->id = id;
+  entry->status = MCIM_STATUS_LOADED;
+  entry->backend = (pcm != NULL ? MCIM_BACKEND_RENDER : MCIM_BACKEND_MCI);
+  entry->volume = volume;
+  entry->filepath = path;
+  entry->pcm = pcm;
+  entry->voice.id = id;
+  entry->voice.gain = 1.0f;
+  entry->voice.targetGain = 1.0f;
+  entry->voice.trim = 1.0f;
+  entry->voice.targetTrim = 1.0f;
+  entry->voice.rate = 1.0f;
+  entry->voice.targetRate = 1.0f;
+  entry->loudness.filepath = path;
+  entry->loudness.context = entry;
+  entry->loudness.status = MCIM_LOUDNESS_NOT_ANALYZED;
+  if (pcm != NULL) {
+    entry->voice.loopStart = pcm->loopStart;
+    entry->voice.loopEnd = pcm->loopEnd;
+  }
+  entry->next = NULL;
+
+  assert(entry->key != MCIM_INVALID_KEY);
+  return entry;
+}
+
+ATTRIB_PURE static bool mcim_entry_is_playing(const MCIM_MUSIC_ENTRY* entry) {
+  return (entry->status >= MCIM_STATUS_PLAYING);
+}
+
+ATTRIB_PURE static bool mcim_entry_equal(const MCIM_MUSIC_ENTRY* entry, const wchar_t* filepath) {
+  assert(entry != NULL);
+  assert(entry->filepath != NULL);
+  assert(filepath != NULL);
+
+  return (wcscmp(entry->filepath, filepath) == 0);
+}
+
+ATTRIB_CONST static MCIM_NOTIFY_FLAGS mcim_convert_flag(uint32_t mci_flag) {
+  MCIM_NOTIFY_FLAGS mcim_flag;
+  switch (mci_flag) {
+    case MCI_NOTIFY_SUCCESSFUL:
+      mcim_flag = MCIM_NOTIFY_SUCCESSFUL;
+      break;
+    case MCI_NOTIFY_SUPERSEDED:
+      mcim_flag = MCIM_NOTIFY_SUPERSEDED;
+      break;
+    case MCI_NOTIFY_ABORTED:
+      mcim_flag = MCIM_NOTIFY_ABORTED;
+      break;
+    case MCI_NOTIFY_FAILURE:
+      /* fallthrough */
+    default:
+      mcim_flag = MCIM_NOTIFY_FAILURE;
+      break;
+  }
+  return mcim_flag;
+}
+
+/**************************************************************************************************/
+
+static MCIM_KEY mcim_load_entry(MCIM_MUSIC_ENTRY* restrict entry,
+                                MCIM_PCM* restrict pcm,
+                                MCIM_RESIDENCY residency,
+                                mcim_allocator_t allocator,
+                                mcim_deallocator_t deallocator) {
+  assert(entry != NULL);
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  if (entry->status != MCIM_STATUS_UNLOADED || entry->backend != MCIM_BACKEND_RENDER) {
+    mcim_wave_free(pcm, deallocator);
+    pcm = NULL;
+  }
+
+  if (entry->status == MCIM_STATUS_UNLOADED) {
+    if (entry->backend == MCIM_BACKEND_RENDER) {
+      // 疑似デバイスIDおよびループ区間はアンロード後も維持する
+      if (pcm == NULL) {
+        pcm = mcim_wave_load(entry->filepath, residency, true, allocator, deallocator);
+      }
+      if (pcm == NULL) {
+        return MCIM_INVALID_KEY;
+      }
+      entry->pcm = pcm;
+    } else {
+      MCIDEVICEID id;
+      if (!mcim_command_open(&id, entry->filepath)) {
+        return MCIM_INVALID_KEY;
+      }
+      entry->id = id;
+    }
+    entry->status = MCIM_STATUS_LOADED;
+  }
+
+  assert(entry->key != MCIM_INVALID_KEY);
+  return entry->key;
+}
+
+static bool mcim_unload_entry(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, mcim_deallocator_t deallocator) {
+  assert(entry != NULL);
+  assert(mixer != NULL);
+  assert(deallocator != NULL);
+
+  if (entry->status >= MCIM_STATUS_LOADED) {
+    if (!mcim_stop_entry(entry, mixer, deallocator)) {
+      return false;
+    }
+    if (!mcim_entry_command_close(entry, mixer, deallocator)) {
+      return false;
+    }
+    entry->status = MCIM_STATUS_UNLOADED;
+  }
+  return true;
+}
+
+static bool mcim_play_entry(MCIM_MUSIC_ENTRY* restrict entry,
+                            MCIM_MIXER* restrict mixer,
+                            int32_t from,
+                            MCIM_CALLBACK_PROC callback,
+                            HWND callbackWindow,
+                            mcim_allocator_t allocator,
+                            mcim_deallocator_t deallocator) {
+  assert(entry != NULL);
+  assert(mixer != NULL);
+  assert(from >= 0);
+  assert(!(from > 0 && callback != NULL));
+  assert(allocator != NULL);
+  assert(deallocator != NULL);
+
+  // レンダリングパスではボイスが終端に達していれば再生中とはみなさない
+  if (entry->status >= MCIM_STATUS_PLAYING) {
+    if (entry->backend != MCIM_BACKEND_RENDER || mcim_mixer_voice_is_active(mixer, &(entry->voice))) {
+      return true;
+    }
+    entry->status = MCIM_STATUS_LOADED;
+  }
+
+  // mci_command実行 → table更新の順とすることでsupersededメッセージが
+  // 元のcallbackに正常に送信されるようにしている
+  if (entry->status >= MCIM_STATUS_LOADED) {
+    if (mcim_entry_command_play(entry, mixer, from, callbackWindow, callback != NULL)) {
+      entry->status = MCIM_STATUS_PLAYING;
+      if (!mcim_add_callback_table(entry->id, callback, allocator)) {
+        mcim_stop_entry(entry, mixer, deallocator);
+        return false;
+      } else {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static bool mcim_stop_entry(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, mcim_deallocator_t deallocator) {
+  assert(entry != NULL);
+  assert(mixer != NULL);
+  assert(deallocator != NULL);
+
+  // フェードアウト中であれば先にタイマーを止める
+  // 止める前にフェードアウトが完了した場合はタイマーから停止と通知が行われている
+  bool aborted = (entry->status == MCIM_STATUS_FADINGOUT && mcim_worker_stop_timer(&(entry->fade.timer)));
+
+  // mci_command実行 → table更新の順とすることでabortedメッセージが
+  // 元のcallbackに正常に送信されるようにしている
+  if (entry->status >= MCIM_STATUS_PLAYING) {
+    if (!mcim_entry_command_stop(entry, mixer)) {
+      return false;
+    }
+    entry->status = MCIM_STATUS_LOADED;
+
+    // フェードアウトはmci_commandにはないため、中断を手動で通知する
+    MCIM_CALLBACK_PROC proc = NULL;
+    if (aborted) {
+      mcim_entry_command_set_volume(entry, mixer, entry->volume);
+      proc = mcim_find_callback(entry->id);
+    }
+    mcim_del_callback_table(entry->id, deallocator);
+    if (proc != NULL) {
+      proc(MCIM_NOTIFY_ABORTED);
+    }
+  }
+  return true;
+}
+
+static bool mcim_fadeout_entry(MCIM_MUSIC_ENTRY* restrict entry,
+                               MCIM_DATA_INTERNAL* restrict data,
+                               double fps,
+                               int32_t time,
+                               MCIM_CALLBACK_PROC callback) {
+  assert(entry != NULL);
+  assert(data != NULL);
+  assert(fps > 0.0);
+  assert(time >= 0);
+
+  MCIM_MIXER* mixer = &(data->mixer);
+  mcim_allocator_t allocator = data->allocator;
+  mcim_deallocator_t deallocator = data->deallocator;
+
+  // オフラインレンダリングでは仮想時間に同期させるため、タイマーではなくミキサー内でフェードアウトする
+  if (data->offline) {
+    if (!mcim_mixer_voice_is_active(mixer, &(entry->voice))) {
+      return false;
+    }
+  } else {
+    // 既にフェードアウト中の場合は指定された時間でやり直す
+    if (entry->status == MCIM_STATUS_FADINGOUT) {
+      mcim_worker_stop_timer(&(entry->fade.timer));
+    }
+    if (!mcim_entry_is_playing(entry)) {
+      return false;
+    }
+  }
+
+  // fadeoutはmci_commandにはないため、
+  // fadeoutの実行を開始しても元のcallbackにabortedが通知されない
+  // そのため、手動でabortedメッセージを再現する必要がある
+  MCIM_CALLBACK_PROC proc = mcim_find_callback(entry->id);
+  if (proc != NULL) {
+    proc(MCIM_NOTIFY_ABORTED);
+  }
+
+  // タイマーが完了時にcallbackを参照するため、table更新 → タイマー開始の順とする
+  if (callback == NULL) {
+    mcim_del_callback_table(entry->id, deallocator);
+  } else {
+    if (!mcim_add_callback_table(entry->id, callback, allocator)) {
+      mcim_stop_entry(entry, mixer, deallocator);
+      return false;
+    }
+  }
+
+  entry->status = MCIM_STATUS_FADINGOUT;
+  if (data->offline) {
+    uint32_t frames = (uint32_t)((double)time * MCIM_MIXER_SAMPLE_RATE / data->offlineFps);
+    mcim_mixer_fade_voice(mixer, &(entry->voice), frames, callback != NULL);
+  } else if (!mcim_start_fadeout(entry, data, fps, time)) {
+    mcim_stop_entry(entry, mixer, deallocator);
+    return false;
+  }
+
+  return true;
+}
+
+/**************************************************************************************************/
+
+static LRESULT CALLBACK mcim_callback(int code, WPARAM wParam, LPARAM lParam) {
+  if (code == HC_ACTION) {
+    MSG* msg = (MSG*)lParam;
+    if (msg->message == MM_MCINOTIFY) {
+      MCIDEVICEID id = (MCIDEVICEID)(msg->lParam);
+      MCIM_CALLBACK_PROC callback = mcim_find_callback(id);
+      if (callback != NULL) {
+        MCIM_NOTIFY_FLAGS flag = mcim_convert_flag((uint32_t)(msg->wParam));
+        mcim_log_write(MCIM_LOG_DEBUG, "mcim_notify", "id", id, "flag", flag);
+        callback(flag);
+        return 0;
+      }
+    }
+  }
+
+  return CallNextHookEx(MCIM_HOOK, code, wParam, lParam);
+}
+
+static MCIM_CALLBACK_PROC mcim_find_callback(MCIDEVICEID id) {
+  MCIM_CALLBACK_TABLE_ENTRY* item;
+
+  EnterCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+  HASH_FIND_INT(MCIM_CALLBACK_TABLE, (void*)(uintptr_t)id, item);
+  LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+  if (item == NULL) {
+    return NULL;
+  }
+  return item->callback;
+}
+
+static bool mcim_add_callback_table(MCIDEVICEID id, MCIM_CALLBACK_PROC callback, mcim_allocator_t allocator) {
+  assert(allocator != NULL);
+
+  if (callback == NULL) {
+    return true;
+  }
+
+  MCIM_CALLBACK_TABLE_ENTRY* item;
+  EnterCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+  HASH_FIND_INT(MCIM_CALLBACK_TABLE, (void*)(uintptr_t)id, item);
+  if (item != NULL) {
+    item->callback = callback;
+    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+    return true;
+  } else {
+    item = (MCIM_CALLBACK_TABLE_ENTRY*)allocator(sizeof(MCIM_CALLBACK_TABLE_ENTRY));
+    if (item == NULL) {
+      LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+      return false;
+    }
+    item->id = id;
+    item->callback = callback;
+    HASH_ADD_INT(MCIM_CALLBACK_TABLE, id, item);
+    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+    return true;
+  }
+}
+
+static void mcim_del_callback_table(MCIDEVICEID id, mcim_deallocator_t deallocator) {
+  assert(deallocator != NULL);
+
+  MCIM_CALLBACK_TABLE_ENTRY* item;
+  EnterCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+  HASH_FIND_INT(MCIM_CALLBACK_TABLE, (void*)(uintptr_t)id, item);
+  if (item != NULL) {
+    HASH_DEL(MCIM_CALLBACK_TABLE, item);
+    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+    deallocator(item);
+  } else {
+    LeaveCriticalSection(&MCIM_CALLBACK_TABLE_MUTEX);
+  }
+}
+
+/**************************************************************************************************/
+
+static void mcim_init_global_mutex(void) {
+  if (!atomic_flag_test_and_set(&MCIM_MUTEX_INITIALIZED)) {
+    InitializeCriticalSectionAndSpinCount(&MCIM_CALLBACK_TABLE_MUTEX, 0);
+    InitializeCriticalSection(&MCIM_HOOK_MUTEX);
+  }
+}
+
+static bool mcim_install_hook(MCIM_DATA_INTERNAL* data) {
+  assert(data != NULL);
+
+  if (data->offline || data->hooked) {
+    return true;
+  }
+
+  LARGE_INTEGER begin;
+  QueryPerformanceCounter(&begin);
+
+  // Hookの設置とMCIM_HOOK_COUNTの更新は一体で行う必要があるため、atomicではなく排他制御する
+  EnterCriticalSection(&MCIM_HOOK_MUTEX);
+  if (MCIM_HOOK_COUNT == 0) {
+    assert(MCIM_HOOK == NULL);
+
+    // スレッドIDが0のままSetWindowsHookExWを呼ぶと全スレッドへのHookとなるため、先に確認する
+    DWORD threadId = GetWindowThreadProcessId(data->hwnd, NULL);
+    if (threadId == 0) {
+      LeaveCriticalSection(&MCIM_HOOK_MUTEX);
+      return false;
+    }
+    MCIM_HOOK = SetWindowsHookExW(WH_GETMESSAGE, mcim_callback, NULL, threadId);
+    if (MCIM_HOOK == NULL) {
+      LeaveCriticalSection(&MCIM_HOOK_MUTEX);
+      return false;
+    }
+  }
+  MCIM_HOOK_COUNT++;
+  LeaveCriticalSection(&MCIM_HOOK_MUTEX);
+
+  data->hooked = true;
+  data->timings.hook = mcim_elapsed_since(&begin);
+  return true;
+}
+
+static bool mcim_uninstall_hook(MCIM_DATA_INTERNAL* data) {
+  assert(data != NULL);
+
+  if (!data->hooked) {
+    return true;
+  }
+  data->hooked = false;
+
+  // グローバルへの影響を抑えるため、
+  // Hookを必要とするインスタンスが一つもないときはメッセージのHookを解除する
+  bool ret = true;
+  EnterCriticalSection(&MCIM_HOOK_MUTEX);
+  assert(MCIM_HOOK_COUNT > 0);
+  if (--MCIM_HOOK_COUNT == 0) {
+    assert(MCIM_HOOK != NULL);
+    ret = (UnhookWindowsHookEx(MCIM_HOOK) != 0);
+    MCIM_HOOK = NULL;
+  }
+  LeaveCriticalSection(&MCIM_HOOK_MUTEX);
+  return ret;
+}
+
+static double mcim_elapsed_since(const LARGE_INTEGER* begin) {
+  assert(begin != NULL);
+
+  LARGE_INTEGER now, freq;
+  QueryPerformanceCounter(&now);
+  QueryPerformanceFrequency(&freq);
+  return (double)(now.QuadPart - begin->QuadPart) / (double)freq.QuadPart;
+}
+
+static bool mcim_open_output(MCIM_DATA_INTERNAL* data) {
+  assert(data != NULL);
+
+  if (data->offline) {
+    return true;
+  }
+
+  // waveOutデバイスとレンダリングスレッドはレンダリングパスのBGMを初めて再生する時点で作成する
+  if (data->output == NULL) {
+    if (!mcim_mixer_prepare(&(data->mixer), data->allocator)) {
+      return false;
+    }
+    LARGE_INTEGER begin;
+    QueryPerformanceCounter(&begin);
+    data->output = mcim_output_open(&(data->mixer), &(data->outputConfig), data->allocator, data->deallocator);
+    if (data->output != NULL) {
+      data->timings.output = mcim_elapsed_since(&begin);
+    }
+  }
+  return (data->output != NULL);
+}
+
+static void mcim_post_notify(void* context, MCIM_VOICE* voice, MCIM_NOTIFY_FLAGS flag) {
+  // MCIと同じ形式でMM_MCINOTIFYを送ることで、mcim_callbackからコールバックを呼び出す
+  PostMessageW((HWND)context, MM_MCINOTIFY, (WPARAM)flag, (LPARAM)(voice->id));
+}
+
+static void mcim_offline_notify(void* context, MCIM_VOICE* voice, MCIM_NOTIFY_FLAGS flag) {
+  (void)(context);
+
+  // レンダリング中はミキサーのロックを保持しているため、ここではコールバックを呼ばずに記録のみ行う
+  voice->pendingNotify = flag;
+}
+
+static void mcim_offline_dispatch(MCIM_DATA_INTERNAL* data) {
+  assert(data != NULL);
+
+  for (MCIM_MUSIC_ENTRY* entry = data->bgmlist; entry != NULL; entry = entry->next) {
+    MCIM_NOTIFY_FLAGS flag = entry->voice.pendingNotify;
+    if (flag == 0) {
+      continue;
+    }
+    entry->voice.pendingNotify = 0;
+
+    MCIM_CALLBACK_PROC callback = mcim_find_callback(entry->id);
+    if (callback != NULL) {
+      callback(flag);
+    }
+  }
+}
+
+static void mcim_request_loudness(MCIM_DATA_INTERNAL* restrict data, MCIM_MUSIC_ENTRY* restrict entry) {
+  assert(data != NULL);
+  assert(entry != NULL);
+
+  // 解析スレッドはファイルを別途開くため、ロード済みのPCMの常駐方式に関わらず解析できる
+  mcim_analyzer_lock(&(data->analyzer));
+  if (data->loudnessEnabled && entry->backend == MCIM_BACKEND_RENDER) {
+    mcim_analyzer_request(&(data->analyzer), &(entry->loudness));
+  }
+  mcim_analyzer_unlock(&(data->analyzer));
+}
+
+static void mcim_loudness_done(void* context, MCIM_LOUDNESS_REQUEST* request) {
+  MCIM_DATA_INTERNAL* data = (MCIM_DATA_INTERNAL*)context;
+  MCIM_MUSIC_ENTRY* entry = (MCIM_MUSIC_ENTRY*)request->context;
+
+  // 再生中であっても次のレンダリングブロック内で補間されるため、そのまま適用してよい
+  mcim_mixer_set_trim(&(data->mixer), &(entry->voice), (float)pow(10.0, mcim_loudness_gain(data, request) / 20.0));
+}
+
+static double mcim_loudness_gain(const MCIM_DATA_INTERNAL* restrict data, const MCIM_LOUDNESS_REQUEST* restrict request) {
+  assert(data != NULL);
+  assert(request != NULL);
+
+  if (!data->loudnessEnabled || request->status != MCIM_LOUDNESS_ANALYZED) {
+    return 0.0;
+  }
+
+  double gain = data->loudnessTarget - request->result.integrated;
+  if (gain < MCIM_LOUDNESS_MIN_GAIN) {
+    gain = MCIM_LOUDNESS_MIN_GAIN;
+  } else if (gain > MCIM_LOUDNESS_MAX_GAIN) {
+    gain = MCIM_LOUDNESS_MAX_GAIN;
+  }
+  return gain;
+}
+
+static bool mcim_entry_command_play(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, int32_t from, HWND callbackWindow, bool notify) {
+  assert(entry != NULL);
+  assert(mixer != NULL);
+  assert(from >= 0);
+  assert(!(from > 0 && notify));
+
+  if (entry->backend == MCIM_BACKEND_RENDER) {
+    uint32_t position = (uint32_t)((uint64_t)from * entry->pcm->sampleRate / 1000);
+    mcim_mixer_start_voice(mixer, &(entry->voice), entry->pcm, position, notify);
+    return true;
+  }
+
+  if (notify) {
+    return mcim_command_play_callback(entry->id, callbackWindow);
+  } else if (from == 0) {
+    return mcim_command_play(entry->id);
+  } else {
+    return mcim_command_play_from(entry->id, from);
+  }
+}
+
+static bool mcim_entry_command_set_volume(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, uint32_t volume) {
+  assert(entry != NULL);
+  assert(mixer != NULL);
+
+  if (entry->backend == MCIM_BACKEND_RENDER) {
+    mcim_mixer_set_gain(mixer, &(entry->voice), (float)volume / (float)entry->volume);
+    return true;
+  }
+  return mcim_command_set_volume(entry->id, volume);
+}
+
+static bool mcim_entry_command_stop(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer) {
+  assert(entry != NULL);
+  assert(mixer != NULL);
+
+  if (entry->backend == MCIM_BACKEND_RENDER) {
+    mcim_mixer_stop_voice(mixer, &(entry->voice));
+    return true;
+  }
+  return mcim_command_stop(entry->id);
+}
+
+static bool mcim_entry_command_close(MCIM_MUSIC_ENTRY* restrict entry, MCIM_MIXER* restrict mixer, mcim_deallocator_t deallocator) {
+  assert(entry != NULL);
+  assert(mixer != NULL);
+  assert(deallocator != NULL);
+
+  if (entry->backend == MCIM_BACKEND_RENDER) {
+    // 停止済みのボイスはレンダリングスレッドから参照されないため、PCMを解放してよい
+    mcim_mixer_stop_voice(mixer, &(entry->voice));
+    mcim_free_effects(mixer, &(entry->voice.effects), deallocator);
+    MCIM_TAP* tap = mcim_mixer_remove_tap(mixer, entry->key);
+    if (tap != NULL) {
+      deallocator(tap);
+    }
+    mcim_wave_free(entry->pcm, deallocator);
+    entry->pcm = NULL;
+    return true;
+  }
+  return mcim_command_close(entry->id);
+}
+
+static MCIM_DSP_CHAIN* mcim_find_effect_chain(MCIM_DATA_INTERNAL* data, MCIM_KEY key) {
+  assert(data != NULL);
+
+  MCIM_MIXER_BUS* bus = mcim_mixer_find_bus(&(data->mixer), key);
+  if (bus != NULL) {
+    return &(bus->effects);
+  }
+  for (MCIM_MUSIC_ENTRY* entry = data->bgmlist; entry != NULL; entry = entry->next) {
+    if (entry->key == key) {
+      if (entry->backend != MCIM_BACKEND_RENDER || entry->status < MCIM_STATUS_LOADED) {
+        return NULL;
+      }
+      return &(entry->voice.effects);
+    }
+  }
+  return NULL;
+}
+
+static void mcim_free_effects(MCIM_MIXER* restrict mixer, MCIM_DSP_CHAIN* restrict chain, mcim_deallocator_t deallocator) {
+  assert(mixer != NULL);
+  assert(chain != NULL);
+  assert(deallocator != NULL);
+
+  // チェーンから外した後はレンダリングスレッドから参照されないため、解放してよい
+  MCIM_DSP_EFFECT* removed[MCIM_DSP_MAX_EFFECTS];
+  const uint32_t count = mcim_mixer_clear_effects(mixer, chain, removed);
+  for (uint32_t i = 0; i < count; i++) {
+    deallocator(removed[i]);
+  }
+}
+
+/**************************************************************************************************/
+
+static bool mcim_command_open(MCIDEVICEID* restrict pId, const wchar_t* restrict filepath) {
+  assert(pId != NULL);
+  assert(filepath != NULL);
+
+  MCI_OPEN_PARMSW mop = {.lpstrDeviceType = L"MPEGVideo", .lpstrElementName = filepath};
+
+  MCIERROR result = mcim_command_send(MCIM_COMMAND_OPEN, 0, MCI_OPEN, MCI_OPEN_TYPE | MCI_OPEN_ELEMENT, (DWORD_PTR)(&mop));
+  *pId = mop.wDeviceID;
+  return (result == 0);
+}
+
+static bool mcim_command_get_volume(MCIDEVICEID id, uint32_t* pVolume) {
+  assert(pVolume != NULL);
+
+  MCI_STATUS_PARMS msp = {.dwItem = MCI_DGV_STATUS_VOLUME};
+
+  if (mcim_command_send(MCIM_COMMAND_STATUS, id, MCI_STATUS, MCI_WAIT | MCI_DGV_STATUS_NOMINAL | MCI_STATUS_ITEM, (DWORD_PTR)(&msp)) != 0) {
+    return false;
+  } else {
+    *pVolume = msp.dwReturn;
+    return true;
+  }
+}
+
+static bool mcim_command_set_volume(MCIDEVICEID id, uint32_t volume) {
+  MCI_DGV_SETAUDIO_PARMSW mdsp = {.dwItem = MCI_DGV_SETAUDIO_VOLUME, .dwValue = volume};
+
+  return (mcim_command_send(MCIM_COMMAND_SETAUDIO, id, MCI_SETAUDIO, MCI_DGV_SETAUDIO_ITEM | MCI_DGV_SETAUDIO_VALUE, (DWORD_PTR)(&mdsp)) == 0);
+}
+
+static bool mcim_command_play(MCIDEVICEID id) {
+  return (mcim_command_send(MCIM_COMMAND_PLAY, id, MCI_PLAY, 0, 0) == 0);
+}
+
+static bool mcim_command_play_callback(MCIDEVICEID id, HWND callbackWindow) {
+  static MCI_PLAY_PARMS mpp = {.dwCallback = 0};
+  if (mpp.dwCallback == 0) {
+    mpp.dwCallback = (DWORD_PTR)callbackWindow;
+  }
+  return (mcim_command_send(MCIM_COMMAND_PLAY, id, MCI_PLAY, MCI_NOTIFY, (DWORD_PTR)(&mpp)) == 0);
+}
+
+static bool mcim_command_play_from(MCIDEVICEID id, int32_t from) {
+  assert(from >= 0);
+
+  static const MCI_SET_PARMS msp = {.dwTimeFormat = MCI_FORMAT_MILLISECONDS};
+  if (mcim_command_send(MCIM_COMMAND_SET, id, MCI_SET, MCI_WAIT | MCI_SET_TIME_FORMAT, (DWORD_PTR)(&msp)) != 0) {
+    return false;
+  }
+
+  MCI_PLAY_PARMS mpp = {.dwFrom = from};
+  return (mcim_command_send(MCIM_COMMAND_PLAY, id, MCI_PLAY, MCI_FROM, (DWORD_PTR)(&mpp)) == 0);
+}
+
+static bool mcim_command_stop(MCIDEVICEID id) {
+  return (mcim_command_send(MCIM_COMMAND_STOP, id, MCI_STOP, MCI_WAIT, 0) == 0);
+}
+
+static bool mcim_command_close(MCIDEVICEID id) {
+  return (mcim_command_send(MCIM_COMMAND_CLOSE, id, MCI_CLOSE, MCI_WAIT, 0) == 0);
+}
+
+static MCIERROR mcim_command_send(MCIM_COMMAND command, MCIDEVICEID id, UINT message, DWORD_PTR flags, DWORD_PTR param) {
+  LARGE_INTEGER begin;
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&begin);
+  MCIERROR result = mciSendCommandW(id, message, flags, param);
+  QueryPerformanceCounter(&end);
+  mcim_stats_record_command(command, end.QuadPart - begin.QuadPart, result == 0);
+  return result;
+}
+
+/**************************************************************************************************/
+
+static bool mcim_start_fadeout(MCIM_MUSIC_ENTRY* restrict entry, MCIM_DATA_INTERNAL* restrict data, double fps, int32_t time) {
+  assert(entry != NULL);
+  assert(data != NULL);
+  assert(!data->offline);
+  assert(fps > 0.0);
+  assert(time >= 0);
+
+  MCIM_FADEOUT* fade = &(entry->fade);
+  fade->timer.step = mcim_fadeout_step;
+  fade->entry = entry;
+  fade->data = data;
+  fade->time = time;
+  fade->count = 0;
+
+  // 初回のみ共有スレッドの準備を含めた時間を記録する
+  if (data->timings.fadeoutThread >= 0.0) {
+    return mcim_worker_start_timer(&(fade->timer), fps);
+  }
+  LARGE_INTEGER begin;
+  QueryPerformanceCounter(&begin);
+  if (!mcim_worker_start_timer(&(fade->timer), fps)) {
+    return false;
+  }
+  data->timings.fadeoutThread = mcim_elapsed_since(&begin);
+  return true;
+}
+
+static bool mcim_fadeout_step(MCIM_WORKER_TIMER* timer) {
+  MCIM_FADEOUT* fade = (MCIM_FADEOUT*)timer;
+  MCIM_MUSIC_ENTRY* entry = fade->entry;
+  MCIM_DATA_INTERNAL* data = fade->data;
+
+  if (++(fade->count) < fade->time) {
+    int32_t volume = (int32_t)(1.0 * entry->volume * (fade->time - fade->count) / fade->time);
+    mcim_entry_command_set_volume(entry, &(data->mixer), volume);
+    return true;
+  }
+
+  // 中断時はmcim_stop_entryがタイマーを止めるため、ここに到達するのは完了時のみ
+  mcim_entry_command_stop(entry, &(data->mixer));
+  mcim_entry_command_set_volume(entry, &(data->mixer), entry->volume);
+  entry->status = MCIM_STATUS_LOADED;
+  mcim_log_write(MCIM_LOG_DEBUG, "mcim_fadeout_done", "key", entry->key, "frames", fade->count);
+  MCIM_CALLBACK_PROC callback = mcim_find_callback(entry->id);
+  mcim_del_callback_table(entry->id, data->deallocator);
+  if (callback != NULL) {
+    callback(MCIM_NOTIFY_SUCCESSFUL);
+  }
+  return false;
+}
+
+/**************************************************************************************************/
+
+static MCIM_TRACE_RECORDER* mcim_get_trace(MCIM_DATA* data) {
+  return (data != NULL ? ((MCIM_DATA_INTERNAL*)data)->trace : NULL);
+}
+
+static MCIM_KEY mcim_load_untraced(MCIM_DATA* data, const wchar_t* filepath) {
+  if (data == NULL || filepath == NULL || filepath[0] == L'\0') {
+    return MCIM_INVALID_KEY;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MUSIC_ENTRY** pentry = &(d->bgmlist);
+
+  while (*pentry != NULL) {
+    if (mcim_entry_equal(*pentry, filepath)) {
+      // 先読みの結果はアンロード済みのBGMを読み直す場合にも使用する
+      MCIM_PCM* pcm = NULL;
+      if ((*pentry)->status == MCIM_STATUS_UNLOADED) {
+        mcim_prefetcher_take(&(d->prefetcher), filepath, &pcm);
+      }
+      MCIM_KEY key = mcim_load_entry(*pentry, pcm, d->residency, d->allocator, d->deallocator);
+      if (key != MCIM_INVALID_KEY) {
+        mcim_request_loudness(d, *pentry);
+      }
+      return key;
+    }
+
+    pentry = &((*pentry)->next);
+  }
+
+  MCIM_PCM* pcm = NULL;
+  mcim_prefetcher_take(&(d->prefetcher), filepath, &pcm);
+  MCIM_MUSIC_ENTRY* new_entry = mcim_create_loaded_entry(filepath, pcm, d->offline, d->residency, d->allocator, d->deallocator);
+  if (new_entry == NULL) {
+    return MCIM_INVALID_KEY;
+  }
+  *pentry = new_entry;
+  if (new_entry->backend == MCIM_BACKEND_RENDER) {
+    atomic_store_explicit(&(new_entry->positionNext), atomic_load_explicit(&(d->positions), memory_order_relaxed), memory_order_relaxed);
+    atomic_store_explicit(&(d->positions), new_entry, memory_order_release);
+  }
+  mcim_request_loudness(d, new_entry);
+  return new_entry->key;
+}
+
+static bool mcim_unload_untraced(MCIM_DATA* data, MCIM_KEY key) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  while (entry != NULL) {
+    if (entry->key == key) {
+      return mcim_unload_entry(entry, &(d->mixer), d->deallocator);
+    }
+    entry = entry->next;
+  }
+
+  return false;
+}
+
+static bool mcim_set_loop_untraced(MCIM_DATA* data, MCIM_KEY key, uint32_t loopStart, uint32_t loopEnd) {
+  if (data == NULL || (loopEnd != 0 && loopStart >= loopEnd)) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  while (entry != NULL) {
+    if (entry->key == key) {
+      if (entry->backend != MCIM_BACKEND_RENDER || entry->status < MCIM_STATUS_LOADED || loopEnd > entry->pcm->frames) {
+        return false;
+      }
+      mcim_mixer_set_loop(&(d->mixer), &(entry->voice), (loopEnd == 0 ? 0 : loopStart), loopEnd);
+      return true;
+    }
+    entry = entry->next;
+  }
+  return false;
+}
+
+static bool mcim_play_untraced(MCIM_DATA* data, MCIM_KEY key, MCIM_CALLBACK_PROC callback) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  while (entry != NULL) {
+    if (entry->key == key) {
+      if (entry->backend == MCIM_BACKEND_RENDER && !mcim_open_output(d)) {
+        return false;
+      }
+      if (callback != NULL && !mcim_install_hook(d)) {
+        return false;
+      }
+      return mcim_play_entry(entry, &(d->mixer), 0, callback, d->hwnd, d->allocator, d->deallocator);
+    }
+    entry = entry->next;
+  }
+  return false;
+}
+
+static bool mcim_play_from_untraced(MCIM_DATA* data, MCIM_KEY key, int32_t from) {
+  if (data == NULL) {
+    return false;
+  }
+
+  if (from < 0) {
+    from = 0;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  while (entry != NULL) {
+    if (entry->key == key) {
+      if (entry->backend == MCIM_BACKEND_RENDER && !mcim_open_output(d)) {
+        return false;
+      }
+      return mcim_play_entry(entry, &(d->mixer), from, NULL, d->hwnd, d->allocator, d->deallocator);
+    }
+    entry = entry->next;
+  }
+  return false;
+}
+
+static MCIM_KEY mcim_stop_untraced(MCIM_DATA* data, MCIM_KEY key) {
+  if (data == NULL) {
+    return MCIM_INVALID_KEY;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  while (entry != NULL) {
+    if (entry->key == key || (key == MCIM_MASTER_KEY && mcim_entry_is_playing(entry))) {
+      if (mcim_stop_entry(entry, &(d->mixer), d->deallocator)) {
+        assert(entry->key != MCIM_INVALID_KEY);
+        return entry->key;
+      } else {
+        return MCIM_INVALID_KEY;
+      }
+    }
+    entry = entry->next;
+  }
+  return MCIM_INVALID_KEY;
+}
+
+static MCIM_KEY mcim_fadeout_untraced(MCIM_DATA* data, MCIM_KEY key, double fps, int32_t time, MCIM_CALLBACK_PROC callback) {
+  if (data == NULL || !(fps > 0.0 && fps <= MCIM_FADEOUT_MAX_FPS) || time < 0) {
+    return MCIM_INVALID_KEY;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  while (entry != NULL) {
+    if (entry->key == key || (key == MCIM_MASTER_KEY && mcim_entry_is_playing(entry))) {
+      if (mcim_fadeout_entry(entry, d, fps, time, callback)) {
+        assert(entry->key != MCIM_INVALID_KEY);
+        return entry->key;
+      } else {
+        return MCIM_INVALID_KEY;
+      }
+    }
+    entry = entry->next;
+  }
+  return MCIM_INVALID_KEY;
+}
+
+static bool mcim_set_fadeout_fps_untraced(MCIM_DATA* data, MCIM_KEY key, double fps) {
+  if (data == NULL || !(fps >= 0.0 && fps <= MCIM_FADEOUT_MAX_FPS)) {
+    return false;
+  }
+
+  // オフライン時のフェードアウトはミキサー内で仮想時間に同期して進むため、フレームレートを持たない
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (d->offline) {
+    return false;
+  }
+  bool found = false;
+  for (MCIM_MUSIC_ENTRY* entry = d->bgmlist; entry != NULL; entry = entry->next) {
+    if (entry->key != key && key != MCIM_MASTER_KEY) {
+      continue;
+    }
+    // 完了したタイマーは動作中でないため、フェードアウト中の状態を見た直後に完了した場合も失敗とする
+    if (entry->status == MCIM_STATUS_FADINGOUT && mcim_worker_set_timer_rate(&(entry->fade.timer), fps)) {
+      found = true;
+    }
+    if (key != MCIM_MASTER_KEY) {
+      break;
+    }
+  }
+  return found;
+}
+
+static MCIM_KEY mcim_sfx_load_untraced(MCIM_DATA* data, const wchar_t* filepath) {
+  if (data == NULL || filepath == NULL || filepath[0] == L'\0') {
+    return MCIM_INVALID_KEY;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (!mcim_wave_probe(filepath)) {
+    return MCIM_INVALID_KEY;
+  }
+
+  // 発音時にメモリ確保やデバイスのオープンが起きないよう、ボイスプールと出力段はロード時に用意する
+  if (!mcim_sfx_pool_prepare(&(d->mixer), MCIM_SFX_DEFAULT_POLYPHONY, d->allocator) || !mcim_open_output(d)) {
+    return MCIM_INVALID_KEY;
+  }
+
+  MCIM_PCM* pcm = mcim_wave_load(filepath, MCIM_RESIDENCY_DECODED, false, d->allocator, d->deallocator);
+  if (pcm == NULL) {
+    return MCIM_INVALID_KEY;
+  }
+
+  MCIM_KEY key = mcim_sfx_pool_add_sample(&(d->mixer), pcm, d->allocator, d->deallocator);
+  if (key == MCIM_INVALID_KEY) {
+    mcim_wave_free(pcm, d->deallocator);
+  }
+  return key;
+}
+
+static bool mcim_sfx_unload_untraced(MCIM_DATA* data, MCIM_KEY key) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_PCM* pcm = mcim_sfx_pool_remove_sample(&(d->mixer), key);
+  if (pcm == NULL) {
+    return false;
+  }
+  mcim_wave_free(pcm, d->deallocator);
+  return true;
+}
+
+static bool mcim_sfx_play_untraced(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority) {
+  if (data == NULL || !(gain >= 0.0f)) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_SFX_POOL* pool = d->mixer.sfx;
+  if (pool == NULL) {
+    return false;
+  }
+  return mcim_sfx_pool_trigger(pool, key, gain, priority);
+}
+
+static bool mcim_sfx_stop_all_untraced(MCIM_DATA* data) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  mcim_sfx_pool_clear(&(d->mixer));
+  return true;
+}
+
+static bool mcim_set_rate_untraced(MCIM_DATA* data, MCIM_KEY key, float rate, MCIM_RATE_MODE mode, float glide) {
+  if (data == NULL || !(rate >= MCIM_RATE_MIN && rate <= MCIM_RATE_MAX) || !(glide >= 0.0f && glide <= MCIM_RATE_MAX_GLIDE) || (mode != MCIM_RATE_RESAMPLE && mode != MCIM_RATE_STRETCH)) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  const uint32_t frames = (uint32_t)(glide * (float)MCIM_MIXER_SAMPLE_RATE / 1000.0f);
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  bool found = false;
+  while (entry != NULL) {
+    if (entry->key == key || (key == MCIM_MASTER_KEY && entry->backend == MCIM_BACKEND_RENDER && entry->status >= MCIM_STATUS_LOADED)) {
+      if (entry->backend != MCIM_BACKEND_RENDER || entry->status < MCIM_STATUS_LOADED) {
+        return false;
+      }
+      if (mode == MCIM_RATE_STRETCH && entry->stretch == NULL) {
+        entry->stretch = mcim_stretch_create(d->allocator);
+        if (entry->stretch == NULL) {
+          return false;
+        }
+      }
+      mcim_mixer_set_rate(&(d->mixer), &(entry->voice), rate, frames, (mode == MCIM_RATE_STRETCH ? entry->stretch : NULL));
+      if (key != MCIM_MASTER_KEY) {
+        return true;
+      }
+      found = true;
+    }
+    entry = entry->next;
+  }
+  return found;
+}
+
+static bool mcim_render_untraced(MCIM_DATA* data, float* buffer, uint32_t frames) {
+  if (data == NULL || buffer == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (!d->offline) {
+    return false;
+  }
+
+  // 解析の完了時点はレンダリングの進み具合と無関係なため、正規化の適用位置が実行毎に変わらないよう完了を待つ
+  if (d->loudnessEnabled) {
+    mcim_analyzer_wait(&(d->analyzer));
+  }
+
+  // 再生終了やフェードアウト完了の通知はブロック毎にまとめて配送し、
+  // コールバック内で行われたmcim_play等は次のブロックから反映させる
+  while (frames > 0) {
+    uint32_t block = (frames < MCIM_OFFLINE_BLOCK_FRAMES ? frames : MCIM_OFFLINE_BLOCK_FRAMES);
+    mcim_mixer_render(&(d->mixer), buffer, block);
+    mcim_mixer_publish_clock(&(d->mixer), d->mixer.renderedFrames, 0, d->mixer.renderedFrames);
+    mcim_offline_dispatch(d);
+    buffer += (size_t)MCIM_MIXER_CHANNELS * block;
+    frames -= block;
+  }
+  return true;
+}
+
+static uint32_t mcim_sfx_play_at_untraced(MCIM_DATA* data, MCIM_KEY key, float gain, int32_t priority, float x, float y) {
+  if (data == NULL || !(gain >= 0.0f)) {
+    return 0;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_SFX_POOL* pool = d->mixer.sfx;
+  if (pool == NULL) {
+    return 0;
+  }
+  return mcim_sfx_pool_trigger_at(pool, key, gain, priority, x, y);
+}
+
+static bool mcim_sfx_move_untraced(MCIM_DATA* data, uint32_t instance, float x, float y) {
+  if (data == NULL || instance == 0) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_SFX_POOL* pool = d->mixer.sfx;
+  if (pool == NULL) {
+    return false;
+  }
+  return mcim_sfx_pool_move(pool, instance, x, y);
+}
+
+static bool mcim_set_ducked_untraced(MCIM_DATA* data, MCIM_KEY key, bool ducked) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  if (key != MCIM_MASTER_KEY) {
+    MCIM_MIXER_BUS* bus = mcim_mixer_find_bus(&(d->mixer), key);
+    if (bus != NULL) {
+      mcim_mixer_set_bus_ducked(&(d->mixer), bus, ducked);
+      return true;
+    }
+  }
+
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  bool found = false;
+  while (entry != NULL) {
+    if (entry->key == key) {
+      if (entry->backend != MCIM_BACKEND_RENDER || entry->status < MCIM_STATUS_LOADED) {
+        return false;
+      }
+      mcim_mixer_set_ducked(&(d->mixer), &(entry->voice), ducked);
+      return true;
+    }
+    if (key == MCIM_MASTER_KEY && entry->backend == MCIM_BACKEND_RENDER && entry->status >= MCIM_STATUS_LOADED) {
+      mcim_mixer_set_ducked(&(d->mixer), &(entry->voice), ducked);
+      found = true;
+    }
+    entry = entry->next;
+  }
+  return found;
+}
+
+static bool mcim_add_eq_untraced(MCIM_DATA* data, MCIM_KEY key, const MCIM_EQ_PARAMS* params, uint32_t* index) {
+  if (data == NULL || params == NULL || index == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_DSP_CHAIN* chain = mcim_find_effect_chain(d, key);
+  if (chain == NULL) {
+    return false;
+  }
+  MCIM_DSP_EFFECT* effect = mcim_dsp_create_eq(params, MCIM_MIXER_SAMPLE_RATE, d->allocator);
+  if (effect == NULL) {
+    return false;
+  }
+  if (!mcim_mixer_add_effect(&(d->mixer), chain, effect, index)) {
+    d->deallocator(effect);
+    return false;
+  }
+  return true;
+}
+
+static bool mcim_set_eq_untraced(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_EQ_PARAMS* params) {
+  if (data == NULL || params == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_DSP_CHAIN* chain = mcim_find_effect_chain(d, key);
+  if (chain == NULL) {
+    return false;
+  }
+  MCIM_DSP_EFFECT* effect = mcim_mixer_get_effect(chain, index);
+  return (effect != NULL && mcim_dsp_set_eq(effect, params, MCIM_MIXER_SAMPLE_RATE));
+}
+
+static bool mcim_add_limiter_untraced(MCIM_DATA* data, MCIM_KEY key, const MCIM_LIMITER_PARAMS* params, uint32_t* index) {
+  if (data == NULL || params == NULL || index == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_DSP_CHAIN* chain = mcim_find_effect_chain(d, key);
+  if (chain == NULL) {
+    return false;
+  }
+  MCIM_DSP_EFFECT* effect = mcim_dsp_create_limiter(params, MCIM_MIXER_SAMPLE_RATE, d->allocator);
+  if (effect == NULL) {
+    return false;
+  }
+  if (!mcim_mixer_add_effect(&(d->mixer), chain, effect, index)) {
+    d->deallocator(effect);
+    return false;
+  }
+  return true;
+}
+
+static bool mcim_set_limiter_untraced(MCIM_DATA* data, MCIM_KEY key, uint32_t index, const MCIM_LIMITER_PARAMS* params) {
+  if (data == NULL || params == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_DSP_CHAIN* chain = mcim_find_effect_chain(d, key);
+  if (chain == NULL) {
+    return false;
+  }
+  MCIM_DSP_EFFECT* effect = mcim_mixer_get_effect(chain, index);
+  return (effect != NULL && mcim_dsp_set_limiter(effect, params, MCIM_MIXER_SAMPLE_RATE));
+}
+
+static bool mcim_clear_effects_untraced(MCIM_DATA* data, MCIM_KEY key) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_DSP_CHAIN* chain = mcim_find_effect_chain(d, key);
+  if (chain == NULL) {
+    return false;
+  }
+  mcim_free_effects(&(d->mixer), chain, d->deallocator);
+  return true;
+}
+
+static MCIM_KEY mcim_create_bus_untraced(MCIM_DATA* data, MCIM_KEY parent) {
+  if (data == NULL) {
+    return MCIM_INVALID_KEY;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MIXER_BUS* parentBus = mcim_mixer_find_bus(&(d->mixer), parent);
+  if (parentBus == NULL) {
+    return MCIM_INVALID_KEY;
+  }
+  MCIM_MIXER_BUS* bus = (MCIM_MIXER_BUS*)d->allocator(sizeof(MCIM_MIXER_BUS));
+  if (bus == NULL) {
+    return MCIM_INVALID_KEY;
+  }
+
+  // バスのキーはBGMのキーと同じ列から採番し、エフェクト等の指定でBGMと区別できるようにする
+  MCIM_KEY key = MCIM_NEXT_KEY++;
+  if (!mcim_mixer_add_bus(&(d->mixer), bus, key, parentBus)) {
+    d->deallocator(bus);
+    return MCIM_INVALID_KEY;
+  }
+  return key;
+}
+
+static bool mcim_destroy_bus_untraced(MCIM_DATA* data, MCIM_KEY bus) {
+  if (data == NULL || bus == MCIM_MASTER_KEY) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MIXER_BUS* target = mcim_mixer_find_bus(&(d->mixer), bus);
+  if (target == NULL) {
+    return false;
+  }
+
+  // 付け替え後はレンダリングスレッドから参照されないため、タップ、エフェクトとバスを解放してよい
+  // ボイスの付け替えはバスの削除より先に積むため、削除の反映時には既に出力先から外れている
+  MCIM_TAP* tap = mcim_mixer_remove_tap(&(d->mixer), bus);
+  if (tap != NULL) {
+    d->deallocator(tap);
+  }
+  for (MCIM_MUSIC_ENTRY* entry = d->bgmlist; entry != NULL; entry = entry->next) {
+    if (entry->voice.route == target) {
+      mcim_mixer_set_voice_bus(&(d->mixer), &(entry->voice), target->route);
+    }
+  }
+  mcim_mixer_remove_bus(&(d->mixer), target);
+  mcim_free_effects(&(d->mixer), &(target->effects), d->deallocator);
+  d->deallocator(target);
+  return true;
+}
+
+static bool mcim_route_bus_untraced(MCIM_DATA* data, MCIM_KEY bus, MCIM_KEY parent) {
+  if (data == NULL || bus == MCIM_MASTER_KEY) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MIXER_BUS* target = mcim_mixer_find_bus(&(d->mixer), bus);
+  MCIM_MIXER_BUS* parentBus = mcim_mixer_find_bus(&(d->mixer), parent);
+  if (target == NULL || parentBus == NULL) {
+    return false;
+  }
+  return mcim_mixer_route_bus(&(d->mixer), target, parentBus);
+}
+
+static bool mcim_set_bus_gain_untraced(MCIM_DATA* data, MCIM_KEY bus, float gain) {
+  if (data == NULL || !(gain >= 0.0f)) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MIXER_BUS* target = mcim_mixer_find_bus(&(d->mixer), bus);
+  if (target == NULL) {
+    return false;
+  }
+  mcim_mixer_set_bus_gain(&(d->mixer), target, gain);
+  return true;
+}
+
+static bool mcim_set_bus_untraced(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MIXER_BUS* target = mcim_mixer_find_bus(&(d->mixer), bus);
+  if (target == NULL) {
+    return false;
+  }
+
+  MCIM_MUSIC_ENTRY* entry = d->bgmlist;
+  bool found = false;
+  while (entry != NULL) {
+    if (entry->key == key) {
+      if (entry->backend != MCIM_BACKEND_RENDER || entry->status < MCIM_STATUS_LOADED) {
+        return false;
+      }
+      mcim_mixer_set_voice_bus(&(d->mixer), &(entry->voice), target);
+      return true;
+    }
+    if (key == MCIM_MASTER_KEY && entry->backend == MCIM_BACKEND_RENDER && entry->status >= MCIM_STATUS_LOADED) {
+      mcim_mixer_set_voice_bus(&(d->mixer), &(entry->voice), target);
+      found = true;
+    }
+    entry = entry->next;
+  }
+  return found;
+}
+
+static bool mcim_set_sfx_bus_untraced(MCIM_DATA* data, MCIM_KEY key, MCIM_KEY bus) {
+  if (data == NULL) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_MIXER_BUS* target = mcim_mixer_find_bus(&(d->mixer), bus);
+  return (target != NULL && mcim_sfx_pool_set_bus(&(d->mixer), key, target));
+}
+
+static bool mcim_set_render_threads_untraced(MCIM_DATA* data, uint32_t count) {
+  if (data == NULL || count > MCIM_RENDER_MAX_THREADS) {
+    return false;
+  }
+
+  MCIM_DATA_INTERNAL* d = (MCIM_DATA_INTERNAL*)data;
+  MCIM_JOBS* jobs = NULL;
+  if (count > 0) {
+    jobs = mcim_jobs_create(count, d->allocator, d->deallocator);
+    if (jobs == NULL) {
+      return false;
+    }
+  }
+
+  // 差し替えはミキサーのロック内で行われるため、戻った時点で以前のスレッドはレンダリングに参加していない
+  MCIM_JOBS* old = mcim_mixer_set_jobs(&(d->mixer), jobs);
+  mcim_jobs_destroy(old, d->deallocator);
+  return true;
 }
@@ -4,17 +4,35 @@
 #include "SyncFPS/SyncFPS.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <windows.h>
 
+// 外部時計とのずれのうち1フレームで補正する割合
+#define SYNC_FPS_CLOCK_GAIN 0.1
+
+// 外部時計とのずれがこれ（秒単位）を超えた場合は補正せず基準を取り直す
+#define SYNC_FPS_CLOCK_RESYNC_THRESHOLD 0.25
+
 typedef struct SYNC_FPS_DATA_INTERNAL {
   double fps;
   double period;
   LARGE_INTEGER timerFreq;
   LARGE_INTEGER timerStart;
+  HANDLE timer;
+  bool highResolution;
+  sync_fps_clock_t clock;
+  void* clockContext;
+  double maxCorrection;
+  bool clockAnchored;
+  double clockOrigin;    // 基準としたフレームの区切りでの外部時計の時刻
+  uint64_t clockFrames;  // 基準としたフレームからの経過フレーム数
+  double correction;     // 次のフレームの待機時間から差し引く秒数
   CRITICAL_SECTION mutex;
   sync_fps_allocator_t allocator;
   sync_fps_deallocator_t deallocator;
 
 } SYNC_FPS_DATA_INTERNAL;
 
+HANDLE sync_fps_create_timer(bool* highResolution);
+
 #endif  // ___SYNCFPS_H__
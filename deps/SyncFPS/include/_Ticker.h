@@ -0,0 +1,33 @@
+﻿#ifndef ___SYNCFPS_TICKER_H__
+#define ___SYNCFPS_TICKER_H__
+
+#include "SyncFPS/Ticker.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <windows.h>
+
+typedef struct _SYNC_TICKER_CALLBACK_ENTRY {
+  SYNC_TICKER_HANDLE handle;
+  sync_ticker_callback_t callback;
+  void* context;
+  struct _SYNC_TICKER_CALLBACK_ENTRY* next;
+} SYNC_TICKER_CALLBACK_ENTRY;
+
+typedef struct _SYNC_TICKER_DATA_INTERNAL {
+  LONGLONG period;
+  LARGE_INTEGER timerFreq;
+  HANDLE timer;
+  HANDLE stopEvent;
+  HANDLE wakeEvent;  // 待機中のティッカースレッドにコールバックの登録を通知する
+  HANDLE hthread;
+  bool highResolution;
+  _Atomic(uint64_t) tick;
+  SYNC_TICKER_HANDLE nextHandle;
+  SYNC_TICKER_CALLBACK_ENTRY* callbacks;
+  CRITICAL_SECTION mutex;
+  sync_fps_allocator_t allocator;
+  sync_fps_deallocator_t deallocator;
+} SYNC_TICKER_DATA_INTERNAL;
+
+#endif  // ___SYNCFPS_TICKER_H__
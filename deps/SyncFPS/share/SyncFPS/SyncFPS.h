@@ -19,6 +19,14 @@
 typedef void* (*sync_fps_allocator_t)(size_t);
 typedef void (*sync_fps_deallocator_t)(void*);
 
+/**
+ * @brief フレーム間隔の基準とする外部時計の関数のテンプレート
+ * @param[in] context set_sync_fps_clock関数で指定したユーザーデータ
+ * @return double 単調増加する時刻（秒単位）、時刻を取得できない場合は負数
+ * @note - wait_sync_fps関数の待機完了毎に一度呼ばれる
+ */
+typedef double (*sync_fps_clock_t)(void* context);
+
 static const sync_fps_allocator_t SYNC_FPS_DEFAULT_MEMORY_ALLOCATOR = malloc;
 static const sync_fps_deallocator_t SYNC_FPS_DEFAULT_MEMORY_DEALLOCATOR = free;
 
@@ -61,6 +69,21 @@ ATTRIB_MALLOC static inline SYNC_FPS_DATA* init_sync_fps(double fps) {
  */
 bool wait_sync_fps(SYNC_FPS_DATA* data);
 
+/**
+ * @brief フレームの区切りを外部時計に追従させる
+ * @param[in,out] data init_sync_fps関数の返り値
+ * @param[in] clock 基準とする外部時計、NULLの場合はQueryPerformanceCounterのみによる待機に戻す
+ * @param[in] context clockに渡すユーザーデータ
+ * @param[in] maxCorrection 1フレームあたりに伸縮させる待機時間の上限（フレーム間隔に対する比率）
+ * @return bool 成功時true、失敗時false
+ * @note - 外部時計との累積のずれを毎フレーム少しずつ待機時間へ反映し、フレーム間隔の急変を避ける
+ * @note - 外部時計が負数を返した場合は補正を止め、次に時刻を取得できたフレームを新たな基準とする
+ * @note - 外部時計がシークやループ等で大きく飛んだ場合は、補正せずその時点を新たな基準とする
+ * @note - dataがNULLの場合は失敗する
+ * @note - maxCorrectionが0未満または1以上の場合は失敗する
+ */
+bool set_sync_fps_clock(SYNC_FPS_DATA* data, sync_fps_clock_t clock, void* context, double maxCorrection);
+
 /**
  * @brief SyncFPS用オブジェクトを解放
  * @param[in,out] data init_sync_fps関数の返り値
@@ -0,0 +1,108 @@
+﻿/**
+ * @file Ticker.h
+ * @author Halkaze
+ * @brief SyncFPS ティッカー公開ヘッダ
+ * @date 2026-10-19
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __SYNCFPS_TICKER_H__
+#define __SYNCFPS_TICKER_H__
+
+#include "SyncFPS.h"
+
+#include <stdint.h>
+
+/**
+ * @brief ティッカー用オブジェクト
+ * @note - 一つのオブジェクトが高分解能タイマーを一つ所有し、登録済みコールバックを単一スレッドから呼び出す
+ * @note - コールバックが一つも登録されていない間はティッカースレッドを待機させ、タイマーを動かさない
+ */
+typedef struct _SYNC_TICKER_DATA SYNC_TICKER_DATA, *PSYNC_TICKER_DATA;
+
+/**
+ * @brief ティッカーに登録されたコールバックの識別子
+ */
+typedef uint32_t SYNC_TICKER_HANDLE;
+
+static const SYNC_TICKER_HANDLE SYNC_TICKER_INVALID_HANDLE = 0;
+
+/**
+ * @brief ティック毎に呼ばれるコールバック関数のテンプレート
+ * @param[in] context 登録時に指定したユーザーデータ
+ * @param[in] tick ティッカー開始からのティック数（1始まり）
+ * @return bool 次のティックでも呼ぶ場合true、登録を解除する場合false
+ * @note - ティッカースレッド上で呼ばれるため、長時間ブロックすると後続のティックが間引かれる
+ */
+typedef bool (*sync_ticker_callback_t)(void* context, uint64_t tick);
+
+/**
+ * @brief 指定されたメモリアロケータを使用してティッカーを初期化し、ティッカースレッドを開始
+ * @param[in] fps 1秒あたりのティック数
+ * @param[in] allocator オブジェクト割り当てに使用するメモリアロケータ
+ * @param[in] deallocator オブジェクト解放に使用するメモリデアロケータ
+ * @return SYNC_TICKER_DATA* 初期化済みティッカー
+ * @note - fpsが0以下の場合は失敗する
+ * @note - allocatorがNULLの場合は失敗する
+ * @note - deallocatorがNULLの場合は失敗する
+ * @note - 失敗時はNULLを返す
+ * @note - 高分解能タイマーが利用できない環境ではtimeBeginPeriod(1)をティッカーの生存期間中一度だけ適用する
+ */
+ATTRIB_MALLOC SYNC_TICKER_DATA* init_sync_ticker_al(double fps, sync_fps_allocator_t allocator, sync_fps_deallocator_t deallocator);
+
+/**
+ * @brief ティッカーを初期化し、ティッカースレッドを開始
+ * @param[in] fps 1秒あたりのティック数
+ * @return SYNC_TICKER_DATA* 初期化済みティッカー
+ * @note - fpsが0以下の場合は失敗する
+ * @note - 失敗時はNULLを返す
+ */
+ATTRIB_MALLOC static inline SYNC_TICKER_DATA* init_sync_ticker(double fps) {
+  return init_sync_ticker_al(fps, SYNC_FPS_DEFAULT_MEMORY_ALLOCATOR, SYNC_FPS_DEFAULT_MEMORY_DEALLOCATOR);
+}
+
+/**
+ * @brief ティック毎に呼ばれるコールバックを登録
+ * @param[in,out] data init_sync_ticker関数の返り値
+ * @param[in] callback ティック毎に呼ぶコールバック関数
+ * @param[in] context callbackに渡すユーザーデータ
+ * @return SYNC_TICKER_HANDLE 成功時登録識別子、失敗時SYNC_TICKER_INVALID_HANDLE
+ * @note - dataがNULLの場合は失敗する
+ * @note - callbackがNULLの場合は失敗する
+ * @note - コールバック内から呼び出してもよい
+ */
+SYNC_TICKER_HANDLE add_sync_ticker_callback(SYNC_TICKER_DATA* data, sync_ticker_callback_t callback, void* context);
+
+/**
+ * @brief 登録済みコールバックを解除
+ * @param[in,out] data init_sync_ticker関数の返り値
+ * @param[in] handle add_sync_ticker_callback関数の返り値
+ * @return bool 成功時true、失敗時false
+ * @note - 本関数がリターンした後、該当コールバックが呼ばれることはない
+ * @note - 別スレッドから呼び出した場合、コールバックの実行中であればその完了まで待機する
+ * @note - dataがNULLの場合は失敗する
+ * @note - handleに対応するコールバックが存在しない、またはコールバックがfalseを返して解除済みの場合は失敗する
+ * @note - コールバック内から呼び出してもよい
+ */
+bool remove_sync_ticker_callback(SYNC_TICKER_DATA* data, SYNC_TICKER_HANDLE handle);
+
+/**
+ * @brief 現在のティック数を取得
+ * @param[in] data init_sync_ticker関数の返り値
+ * @return uint64_t ティッカー開始からのティック数
+ * @note - dataがNULLの場合は0を返す
+ */
+uint64_t get_sync_ticker_count(const SYNC_TICKER_DATA* data);
+
+/**
+ * @brief ティッカースレッドを停止し、ティッカーを解放
+ * @param[in,out] data init_sync_ticker関数の返り値
+ * @return bool 成功時true、失敗時false
+ * @note - コールバック内から呼び出した場合の処理は未定義
+ * @note - 引数がNULLであった場合は何もせずtrueを返す
+ */
+bool free_sync_ticker(SYNC_TICKER_DATA* data);
+
+#endif  // __SYNCFPS_TICKER_H__
@@ -1,5 +1,9 @@
 ﻿#include "_SyncFPS.h"
 
+#include <math.h>
+
+static void sync_fps_update_clock(SYNC_FPS_DATA_INTERNAL* d);
+
 SYNC_FPS_DATA* init_sync_fps_al(double fps, sync_fps_allocator_t allocator, sync_fps_deallocator_t deallocator) {
   if (fps <= 0.0 || allocator == NULL || deallocator == NULL) {
     return NULL;
@@ -18,6 +22,20 @@ SYNC_FPS_DATA* init_sync_fps_al(double fps, sync_fps_allocator_t allocator, sync
   QueryPerformanceCounter(&(ret->timerStart));
   InitializeCriticalSection(&(ret->mutex));
 
+  // タイマーの作成に失敗した場合はSleepによる待機にフォールバックするため、エラーとはしない
+  ret->timer = sync_fps_create_timer(&(ret->highResolution));
+
+  // Sleepで待機する場合に限り、システム全体のタイマー分解能の変更を毎フレームではなく生存期間中に一度だけ行う
+  if (!(ret->highResolution)) {
+    timeBeginPeriod(1);
+  }
+
+  ret->clock = NULL;
+  ret->clockContext = NULL;
+  ret->maxCorrection = 0.0;
+  ret->clockAnchored = false;
+  ret->correction = 0.0;
+
   ret->allocator = allocator;
   ret->deallocator = deallocator;
 
@@ -40,27 +58,111 @@ bool wait_sync_fps(SYNC_FPS_DATA* data) {
   LARGE_INTEGER t;
   QueryPerformanceCounter(&t);
   double time = (double)(t.QuadPart - (d->timerStart).QuadPart) / (double)((d->timerFreq).QuadPart);
-  if (time < d->period) {
-    DWORD sleepTime = (DWORD)((d->period - time) * 1000);
-    timeBeginPeriod(1);
-    Sleep(sleepTime);
-    timeEndPeriod(1);
+  double period = d->period - d->correction;
+  if (time < period) {
+    if (d->highResolution) {
+      // 高分解能タイマーであればシステム全体のタイマー分解能を変更せずに済む
+      LARGE_INTEGER due = {.QuadPart = -(LONGLONG)((period - time) * 10000000.0)};
+      SetWaitableTimer(d->timer, &due, 0, NULL, NULL, FALSE);
+      WaitForSingleObject(d->timer, INFINITE);
+    } else {
+      DWORD sleepTime = (DWORD)((period - time) * 1000);
+      Sleep(sleepTime);
+    }
   }
   QueryPerformanceCounter(&(d->timerStart));
+  sync_fps_update_clock(d);
 
   LeaveCriticalSection(&(d->mutex));
   return true;
 }
 
+bool set_sync_fps_clock(SYNC_FPS_DATA* data, sync_fps_clock_t clock, void* context, double maxCorrection) {
+  if (data == NULL || !(maxCorrection >= 0.0 && maxCorrection < 1.0)) {
+    return false;
+  }
+
+  SYNC_FPS_DATA_INTERNAL* d = (SYNC_FPS_DATA_INTERNAL*)data;
+  EnterCriticalSection(&(d->mutex));
+  d->clock = clock;
+  d->clockContext = context;
+  d->maxCorrection = maxCorrection;
+  d->clockAnchored = false;
+  d->correction = 0.0;
+  LeaveCriticalSection(&(d->mutex));
+  return true;
+}
+
 bool free_sync_fps(SYNC_FPS_DATA* data) {
   if (data == NULL) {
     return true;
   }
 
   SYNC_FPS_DATA_INTERNAL* d = (SYNC_FPS_DATA_INTERNAL*)data;
+  if (d->timer != NULL) {
+    CloseHandle(d->timer);
+    d->timer = NULL;
+  }
+  if (!(d->highResolution)) {
+    timeEndPeriod(1);
+  }
   DeleteCriticalSection(&(d->mutex));
   SecureZeroMemory(&(d->mutex), sizeof(CRITICAL_SECTION));
 
   d->deallocator(data);
   return true;
 }
+
+HANDLE sync_fps_create_timer(bool* highResolution) {
+  assert(highResolution != NULL);
+
+  // CREATE_WAITABLE_TIMER_HIGH_RESOLUTIONはWindows 10 1803以降でのみ有効であり、
+  // それ以前の環境では通常のWaitableTimerにフォールバックする
+  HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+  if (timer != NULL) {
+    *highResolution = true;
+    return timer;
+  }
+
+  *highResolution = false;
+  return CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+}
+
+/**************************************************************************************************/
+
+static void sync_fps_update_clock(SYNC_FPS_DATA_INTERNAL* d) {
+  assert(d != NULL);
+
+  if (d->clock == NULL) {
+    return;
+  }
+
+  double now = d->clock(d->clockContext);
+  if (now < 0.0) {
+    d->clockAnchored = false;
+    d->correction = 0.0;
+    return;
+  }
+  if (!(d->clockAnchored)) {
+    d->clockAnchored = true;
+    d->clockOrigin = now;
+    d->clockFrames = 0;
+    d->correction = 0.0;
+    return;
+  }
+
+  // 外部時計が進んでいる（errorが正）場合は次のフレームを短くし、遅れている場合は長くする
+  d->clockFrames++;
+  double error = now - (d->clockOrigin + (double)(d->clockFrames) * d->period);
+  if (fabs(error) > SYNC_FPS_CLOCK_RESYNC_THRESHOLD) {
+    d->clockOrigin = now;
+    d->clockFrames = 0;
+    d->correction = 0.0;
+    return;
+  }
+
+  // 補正量を制限し、一度に大きく補正してフレーム間隔が揺れることを防ぐ
+  double limit = d->maxCorrection * d->period;
+  double correction = error * SYNC_FPS_CLOCK_GAIN;
+  d->correction = (correction > limit ? limit : (correction < -limit ? -limit : correction));
+}
@@ -0,0 +1,270 @@
+﻿#include "_SyncFPS.h"
+#include "_Ticker.h"
+
+#include <process.h>
+
+static void sync_ticker_arm(SYNC_TICKER_DATA_INTERNAL* d, LONGLONG deadline);
+static void sync_ticker_dispatch(SYNC_TICKER_DATA_INTERNAL* d, uint64_t tick);
+static void sync_ticker_sweep(SYNC_TICKER_DATA_INTERNAL* d);
+static bool sync_ticker_idle(SYNC_TICKER_DATA_INTERNAL* d);
+static unsigned __stdcall sync_ticker_thread(void* pargs);
+
+SYNC_TICKER_DATA* init_sync_ticker_al(double fps, sync_fps_allocator_t allocator, sync_fps_deallocator_t deallocator) {
+  if (fps <= 0.0 || allocator == NULL || deallocator == NULL) {
+    return NULL;
+  }
+
+  SYNC_TICKER_DATA_INTERNAL* ret = (SYNC_TICKER_DATA_INTERNAL*)allocator(sizeof(SYNC_TICKER_DATA_INTERNAL));
+  if (ret == NULL) {
+    return NULL;
+  }
+  SecureZeroMemory(ret, sizeof(SYNC_TICKER_DATA_INTERNAL));
+
+  QueryPerformanceFrequency(&(ret->timerFreq));
+  ret->period = (LONGLONG)((double)((ret->timerFreq).QuadPart) / fps);
+  if (ret->period <= 0) {
+    ret->period = 1;
+  }
+  atomic_init(&(ret->tick), 0);
+  ret->nextHandle = SYNC_TICKER_INVALID_HANDLE + 1;
+  ret->callbacks = NULL;
+  ret->allocator = allocator;
+  ret->deallocator = deallocator;
+  InitializeCriticalSection(&(ret->mutex));
+
+  ret->timer = sync_fps_create_timer(&(ret->highResolution));
+  if (ret->timer == NULL) {
+    DeleteCriticalSection(&(ret->mutex));
+    deallocator(ret);
+    return NULL;
+  }
+
+  ret->stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+  ret->wakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+  if (ret->stopEvent == NULL || ret->wakeEvent == NULL) {
+    if (ret->stopEvent != NULL) {
+      CloseHandle(ret->stopEvent);
+    }
+    if (ret->wakeEvent != NULL) {
+      CloseHandle(ret->wakeEvent);
+    }
+    CloseHandle(ret->timer);
+    DeleteCriticalSection(&(ret->mutex));
+    deallocator(ret);
+    return NULL;
+  }
+
+  // 高分解能タイマーが使えない場合のみ、フレーム毎ではなくティッカーの生存期間中一度だけ分解能を変更する
+  if (!ret->highResolution) {
+    timeBeginPeriod(1);
+  }
+
+  ret->hthread = (HANDLE)_beginthreadex(NULL, 0, sync_ticker_thread, ret, 0, NULL);
+  if (ret->hthread == (HANDLE)0) {
+    if (!ret->highResolution) {
+      timeEndPeriod(1);
+    }
+    CloseHandle(ret->wakeEvent);
+    CloseHandle(ret->stopEvent);
+    CloseHandle(ret->timer);
+    DeleteCriticalSection(&(ret->mutex));
+    deallocator(ret);
+    return NULL;
+  }
+
+  return (SYNC_TICKER_DATA*)ret;
+}
+
+SYNC_TICKER_HANDLE add_sync_ticker_callback(SYNC_TICKER_DATA* data, sync_ticker_callback_t callback, void* context) {
+  if (data == NULL || callback == NULL) {
+    return SYNC_TICKER_INVALID_HANDLE;
+  }
+
+  SYNC_TICKER_DATA_INTERNAL* d = (SYNC_TICKER_DATA_INTERNAL*)data;
+  SYNC_TICKER_CALLBACK_ENTRY* entry = (SYNC_TICKER_CALLBACK_ENTRY*)d->allocator(sizeof(SYNC_TICKER_CALLBACK_ENTRY));
+  if (entry == NULL) {
+    return SYNC_TICKER_INVALID_HANDLE;
+  }
+  entry->callback = callback;
+  entry->context = context;
+
+  EnterCriticalSection(&(d->mutex));
+  entry->handle = d->nextHandle++;
+  if (d->nextHandle == SYNC_TICKER_INVALID_HANDLE) {
+    d->nextHandle++;
+  }
+  entry->next = d->callbacks;
+  d->callbacks = entry;
+  SYNC_TICKER_HANDLE handle = entry->handle;
+  LeaveCriticalSection(&(d->mutex));
+  SetEvent(d->wakeEvent);
+
+  return handle;
+}
+
+bool remove_sync_ticker_callback(SYNC_TICKER_DATA* data, SYNC_TICKER_HANDLE handle) {
+  if (data == NULL || handle == SYNC_TICKER_INVALID_HANDLE) {
+    return false;
+  }
+
+  SYNC_TICKER_DATA_INTERNAL* d = (SYNC_TICKER_DATA_INTERNAL*)data;
+  bool found = false;
+
+  // ディスパッチ中はmutexを保持しているため、別スレッドからの解除はディスパッチ完了まで待機する
+  // ティッカースレッド自身からの解除（コールバック内）ではリストを辿っている最中の可能性があるため、
+  // ここではcallbackをNULLにするのみとし、実際の解放は次回ディスパッチ前に行う
+  EnterCriticalSection(&(d->mutex));
+  for (SYNC_TICKER_CALLBACK_ENTRY* entry = d->callbacks; entry != NULL; entry = entry->next) {
+    if (entry->handle == handle && entry->callback != NULL) {
+      entry->callback = NULL;
+      found = true;
+      break;
+    }
+  }
+  LeaveCriticalSection(&(d->mutex));
+
+  return found;
+}
+
+uint64_t get_sync_ticker_count(const SYNC_TICKER_DATA* data) {
+  if (data == NULL) {
+    return 0;
+  }
+
+  const SYNC_TICKER_DATA_INTERNAL* d = (const SYNC_TICKER_DATA_INTERNAL*)data;
+  return atomic_load(&(d->tick));
+}
+
+bool free_sync_ticker(SYNC_TICKER_DATA* data) {
+  if (data == NULL) {
+    return true;
+  }
+
+  SYNC_TICKER_DATA_INTERNAL* d = (SYNC_TICKER_DATA_INTERNAL*)data;
+
+  SetEvent(d->stopEvent);
+  if (WaitForSingleObject(d->hthread, INFINITE) != WAIT_OBJECT_0) {
+    return false;
+  }
+  CloseHandle(d->hthread);
+  CloseHandle(d->wakeEvent);
+  CloseHandle(d->stopEvent);
+  CancelWaitableTimer(d->timer);
+  CloseHandle(d->timer);
+  if (!d->highResolution) {
+    timeEndPeriod(1);
+  }
+
+  SYNC_TICKER_CALLBACK_ENTRY* entry = d->callbacks;
+  while (entry != NULL) {
+    SYNC_TICKER_CALLBACK_ENTRY* temp = entry->next;
+    d->deallocator(entry);
+    entry = temp;
+  }
+  d->callbacks = NULL;
+
+  DeleteCriticalSection(&(d->mutex));
+  SecureZeroMemory(&(d->mutex), sizeof(CRITICAL_SECTION));
+
+  d->deallocator(data);
+  return true;
+}
+
+/**************************************************************************************************/
+
+static void sync_ticker_arm(SYNC_TICKER_DATA_INTERNAL* d, LONGLONG deadline) {
+  assert(d != NULL);
+
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+
+  // SetWaitableTimerの相対時間は100ns単位の負数で指定する
+  LARGE_INTEGER due;
+  LONGLONG remain = deadline - now.QuadPart;
+  due.QuadPart = -(remain > 0 ? (remain * 10000000) / (d->timerFreq).QuadPart : 0);
+  if (due.QuadPart == 0) {
+    due.QuadPart = -1;
+  }
+  SetWaitableTimer(d->timer, &due, 0, NULL, NULL, FALSE);
+}
+
+static void sync_ticker_dispatch(SYNC_TICKER_DATA_INTERNAL* d, uint64_t tick) {
+  assert(d != NULL);
+
+  EnterCriticalSection(&(d->mutex));
+  sync_ticker_sweep(d);
+  for (SYNC_TICKER_CALLBACK_ENTRY* entry = d->callbacks; entry != NULL; entry = entry->next) {
+    // コールバック内で解除された場合に備え、呼び出し直前にNULLチェックする
+    sync_ticker_callback_t callback = entry->callback;
+    if (callback != NULL && !callback(entry->context, tick)) {
+      entry->callback = NULL;
+    }
+  }
+  LeaveCriticalSection(&(d->mutex));
+}
+
+static void sync_ticker_sweep(SYNC_TICKER_DATA_INTERNAL* d) {
+  assert(d != NULL);
+
+  SYNC_TICKER_CALLBACK_ENTRY** pentry = &(d->callbacks);
+  while (*pentry != NULL) {
+    SYNC_TICKER_CALLBACK_ENTRY* entry = *pentry;
+    if (entry->callback == NULL) {
+      *pentry = entry->next;
+      d->deallocator(entry);
+    } else {
+      pentry = &(entry->next);
+    }
+  }
+}
+
+static bool sync_ticker_idle(SYNC_TICKER_DATA_INTERNAL* d) {
+  assert(d != NULL);
+
+  EnterCriticalSection(&(d->mutex));
+  sync_ticker_sweep(d);
+  bool ret = (d->callbacks == NULL);
+  LeaveCriticalSection(&(d->mutex));
+  return ret;
+}
+
+static unsigned __stdcall sync_ticker_thread(void* pargs) {
+  SYNC_TICKER_DATA_INTERNAL* d = (SYNC_TICKER_DATA_INTERNAL*)pargs;
+  HANDLE handles[2] = {d->stopEvent, d->timer};
+  HANDLE idleHandles[2] = {d->stopEvent, d->wakeEvent};
+
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  LONGLONG deadline = now.QuadPart + d->period;
+
+  while (true) {
+    // 登録が無い間は周期的に起床せず、登録されてから1周期後を次の期限とする
+    if (sync_ticker_idle(d)) {
+      if (WaitForMultipleObjects(2, idleHandles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+        break;
+      }
+      QueryPerformanceCounter(&now);
+      deadline = now.QuadPart + d->period;
+      continue;
+    }
+
+    sync_ticker_arm(d, deadline);
+    if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+      break;
+    }
+
+    sync_ticker_dispatch(d, atomic_fetch_add(&(d->tick), 1) + 1);
+
+    // 期限は開始時刻からの周期の整数倍で管理し、誤差を累積させない
+    // コールバックが周期を超えて処理落ちした場合は、遅れたティックをまとめて飛ばす
+    deadline += d->period;
+    QueryPerformanceCounter(&now);
+    if (deadline <= now.QuadPart) {
+      deadline += ((now.QuadPart - deadline) / d->period + 1) * d->period;
+    }
+  }
+
+  return 0;
+}
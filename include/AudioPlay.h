@@ -11,4 +11,12 @@
 
 static int32_t (*const TimerWaitSync)(void) = (int32_t(*const)(void))0x482b50;
 
+/**
+ * @brief ログの初期化およびBGMの再生を開始
+ * @note - DllMainでは何も開始しないため、ホストはプラグインの読み込み後（ローダーロックの外）に一度呼び出す必要がある
+ * @note - 初期化は初回の呼び出し時に作成する専用のスレッドで行い、呼び出し元のスレッドでは待機しない
+ * @note - 二回目以降の呼び出しは何もしない（スレッドの作成に失敗した場合は再度呼び出せる）
+ */
+__declspec(dllexport) void audioplay_start(void);
+
 #endif  // __AUDIOPLAY_H__
@@ -13,22 +13,17 @@ void init_log(void) {
   SetConsoleOutputCP(CP_UTF8);
   UNUSED(freopen_s(&fp, "CONOUT$", "w", stdout));
   UNUSED(freopen_s(&fp, "CONOUT$", "w", stderr));
+
+  // コールバックはゲームのメッセージスレッドで呼ばれるため、コンソールへの書き込みはログのスレッドに任せる
+  mcim_set_log_output(GetStdHandle(STD_OUTPUT_HANDLE), MCIM_LOG_DEBUG);
 }
 
 void MCIM_CALLBACK(MCIM_NOTIFY_FLAGS flag) {
-  printf("MCIM_CALLBACK: flag = %d\n", flag);
+  mcim_log(MCIM_LOG_INFO, "MCIM_CALLBACK", "flag", flag, NULL, 0);
 }
 
 void MCIM_FADEOUT_CALLBACK(MCIM_NOTIFY_FLAGS flag) {
-  printf("MCIM_FADEOUT_CALLBACK: flag = %d\n", flag);
-}
-
-void MCIM_WAIT(void) {
-  static SYNC_FPS_DATA* fps = NULL;
-  if (fps == NULL) {
-    fps = init_sync_fps(60.0);
-  }
-  wait_sync_fps(fps);
+  mcim_log(MCIM_LOG_INFO, "MCIM_FADEOUT_CALLBACK", "flag", flag, NULL, 0);
 }
 
 void func(void* pargs) {
@@ -46,7 +41,7 @@ void func(void* pargs) {
     QueryPerformanceCounter(&mTimeEnd);
     // mFrameTime = フレームごとの間隔（単位：秒）
     double mFrameTime = (double)(mTimeEnd.QuadPart - mTimeStart.QuadPart) / (double)(mTimeFreq.QuadPart);
-    printf("T = %.15f, FPS = %f\n", mFrameTime, 1.0 / mFrameTime);
+    mcim_log(MCIM_LOG_DEBUG, "frame", "us", (int64_t)(mFrameTime * 1e6), "mfps", (int64_t)(1e3 / mFrameTime));
   }
 
   free_sync_fps(fps);
@@ -57,34 +52,53 @@ void test_mcim(void* pargs) {
 
   MCIM_DATA* mcim = mcim_init(win_get_window());
   if (mcim == NULL) {
-    printf("mcim_init => NULL\n");
+    mcim_log(MCIM_LOG_ERROR, "mcim_init => NULL", NULL, 0, NULL, 0);
     return;
   }
   MCIM_KEY key = mcim_load(mcim, TEST_MUSIC_PATH);
   if (key == MCIM_INVALID_KEY) {
-    printf("mcim_load => MCIM_INVALID_KEY\n");
+    mcim_log(MCIM_LOG_ERROR, "mcim_load => MCIM_INVALID_KEY", NULL, 0, NULL, 0);
     return;
   }
   if (!mcim_play(mcim, key, MCIM_CALLBACK)) {
-    printf("mcim_play => false\n");
+    mcim_log(MCIM_LOG_ERROR, "mcim_play => false", NULL, 0, NULL, 0);
     return;
   }
   /*
-  if (mcim_fadeout(mcim, key, NULL, 300, MCIM_FADEOUT_CALLBACK) == MCIM_INVALID_KEY) {
-    printf("mcim_fadeout => MCIM_INVALID_KEY\n");
+  if (mcim_fadeout(mcim, key, 60.0, 300, MCIM_FADEOUT_CALLBACK) == MCIM_INVALID_KEY) {
+    mcim_log(MCIM_LOG_ERROR, "mcim_fadeout => MCIM_INVALID_KEY", NULL, 0, NULL, 0);
     return;
   }
   */
 }
 
+void audioplay_startup(void* pargs) {
+  UNUSED(pargs);
+
+  init_log();
+  test_mcim(NULL);
+}
+
+void audioplay_start(void) {
+  static volatile LONG started = 0;
+  if (InterlockedCompareExchange(&started, 1, 0) != 0) {
+    return;
+  }
+
+  // 呼び出し元を待たせないよう、コンソールの作成とBGMの再生は専用のスレッドで行う
+  if (_beginthread(audioplay_startup, 0, NULL) == (uintptr_t)-1L) {
+    InterlockedExchange(&started, 0);
+  }
+  //_beginthread(func, 0, NULL);
+}
+
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpReserved) {
   UNUSED(hinstDLL);
   UNUSED(lpReserved);
   switch (fdwReason) {
     case DLL_PROCESS_ATTACH:
-      init_log();
-      _beginthread(test_mcim, 0, NULL);
-      //_beginthread(func, 0, NULL);
+      // ローダーロック中はスレッドもコンソールも作成せず、ホストからのaudioplay_startの初回呼び出しまで開始を遅延する
+      // 静的リンクしたCRTはDLL_THREAD_ATTACH/DETACHでスレッド毎のデータを管理するため、DisableThreadLibraryCallsは呼ばない
       break;
     default:
       break;
@@ -0,0 +1,149 @@
+﻿#include "MCIManager/MCIManager.h"
+#include "TestCommon.h"
+
+#include <wchar.h>
+
+// 1分間のステレオ16bit PCM（デコード後は約21MB）
+#define BENCH_SECONDS 60
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_DECODE_RUNS 5
+#define BENCH_WARM_RUNS 20
+
+static double bench_load(MCIM_DATA* data, const wchar_t* path);
+static bool bench_corrupt_cache(const wchar_t* directory);
+static void bench_remove_cache(const wchar_t* directory);
+
+int main(void) {
+  wchar_t path[MAX_PATH];
+  wchar_t directory[MAX_PATH];
+  if (!test_check(test_temp_path(path), "create temporary file") ||
+      !test_check(test_save_pcm16(path, BENCH_SECONDS * BENCH_SAMPLE_RATE, 2, BENCH_SAMPLE_RATE), "save source wave") ||
+      !test_check(swprintf(directory, MAX_PATH, L"%ls.cache", path) > 0, "cache directory name")) {
+    return 1;
+  }
+
+  MCIM_DATA* data = mcim_init_offline(60.0);
+  bool ok = test_check(data != NULL, "mcim_init_offline");
+  double decode[BENCH_DECODE_RUNS];
+  double warm[BENCH_WARM_RUNS];
+  double store = 0.0;
+  double verify = 0.0;
+
+  // キャッシュを使用しない場合の、ファイルの読み込みとデコードに要する時間
+  for (uint32_t i = 0; ok && i < BENCH_DECODE_RUNS; i++) {
+    decode[i] = bench_load(data, path);
+    ok = test_check(decode[i] >= 0.0, "load without cache");
+  }
+
+  MCIM_CACHE_STATS before;
+  ok = ok && test_check(mcim_set_cache_directory(directory), "mcim_set_cache_directory") && test_check(mcim_get_cache_stats(&before), "mcim_get_cache_stats");
+
+  // 初回はデコードしてキャッシュを作成し、2回目はPCMの破損を検出して作り直す必要がある
+  if (ok) {
+    store = bench_load(data, path);
+    ok = test_check(store >= 0.0, "first load with cache") && test_check(bench_corrupt_cache(directory), "corrupt cached PCM") &&
+         test_check(bench_load(data, path) >= 0.0, "load after corruption");
+  }
+
+  // 作り直した後の最初のロードでPCM全体を検証し、以後は検証せずにメモリマップする
+  if (ok) {
+    verify = bench_load(data, path);
+    ok = test_check(verify >= 0.0, "first map after store");
+  }
+  for (uint32_t i = 0; ok && i < BENCH_WARM_RUNS; i++) {
+    warm[i] = bench_load(data, path);
+    ok = test_check(warm[i] >= 0.0, "warm load");
+  }
+
+  MCIM_CACHE_STATS after;
+  if (ok && test_check(mcim_get_cache_stats(&after), "mcim_get_cache_stats")) {
+    const uint32_t hits = after.hits - before.hits;
+    const uint32_t misses = after.misses - before.misses;
+    const uint32_t invalidated = after.invalidated - before.invalidated;
+    const double decodeMedian = test_percentile(decode, BENCH_DECODE_RUNS, 50.0);
+    const double warmMedian = test_percentile(warm, BENCH_WARM_RUNS, 50.0);
+    printf("warm start: %d s stereo 16-bit PCM\n", BENCH_SECONDS);
+    printf("decode without cache:   median %.2f ms\n", decodeMedian * 1.0e3);
+    printf("decode + store:         %.2f ms\n", store * 1.0e3);
+    printf("first map (verify):     %.2f ms\n", verify * 1.0e3);
+    printf("warm map:               median %.3f ms, p99 %.3f ms (x%.0f faster than decode)\n",
+           warmMedian * 1.0e3,
+           test_percentile(warm, BENCH_WARM_RUNS, 99.0) * 1.0e3,
+           decodeMedian / warmMedian);
+    printf("cache stats: %u hits, %u misses, %u invalidated\n", hits, misses, invalidated);
+    ok = test_check(misses == 2 && invalidated == 1, "corrupted PCM is detected and rebuilt") &&
+         test_check(hits == BENCH_WARM_RUNS + 1, "every later load maps the cache");
+  }
+
+  mcim_set_cache_directory(NULL);
+  if (data != NULL) {
+    ok = test_check(mcim_exit(data), "mcim_exit") && ok;
+  }
+  bench_remove_cache(directory);
+  DeleteFileW(path);
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static double bench_load(MCIM_DATA* data, const wchar_t* path) {
+  const double begin = test_now();
+  const MCIM_KEY key = mcim_load(data, path);
+  const double elapsed = test_now() - begin;
+  if (key == MCIM_INVALID_KEY || !mcim_unload(data, key)) {
+    return -1.0;
+  }
+  return elapsed;
+}
+
+static bool bench_corrupt_cache(const wchar_t* directory) {
+  // ディレクトリにはこのベンチマークが作成したキャッシュファイルのみが存在する
+  wchar_t pattern[MAX_PATH];
+  wchar_t filename[MAX_PATH];
+  WIN32_FIND_DATAW find;
+  swprintf(pattern, MAX_PATH, L"%ls\\*.mcimcache", directory);
+  HANDLE hfind = FindFirstFileW(pattern, &find);
+  if (hfind == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  swprintf(filename, MAX_PATH, L"%ls\\%ls", directory, find.cFileName);
+  FindClose(hfind);
+
+  // PCMの末尾の1バイトを反転させる（ヘッダのチェックサムやファイルサイズでは検出できない）
+  HANDLE hfile = CreateFileW(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hfile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  uint8_t value = 0;
+  DWORD transferred = 0;
+  OVERLAPPED overlapped = {0};
+  bool ret = GetFileSizeEx(hfile, &size) != 0 && size.QuadPart > 0;
+  if (ret) {
+    overlapped.Offset = (DWORD)(size.QuadPart - 1);
+    overlapped.OffsetHigh = (DWORD)((uint64_t)(size.QuadPart - 1) >> 32);
+    ret = ReadFile(hfile, &value, 1, &transferred, &overlapped) != 0 && transferred == 1;
+  }
+  if (ret) {
+    value ^= 0xFF;
+    ret = WriteFile(hfile, &value, 1, &transferred, &overlapped) != 0 && transferred == 1;
+  }
+  CloseHandle(hfile);
+  return ret;
+}
+
+static void bench_remove_cache(const wchar_t* directory) {
+  wchar_t pattern[MAX_PATH];
+  wchar_t filename[MAX_PATH];
+  WIN32_FIND_DATAW find;
+  swprintf(pattern, MAX_PATH, L"%ls\\*.mcimcache*", directory);
+  HANDLE hfind = FindFirstFileW(pattern, &find);
+  if (hfind != INVALID_HANDLE_VALUE) {
+    do {
+      swprintf(filename, MAX_PATH, L"%ls\\%ls", directory, find.cFileName);
+      DeleteFileW(filename);
+    } while (FindNextFileW(hfind, &find) != 0);
+    FindClose(hfind);
+  }
+  RemoveDirectoryW(directory);
+}
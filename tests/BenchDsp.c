@@ -0,0 +1,127 @@
+﻿#include "TestCommon.h"
+#include "TestKernels.h"
+#include "_MCIMDsp.h"
+#include "_MCIMMixer.h"
+
+// レンダリングと同じブロック長で、インサートエフェクトのチェーン全体を処理する
+#define BENCH_FRAMES MCIM_MIXER_BLOCK_FRAMES
+#define BENCH_BLOCKS 20000
+
+// 入力は複数ブロック分の雑音を順に使い、リミッターが常に働くよう上限を超える振幅とする
+#define BENCH_SOURCE_BLOCKS 16
+#define BENCH_AMPLITUDE 2.0f
+#define BENCH_CEILING_DB -1.0f
+
+typedef struct _BENCH_CHAIN {
+  const char* name;
+  bool eq;
+  bool limiter;
+} BENCH_CHAIN;
+
+static const BENCH_CHAIN BENCH_CHAINS[] = {
+    {"eq (4 bands)", true, false},
+    {"limiter", false, true},
+    {"eq + limiter", true, true},
+};
+
+static float BENCH_SOURCE[BENCH_FRAMES * 2 * BENCH_SOURCE_BLOCKS];
+
+static bool bench_run(const MCIM_KERNELS* kernels, const BENCH_CHAIN* chain, double* cost, float* peak);
+
+int main(void) {
+  static double cost[BENCH_BLOCKS];
+  const MCIM_KERNELS* tables[TEST_KERNEL_TABLES_MAX];
+  const uint32_t count = test_kernel_tables(tables);
+  const double blockSeconds = (double)BENCH_FRAMES / (double)MCIM_MIXER_SAMPLE_RATE;
+  const float ceiling = powf(10.0f, BENCH_CEILING_DB / 20.0f);
+
+  uint32_t seed = 0x2545f491u;
+  test_fill_random(BENCH_SOURCE, BENCH_FRAMES * 2 * BENCH_SOURCE_BLOCKS, BENCH_AMPLITUDE, &seed);
+
+  printf("dsp chain: %u-frame blocks at %u Hz, %u blocks per case (budget %.1f us per block)\n",
+         BENCH_FRAMES,
+         MCIM_MIXER_SAMPLE_RATE,
+         BENCH_BLOCKS,
+         blockSeconds * 1.0e6);
+  bool ok = true;
+  for (size_t c = 0; ok && c < sizeof(BENCH_CHAINS) / sizeof(BENCH_CHAINS[0]); c++) {
+    const BENCH_CHAIN* chain = &(BENCH_CHAINS[c]);
+    for (uint32_t t = 0; ok && t < count; t++) {
+      float peak = 0.0f;
+      ok = test_check(bench_run(tables[t], chain, cost, &peak), "create insert effects");
+      if (!ok) {
+        break;
+      }
+      const double p50 = test_percentile(cost, BENCH_BLOCKS, 50.0);
+      const double p99 = test_percentile(cost, BENCH_BLOCKS, 99.0);
+      printf("%-14s %-8s block p50 %6.2f us, p99 %6.2f us, max %7.2f us; %5.1f ns per frame, %.2f%% of budget at p99\n",
+             chain->name,
+             tables[t]->name,
+             p50 * 1.0e6,
+             p99 * 1.0e6,
+             test_percentile(cost, BENCH_BLOCKS, 100.0) * 1.0e6,
+             p50 / (double)BENCH_FRAMES * 1.0e9,
+             p99 / blockSeconds * 100.0);
+
+      // 処理結果が発散していないこと、リミッターが上限を守っていることも確かめる
+      ok = test_check(isfinite(peak), "effect output is finite") &&
+           test_check(!chain->limiter || peak <= ceiling * 1.001f, "limiter keeps the output under the ceiling") &&
+           test_check(p99 < blockSeconds, "effect chain fits in the block budget at p99");
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static bool bench_run(const MCIM_KERNELS* kernels, const BENCH_CHAIN* chain, double* cost, float* peak) {
+  static float buffer[BENCH_FRAMES * 2];
+
+  // 帯域毎に異なる特性の区間を全て使い、イコライザの縦続接続を最大段数で処理する
+  const MCIM_EQ_PARAMS eq = {
+      .bandCount = MCIM_EQ_MAX_BANDS,
+      .bands =
+          {
+              {.filter = MCIM_EQ_HIGHPASS, .frequency = 40.0f, .q = 0.707f},
+              {.filter = MCIM_EQ_LOWSHELF, .frequency = 200.0f, .q = 0.707f, .gain = 3.0f},
+              {.filter = MCIM_EQ_PEAKING, .frequency = 2500.0f, .q = 1.4f, .gain = -4.0f},
+              {.filter = MCIM_EQ_HIGHSHELF, .frequency = 8000.0f, .q = 0.707f, .gain = 2.0f},
+          },
+  };
+  const MCIM_LIMITER_PARAMS limiter = {.ceiling = BENCH_CEILING_DB, .lookahead = 5.0f, .release = 50.0f};
+
+  MCIM_DSP_CHAIN effects;
+  MCIM_DSP_EFFECT* created[2] = {NULL, NULL};
+  uint32_t count = 0;
+  if (chain->eq) {
+    created[count++] = mcim_dsp_create_eq(&eq, MCIM_MIXER_SAMPLE_RATE, malloc);
+  }
+  if (chain->limiter) {
+    created[count++] = mcim_dsp_create_limiter(&limiter, MCIM_MIXER_SAMPLE_RATE, malloc);
+  }
+  bool ok = true;
+  for (uint32_t i = 0; i < MCIM_DSP_MAX_EFFECTS; i++) {
+    atomic_init(&(effects.effects[i]), (i < count ? created[i] : NULL));
+    ok = ok && (i >= count || created[i] != NULL);
+  }
+  atomic_init(&(effects.count), count);
+
+  // 先読み区間の遅延が抜けるまでは計測せずに処理し、以降の出力のピークを求める
+  *peak = 0.0f;
+  for (uint32_t b = 0; ok && b < BENCH_SOURCE_BLOCKS + BENCH_BLOCKS; b++) {
+    memcpy(buffer, BENCH_SOURCE + (size_t)(b % BENCH_SOURCE_BLOCKS) * BENCH_FRAMES * 2, sizeof(buffer));
+    const double begin = test_now();
+    mcim_dsp_process(&effects, kernels, buffer, BENCH_FRAMES);
+    const double elapsed = test_now() - begin;
+    if (b >= BENCH_SOURCE_BLOCKS) {
+      cost[b - BENCH_SOURCE_BLOCKS] = elapsed;
+      const float blockPeak = kernels->peak(buffer, BENCH_FRAMES * 2);
+      *peak = (blockPeak > *peak || isnan(blockPeak) ? blockPeak : *peak);
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    free(created[i]);
+  }
+  return ok;
+}
@@ -0,0 +1,171 @@
+﻿#include "TestCommon.h"
+#include "TestKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+// ミキサーのブロック長と同じ長さの入力を繰り返し処理する
+#define BENCH_FRAMES 256
+#define BENCH_FFT_SIZE 1024
+#define BENCH_SECONDS 0.2
+
+typedef struct _BENCH_BUFFERS {
+  float dst[BENCH_FRAMES * 2];
+  float src[BENCH_FRAMES * 4];
+  int16_t s16[BENCH_FRAMES * 2];
+  float fftRe[BENCH_FFT_SIZE];
+  float fftIm[BENCH_FFT_SIZE];
+  float twRe[BENCH_FFT_SIZE];  // 段毎の回転因子（幅halfの段はhalf - 1から）
+  float twIm[BENCH_FFT_SIZE];
+  float sink;
+} BENCH_BUFFERS;
+
+typedef struct _BENCH_KERNEL {
+  const char* name;
+  uint32_t frames;  // 1回の呼び出しで処理するフレーム数（FFTは点数）
+  void (*run)(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+} BENCH_KERNEL;
+
+static BENCH_BUFFERS BENCH_DATA;
+
+static void bench_mix_ramp(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_mix_pan(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_scale_ramp(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_peak(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_biquad(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_dot(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_resample(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_float_to_s16(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_s16_to_float(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static void bench_fft(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers);
+static double bench_measure(const MCIM_KERNELS* kernels, const BENCH_KERNEL* kernel);
+
+static const BENCH_KERNEL BENCH_KERNELS[] = {
+    {"mix_ramp", BENCH_FRAMES, bench_mix_ramp},
+    {"mix_pan", BENCH_FRAMES, bench_mix_pan},
+    {"scale_ramp", BENCH_FRAMES, bench_scale_ramp},
+    {"peak", BENCH_FRAMES, bench_peak},
+    {"biquad", BENCH_FRAMES, bench_biquad},
+    {"dot", BENCH_FRAMES, bench_dot},
+    {"resample", BENCH_FRAMES, bench_resample},
+    {"float_to_s16", BENCH_FRAMES, bench_float_to_s16},
+    {"s16_to_float", BENCH_FRAMES, bench_s16_to_float},
+    {"fft (all passes)", BENCH_FFT_SIZE, bench_fft},
+};
+
+int main(void) {
+  const MCIM_KERNELS* tables[TEST_KERNEL_TABLES_MAX];
+  const uint32_t count = test_kernel_tables(tables);
+
+  uint32_t seed = 0x9e3779b9u;
+  test_fill_random(BENCH_DATA.dst, BENCH_FRAMES * 2, 0.5f, &seed);
+  test_fill_random(BENCH_DATA.src, BENCH_FRAMES * 4, 1.0f, &seed);
+  test_fill_random(BENCH_DATA.fftRe, BENCH_FFT_SIZE, 1.0f, &seed);
+  test_fill_random(BENCH_DATA.fftIm, BENCH_FFT_SIZE, 1.0f, &seed);
+  for (uint32_t i = 0; i < BENCH_FRAMES * 2; i++) {
+    BENCH_DATA.s16[i] = (int16_t)(BENCH_DATA.src[i] * 32767.0f);
+  }
+  for (uint32_t half = 1; half < BENCH_FFT_SIZE; half *= 2) {
+    for (uint32_t k = 0; k < half; k++) {
+      const double angle = -3.14159265358979323846 * (double)k / (double)half;
+      BENCH_DATA.twRe[half - 1 + k] = (float)cos(angle);
+      BENCH_DATA.twIm[half - 1 + k] = (float)sin(angle);
+    }
+  }
+
+  // 1列目は汎用実装に対する速度比
+  printf("%-18s", "Mframes/s");
+  for (uint32_t t = 0; t < count; t++) {
+    printf("%20s", tables[t]->name);
+  }
+  printf("\n");
+  for (size_t k = 0; k < sizeof(BENCH_KERNELS) / sizeof(BENCH_KERNELS[0]); k++) {
+    printf("%-18s", BENCH_KERNELS[k].name);
+    double generic = 0.0;
+    for (uint32_t t = 0; t < count; t++) {
+      const double rate = bench_measure(tables[t], &(BENCH_KERNELS[k]));
+      if (t == 0) {
+        generic = rate;
+        printf("%20.1f", rate * 1.0e-6);
+      } else {
+        printf("%12.1f (x%4.1f)", rate * 1.0e-6, rate / generic);
+      }
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+/**************************************************************************************************/
+
+static void bench_mix_ramp(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  kernels->mix_ramp(buffers->dst, buffers->src, BENCH_FRAMES, 0.5f, -1.0e-4f);
+}
+
+static void bench_mix_pan(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  const float gain[2] = {0.4f, 0.6f};
+  const float gainStep[2] = {1.0e-4f, -1.0e-4f};
+  kernels->mix_pan(buffers->dst, buffers->src, BENCH_FRAMES, gain, gainStep);
+}
+
+static void bench_scale_ramp(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  // 繰り返しても値が減衰して非正規化数にならないよう、ゲインは1とする
+  kernels->scale_ramp(buffers->dst, BENCH_FRAMES, 1.0f, 0.0f);
+}
+
+static void bench_peak(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  buffers->sink += kernels->peak(buffers->src, BENCH_FRAMES * 2);
+}
+
+static void bench_biquad(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  static float state[4];
+  const MCIM_BIQUAD_COEFS coefs = {.b0 = 0.2f, .b1 = 0.4f, .b2 = 0.2f, .a1 = -0.5f, .a2 = 0.1f};
+  memcpy(buffers->dst, buffers->src, sizeof(float) * BENCH_FRAMES * 2);
+  kernels->biquad(buffers->dst, BENCH_FRAMES, &coefs, state);
+}
+
+static void bench_dot(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  buffers->sink += kernels->dot(buffers->src, buffers->dst, BENCH_FRAMES * 2);
+}
+
+static void bench_resample(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  // 48kHzから44.1kHzへの変換に相当する刻み幅
+  const uint64_t step = (uint64_t)(48000.0 / 44100.0 * 4294967296.0);
+  kernels->resample(buffers->dst, buffers->src, 2, 0, step, BENCH_FRAMES);
+}
+
+static void bench_float_to_s16(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  kernels->float_to_s16(buffers->s16, buffers->src, BENCH_FRAMES * 2);
+}
+
+static void bench_s16_to_float(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  kernels->s16_to_float(buffers->dst, buffers->s16, BENCH_FRAMES * 2);
+}
+
+static void bench_fft(const MCIM_KERNELS* kernels, BENCH_BUFFERS* buffers) {
+  // 値が発散しないよう、各回の入力は同じ値から始める
+  memcpy(buffers->fftRe, buffers->src, sizeof(float) * BENCH_FFT_SIZE);
+  memset(buffers->fftIm, 0, sizeof(float) * BENCH_FFT_SIZE);
+  for (uint32_t half = 1; half < BENCH_FFT_SIZE; half *= 2) {
+    const float* twRe = buffers->twRe + half - 1;
+    const float* twIm = buffers->twIm + half - 1;
+    kernels->fft_pass(buffers->fftRe, buffers->fftIm, twRe, twIm, BENCH_FFT_SIZE, half);
+  }
+}
+
+static double bench_measure(const MCIM_KERNELS* kernels, const BENCH_KERNEL* kernel) {
+  // 初回の呼び出しによるキャッシュミスを除くため、一度実行してから計測する
+  kernel->run(kernels, &BENCH_DATA);
+
+  uint64_t calls = 0;
+  const double begin = test_now();
+  double elapsed = 0.0;
+  do {
+    for (uint32_t i = 0; i < 64; i++) {
+      kernel->run(kernels, &BENCH_DATA);
+    }
+    calls += 64;
+    elapsed = test_now() - begin;
+  } while (elapsed < BENCH_SECONDS);
+  return (double)calls * (double)kernel->frames / elapsed;
+}
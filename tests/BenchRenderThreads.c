@@ -0,0 +1,132 @@
+﻿#include "MCIManager/MCIManager.h"
+#include "TestCommon.h"
+
+// 効果音のサンプル毎に出力先のバスを分け、サンプル毎に同じ数のボイスを発音させる
+#define BENCH_SOURCES 4
+#define BENCH_VOICES_PER_SOURCE 16
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_RENDER_SECONDS 10
+#define BENCH_BLOCK_FRAMES 256
+#define BENCH_BLOCKS (BENCH_RENDER_SECONDS * BENCH_SAMPLE_RATE / BENCH_BLOCK_FRAMES)
+#define BENCH_OUTPUT_FRAMES (BENCH_BLOCKS * BENCH_BLOCK_FRAMES)
+
+// 効果音は計測中に鳴り終わらない長さとする
+#define BENCH_SOURCE_FRAMES ((BENCH_RENDER_SECONDS + 2) * BENCH_SAMPLE_RATE)
+
+// 全ボイスを足しても飽和しない振幅
+#define BENCH_AMPLITUDE 0.01f
+
+// レンダリングを分担するスレッドの数（0はレンダリングスレッドのみ）
+static const uint32_t BENCH_THREADS[] = {0, 1, 3, 7, 15};
+#define BENCH_THREAD_CASES (sizeof(BENCH_THREADS) / sizeof(BENCH_THREADS[0]))
+
+typedef struct _BENCH_RESULT {
+  double mean;     // ブロックの所要時間の平均（秒）
+  double p99;      // ブロックの所要時間の99パーセンタイル（秒）
+  double gainP99;  // ブロック毎に呼ぶmcim_set_bus_gainの所要時間の99パーセンタイル（秒）
+} BENCH_RESULT;
+
+static bool bench_run(wchar_t (*paths)[MAX_PATH], uint32_t threads, float* output, BENCH_RESULT* result);
+
+int main(void) {
+  float* source = (float*)malloc(sizeof(float) * 2 * BENCH_SOURCE_FRAMES);
+  float* serialOutput = (float*)malloc(sizeof(float) * 2 * BENCH_OUTPUT_FRAMES);
+  float* parallelOutput = (float*)malloc(sizeof(float) * 2 * BENCH_OUTPUT_FRAMES);
+  bool ok = test_check(source != NULL && serialOutput != NULL && parallelOutput != NULL, "allocate buffers");
+
+  wchar_t paths[BENCH_SOURCES][MAX_PATH];
+  uint32_t created = 0;
+  for (uint32_t i = 0; ok && i < BENCH_SOURCES; i++) {
+    for (uint32_t f = 0; f < BENCH_SOURCE_FRAMES; f++) {
+      const double phase = 2.0 * 3.14159265358979323846 * (220.0 * (i + 1)) * (double)f / (double)BENCH_SAMPLE_RATE;
+      source[2 * f] = BENCH_AMPLITUDE * (float)sin(phase);
+      source[2 * f + 1] = BENCH_AMPLITUDE * (float)cos(phase);
+    }
+    ok = test_check(test_temp_path(paths[i]), "create temporary file");
+    created += (ok ? 1 : 0);
+    ok = ok && test_check(mcim_save_wave(paths[i], source, BENCH_SOURCE_FRAMES), "save source wave");
+  }
+
+  BENCH_RESULT results[BENCH_THREAD_CASES];
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; ok && i < BENCH_THREAD_CASES; i++) {
+    float* output = (i == 0 ? serialOutput : parallelOutput);
+    ok = test_check(bench_run(paths, BENCH_THREADS[i], output, &(results[i])), "render with mcim_set_render_threads");
+    // ミックスの順序はジョブの分割のみで決まるため、スレッド数によらず出力はビット単位で一致する
+    if (ok && i != 0 && memcmp(serialOutput, parallelOutput, sizeof(float) * 2 * BENCH_OUTPUT_FRAMES) != 0) {
+      mismatches++;
+    }
+  }
+
+  if (ok) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    printf("voices: %u on %u buses, %u blocks of %u frames, %lu logical processors\n", BENCH_SOURCES * BENCH_VOICES_PER_SOURCE, BENCH_SOURCES,
+           BENCH_BLOCKS, BENCH_BLOCK_FRAMES, (unsigned long)info.dwNumberOfProcessors);
+    const double blockSeconds = (double)BENCH_BLOCK_FRAMES / (double)BENCH_SAMPLE_RATE;
+    for (uint32_t i = 0; i < BENCH_THREAD_CASES; i++) {
+      printf("threads %2u: block mean %.1f us (%.2fx serial, %.1f%% of real time), p99 %.1f us, set_bus_gain p99 %.2f us\n", BENCH_THREADS[i],
+             results[i].mean * 1.0e6, results[0].mean / results[i].mean, 100.0 * results[i].mean / blockSeconds, results[i].p99 * 1.0e6,
+             results[i].gainP99 * 1.0e6);
+    }
+    ok = test_check(mismatches == 0, "output is bit-identical for every thread count");
+  }
+
+  for (uint32_t i = 0; i < created; i++) {
+    DeleteFileW(paths[i]);
+  }
+  free(source);
+  free(serialOutput);
+  free(parallelOutput);
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static bool bench_run(wchar_t (*paths)[MAX_PATH], uint32_t threads, float* output, BENCH_RESULT* result) {
+  static double blockCost[BENCH_BLOCKS];
+  static double gainCost[BENCH_BLOCKS];
+
+  // スレッド数毎に作り直し、同じ構成と発音から同じ出力となるようにする
+  MCIM_DATA* data = mcim_init_offline(60.0);
+  if (data == NULL) {
+    return false;
+  }
+  bool ok = mcim_set_render_threads(data, threads) && mcim_set_sfx_polyphony(data, BENCH_SOURCES * BENCH_VOICES_PER_SOURCE);
+
+  // 2段のバスとし、同じ段のバスを並列にミックスさせる
+  MCIM_KEY buses[BENCH_SOURCES];
+  for (uint32_t i = 0; ok && i < BENCH_SOURCES; i++) {
+    buses[i] = mcim_create_bus(data, (i < 2 ? MCIM_MASTER_KEY : buses[i - 2]));
+    ok = (buses[i] != MCIM_INVALID_KEY);
+  }
+  for (uint32_t i = 0; ok && i < BENCH_SOURCES; i++) {
+    MCIM_KEY key = mcim_sfx_load(data, paths[i]);
+    ok = (key != MCIM_INVALID_KEY) && mcim_set_sfx_bus(data, key, buses[i]);
+    for (uint32_t v = 0; ok && v < BENCH_VOICES_PER_SOURCE; v++) {
+      ok = mcim_sfx_play(data, key, 1.0f, 0);
+    }
+  }
+
+  double total = 0.0;
+  for (uint32_t i = 0; ok && i < BENCH_BLOCKS; i++) {
+    // バスの音量の変更は毎ブロック行い、レンダリングを待たずに戻ることを確かめる
+    const double gainBegin = test_now();
+    ok = mcim_set_bus_gain(data, buses[i % BENCH_SOURCES], 0.5f + 0.5f * (float)((i / BENCH_SOURCES) & 1));
+    gainCost[i] = test_now() - gainBegin;
+
+    const double begin = test_now();
+    ok = ok && mcim_render(data, output + (size_t)i * BENCH_BLOCK_FRAMES * 2, BENCH_BLOCK_FRAMES);
+    blockCost[i] = test_now() - begin;
+    total += blockCost[i];
+  }
+  ok = mcim_exit(data) && ok;
+  if (!ok) {
+    return false;
+  }
+
+  result->mean = total / (double)BENCH_BLOCKS;
+  result->p99 = test_percentile(blockCost, BENCH_BLOCKS, 99.0);
+  result->gainP99 = test_percentile(gainCost, BENCH_BLOCKS, 99.0);
+  return true;
+}
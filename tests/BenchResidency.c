@@ -0,0 +1,144 @@
+﻿#include "MCIManager/MCIManager.h"
+#include "TestCommon.h"
+
+// 同時に再生するBGMの数（ボイス毎の費用は合計を割って求める）
+#define BENCH_VOICES 8
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_SOURCE_SECONDS 30
+#define BENCH_RENDER_SECONDS 10
+#define BENCH_BLOCK_FRAMES 256
+#define BENCH_BLOCKS (BENCH_RENDER_SECONDS * BENCH_SAMPLE_RATE / BENCH_BLOCK_FRAMES)
+#define BENCH_OUTPUT_FRAMES (BENCH_BLOCKS * BENCH_BLOCK_FRAMES)
+
+// 全ボイスを足しても飽和しない振幅
+#define BENCH_AMPLITUDE 0.1f
+
+// MCIM_RESIDENCY_INT16の常駐メモリはDECODEDの半分（16bitとfloatの比）となる
+#define BENCH_INT16_MEMORY_RATIO 0.5
+
+typedef struct _BENCH_RESULT {
+  size_t residentBytes;  // ロードにより増えたmcim_get_memory_statsのresidentBytes
+  double loadTime;       // 全BGMのロードに要した時間（秒）
+  double perVoice;       // 1ボイスあたりのレンダリングの所要時間の実時間に対する割合
+  double p99Block;       // 全ボイスをミックスするブロックの所要時間の99パーセンタイル（秒）
+} BENCH_RESULT;
+
+static bool bench_run(wchar_t (*paths)[MAX_PATH], MCIM_RESIDENCY residency, float* output, BENCH_RESULT* result);
+static void bench_print(const char* name, const BENCH_RESULT* result, const BENCH_RESULT* decoded);
+
+int main(void) {
+  // 変換の対象となるIEEE floatのWAVをmcim_save_waveで作成する（ファイル毎に周波数を変える）
+  const uint32_t sourceFrames = BENCH_SOURCE_SECONDS * BENCH_SAMPLE_RATE;
+  float* source = (float*)malloc(sizeof(float) * 2 * sourceFrames);
+  float* decodedOutput = (float*)malloc(sizeof(float) * 2 * BENCH_OUTPUT_FRAMES);
+  float* int16Output = (float*)malloc(sizeof(float) * 2 * BENCH_OUTPUT_FRAMES);
+  bool ok = test_check(source != NULL && decodedOutput != NULL && int16Output != NULL, "allocate buffers");
+
+  wchar_t paths[BENCH_VOICES][MAX_PATH];
+  uint32_t created = 0;
+  for (uint32_t i = 0; ok && i < BENCH_VOICES; i++) {
+    for (uint32_t f = 0; f < sourceFrames; f++) {
+      const double phase = 2.0 * 3.14159265358979323846 * (110.0 * (i + 1)) * (double)f / (double)BENCH_SAMPLE_RATE;
+      source[2 * f] = BENCH_AMPLITUDE * (float)sin(phase);
+      source[2 * f + 1] = BENCH_AMPLITUDE * (float)cos(phase);
+    }
+    ok = test_check(test_temp_path(paths[i]), "create temporary file");
+    created += (ok ? 1 : 0);
+    ok = ok && test_check(mcim_save_wave(paths[i], source, sourceFrames), "save source wave");
+  }
+
+  BENCH_RESULT decoded;
+  BENCH_RESULT encoded;
+  BENCH_RESULT int16;
+  ok = ok && test_check(bench_run(paths, MCIM_RESIDENCY_DECODED, decodedOutput, &decoded), "render with MCIM_RESIDENCY_DECODED") &&
+       test_check(bench_run(paths, MCIM_RESIDENCY_ENCODED, NULL, &encoded), "render with MCIM_RESIDENCY_ENCODED") &&
+       test_check(bench_run(paths, MCIM_RESIDENCY_INT16, int16Output, &int16), "render with MCIM_RESIDENCY_INT16");
+
+  if (ok) {
+    // INT16は変換時の丸め誤差（1ボイスあたり最大で半LSB）のみが出力の差となる
+    double maxDiff = 0.0;
+    for (uint32_t i = 0; i < 2 * BENCH_OUTPUT_FRAMES; i++) {
+      const double diff = fabs((double)decodedOutput[i] - (double)int16Output[i]);
+      maxDiff = (diff > maxDiff ? diff : maxDiff);
+    }
+
+    printf("voices: %u IEEE float sources of %u s, %u blocks of %u frames\n", BENCH_VOICES, BENCH_SOURCE_SECONDS, BENCH_BLOCKS, BENCH_BLOCK_FRAMES);
+    bench_print("decoded", &decoded, &decoded);
+    bench_print("encoded", &encoded, &decoded);
+    bench_print("int16  ", &int16, &decoded);
+    printf("int16 vs decoded output: max abs diff %.3g (%.2f LSB of 16bit)\n", maxDiff, maxDiff * 32768.0);
+    const double ratio = (double)int16.residentBytes / (double)decoded.residentBytes;
+    ok = test_check(decoded.residentBytes > 0, "every BGM is resident") &&
+         test_check(ratio <= BENCH_INT16_MEMORY_RATIO * 1.01, "int16 residency halves resident memory") &&
+         test_check(maxDiff * 32768.0 <= 0.5 * BENCH_VOICES + 1.0, "int16 residency only adds rounding error");
+  }
+
+  for (uint32_t i = 0; i < created; i++) {
+    DeleteFileW(paths[i]);
+  }
+  free(source);
+  free(decodedOutput);
+  free(int16Output);
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static bool bench_run(wchar_t (*paths)[MAX_PATH], MCIM_RESIDENCY residency, float* output, BENCH_RESULT* result) {
+  static double blockCost[BENCH_BLOCKS];
+  static float block[BENCH_BLOCK_FRAMES * 2];
+
+  // 常駐方式毎に作り直し、前の方式でロードしたPCMを解放してから計測する
+  MCIM_DATA* data = mcim_init_offline(60.0);
+  if (data == NULL) {
+    return false;
+  }
+  MCIM_MEMORY_STATS before;
+  MCIM_MEMORY_STATS after;
+  bool ok = mcim_set_residency(data, residency) && mcim_get_memory_stats(&before);
+
+  MCIM_KEY keys[BENCH_VOICES];
+  const double loadBegin = test_now();
+  for (uint32_t i = 0; ok && i < BENCH_VOICES; i++) {
+    keys[i] = mcim_load(data, paths[i]);
+    ok = (keys[i] != MCIM_INVALID_KEY);
+  }
+  result->loadTime = test_now() - loadBegin;
+  ok = ok && mcim_get_memory_stats(&after);
+  for (uint32_t i = 0; ok && i < BENCH_VOICES; i++) {
+    ok = mcim_play(data, keys[i], NULL);
+  }
+
+  // 最初のブロックは再生開始を含むため計測から除く
+  ok = ok && mcim_render(data, block, BENCH_BLOCK_FRAMES);
+  double total = 0.0;
+  for (uint32_t i = 0; ok && i < BENCH_BLOCKS; i++) {
+    float* target = (output != NULL ? output + (size_t)i * BENCH_BLOCK_FRAMES * 2 : block);
+    const double begin = test_now();
+    ok = mcim_render(data, target, BENCH_BLOCK_FRAMES);
+    blockCost[i] = test_now() - begin;
+    total += blockCost[i];
+  }
+  ok = mcim_exit(data) && ok;
+  if (!ok) {
+    return false;
+  }
+
+  const double renderSeconds = (double)BENCH_OUTPUT_FRAMES / (double)BENCH_SAMPLE_RATE;
+  result->residentBytes = after.residentBytes - before.residentBytes;
+  result->perVoice = total / renderSeconds / (double)BENCH_VOICES;
+  result->p99Block = test_percentile(blockCost, BENCH_BLOCKS, 99.0);
+  return true;
+}
+
+static void bench_print(const char* name, const BENCH_RESULT* result, const BENCH_RESULT* decoded) {
+  const double frameSeconds = 1.0 / (double)BENCH_SAMPLE_RATE;
+  printf("%s: resident %.1f MB (%.0f%% of decoded), load %.1f ms, %.1f ns per frame per voice (%.1fx decoded), block p99 %.1f us\n",
+         name,
+         (double)result->residentBytes / (1024.0 * 1024.0),
+         100.0 * (double)result->residentBytes / (double)decoded->residentBytes,
+         result->loadTime * 1.0e3,
+         result->perVoice * frameSeconds * 1.0e9,
+         result->perVoice / decoded->perVoice,
+         result->p99Block * 1.0e6);
+}
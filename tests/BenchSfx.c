@@ -0,0 +1,175 @@
+﻿#include "MCIManager/MCIManager.h"
+#include "TestCommon.h"
+
+// 計測用の1ボイスを除き、同時発音数の上限までボイスを発音させておく
+#define BENCH_VOICES 256
+#define BENCH_BLOCK_FRAMES 256
+#define BENCH_TRIALS 400
+
+// 計測用の効果音が鳴り終わってボイスが回収されるまでのブロック数
+#define BENCH_PROBE_FRAMES 1000
+#define BENCH_BLOCKS_PER_TRIAL 5
+#define BENCH_PROBE_VALUE 0.25f
+
+// 背景のボイスは計測中に鳴り終わらない長さとする
+#define BENCH_BACKGROUND_FRAMES (BENCH_TRIALS * BENCH_BLOCKS_PER_TRIAL * BENCH_BLOCK_FRAMES + 44100)
+
+// 位置を指定した同時発音数の上限のボイスを、聴取者の周りを周回させながら毎ブロック移動させる
+#define BENCH_MOVING_BLOCKS (BENCH_TRIALS * BENCH_BLOCKS_PER_TRIAL)
+#define BENCH_MOVING_RINGS 16
+#define BENCH_MOVING_STEP 0.01f
+
+static bool bench_save(wchar_t* path, uint32_t frames, float value);
+static bool bench_moving(MCIM_DATA* data, MCIM_KEY key, float* block, double* blockCost);
+
+int main(void) {
+  static double triggerCost[BENCH_TRIALS];
+  static double blockCost[BENCH_TRIALS * BENCH_BLOCKS_PER_TRIAL];
+  static float block[BENCH_BLOCK_FRAMES * 2];
+
+  // 背景のボイスは無音とし、出力に最初に現れた非0のサンプルを計測用の効果音の発音位置とみなす
+  wchar_t backgroundPath[MAX_PATH];
+  wchar_t probePath[MAX_PATH];
+  if (!test_check(bench_save(backgroundPath, BENCH_BACKGROUND_FRAMES, 0.0f), "save background wave") ||
+      !test_check(bench_save(probePath, BENCH_PROBE_FRAMES, BENCH_PROBE_VALUE), "save probe wave")) {
+    return 1;
+  }
+
+  MCIM_DATA* data = mcim_init_offline(60.0);
+  bool ok = test_check(data != NULL, "mcim_init_offline");
+  MCIM_KEY background = MCIM_INVALID_KEY;
+  MCIM_KEY probe = MCIM_INVALID_KEY;
+  if (ok) {
+    background = mcim_sfx_load(data, backgroundPath);
+    probe = mcim_sfx_load(data, probePath);
+    ok = test_check(background != MCIM_INVALID_KEY && probe != MCIM_INVALID_KEY, "mcim_sfx_load") &&
+         test_check(mcim_set_sfx_polyphony(data, BENCH_VOICES), "mcim_set_sfx_polyphony");
+  }
+  for (uint32_t i = 0; ok && i < BENCH_VOICES - 1; i++) {
+    ok = test_check(mcim_sfx_play(data, background, 1.0f, 1), "start background voice");
+  }
+  ok = ok && test_check(mcim_render(data, block, BENCH_BLOCK_FRAMES), "mcim_render");
+
+  uint32_t lateTriggers = 0;
+  uint32_t maxOnset = 0;
+  uint32_t blocks = 0;
+  for (uint32_t trial = 0; ok && trial < BENCH_TRIALS; trial++) {
+    const double begin = test_now();
+    ok = test_check(mcim_sfx_play(data, probe, 1.0f, 0), "trigger probe");
+    triggerCost[trial] = test_now() - begin;
+
+    for (uint32_t b = 0; ok && b < BENCH_BLOCKS_PER_TRIAL; b++) {
+      const double renderBegin = test_now();
+      ok = test_check(mcim_render(data, block, BENCH_BLOCK_FRAMES), "mcim_render");
+      blockCost[blocks++] = test_now() - renderBegin;
+      if (b != 0) {
+        continue;
+      }
+      // 発音は次のレンダリングブロックの先頭から開始されるため、最初のフレームに現れる必要がある
+      uint32_t onset = 0;
+      while (onset < BENCH_BLOCK_FRAMES && block[onset * 2] == 0.0f) {
+        onset++;
+      }
+      if (onset != 0) {
+        lateTriggers++;
+        maxOnset = (onset > maxOnset ? onset : maxOnset);
+      }
+    }
+  }
+
+  if (ok) {
+    double total = 0.0;
+    for (uint32_t i = 0; i < blocks; i++) {
+      total += blockCost[i];
+    }
+    const double blockSeconds = (double)BENCH_BLOCK_FRAMES / 44100.0;
+    const double meanBlock = total / (double)blocks;
+    printf("sfx voices: %u active, %u trials\n", BENCH_VOICES, BENCH_TRIALS);
+    printf("trigger cost (mcim_sfx_play): p50 %.2f us, p99 %.2f us, max %.2f us\n",
+           test_percentile(triggerCost, BENCH_TRIALS, 50.0) * 1.0e6,
+           test_percentile(triggerCost, BENCH_TRIALS, 99.0) * 1.0e6,
+           test_percentile(triggerCost, BENCH_TRIALS, 100.0) * 1.0e6);
+    printf("trigger-to-mix: %u/%u triggers audible at frame 0 of the next block (worst onset %u frames)\n",
+           BENCH_TRIALS - lateTriggers,
+           BENCH_TRIALS,
+           maxOnset);
+    // 実時間の出力では、発音要求は次のブロックの開始を待ってから出力段の遅延を経て再生される
+    MCIM_LATENCY_INFO latency;
+    if (mcim_get_latency(data, &latency)) {
+      printf("trigger-to-output bound with the default output config: %.1f ms (one block) + %.1f ms (output)\n",
+             blockSeconds * 1.0e3,
+             latency.configured * 1.0e3);
+    }
+    printf("block cost (%u frames): mean %.1f us, p99 %.1f us, max %.1f us (%.1f%% of real time at p99)\n",
+           BENCH_BLOCK_FRAMES,
+           meanBlock * 1.0e6,
+           test_percentile(blockCost, blocks, 99.0) * 1.0e6,
+           test_percentile(blockCost, blocks, 100.0) * 1.0e6,
+           test_percentile(blockCost, blocks, 99.0) / blockSeconds * 100.0);
+    printf("per voice: %.1f ns per frame\n", meanBlock / (double)BENCH_BLOCK_FRAMES / (double)BENCH_VOICES * 1.0e9);
+    ok = test_check(lateTriggers == 0, "every trigger is mixed from the first frame of the next block");
+  }
+  ok = ok && bench_moving(data, background, block, blockCost);
+
+  if (data != NULL) {
+    ok = test_check(mcim_exit(data), "mcim_exit") && ok;
+  }
+  DeleteFileW(backgroundPath);
+  DeleteFileW(probePath);
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static bool bench_moving(MCIM_DATA* data, MCIM_KEY key, float* block, double* blockCost) {
+  static uint32_t instances[BENCH_VOICES];
+
+  // 距離減衰が働くよう、周回の半径は基準距離から段階的に離していく
+  const MCIM_SFX_LISTENER_CONFIG listener = {.x = 0.0f, .y = 0.0f, .panWidth = 4.0f, .referenceDistance = 1.0f, .rolloff = 1.0f};
+  bool ok = test_check(mcim_sfx_stop_all(data), "mcim_sfx_stop_all") &&
+            test_check(mcim_sfx_set_listener(data, &listener), "mcim_sfx_set_listener");
+  for (uint32_t i = 0; ok && i < BENCH_VOICES; i++) {
+    instances[i] = mcim_sfx_play_at(data, key, 1.0f, 1, (float)(1 + i % BENCH_MOVING_RINGS), 0.0f);
+    ok = test_check(instances[i] != 0, "start positioned voice");
+  }
+
+  uint32_t rejectedMoves = 0;
+  for (uint32_t b = 0; ok && b < BENCH_MOVING_BLOCKS; b++) {
+    for (uint32_t i = 0; i < BENCH_VOICES; i++) {
+      const float radius = (float)(1 + i % BENCH_MOVING_RINGS);
+      const float angle = 6.28318531f * (float)i / (float)BENCH_VOICES + BENCH_MOVING_STEP * (float)b;
+      rejectedMoves += (mcim_sfx_move(data, instances[i], radius * cosf(angle), radius * sinf(angle)) ? 0 : 1);
+    }
+    const double begin = test_now();
+    ok = test_check(mcim_render(data, block, BENCH_BLOCK_FRAMES), "mcim_render");
+    blockCost[b] = test_now() - begin;
+  }
+  if (!ok) {
+    return false;
+  }
+
+  const double blockSeconds = (double)BENCH_BLOCK_FRAMES / 44100.0;
+  const double p99 = test_percentile(blockCost, BENCH_MOVING_BLOCKS, 99.0);
+  printf("moving voices: %u positioned voices moved every block, %u blocks\n", BENCH_VOICES, BENCH_MOVING_BLOCKS);
+  printf("block cost (%u frames): p50 %.1f us, p99 %.1f us, max %.1f us (%.1f%% of real time at p99)\n",
+         BENCH_BLOCK_FRAMES,
+         test_percentile(blockCost, BENCH_MOVING_BLOCKS, 50.0) * 1.0e6,
+         p99 * 1.0e6,
+         test_percentile(blockCost, BENCH_MOVING_BLOCKS, 100.0) * 1.0e6,
+         p99 / blockSeconds * 100.0);
+  return test_check(rejectedMoves == 0, "every mcim_sfx_move is accepted") &&
+         test_check(p99 < blockSeconds, "moving positioned voices fit in the block budget at p99");
+}
+
+static bool bench_save(wchar_t* path, uint32_t frames, float value) {
+  float* buffer = (float*)malloc(sizeof(float) * frames * 2);
+  if (buffer == NULL) {
+    return false;
+  }
+  for (uint32_t i = 0; i < frames * 2; i++) {
+    buffer[i] = value;
+  }
+  const bool ret = test_temp_path(path) && mcim_save_wave(path, buffer, frames);
+  free(buffer);
+  return ret;
+}
@@ -0,0 +1,282 @@
+﻿#include "MCIManager/MCIManager.h"
+#include "TestCommon.h"
+
+// 常駐させずにファイルから読み込みながら同時に再生するBGMの数
+#define BENCH_STREAMS 32
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_SOURCE_SECONDS 20
+#define BENCH_BLOCK_FRAMES 256
+
+// 実時間の間隔でブロックを生成して遅延の裾を測る区間と、間隔を空けずに生成してスループットを測る区間
+#define BENCH_PACED_BLOCKS (8 * BENCH_SAMPLE_RATE / BENCH_BLOCK_FRAMES)
+#define BENCH_THROUGHPUT_BLOCKS ((BENCH_SOURCE_SECONDS - 1) * BENCH_SAMPLE_RATE / BENCH_BLOCK_FRAMES)
+
+// 同期読み込みの比較対象は、ライブラリのストリーミングと同じ区間の長さ（MCIM_PCM_WINDOW_FRAMES）で読み込む
+#define BENCH_WINDOW_FRAMES 8192
+#define BENCH_FRAME_BYTES 4
+#define BENCH_HEADER_BYTES 44
+
+// 同期読み込みでストリーミングを再現するストリーム毎の状態
+typedef struct _BENCH_SYNC_STREAM {
+  HANDLE hfile;
+  uint32_t position;
+  uint32_t windowEnd;
+  int16_t raw[BENCH_WINDOW_FRAMES * 2];
+  float samples[BENCH_WINDOW_FRAMES * 2];
+} BENCH_SYNC_STREAM;
+
+typedef struct _BENCH_RESULT {
+  double p50;      // ブロックの所要時間（秒、実時間の間隔で生成した場合）
+  double p99;
+  double max;
+  double speed;    // 間隔を空けずに生成した場合の、実時間に対する速さ（全ストリームの合計）
+  double mbps;     // 上記の区間の読み込み速度（MB/s）
+  uint64_t bytes;  // 上記の区間で読み込んだデータ量
+} BENCH_RESULT;
+
+static bool bench_run_stream(MCIM_DATA* data, const MCIM_KEY* keys, BENCH_RESULT* result, MCIM_STREAM_STATS* stream);
+static bool bench_run_sync(wchar_t (*paths)[MAX_PATH], BENCH_RESULT* result);
+static bool bench_sync_block(BENCH_SYNC_STREAM* streams, uint64_t* bytes);
+static void bench_summarize(double* cost, uint32_t blocks, BENCH_RESULT* result);
+static void bench_pace(double deadline);
+static double bench_wait_p99(const MCIM_STREAM_STATS* stats);
+static void bench_print(const char* name, const BENCH_RESULT* result);
+
+int main(void) {
+  static wchar_t paths[BENCH_STREAMS][MAX_PATH];
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    if (!test_check(test_temp_path(paths[i]), "create temporary file") ||
+        !test_check(test_save_pcm16(paths[i], BENCH_SOURCE_SECONDS * BENCH_SAMPLE_RATE, 2, BENCH_SAMPLE_RATE), "save source wave")) {
+      return 1;
+    }
+  }
+
+  // 予算を最小にし、全てのBGMを常駐させずにストリーミングで再生させる
+  MCIM_MEMORY_STATS memoryBefore;
+  MCIM_MEMORY_STATS memoryAfter;
+  mcim_set_memory_budget(1);
+  MCIM_DATA* data = mcim_init_offline(60.0);
+  bool ok = test_check(data != NULL, "mcim_init_offline") && test_check(mcim_get_memory_stats(&memoryBefore), "mcim_get_memory_stats");
+  MCIM_KEY keys[BENCH_STREAMS];
+  for (uint32_t i = 0; ok && i < BENCH_STREAMS; i++) {
+    keys[i] = mcim_load(data, paths[i]);
+    ok = test_check(keys[i] != MCIM_INVALID_KEY, "mcim_load");
+  }
+  ok = ok && test_check(mcim_get_memory_stats(&memoryAfter), "mcim_get_memory_stats") &&
+       test_check(memoryAfter.streamedCount - memoryBefore.streamedCount == BENCH_STREAMS, "every BGM is streamed");
+
+  BENCH_RESULT stream;
+  BENCH_RESULT sync;
+  MCIM_STREAM_STATS stats;
+  ok = ok && test_check(bench_run_stream(data, keys, &stream, &stats), "render streamed BGM") &&
+       test_check(bench_run_sync(paths, &sync), "synchronous reads");
+
+  if (ok) {
+    printf("streams: %u x %d s stereo 16-bit PCM, %u-frame blocks\n", BENCH_STREAMS, BENCH_SOURCE_SECONDS, BENCH_BLOCK_FRAMES);
+    printf("note: the source files were just written and are likely served from the OS file cache\n");
+    printf("note: readahead block cost includes mixing %u voices; synchronous block cost is the reads and conversion alone\n", BENCH_STREAMS);
+    bench_print("overlapped readahead", &stream);
+    bench_print("synchronous reads", &sync);
+    printf("readahead: %llu reads, %llu hits (%.1f%%), %.2f ms blocked on disk in total, %llu late windows\n",
+           (unsigned long long)stats.reads,
+           (unsigned long long)stats.readaheadHits,
+           (stats.reads > 0 ? (double)stats.readaheadHits / (double)stats.reads * 100.0 : 0.0),
+           stats.waitTime * 1.0e3,
+           (unsigned long long)stats.underruns);
+    printf("readahead wait p99: < %.0f us\n", bench_wait_p99(&stats) * 1.0e6);
+    ok = test_check(stats.reads > 0 && stream.bytes > 0, "streamed BGM reads from the file") &&
+         test_check(stats.underruns == 0, "offline rendering waits for streamed reads instead of dropping them");
+  }
+
+  if (data != NULL) {
+    ok = test_check(mcim_exit(data), "mcim_exit") && ok;
+  }
+  mcim_set_memory_budget(0);
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    DeleteFileW(paths[i]);
+  }
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static bool bench_run_stream(MCIM_DATA* data, const MCIM_KEY* keys, BENCH_RESULT* result, MCIM_STREAM_STATS* stream) {
+  static double cost[BENCH_THROUGHPUT_BLOCKS];
+  static float block[BENCH_BLOCK_FRAMES * 2];
+  const double blockSeconds = (double)BENCH_BLOCK_FRAMES / (double)BENCH_SAMPLE_RATE;
+
+  // 実時間の間隔で生成し、先読みが間に合う条件でのミキサーのブロックの所要時間を測る
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    if (!mcim_play(data, keys[i], NULL)) {
+      return false;
+    }
+  }
+  MCIM_STATS before;
+  MCIM_STATS after;
+  if (!mcim_get_stats(data, &before)) {
+    return false;
+  }
+  const double start = test_now();
+  for (uint32_t i = 0; i < BENCH_PACED_BLOCKS; i++) {
+    bench_pace(start + (double)i * blockSeconds);
+    const double begin = test_now();
+    if (!mcim_render(data, block, BENCH_BLOCK_FRAMES)) {
+      return false;
+    }
+    cost[i] = test_now() - begin;
+  }
+  if (!mcim_get_stats(data, &after)) {
+    return false;
+  }
+  bench_summarize(cost, BENCH_PACED_BLOCKS, result);
+  *stream = after.stream;
+  for (uint32_t i = 0; i < MCIM_STATS_LATENCY_BUCKETS; i++) {
+    stream->wait[i] -= before.stream.wait[i];
+  }
+  stream->reads -= before.stream.reads;
+  stream->readaheadHits -= before.stream.readaheadHits;
+  stream->bytes -= before.stream.bytes;
+  stream->waitTime -= before.stream.waitTime;
+  stream->underruns -= before.stream.underruns;
+
+  // 先頭から再生し直し、間隔を空けずにファイルの終端近くまで生成する
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    if (mcim_stop(data, keys[i]) == MCIM_INVALID_KEY || !mcim_play(data, keys[i], NULL)) {
+      return false;
+    }
+  }
+  if (!mcim_get_stats(data, &before)) {
+    return false;
+  }
+  const double begin = test_now();
+  for (uint32_t i = 0; i < BENCH_THROUGHPUT_BLOCKS; i++) {
+    if (!mcim_render(data, block, BENCH_BLOCK_FRAMES)) {
+      return false;
+    }
+  }
+  const double elapsed = test_now() - begin;
+  if (!mcim_get_stats(data, &after)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    if (mcim_stop(data, keys[i]) == MCIM_INVALID_KEY) {
+      return false;
+    }
+  }
+
+  result->bytes = after.stream.bytes - before.stream.bytes;
+  result->speed = (double)BENCH_THROUGHPUT_BLOCKS * blockSeconds * BENCH_STREAMS / elapsed;
+  result->mbps = (double)result->bytes / elapsed / 1.0e6;
+  return true;
+}
+
+static bool bench_run_sync(wchar_t (*paths)[MAX_PATH], BENCH_RESULT* result) {
+  static BENCH_SYNC_STREAM streams[BENCH_STREAMS];
+  static double cost[BENCH_THROUGHPUT_BLOCKS];
+  const double blockSeconds = (double)BENCH_BLOCK_FRAMES / (double)BENCH_SAMPLE_RATE;
+
+  bool ok = true;
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    streams[i].hfile = CreateFileW(paths[i], GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    ok = ok && (streams[i].hfile != INVALID_HANDLE_VALUE);
+  }
+
+  // ライブラリと同じ間隔と同じ長さの区間で、必要になった時点でその場で読み込む
+  for (uint32_t pass = 0; ok && pass < 2; pass++) {
+    const uint32_t blocks = (pass == 0 ? BENCH_PACED_BLOCKS : BENCH_THROUGHPUT_BLOCKS);
+    for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+      streams[i].position = 0;
+      streams[i].windowEnd = 0;
+    }
+    uint64_t bytes = 0;
+    const double start = test_now();
+    for (uint32_t b = 0; ok && b < blocks; b++) {
+      if (pass == 0) {
+        bench_pace(start + (double)b * blockSeconds);
+      }
+      const double begin = test_now();
+      ok = bench_sync_block(streams, &bytes);
+      cost[b] = test_now() - begin;
+    }
+    const double elapsed = test_now() - start;
+    if (ok && pass == 0) {
+      bench_summarize(cost, blocks, result);
+    } else if (ok) {
+      result->bytes = bytes;
+      result->speed = (double)blocks * blockSeconds * BENCH_STREAMS / elapsed;
+      result->mbps = (double)bytes / elapsed / 1.0e6;
+    }
+  }
+
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    if (streams[i].hfile != INVALID_HANDLE_VALUE) {
+      CloseHandle(streams[i].hfile);
+    }
+  }
+  return ok;
+}
+
+static bool bench_sync_block(BENCH_SYNC_STREAM* streams, uint64_t* bytes) {
+  for (uint32_t i = 0; i < BENCH_STREAMS; i++) {
+    BENCH_SYNC_STREAM* stream = &(streams[i]);
+    if (stream->position + BENCH_BLOCK_FRAMES > stream->windowEnd) {
+      OVERLAPPED overlapped = {0};
+      const uint64_t offset = BENCH_HEADER_BYTES + (uint64_t)stream->position * BENCH_FRAME_BYTES;
+      overlapped.Offset = (DWORD)offset;
+      overlapped.OffsetHigh = (DWORD)(offset >> 32);
+      DWORD transferred = 0;
+      if (ReadFile(stream->hfile, stream->raw, sizeof(stream->raw), &transferred, &overlapped) == 0 && GetLastError() != ERROR_HANDLE_EOF) {
+        return false;
+      }
+      const uint32_t frames = transferred / BENCH_FRAME_BYTES;
+      for (uint32_t s = 0; s < frames * 2; s++) {
+        stream->samples[s] = (float)stream->raw[s] * (1.0f / 32768.0f);
+      }
+      stream->windowEnd = stream->position + frames;
+      *bytes += transferred;
+    }
+    stream->position += BENCH_BLOCK_FRAMES;
+  }
+  return true;
+}
+
+static void bench_summarize(double* cost, uint32_t blocks, BENCH_RESULT* result) {
+  result->p50 = test_percentile(cost, blocks, 50.0);
+  result->p99 = test_percentile(cost, blocks, 99.0);
+  result->max = test_percentile(cost, blocks, 100.0);
+}
+
+static void bench_pace(double deadline) {
+  // Sleepの分解能は粗いため、残りが短くなったら空回りして待つ
+  for (double now = test_now(); now < deadline; now = test_now()) {
+    if (deadline - now > 0.002) {
+      Sleep((DWORD)((deadline - now) * 1000.0) - 1);
+    }
+  }
+}
+
+static double bench_wait_p99(const MCIM_STREAM_STATS* stats) {
+  // 待ち時間は2の冪のマイクロ秒単位の区間で集計されているため、99パーセンタイルを含む区間の上限を返す
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < MCIM_STATS_LATENCY_BUCKETS; i++) {
+    total += stats->wait[i];
+  }
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < MCIM_STATS_LATENCY_BUCKETS; i++) {
+    count += stats->wait[i];
+    if (count * 100 >= total * 99) {
+      return (double)(2ull << i) * 1.0e-6;
+    }
+  }
+  return 0.0;
+}
+
+static void bench_print(const char* name, const BENCH_RESULT* result) {
+  printf("%s: block p50 %.1f us, p99 %.1f us, max %.1f us; throughput x%.0f real time, %.1f MB/s\n",
+         name,
+         result->p50 * 1.0e6,
+         result->p99 * 1.0e6,
+         result->max * 1.0e6,
+         result->speed,
+         result->mbps);
+}
@@ -0,0 +1,115 @@
+﻿#include "MCIManager/MCIManager.h"
+#include "TestCommon.h"
+
+// 同時に再生するBGMの数（ボイス毎の費用は合計を割って求める）
+#define BENCH_VOICES 8
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_SOURCE_SECONDS 30
+#define BENCH_RENDER_SECONDS 10
+#define BENCH_BLOCK_FRAMES 256
+#define BENCH_BLOCKS (BENCH_RENDER_SECONDS * BENCH_SAMPLE_RATE / BENCH_BLOCK_FRAMES)
+#define BENCH_RATE 1.25f
+
+// mcim_set_rateの説明に記載した、MCIM_RATE_STRETCHの1ボイスあたりのCPU時間の予算（実時間に対する割合）
+#define BENCH_STRETCH_BUDGET 0.005
+
+typedef struct _BENCH_RESULT {
+  double perVoice;  // 1ボイスあたりの所要時間の実時間に対する割合
+  double p99Block;  // 全ボイスをミックスするブロックの所要時間の99パーセンタイル（秒）
+  double stretch;   // mcim_get_statsのstretchから求めた時間伸縮のみの1フレームあたりの所要時間（秒）
+} BENCH_RESULT;
+
+static bool bench_run(MCIM_DATA* data, const MCIM_KEY* keys, MCIM_RATE_MODE mode, BENCH_RESULT* result);
+
+int main(void) {
+  wchar_t paths[BENCH_VOICES][MAX_PATH];
+  for (uint32_t i = 0; i < BENCH_VOICES; i++) {
+    if (!test_check(test_temp_path(paths[i]), "create temporary file") ||
+        !test_check(test_save_pcm16(paths[i], BENCH_SOURCE_SECONDS * BENCH_SAMPLE_RATE, 2, BENCH_SAMPLE_RATE), "save source wave")) {
+      return 1;
+    }
+  }
+
+  // BGMはファイル毎に1ボイスであるため、ボイス数と同じだけ別のファイルを読み込む
+  MCIM_DATA* data = mcim_init_offline(60.0);
+  bool ok = test_check(data != NULL, "mcim_init_offline");
+  MCIM_KEY keys[BENCH_VOICES];
+  for (uint32_t i = 0; ok && i < BENCH_VOICES; i++) {
+    keys[i] = mcim_load(data, paths[i]);
+    ok = test_check(keys[i] != MCIM_INVALID_KEY, "mcim_load");
+  }
+
+  BENCH_RESULT resample;
+  BENCH_RESULT stretch;
+  ok = ok && test_check(bench_run(data, keys, MCIM_RATE_RESAMPLE, &resample), "render with MCIM_RATE_RESAMPLE") &&
+       test_check(bench_run(data, keys, MCIM_RATE_STRETCH, &stretch), "render with MCIM_RATE_STRETCH");
+
+  if (ok) {
+    const double frameSeconds = 1.0 / (double)BENCH_SAMPLE_RATE;
+    printf("voices: %u at rate %.2f, %u blocks of %u frames\n", BENCH_VOICES, BENCH_RATE, BENCH_BLOCKS, BENCH_BLOCK_FRAMES);
+    printf("resample: %.1f ns per frame per voice (%.3f%% of real time per voice), block p99 %.1f us\n",
+           resample.perVoice * frameSeconds * 1.0e9,
+           resample.perVoice * 100.0,
+           resample.p99Block * 1.0e6);
+    printf("stretch:  %.1f ns per frame per voice (%.3f%% of real time per voice), block p99 %.1f us\n",
+           stretch.perVoice * frameSeconds * 1.0e9,
+           stretch.perVoice * 100.0,
+           stretch.p99Block * 1.0e6);
+    printf("stretch alone (mcim_get_stats): %.1f ns per frame per voice\n", stretch.stretch * 1.0e9);
+    printf("budget: %.3f%% of real time per stretched voice\n", BENCH_STRETCH_BUDGET * 100.0);
+    ok = test_check(stretch.perVoice <= BENCH_STRETCH_BUDGET, "stretched voice stays within the real-time budget");
+  }
+
+  if (data != NULL) {
+    ok = test_check(mcim_exit(data), "mcim_exit") && ok;
+  }
+  for (uint32_t i = 0; i < BENCH_VOICES; i++) {
+    DeleteFileW(paths[i]);
+  }
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static bool bench_run(MCIM_DATA* data, const MCIM_KEY* keys, MCIM_RATE_MODE mode, BENCH_RESULT* result) {
+  static double blockCost[BENCH_BLOCKS];
+  static float block[BENCH_BLOCK_FRAMES * 2];
+
+  for (uint32_t i = 0; i < BENCH_VOICES; i++) {
+    if (!mcim_set_rate(data, keys[i], BENCH_RATE, mode, 0.0f) || !mcim_play(data, keys[i], NULL)) {
+      return false;
+    }
+  }
+
+  // 最初のブロックは再生開始と時間伸縮の初期化を含むため計測から除く
+  MCIM_STATS before;
+  MCIM_STATS after;
+  if (!mcim_render(data, block, BENCH_BLOCK_FRAMES) || !mcim_get_stats(data, &before)) {
+    return false;
+  }
+  double total = 0.0;
+  for (uint32_t i = 0; i < BENCH_BLOCKS; i++) {
+    const double begin = test_now();
+    if (!mcim_render(data, block, BENCH_BLOCK_FRAMES)) {
+      return false;
+    }
+    blockCost[i] = test_now() - begin;
+    total += blockCost[i];
+  }
+  if (!mcim_get_stats(data, &after)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < BENCH_VOICES; i++) {
+    if (mcim_stop(data, keys[i]) == MCIM_INVALID_KEY) {
+      return false;
+    }
+  }
+
+  const double renderSeconds = (double)BENCH_BLOCKS * BENCH_BLOCK_FRAMES / (double)BENCH_SAMPLE_RATE;
+  const uint64_t frames = after.stretch.frames - before.stretch.frames;
+  result->perVoice = total / renderSeconds / (double)BENCH_VOICES;
+  result->p99Block = test_percentile(blockCost, BENCH_BLOCKS, 99.0);
+  result->stretch = (frames > 0 ? (after.stretch.totalTime - before.stretch.totalTime) / (double)frames : 0.0);
+  return true;
+}
@@ -0,0 +1,112 @@
+﻿#include "TestCommon.h"
+#include "TestKernels.h"
+#include "_MCIMTap.h"
+
+// レンダリングと同じブロック長で、窓掛け、FFT、振幅の計算と三重バッファへの公開までを計測する
+#define BENCH_FRAMES MCIM_TAP_BLOCK_FRAMES
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_BLOCKS 8192
+
+// 入力はビンの中心に置いた正弦波とし、公開されたスペクトルがその振幅を示すことも確かめる
+#define BENCH_SIGNAL_BIN 32
+#define BENCH_AMPLITUDE 0.5f
+#define BENCH_TOLERANCE 0.01f
+
+static const uint32_t BENCH_SIZES[] = {512, 1024, 2048, 4096};
+
+typedef struct _BENCH_RESULT {
+  double fftP50;    // FFTを行ったブロックの所要時間（秒）
+  double fftP99;
+  double fftMax;
+  double plainP50;  // FFTを行わなかったブロックの所要時間（秒）
+  uint32_t fftBlocks;
+  float level;      // 最後に読み出したスペクトルのBENCH_SIGNAL_BINの値
+} BENCH_RESULT;
+
+static bool bench_run(const MCIM_KERNELS* kernels, uint32_t size, BENCH_RESULT* result);
+
+int main(void) {
+  const MCIM_KERNELS* tables[TEST_KERNEL_TABLES_MAX];
+  const uint32_t count = test_kernel_tables(tables);
+  const double blockSeconds = (double)BENCH_FRAMES / (double)BENCH_SAMPLE_RATE;
+
+  // タップ毎のFFTはブロックあたり高々1回であるため、全てのタップが同じブロックでFFTを行う場合が1ブロックの上限となる
+  printf("analysis taps: %u-frame blocks at %u Hz, %u blocks per case (budget %.1f us per block)\n",
+         BENCH_FRAMES,
+         BENCH_SAMPLE_RATE,
+         BENCH_BLOCKS,
+         blockSeconds * 1.0e6);
+  bool ok = true;
+  for (size_t s = 0; ok && s < sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]); s++) {
+    const uint32_t size = BENCH_SIZES[s];
+    for (uint32_t t = 0; ok && t < count; t++) {
+      BENCH_RESULT result;
+      ok = test_check(bench_run(tables[t], size, &result), "mcim_tap_create");
+      if (!ok) {
+        break;
+      }
+      const double bound = result.fftP99 * (double)MCIM_ANALYSIS_MAX_TAPS;
+      printf("fft %4u %-8s fft block p50 %6.2f us, p99 %6.2f us, max %7.2f us; idle p50 %5.2f us; %u taps %.1f%% of budget\n",
+             size,
+             tables[t]->name,
+             result.fftP50 * 1.0e6,
+             result.fftP99 * 1.0e6,
+             result.fftMax * 1.0e6,
+             result.plainP50 * 1.0e6,
+             MCIM_ANALYSIS_MAX_TAPS,
+             bound / blockSeconds * 100.0);
+
+      const uint32_t expected = BENCH_BLOCKS * BENCH_FRAMES / (size / 2);
+      ok = test_check(result.fftBlocks == expected, "one FFT every fftSize / 2 frames, at most one per block") &&
+           test_check(fabsf(result.level - BENCH_AMPLITUDE) <= BENCH_TOLERANCE, "published spectrum shows the input sine") &&
+           test_check(bound < blockSeconds, "the maximum number of taps fits in the block budget at p99");
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static bool bench_run(const MCIM_KERNELS* kernels, uint32_t size, BENCH_RESULT* result) {
+  static double fftCost[BENCH_BLOCKS];
+  static double plainCost[BENCH_BLOCKS];
+  static float block[BENCH_FRAMES * 2];
+  static MCIM_ANALYSIS analysis;
+
+  MCIM_TAP* tap = mcim_tap_create(0, size, BENCH_SAMPLE_RATE, malloc);
+  if (tap == NULL) {
+    return false;
+  }
+
+  // 読み出し側も毎ブロック読み出し、新しいスナップショットが公開されたブロックをFFTを行ったブロックとみなす
+  const double step = 2.0 * 3.14159265358979323846 * (double)BENCH_SIGNAL_BIN / (double)size;
+  uint32_t fftBlocks = 0;
+  uint32_t plainBlocks = 0;
+  analysis.frame = 0;
+  for (uint32_t b = 0; b < BENCH_BLOCKS; b++) {
+    for (uint32_t i = 0; i < BENCH_FRAMES; i++) {
+      const float value = BENCH_AMPLITUDE * (float)sin(step * (double)(b * BENCH_FRAMES + i));
+      block[2 * i] = value;
+      block[2 * i + 1] = value;
+    }
+    const uint64_t published = analysis.frame;
+    const double begin = test_now();
+    mcim_tap_process(tap, kernels, block, BENCH_FRAMES, (uint64_t)(b + 1) * BENCH_FRAMES);
+    const double elapsed = test_now() - begin;
+    mcim_tap_read(tap, &analysis);
+    if (analysis.frame != published) {
+      fftCost[fftBlocks++] = elapsed;
+    } else {
+      plainCost[plainBlocks++] = elapsed;
+    }
+  }
+  free(tap);
+
+  result->fftBlocks = fftBlocks;
+  result->fftP50 = (fftBlocks > 0 ? test_percentile(fftCost, fftBlocks, 50.0) : 0.0);
+  result->fftP99 = (fftBlocks > 0 ? test_percentile(fftCost, fftBlocks, 99.0) : 0.0);
+  result->fftMax = (fftBlocks > 0 ? test_percentile(fftCost, fftBlocks, 100.0) : 0.0);
+  result->plainP50 = (plainBlocks > 0 ? test_percentile(plainCost, plainBlocks, 50.0) : 0.0);
+  result->level = analysis.spectrum[BENCH_SIGNAL_BIN];
+  return true;
+}
@@ -0,0 +1,121 @@
+﻿#ifndef __TEST_COMMON_H__
+#define __TEST_COMMON_H__
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+/**
+ * @brief 一時ファイルのパスを作成
+ * @param[out] path 作成したパスの格納先（MAX_PATH文字以上）
+ * @return bool 成功時true、失敗時false
+ * @note - 空のファイルが作成されるため、使用後はDeleteFileWで削除する
+ */
+static inline bool test_temp_path(wchar_t* path) {
+  wchar_t dir[MAX_PATH];
+  DWORD length = GetTempPathW(MAX_PATH, dir);
+  if (length == 0 || length >= MAX_PATH) {
+    return false;
+  }
+  return GetTempFileNameW(dir, L"mcm", 0, path) != 0;
+}
+
+/**
+ * @brief 16bit PCMのWAVファイルを作成
+ * @param[in] path 作成するファイルのパス（既存のファイルは上書きする）
+ * @param[in] frames フレーム数
+ * @param[in] channels チャンネル数
+ * @param[in] sampleRate サンプルレート
+ * @return bool 成功時true、失敗時false
+ * @note - 内容はチャンネル毎に周波数の異なる正弦波であり、サンプルの位置から再現できる
+ */
+static inline bool test_save_pcm16(const wchar_t* path, uint32_t frames, uint16_t channels, uint32_t sampleRate) {
+  const uint32_t dataSize = frames * channels * (uint32_t)sizeof(int16_t);
+  uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0};
+  const uint32_t riffSize = 36 + dataSize;
+  const uint32_t byteRate = sampleRate * channels * (uint32_t)sizeof(int16_t);
+  const uint16_t blockAlign = (uint16_t)(channels * sizeof(int16_t));
+  const uint16_t bitsPerSample = 16;
+  memcpy(header + 4, &riffSize, 4);
+  memcpy(header + 22, &channels, 2);
+  memcpy(header + 24, &sampleRate, 4);
+  memcpy(header + 28, &byteRate, 4);
+  memcpy(header + 32, &blockAlign, 2);
+  memcpy(header + 34, &bitsPerSample, 2);
+  memcpy(header + 36, "data", 4);
+  memcpy(header + 40, &dataSize, 4);
+
+  int16_t* samples = (int16_t*)malloc(dataSize);
+  if (samples == NULL) {
+    return false;
+  }
+  for (uint32_t i = 0; i < frames; i++) {
+    for (uint16_t c = 0; c < channels; c++) {
+      const double phase = 2.0 * 3.14159265358979323846 * (220.0 * (c + 1)) * (double)i / (double)sampleRate;
+      samples[(size_t)i * channels + c] = (int16_t)(sin(phase) * 16384.0);
+    }
+  }
+
+  bool ret = false;
+  HANDLE hfile = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hfile != INVALID_HANDLE_VALUE) {
+    DWORD written = 0;
+    ret = WriteFile(hfile, header, sizeof(header), &written, NULL) != 0 && written == sizeof(header) &&
+          WriteFile(hfile, samples, dataSize, &written, NULL) != 0 && written == dataSize;
+    CloseHandle(hfile);
+  }
+  free(samples);
+  return ret;
+}
+
+/**
+ * @brief 単調増加する時刻を取得
+ * @return double 秒単位の時刻（起点は不定）
+ */
+static inline double test_now(void) {
+  LARGE_INTEGER freq;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)freq.QuadPart;
+}
+
+// qsort用の比較関数
+static inline int test_compare_double(const void* a, const void* b) {
+  const double x = *(const double*)a;
+  const double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief 計測値のパーセンタイルを取得
+ * @param[in,out] values 計測値（昇順に並べ替えられる）
+ * @param[in] count 計測値の数（1以上）
+ * @param[in] percentile 0～100
+ * @return double 最近接順位法によるパーセンタイル
+ */
+static inline double test_percentile(double* values, uint32_t count, double percentile) {
+  qsort(values, count, sizeof(double), test_compare_double);
+  uint32_t rank = (uint32_t)ceil(percentile / 100.0 * (double)count);
+  rank = (rank == 0 ? 1 : (rank > count ? count : rank));
+  return values[rank - 1];
+}
+
+/**
+ * @brief 条件が満たされなかった場合に失敗を出力
+ * @param[in] condition 検査する条件
+ * @param[in] message 失敗時に出力するメッセージ
+ * @return bool condition
+ */
+static inline bool test_check(bool condition, const char* message) {
+  if (!condition) {
+    fprintf(stderr, "FAILED: %s\n", message);
+  }
+  return condition;
+}
+
+#endif  // __TEST_COMMON_H__
@@ -0,0 +1,180 @@
+﻿#include "TestCommon.h"
+#include "TestKernels.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// SIMD幅で割り切れない長さとし、各ISA実装の端数処理も比較する
+#define TEST_FRAMES 1021
+#define TEST_FFT_SIZE 1024
+
+// 要素毎の演算は演算順序が同じであり、FMAによる丸めの差のみを許容する
+#define TEST_TOLERANCE 1.0e-5f
+
+// ゲインのランプ（SIMD実装はゲインを刻み幅ずつ加算する）、再帰フィルタ、総和およびFFTの多段の演算は、
+// 累積順序の違いによる誤差を許容する
+#define TEST_ACCUMULATE_TOLERANCE 1.0e-4f
+
+// 16bit整数への変換は丸めの差による1LSBまでのずれを許容する
+#define TEST_S16_TOLERANCE 1
+
+typedef struct _TEST_KERNEL_OUTPUT {
+  float mixRamp[TEST_FRAMES * 2];
+  float mixPan[TEST_FRAMES * 2];
+  float scaleRamp[TEST_FRAMES * 2];
+  float peak;
+  float biquad[TEST_FRAMES * 2];
+  float biquadState[4];
+  float dot;
+  float resampleMono[TEST_FRAMES * 2];
+  float resampleStereo[TEST_FRAMES * 2];
+  int16_t toS16[TEST_FRAMES * 2];
+  float fromS16[TEST_FRAMES * 2];
+  float fftRe[TEST_FFT_SIZE];
+  float fftIm[TEST_FFT_SIZE];
+} TEST_KERNEL_OUTPUT;
+
+typedef struct _TEST_KERNEL_INPUT {
+  float dst[TEST_FRAMES * 2];
+  float src[TEST_FRAMES * 2];
+  float wide[TEST_FRAMES * 2];  // 飽和を含む16bit変換用
+  float resampleSrc[TEST_FRAMES * 4];
+  int16_t s16[TEST_FRAMES * 2];
+  float fftRe[TEST_FFT_SIZE];
+  float fftIm[TEST_FFT_SIZE];
+  float twRe[TEST_FFT_SIZE / 2];
+  float twIm[TEST_FFT_SIZE / 2];
+} TEST_KERNEL_INPUT;
+
+static TEST_KERNEL_INPUT TEST_INPUT;
+static TEST_KERNEL_OUTPUT TEST_OUTPUT[TEST_KERNEL_TABLES_MAX];
+
+static void test_prepare_input(TEST_KERNEL_INPUT* input);
+static void test_run(const MCIM_KERNELS* kernels, const TEST_KERNEL_INPUT* input, TEST_KERNEL_OUTPUT* output);
+static uint32_t test_compare(const char* table, const char* kernel, const float* actual, const float* expected, uint32_t count, float tolerance);
+static uint32_t test_compare_s16(const char* table, const int16_t* actual, const int16_t* expected, uint32_t count);
+
+int main(void) {
+  const MCIM_KERNELS* tables[TEST_KERNEL_TABLES_MAX];
+  const uint32_t count = test_kernel_tables(tables);
+  printf("selected kernels: %s (%u tables runnable)\n", mcim_select_kernels()->name, count);
+
+  test_prepare_input(&TEST_INPUT);
+  for (uint32_t i = 0; i < count; i++) {
+    test_run(tables[i], &TEST_INPUT, &(TEST_OUTPUT[i]));
+  }
+
+  uint32_t failures = 0;
+  const TEST_KERNEL_OUTPUT* e = &(TEST_OUTPUT[0]);
+  for (uint32_t i = 1; i < count; i++) {
+    const TEST_KERNEL_OUTPUT* a = &(TEST_OUTPUT[i]);
+    const char* name = tables[i]->name;
+    uint32_t mismatches = 0;
+    mismatches += test_compare(name, "mix_ramp", a->mixRamp, e->mixRamp, TEST_FRAMES * 2, TEST_ACCUMULATE_TOLERANCE);
+    mismatches += test_compare(name, "mix_pan", a->mixPan, e->mixPan, TEST_FRAMES * 2, TEST_ACCUMULATE_TOLERANCE);
+    mismatches += test_compare(name, "scale_ramp", a->scaleRamp, e->scaleRamp, TEST_FRAMES * 2, TEST_ACCUMULATE_TOLERANCE);
+    mismatches += test_compare(name, "peak", &(a->peak), &(e->peak), 1, 0.0f);
+    mismatches += test_compare(name, "biquad", a->biquad, e->biquad, TEST_FRAMES * 2, TEST_ACCUMULATE_TOLERANCE);
+    mismatches += test_compare(name, "biquad state", a->biquadState, e->biquadState, 4, TEST_ACCUMULATE_TOLERANCE);
+    mismatches += test_compare(name, "dot", &(a->dot), &(e->dot), 1, TEST_ACCUMULATE_TOLERANCE);
+    mismatches += test_compare(name, "resample mono", a->resampleMono, e->resampleMono, TEST_FRAMES * 2, TEST_TOLERANCE);
+    mismatches += test_compare(name, "resample stereo", a->resampleStereo, e->resampleStereo, TEST_FRAMES * 2, TEST_TOLERANCE);
+    mismatches += test_compare_s16(name, a->toS16, e->toS16, TEST_FRAMES * 2);
+    mismatches += test_compare(name, "s16_to_float", a->fromS16, e->fromS16, TEST_FRAMES * 2, 0.0f);
+    mismatches += test_compare(name, "fft_pass re", a->fftRe, e->fftRe, TEST_FFT_SIZE, TEST_ACCUMULATE_TOLERANCE);
+    mismatches += test_compare(name, "fft_pass im", a->fftIm, e->fftIm, TEST_FFT_SIZE, TEST_ACCUMULATE_TOLERANCE);
+    failures += mismatches;
+    if (mismatches == 0) {
+      printf("%s matches %s\n", name, tables[0]->name);
+    }
+  }
+  return test_check(failures == 0, "all runnable kernel tables match the generic kernels") ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static void test_prepare_input(TEST_KERNEL_INPUT* input) {
+  uint32_t seed = 0x12345678u;
+  test_fill_random(input->dst, TEST_FRAMES * 2, 0.5f, &seed);
+  test_fill_random(input->src, TEST_FRAMES * 2, 1.0f, &seed);
+  test_fill_random(input->wide, TEST_FRAMES * 2, 1.25f, &seed);
+  test_fill_random(input->resampleSrc, TEST_FRAMES * 4, 1.0f, &seed);
+  test_fill_random(input->fftRe, TEST_FFT_SIZE, 1.0f, &seed);
+  test_fill_random(input->fftIm, TEST_FFT_SIZE, 1.0f, &seed);
+  for (uint32_t i = 0; i < TEST_FRAMES * 2; i++) {
+    input->s16[i] = (int16_t)(input->src[i] * 32767.0f);
+  }
+}
+
+static void test_run(const MCIM_KERNELS* kernels, const TEST_KERNEL_INPUT* input, TEST_KERNEL_OUTPUT* output) {
+  memcpy(output->mixRamp, input->dst, sizeof(output->mixRamp));
+  kernels->mix_ramp(output->mixRamp, input->src, TEST_FRAMES, 0.3f, 1.0e-4f);
+
+  const float gain[2] = {0.2f, 0.7f};
+  const float gainStep[2] = {1.0e-4f, -1.0e-4f};
+  memcpy(output->mixPan, input->dst, sizeof(output->mixPan));
+  kernels->mix_pan(output->mixPan, input->src, TEST_FRAMES, gain, gainStep);
+
+  memcpy(output->scaleRamp, input->src, sizeof(output->scaleRamp));
+  kernels->scale_ramp(output->scaleRamp, TEST_FRAMES, 1.0f, -5.0e-4f);
+
+  output->peak = kernels->peak(input->src, TEST_FRAMES * 2);
+
+  const MCIM_BIQUAD_COEFS coefs = {.b0 = 0.2f, .b1 = 0.4f, .b2 = 0.2f, .a1 = -0.5f, .a2 = 0.1f};
+  memcpy(output->biquad, input->src, sizeof(output->biquad));
+  memset(output->biquadState, 0, sizeof(output->biquadState));
+  kernels->biquad(output->biquad, TEST_FRAMES, &coefs, output->biquadState);
+
+  output->dot = kernels->dot(input->src, input->dst, TEST_FRAMES * 2);
+
+  // 位置の小数部と非整数の刻み幅で補間し、読み出しが入力の範囲に収まるようにする
+  const uint64_t position = ((uint64_t)3 << 32) | 0x40000000u;
+  const uint64_t step = (uint64_t)(1.37 * 4294967296.0);
+  kernels->resample(output->resampleMono, input->resampleSrc, 1, position, step, TEST_FRAMES);
+  kernels->resample(output->resampleStereo, input->resampleSrc, 2, position, step, TEST_FRAMES);
+
+  kernels->float_to_s16(output->toS16, input->wide, TEST_FRAMES * 2);
+  kernels->s16_to_float(output->fromS16, input->s16, TEST_FRAMES * 2);
+
+  // ビット反転を省いた全段を通し、全ての段の幅でバタフライを比較する
+  float twRe[TEST_FFT_SIZE / 2];
+  float twIm[TEST_FFT_SIZE / 2];
+  memcpy(output->fftRe, input->fftRe, sizeof(output->fftRe));
+  memcpy(output->fftIm, input->fftIm, sizeof(output->fftIm));
+  for (uint32_t half = 1; half < TEST_FFT_SIZE; half *= 2) {
+    for (uint32_t k = 0; k < half; k++) {
+      const double angle = -3.14159265358979323846 * (double)k / (double)half;
+      twRe[k] = (float)cos(angle);
+      twIm[k] = (float)sin(angle);
+    }
+    kernels->fft_pass(output->fftRe, output->fftIm, twRe, twIm, TEST_FFT_SIZE, half);
+  }
+}
+
+static uint32_t test_compare(const char* table, const char* kernel, const float* actual, const float* expected, uint32_t count, float tolerance) {
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const float scale = fabsf(expected[i]) > 1.0f ? fabsf(expected[i]) : 1.0f;
+    if (fabsf(actual[i] - expected[i]) <= tolerance * scale) {
+      continue;
+    }
+    if (mismatches++ == 0) {
+      fprintf(stderr, "%s %s[%u]: expected %.9g, got %.9g\n", table, kernel, i, expected[i], actual[i]);
+    }
+  }
+  return mismatches;
+}
+
+static uint32_t test_compare_s16(const char* table, const int16_t* actual, const int16_t* expected, uint32_t count) {
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (abs((int)actual[i] - (int)expected[i]) <= TEST_S16_TOLERANCE) {
+      continue;
+    }
+    if (mismatches++ == 0) {
+      fprintf(stderr, "%s float_to_s16[%u]: expected %d, got %d\n", table, i, expected[i], actual[i]);
+    }
+  }
+  return mismatches;
+}
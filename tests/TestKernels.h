@@ -0,0 +1,52 @@
+﻿#ifndef __TEST_KERNELS_H__
+#define __TEST_KERNELS_H__
+
+#include "_MCIMKernels.h"
+
+#define TEST_KERNEL_TABLES_MAX 4
+
+/**
+ * @brief 実行中のCPUで実行可能なカーネル群を列挙
+ * @param[out] tables 列挙先（汎用実装が先頭となる）
+ * @return uint32_t 列挙した数
+ * @note - 各ISAは前のISAを包含するため、mcim_select_kernelsが選択した表までを実行可能とみなす
+ */
+static inline uint32_t test_kernel_tables(const MCIM_KERNELS* tables[TEST_KERNEL_TABLES_MAX]) {
+  const MCIM_KERNELS* all[TEST_KERNEL_TABLES_MAX] = {&MCIM_KERNELS_GENERIC};
+  uint32_t known = 1;
+#ifdef MCIM_KERNELS_X86
+  all[known++] = &MCIM_KERNELS_SSE2;
+  all[known++] = &MCIM_KERNELS_AVX2;
+  all[known++] = &MCIM_KERNELS_AVX512;
+#endif
+
+  const MCIM_KERNELS* selected = mcim_select_kernels();
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < known; i++) {
+    tables[count++] = all[i];
+    if (all[i] == selected) {
+      break;
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief 再現可能な一様乱数で[-scale, scale)を埋める
+ * @param[out] dst 出力先
+ * @param[in] count サンプル数
+ * @param[in] scale 振幅
+ * @param[in,out] seed 乱数の状態（0以外）
+ */
+static inline void test_fill_random(float* dst, uint32_t count, float scale, uint32_t* seed) {
+  uint32_t x = *seed;
+  for (uint32_t i = 0; i < count; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    dst[i] = ((float)(x >> 8) * (1.0f / 8388608.0f) - 1.0f) * scale;
+  }
+  *seed = x;
+}
+
+#endif  // __TEST_KERNELS_H__
@@ -0,0 +1,101 @@
+﻿#include "MCIManager/MCIManager.h"
+#include "TestCommon.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// 100Hzの正弦波が整数周期で収まるよう、イントロとループ区間を周期の倍数とする
+#define TEST_PERIOD 441
+#define TEST_LOOP_START (TEST_PERIOD * 25)
+#define TEST_LOOP_END (TEST_LOOP_START + TEST_PERIOD * 50)
+#define TEST_TAIL_FRAMES (TEST_PERIOD * 10)
+#define TEST_TOTAL_FRAMES (TEST_LOOP_END + TEST_TAIL_FRAMES)
+
+// ループ区間の長さを割り切らないブロック長とし、継ぎ目がブロックの途中と境界の両方に来るようにする
+#define TEST_BLOCK_FRAMES 1000
+#define TEST_SEAMS 3
+#define TEST_RENDER_FRAMES (TEST_LOOP_END + (TEST_LOOP_END - TEST_LOOP_START) * TEST_SEAMS + TEST_BLOCK_FRAMES)
+
+// 同じサンプルレートでは補間を経ずにそのまま出力されるため、float演算の誤差のみを許容する
+#define TEST_TOLERANCE 1.0e-4
+
+// ループ終端を越えて再生された場合に検出できるよう、終端以降は一定値とする
+#define TEST_TAIL_VALUE 0.9f
+
+static float test_source(uint32_t frame, uint32_t channel);
+
+int main(void) {
+  float* source = (float*)malloc(sizeof(float) * TEST_TOTAL_FRAMES * 2);
+  float* output = (float*)malloc(sizeof(float) * TEST_RENDER_FRAMES * 2);
+  if (!test_check(source != NULL && output != NULL, "allocate buffers")) {
+    return 1;
+  }
+  for (uint32_t i = 0; i < TEST_TOTAL_FRAMES; i++) {
+    source[i * 2] = test_source(i, 0);
+    source[i * 2 + 1] = test_source(i, 1);
+  }
+
+  wchar_t path[MAX_PATH];
+  if (!test_check(test_temp_path(path), "create temporary file") ||
+      !test_check(mcim_save_wave(path, source, TEST_TOTAL_FRAMES), "save source wave")) {
+    return 1;
+  }
+
+  bool ok = false;
+  MCIM_DATA* data = mcim_init_offline(60.0);
+  MCIM_KEY key = MCIM_INVALID_KEY;
+  if (test_check(data != NULL, "mcim_init_offline")) {
+    key = mcim_load(data, path);
+  }
+  if (test_check(key != MCIM_INVALID_KEY, "mcim_load") &&
+      test_check(mcim_set_loop(data, key, TEST_LOOP_START, TEST_LOOP_END), "mcim_set_loop") &&
+      test_check(mcim_play(data, key, NULL), "mcim_play")) {
+    ok = true;
+    for (uint32_t done = 0; ok && done < TEST_RENDER_FRAMES; done += TEST_BLOCK_FRAMES) {
+      ok = test_check(mcim_render(data, output + (size_t)done * 2, TEST_BLOCK_FRAMES), "mcim_render");
+    }
+  }
+
+  // イントロの後はloopStart～loopEndが隙間も重複もなく繰り返されていることを、全サンプルについて確認する
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; ok && i < TEST_RENDER_FRAMES; i++) {
+    uint32_t frame = i;
+    if (frame >= TEST_LOOP_END) {
+      frame = TEST_LOOP_START + (frame - TEST_LOOP_END) % (TEST_LOOP_END - TEST_LOOP_START);
+    }
+    for (uint32_t c = 0; c < 2; c++) {
+      const float expected = source[frame * 2 + c];
+      const float actual = output[(size_t)i * 2 + c];
+      if (fabs((double)actual - (double)expected) <= TEST_TOLERANCE) {
+        continue;
+      }
+      if (mismatches++ < 8) {
+        const int32_t seam = (i >= TEST_LOOP_END ? (int32_t)frame - TEST_LOOP_START : (int32_t)i - TEST_LOOP_END);
+        fprintf(stderr, "frame %u channel %u: expected %f, got %f (%d frames from seam)\n", i, c, expected, actual, seam);
+      }
+    }
+  }
+  ok = ok && test_check(mismatches == 0, "rendered output matches intro + seamless loop");
+
+  if (data != NULL) {
+    ok = test_check(mcim_exit(data), "mcim_exit") && ok;
+  }
+  DeleteFileW(path);
+  free(source);
+  free(output);
+  if (ok) {
+    printf("loop seam: %u frames, %u seams, no discontinuity\n", TEST_RENDER_FRAMES, TEST_SEAMS);
+  }
+  return ok ? 0 : 1;
+}
+
+/**************************************************************************************************/
+
+static float test_source(uint32_t frame, uint32_t channel) {
+  if (frame >= TEST_LOOP_END) {
+    return TEST_TAIL_VALUE;
+  }
+  // 無音と区別できるよう直流分を加え、左右で位相をずらして入れ替わりも検出する
+  const double phase = 2.0 * 3.14159265358979323846 * (double)(frame % TEST_PERIOD) / (double)TEST_PERIOD;
+  return (float)(0.1 + 0.4 * (channel == 0 ? sin(phase) : cos(phase)));
+}